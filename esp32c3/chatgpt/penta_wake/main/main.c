@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "esp_sleep.h"
+#include "esp_pm.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 
@@ -17,6 +17,10 @@
 
 static const char *TAG = "PENTA";
 
+/* Held only while a wake key goes out; idle is left to esp_pm */
+static esp_pm_lock_handle_t wake_cpu_lock;
+static esp_pm_lock_handle_t wake_nls_lock;
+
 /* UUIDs */
 static const ble_uuid128_t service_uuid =
     BLE_UUID128_INIT(0xab,0x90,0x78,0x56,0x34,0x12,0x34,0x12,
@@ -98,10 +102,16 @@ static void send_wake_key(void)
 
     uint8_t keycode[6] = { HID_KEY_A };
 
+    if (wake_cpu_lock) esp_pm_lock_acquire(wake_cpu_lock);
+    if (wake_nls_lock) esp_pm_lock_acquire(wake_nls_lock);
+
     tud_hid_keyboard_report(0,0,keycode);
     vTaskDelay(pdMS_TO_TICKS(30));
     tud_hid_keyboard_report(0,0,NULL);
 
+    if (wake_nls_lock) esp_pm_lock_release(wake_nls_lock);
+    if (wake_cpu_lock) esp_pm_lock_release(wake_cpu_lock);
+
     ESP_LOGI(TAG,"USB Wake Sent");
 }
 
@@ -130,12 +140,26 @@ tusb_desc_device_t const desc_device =
 const uint8_t *tud_descriptor_device_cb(void){ return (uint8_t*)&desc_device; }
 const uint8_t *tud_hid_descriptor_report_cb(uint8_t itf){ return desc_hid_report; }
 
-/* Power Save Task */
-void sleep_task(void *arg)
+/* Power Management: automatic light sleep whenever FreeRTOS is idle.
+ * Calling esp_light_sleep_start() in a loop instead would stop the
+ * scheduler and the BLE/USB stacks every time round. */
+static void pm_init(void)
 {
-    while (1) {
-        esp_light_sleep_start();
+    esp_pm_config_t pm_cfg = {
+        .max_freq_mhz = 80,
+        .min_freq_mhz = 10,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&pm_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG,"PM config failed: %s",esp_err_to_name(err));
+        return;
     }
+
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX,0,"wake_cpu",
+                           &wake_cpu_lock) != ESP_OK) wake_cpu_lock = NULL;
+    if (esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP,0,"wake_nls",
+                           &wake_nls_lock) != ESP_OK) wake_nls_lock = NULL;
 }
 
 /* MAIN */
@@ -161,6 +185,6 @@ void app_main(void)
 
     nimble_port_freertos_init(host_task);
 
-    /* Sleep loop */
-    xTaskCreate(sleep_task,"sleep",2048,NULL,1,NULL);
+    /* Light sleep */
+    pm_init();
 }
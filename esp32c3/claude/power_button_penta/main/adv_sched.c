@@ -0,0 +1,164 @@
+/**
+ * adv_sched.c
+ *
+ * Adaptive advertising interval.
+ *
+ * A fixed 20–40 ms interval is quick to discover but keeps the radio busy
+ * forever; 500–1000 ms is cheap but adds up to a second of discovery
+ * latency.  The scheduler uses the fast interval only when a wake request
+ * is likely – right after boot, a client disconnect, the host suspending
+ * its USB port or the pairing button – and then decays step by step:
+ *
+ *   FAST ──(burst)──▶ MEDIUM ──(60 s)──▶ SLOW
+ *
+ * With CONFIG_PENTA_ADV_SLOW_WHEN_HOST_AWAKE the interval drops further to
+ * HOST_AWAKE while the USB bus is active, since nobody needs to wake an
+ * already running host.  A host suspend always restarts the fast burst.
+ *
+ * The intervals and the burst length are tuning parameters (tuning.h);
+ * a change to the current mode's interval is pushed at once by
+ * adv_sched_refresh().  The active interval goes to the BLE backend
+ * through ble_server_set_adv_interval().
+ */
+
+#include "adv_sched.h"
+#include "ble_server.h"
+#include "trace.h"
+#include "tuning.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+#define MEDIUM_HOLD_US          (60LL * 1000 * 1000)
+
+/* Intervals come from tuning: TUNE_ADV_<mode>_MIN, _MAX in mode order */
+typedef struct {
+    int64_t  hold_us;           /* time before decaying, 0 = stay */
+    adv_mode_t next;
+} adv_mode_cfg_t;
+
+static const adv_mode_cfg_t mode_cfg[] = {
+    [ADV_MODE_FAST]       = { -1, ADV_MODE_MEDIUM },  /* TUNE_ADV_BURST_S */
+    [ADV_MODE_MEDIUM]     = { MEDIUM_HOLD_US, ADV_MODE_SLOW },
+    [ADV_MODE_SLOW]       = { 0, ADV_MODE_SLOW },
+    [ADV_MODE_HOST_AWAKE] = { 0, ADV_MODE_HOST_AWAKE },
+};
+
+static SemaphoreHandle_t lock;
+static StaticSemaphore_t lock_buf;
+static esp_timer_handle_t decay_timer;
+static adv_sched_state_t state;
+
+/* ── Mode switching ──────────────────────────────────────────────────────── */
+static void mode_interval(adv_mode_t mode, uint16_t *min, uint16_t *max)
+{
+    tune_id_t id = (tune_id_t)(TUNE_ADV_FAST_MIN + 2 * mode);
+    uint32_t lo, hi;
+
+    tuning_get_pair(id, (tune_id_t)(id + 1), &lo, &hi);
+    *min = (uint16_t)lo;
+    *max = (uint16_t)hi;
+}
+
+/* Caller holds the lock */
+static void enter_mode(adv_mode_t mode)
+{
+    int64_t hold_us = mode_cfg[mode].hold_us;
+
+    if (hold_us < 0) {
+        hold_us = tuning_get(TUNE_ADV_BURST_S) * 1000000LL;
+    }
+    esp_timer_stop(decay_timer);   /* ESP_ERR_INVALID_STATE if idle: fine */
+    if (hold_us > 0) {
+        esp_timer_start_once(decay_timer, hold_us);
+    }
+
+    if (mode == state.mode && state.transitions > 0) {
+        return;                     /* burst re-armed, interval unchanged */
+    }
+
+    state.mode          = mode;
+    mode_interval(mode, &state.itvl_min, &state.itvl_max);
+    state.mode_since_us = esp_timer_get_time();
+    state.transitions++;
+
+    ble_server_set_adv_interval(state.itvl_min, state.itvl_max);
+    trace_log(TRACE_EVT_ADV_MODE, (uint16_t)mode, state.itvl_min);
+}
+
+static void decay_cb(void *arg)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    adv_mode_t next = mode_cfg[state.mode].next;
+    if (next != state.mode) {
+        enter_mode(next);
+    }
+    xSemaphoreGive(lock);
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void adv_sched_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buf);
+
+    const esp_timer_create_args_t args = {
+        .callback = decay_cb,
+        .name     = "adv_decay",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &decay_timer));
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    enter_mode(ADV_MODE_FAST);
+    xSemaphoreGive(lock);
+}
+
+void adv_sched_on_event(adv_evt_t evt)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    switch (evt) {
+    case ADV_EVT_DISCONNECT:
+        /* The client may want to reconnect right away – unless the host is
+         * up and nobody needs to reach us quickly. */
+        if (state.mode != ADV_MODE_HOST_AWAKE) {
+            enter_mode(ADV_MODE_FAST);
+        }
+        break;
+
+    case ADV_EVT_HOST_SUSPEND:
+    case ADV_EVT_PAIRING:
+        /* Someone is standing next to the device with a phone */
+        enter_mode(ADV_MODE_FAST);
+        break;
+
+    case ADV_EVT_HOST_AWAKE:
+#if CONFIG_PENTA_ADV_SLOW_WHEN_HOST_AWAKE
+        enter_mode(ADV_MODE_HOST_AWAKE);
+#endif
+        break;
+    }
+    xSemaphoreGive(lock);
+}
+
+void adv_sched_refresh(void)
+{
+    uint16_t min, max;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    mode_interval(state.mode, &min, &max);
+    if (min != state.itvl_min || max != state.itvl_max) {
+        state.itvl_min = min;
+        state.itvl_max = max;
+        ble_server_set_adv_interval(min, max);
+        trace_log(TRACE_EVT_ADV_MODE, (uint16_t)state.mode, min);
+    }
+    xSemaphoreGive(lock);
+}
+
+void adv_sched_get_state(adv_sched_state_t *out)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = state;
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+/** Advertising modes, from most to least aggressive.  Default intervals;
+ *  each is a tuning parameter (tuning.h). */
+typedef enum {
+    ADV_MODE_FAST = 0,      /* 20–40 ms burst after boot/disconnect/suspend */
+    ADV_MODE_MEDIUM,        /* 152.5–211.25 ms while the burst decays       */
+    ADV_MODE_SLOW,          /* 500–1000 ms once nothing has happened        */
+    ADV_MODE_HOST_AWAKE,    /* 2–2.5 s while the host is up (optional)      */
+} adv_mode_t;
+
+/** Events that drive the scheduler. */
+typedef enum {
+    ADV_EVT_DISCONNECT = 0, /* a BLE client dropped off                     */
+    ADV_EVT_HOST_SUSPEND,   /* USB host suspended the bus (S3 entry)        */
+    ADV_EVT_HOST_AWAKE,     /* USB bus mounted or resumed                   */
+    ADV_EVT_PAIRING,        /* pairing window opened with the BOOT button   */
+} adv_evt_t;
+
+/** Snapshot of the scheduler, for monitoring. */
+typedef struct {
+    adv_mode_t mode;
+    uint16_t   itvl_min;        /* current interval, 0.625 ms units */
+    uint16_t   itvl_max;
+    uint32_t   transitions;     /* mode changes since boot          */
+    int64_t    mode_since_us;   /* esp_timer time of the last change */
+} adv_sched_state_t;
+
+/**
+ * Start the scheduler in ADV_MODE_FAST.
+ * Must be called before ble_server_init() so the first advertising set
+ * already uses the scheduled interval.
+ */
+void adv_sched_init(void);
+
+/** Feed an event into the scheduler.  Task context only. */
+void adv_sched_on_event(adv_evt_t evt);
+
+/**
+ * Re-read the intervals from tuning and push the current mode's if it
+ * changed.  A new burst length applies from the next burst.  Task or BLE
+ * stack context; called by tuning.c.
+ */
+void adv_sched_refresh(void);
+
+/** Copy the current scheduler state into *out. */
+void adv_sched_get_state(adv_sched_state_t *out);
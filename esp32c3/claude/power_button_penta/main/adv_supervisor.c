@@ -0,0 +1,131 @@
+/**
+ * adv_supervisor.c
+ *
+ * Keeps the dongle discoverable.
+ *
+ * Advertising is restarted from BLE callbacks after every connect,
+ * disconnect and interval change.  If one of those restarts fails, or the
+ * controller stops an advertising set without telling the host, nothing
+ * else would start it again and the host could not be woken until the
+ * next power cycle.  This task checks the backend's view periodically and
+ * escalates:
+ *
+ *   1. restart advertising, waiting ADV_RETRY_MIN_MS, then twice as long
+ *      after each further failure;
+ *   2. after CONFIG_PENTA_ADV_RECOVER_AFTER failed restarts, reset the BLE
+ *      host and controller (ble_server_recover()).
+ *
+ * The backends report failed starts and host resets so a check runs at
+ * once instead of at the next period.
+ */
+
+#include "adv_supervisor.h"
+#include "ble_server.h"
+#include "mem_budget.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "ADV_SUP";
+
+#define CHECK_PERIOD_MS     CONFIG_PENTA_ADV_SUPERVISE_MS
+#define ADV_RETRY_MIN_MS    250
+#define SETTLE_MS           2000    /* host resync after a reset */
+
+static TaskHandle_t task;
+static adv_supervisor_stats_t stats;
+static volatile bool host_reset_seen;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void count(uint32_t *field)
+{
+    portENTER_CRITICAL(&stats_lock);
+    (*field)++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/* ── Escalation ──────────────────────────────────────────────────────────── */
+static void supervise(void)
+{
+    uint32_t backoff_ms = ADV_RETRY_MIN_MS;
+
+    for (int attempt = 0; ; attempt++) {
+        count(&stats.checks);
+        if (ble_server_adv_healthy()) {
+            return;
+        }
+        if (attempt == 0) {
+            count(&stats.down);
+        }
+        if (attempt == CONFIG_PENTA_ADV_RECOVER_AFTER) {
+            ESP_LOGW(TAG, "Advertising still off after %d restarts, "
+                          "resetting BLE", attempt);
+            count(&stats.recoveries);
+            trace_log(TRACE_EVT_ADV_RECOVER, (uint16_t)stats.recoveries, 0);
+            ble_server_recover();
+            vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+            return;
+        }
+
+        count(&stats.retries);
+        trace_log(TRACE_EVT_ADV_RETRY, (uint16_t)(attempt + 1), backoff_ms);
+        ble_server_restart_advertising();
+        vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+        if (backoff_ms < CHECK_PERIOD_MS) {
+            backoff_ms *= 2;
+        }
+    }
+}
+
+/* ── Supervisor task ─────────────────────────────────────────────────────── */
+static void supervisor_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CHECK_PERIOD_MS));
+        if (host_reset_seen) {
+            /* The stack restarts advertising itself once it has resynced */
+            host_reset_seen = false;
+            vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+        }
+        supervise();
+        /* Failures reported while escalating are handled already */
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void adv_supervisor_init(void)
+{
+    static StackType_t stack[ADV_SUP_TASK_STACK];
+    static StaticTask_t tcb;
+    task = xTaskCreateStatic(supervisor_task, "adv_sup", ADV_SUP_TASK_STACK,
+                             NULL, ADV_SUP_TASK_PRIO, stack, &tcb);
+}
+
+void adv_supervisor_on_adv_failed(int err)
+{
+    trace_log(TRACE_EVT_ADV_FAILED, 0, (uint32_t)err);
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void adv_supervisor_on_host_reset(int reason)
+{
+    count(&stats.host_resets);
+    trace_log(TRACE_EVT_HOST_RESET, (uint16_t)reason, stats.host_resets);
+    host_reset_seen = true;
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void adv_supervisor_get_stats(adv_supervisor_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+/** Supervisor counters, reported in the stats characteristic. */
+typedef struct {
+    uint32_t checks;            /* health checks run                        */
+    uint32_t down;              /* checks that found advertising off        */
+    uint32_t retries;           /* advertising restarts issued              */
+    uint32_t recoveries;        /* host and controller resets issued        */
+    uint32_t host_resets;       /* resets reported by the BLE stack itself  */
+} adv_supervisor_stats_t;
+
+/**
+ * Start the supervisor task.  Every CONFIG_PENTA_ADV_SUPERVISE_MS it asks
+ * the backend whether the device is discoverable; if not it restarts
+ * advertising with exponential backoff and, after
+ * CONFIG_PENTA_ADV_RECOVER_AFTER failed restarts, resets the BLE host and
+ * controller.  Call after ble_server_init().
+ */
+void adv_supervisor_init(void);
+
+/**
+ * Advertising failed to start or stopped unexpectedly: check now instead
+ * of at the next period.  BLE stack context.
+ */
+void adv_supervisor_on_adv_failed(int err);
+
+/**
+ * The BLE stack reset itself (NimBLE host reset).  Counted, and the next
+ * check waits for the stack to resync first.  BLE stack context.
+ */
+void adv_supervisor_on_host_reset(int reason);
+
+void adv_supervisor_get_stats(adv_supervisor_stats_t *out);
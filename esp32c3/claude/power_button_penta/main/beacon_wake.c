@@ -0,0 +1,167 @@
+/**
+ * beacon_wake.c
+ *
+ * Connectionless wake: instead of connect → discover → write, the Pi
+ * broadcasts a short burst of signed advertisements and the dongle picks
+ * one up with a duty-cycled passive scan.  No link is ever set up, so the
+ * wake costs one scan window of latency instead of several round trips.
+ *
+ * The scan runs next to the normal advertising / GATT service; the
+ * controller interleaves the two.  CONFIG_PENTA_BEACON_SCAN_INTERVAL_MS and
+ * CONFIG_PENTA_BEACON_SCAN_WINDOW_MS trade idle current against latency:
+ * the worst-case wait is one interval, the radio is on window/interval of
+ * the time.  The scan is shared with proximity wake (scan_sched.c), which
+ * may run it denser for a while, never sparser.
+ *
+ * Authentication: HMAC-SHA256 over type | counter | our BT MAC with the key
+ * from CONFIG_PENTA_BEACON_KEY, truncated to 8 bytes.  The counter must
+ * increase.  Cheap checks (length, company ID, counter) run before the
+ * HMAC so foreign adverts cost almost nothing.
+ *
+ * So that a reboot does not reopen the replay window, NVS holds a counter
+ * reservation (counter_rsv.c), not every accepted counter: accepting one
+ * within half a block of the reservation queues a new one,
+ * CONFIG_PENTA_BEACON_COUNTER_BLOCK ahead, for the timer task.  After a
+ * reboot only counters above the reservation are accepted.
+ */
+
+#include "beacon_wake.h"
+#include "hmac_util.h"
+#include "counter_rsv.h"
+#include "scan_sched.h"
+#include "wake_dispatch.h"
+#include "conn_table.h"
+#include "latency.h"
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "mbedtls/md.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "BEACON";
+
+#define BEACON_COMPANY_ID       0xFFFF    /* Bluetooth SIG "testing" ID */
+#define BEACON_TYPE_WAKE        0x01
+#define BEACON_TAG_LEN          8
+#define BEACON_KEY_LEN          32
+
+/* company(2) | type(1) | counter(4) | tag(8) */
+#define BEACON_PAYLOAD_LEN      (2 + 1 + 4 + BEACON_TAG_LEN)
+
+#define AD_TYPE_MANUFACTURER    0xFF
+
+#define NVS_KEY_RESERVED        "bcn_rsv"
+
+static uint8_t key[BEACON_KEY_LEN];
+static uint8_t own_mac[6];
+static beacon_wake_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static counter_rsv_t rsv = {
+    .nvs_key     = NVS_KEY_RESERVED,
+    .block       = CONFIG_PENTA_BEACON_COUNTER_BLOCK,
+    .lock        = &stats_lock,
+    .reserved    = &stats.reserved,
+    .nvs_writes  = &stats.nvs_writes,
+    .pend_errors = &stats.pend_errors,
+    .nvs_errors  = &stats.nvs_errors,
+};
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+/* Find our manufacturer-specific AD structure; returns its payload */
+static const uint8_t *find_payload(const uint8_t *data, uint8_t len)
+{
+    for (uint8_t pos = 0; pos + 1 < len; ) {
+        uint8_t field_len = data[pos];
+        if (field_len == 0 || pos + 1 + field_len > len) {
+            break;
+        }
+        const uint8_t *field = &data[pos + 1];
+        if (field[0] == AD_TYPE_MANUFACTURER &&
+            field_len - 1 == BEACON_PAYLOAD_LEN &&
+            field[1] == (BEACON_COMPANY_ID & 0xFF) &&
+            field[2] == (BEACON_COMPANY_ID >> 8)) {
+            return &field[1];
+        }
+        pos += 1 + field_len;
+    }
+    return NULL;
+}
+
+/* ── Advertising report handler (BLE stack context) ─────────────────────── */
+static void on_adv_report(const uint8_t *addr, int8_t rssi,
+                          const uint8_t *data, uint8_t len)
+{
+    (void)addr; (void)rssi;
+
+    const uint8_t *p = find_payload(data, len);
+    if (p == NULL || p[2] != BEACON_TYPE_WAKE) {
+        return;
+    }
+    stats.seen++;
+
+    uint32_t counter = (uint32_t)p[3] | ((uint32_t)p[4] << 8) |
+                       ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 24);
+    if (counter <= stats.last_counter) {
+        stats.replayed++;       /* also the normal case for a repeated burst */
+        return;
+    }
+
+    uint8_t msg[1 + 4 + sizeof(own_mac)];
+    msg[0] = p[2];
+    memcpy(&msg[1], &p[3], 4);
+    memcpy(&msg[5], own_mac, sizeof(own_mac));
+
+    uint8_t mac[32];
+    const mbedtls_md_info_t *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    if (mbedtls_md_hmac(md, key, sizeof(key), msg, sizeof(msg), mac) != 0 ||
+        !hmac_util_tag_equal(mac, &p[7], BEACON_TAG_LEN)) {
+        stats.bad_tag++;
+        return;
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.last_counter = counter;
+    stats.accepted++;
+    portEXIT_CRITICAL(&stats_lock);
+    counter_rsv_accept(&rsv, counter);
+    latency_mark(LAT_STAGE_GATT_WRITE);     /* request received */
+    if (!wake_dispatch_post(CONN_TABLE_NONE, WAKE_CMD_WAKE)) {
+        ESP_LOGW(TAG, "Wake queue full – beacon dropped");
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void beacon_wake_init(void)
+{
+    if (!hmac_util_parse_key(CONFIG_PENTA_BEACON_KEY, key, sizeof(key))) {
+        ESP_LOGE(TAG, "CONFIG_PENTA_BEACON_KEY must be %d hex digits – "
+                      "beacon wake disabled", BEACON_KEY_LEN * 2);
+        return;
+    }
+    ESP_ERROR_CHECK(esp_read_mac(own_mac, ESP_MAC_BT));
+
+    /* Anything up to the reservation may have been accepted before the
+     * reset */
+    stats.last_counter = counter_rsv_load(&rsv);
+
+    /* Repeats of a burst are dropped in the controller; the window is
+     * capped at the interval there */
+    scan_sched_request(SCAN_CLIENT_BEACON,
+                       SCAN_MS_TO_UNITS(CONFIG_PENTA_BEACON_SCAN_INTERVAL_MS),
+                       SCAN_MS_TO_UNITS(CONFIG_PENTA_BEACON_SCAN_WINDOW_MS),
+                       false, on_adv_report);
+
+    ESP_LOGI(TAG, "Beacon scan %d/%d ms, last counter %u",
+             CONFIG_PENTA_BEACON_SCAN_WINDOW_MS,
+             CONFIG_PENTA_BEACON_SCAN_INTERVAL_MS,
+             (unsigned)stats.last_counter);
+}
+
+void beacon_wake_get_stats(beacon_wake_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
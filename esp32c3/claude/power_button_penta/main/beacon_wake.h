@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/** Counters for the connectionless wake path. */
+typedef struct {
+    uint32_t seen;          /* reports carrying our manufacturer data      */
+    uint32_t accepted;      /* authenticated beacons that posted a wake    */
+    uint32_t replayed;      /* rejected: counter not above the last one    */
+    uint32_t bad_tag;       /* rejected: HMAC mismatch                     */
+    uint32_t last_counter;  /* highest accepted counter                    */
+    uint32_t reserved;      /* counter reservation stored in NVS           */
+    uint32_t nvs_writes;    /* reservations committed since boot           */
+    uint32_t pend_errors;   /* reservations not queued: timer queue full   */
+    uint32_t nvs_errors;    /* reservations queued but not stored          */
+} beacon_wake_stats_t;
+
+/**
+ * Start the duty-cycled passive scan for signed wake beacons.
+ * Only built with CONFIG_PENTA_BEACON_WAKE; call after scan_sched_init().
+ *
+ * Beacon format – one manufacturer-specific AD structure:
+ *   company ID 0xFFFF (LE) | type 0x01 | counter u32 LE | tag[8]
+ * where tag = HMAC-SHA256(key, type | counter | dongle BT MAC)[0..7].
+ * A beacon is accepted only if its counter is above the last accepted one,
+ * and after a reboot above the reservation kept in NVS.
+ */
+void beacon_wake_init(void);
+
+/** Copy the beacon counters into *out. */
+void beacon_wake_get_stats(beacon_wake_stats_t *out);
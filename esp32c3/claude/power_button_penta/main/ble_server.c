@@ -1,19 +1,53 @@
 /**
  * ble_server.c
  *
+ * Bluedroid implementation of ble_server.h (the default).  The NimBLE
+ * equivalent lives in ble_server_nimble.c.
+ *
  * Advertises a custom BLE service:
  *   Service UUID  : 0x00FF
- *   Characteristic: 0xFF01  (WRITE | WRITE_NO_RSP)
+ *   Characteristic: 0xFF01  (WRITE | WRITE_NO_RSP | READ)
  *   User descriptor: "Power button Penta"
+ *   Characteristic: 0xFF02  (READ)  – wake statistics, see stats.h
+ *   User descriptor: "Wake statistics"
+ *   Characteristic: 0xFF03  (READ | NOTIFY)  – host state, see host_state.h
+ *   User descriptor: "Host state"
+ *   Characteristic: 0xFF05  (WRITE | NOTIFY) – update control, CONFIG_PENTA_OTA
+ *   Characteristic: 0xFF06  (WRITE_NO_RSP)   – update data, see ota_update.h
+ *   Characteristic: 0xFF07  (READ | WRITE)   – tuning, CONFIG_PENTA_TUNING,
+ *                                               see tuning.h
  *
- * Any write to the characteristic triggers usb_hid_send_wake_key().
+ * Writes to 0xFF01 are opcode sequences (wake_proto.h) that are queued
+ * on the dispatcher (wake_dispatch.c) and run in its task; a read returns
+ * the protocol reply.
  *
  * The device advertises as "Penta Power Btn" and keeps BLE advertising alive
- * after connection so other clients can still discover it.
+ * after a connection so other clients can still discover it, up to
+ * CONFIG_PENTA_MAX_CONNECTIONS links.  MTU, subscriptions and the wake
+ * reply are kept per link in conn_table.h.
+ *
+ * With CONFIG_PENTA_BOND_FILTER both values need an encrypted link and
+ * the advertising set only answers the bonded peers (pair_window.h).
+ *
+ * Advertising is legacy ADV_IND on the 1M PHY.  BLE 5 extended
+ * advertising is only implemented in the NimBLE backend: Bluedroid's
+ * extended API replaces every legacy GAP call used here.  For the same
+ * reason a firmware update gets the longest data length but stays on the
+ * PHY the central picked.
  */
 
 #include "ble_server.h"
-#include "usb_hid.h"
+#include "wake_proto.h"
+#include "wake_dispatch.h"
+#include "adv_sched.h"
+#include "adv_supervisor.h"
+#include "conn_policy.h"
+#include "conn_table.h"
+#include "latency.h"
+#include "stats.h"
+#include "host_state.h"
+#include "boot_time.h"
+#include "trace.h"
 
 #include "esp_log.h"
 #include "esp_bt.h"
@@ -21,19 +55,47 @@
 #include "esp_gatts_api.h"
 #include "esp_bt_main.h"
 #include "esp_gatt_common_api.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <string.h>
+#if CONFIG_PENTA_BOND_FILTER
+#include "pair_window.h"
+#endif
+#if CONFIG_PENTA_PROXIMITY_WAKE
+#include "proximity_wake.h"
+#endif
+#if CONFIG_PENTA_OTA
+#include "ota_update.h"
+#endif
+#if CONFIG_PENTA_TUNING
+#include "tuning.h"
+#endif
 
 static const char *TAG = "BLE_PWR";
 
 /* ── UUIDs ───────────────────────────────────────────────────────────────── */
 #define WAKE_SERVICE_UUID       0x00FF
 #define WAKE_CHAR_UUID          0xFF01
+#define STATS_CHAR_UUID         0xFF02
+#define HOST_CHAR_UUID          0xFF03
+#define TRACE_CHAR_UUID         0xFF04
+#define OTA_CTRL_CHAR_UUID      0xFF05
+#define OTA_DATA_CHAR_UUID      0xFF06
+#define TUNE_CHAR_UUID          0xFF07
+
+/* A full 512-byte attribute per write for firmware updates; otherwise
+ * one wake sequence */
+#if CONFIG_PENTA_OTA
+#define LOCAL_MTU               517
+#else
+#define LOCAL_MTU               128
+#endif
 
 /* ── GAP advertising payload ─────────────────────────────────────────────── */
 #define DEVICE_NAME             "Penta Power Btn"
 
+/* Interval is owned by adv_sched.c; these are the boot (fast) values */
 static esp_ble_adv_params_t adv_params = {
     .adv_int_min        = 0x20,   /* 20 ms – snappy discovery */
     .adv_int_max        = 0x40,
@@ -43,6 +105,27 @@ static esp_ble_adv_params_t adv_params = {
     .adv_filter_policy  = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
+
+/* Passive scan (scan_sched.c); interval, window and duplicate filter set
+ * by ble_server_start_scan.  One scan command is in flight at a time; a
+ * change that arrives meanwhile is applied once it completes. */
+static esp_ble_scan_params_t scan_params = {
+    .scan_type          = BLE_SCAN_TYPE_PASSIVE,
+    .own_addr_type      = BLE_ADDR_TYPE_PUBLIC,
+    .scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL,
+    .scan_duplicate     = BLE_SCAN_DUPLICATE_ENABLE,
+};
+static ble_server_adv_report_cb_t adv_report_cb;
+static portMUX_TYPE scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool scan_wanted;                   /* started, not stopped since   */
+static bool scan_running;                  /* controller is scanning       */
+static bool scan_busy;                     /* set / start / stop in flight */
+static bool scan_stale;                    /* parameters changed since     */
+static bool adv_data_ready;                /* advertising may be started   */
+static volatile bool adv_restart_pending;  /* stop issued, start on STOP_COMPLETE */
+static volatile int64_t adv_restart_us;    /* when that stop was issued    */
+static volatile bool adv_running;          /* started, not stopped since   */
+
 static esp_ble_adv_data_t adv_data = {
     .set_scan_rsp        = false,
     .include_name        = true,
@@ -59,6 +142,20 @@ static esp_ble_adv_data_t adv_data = {
     .flag = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
 };
 
+/* The advertising packet is full; the service UUID goes in the scan
+ * response so fleet tools can find every dongle by UUID.  Bluedroid
+ * shortens the base-UUID form to 16 bits. */
+static uint8_t service_uuid128[16] = {
+    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+    0x00, 0x10, 0x00, 0x00, 0xff, 0x00, 0x00, 0x00,
+};
+
+static esp_ble_adv_data_t scan_rsp_data = {
+    .set_scan_rsp        = true,
+    .service_uuid_len    = sizeof(service_uuid128),
+    .p_service_uuid      = service_uuid128,
+};
+
 /* ── GATT attribute table ────────────────────────────────────────────────── */
 #define GATTS_PROFILE_IDX   0
 #define GATTS_APP_ID        0
@@ -68,6 +165,30 @@ enum {
     IDX_CHAR_WAKE,
     IDX_CHAR_WAKE_VAL,
     IDX_CHAR_WAKE_DESC,   /* User Description */
+    IDX_CHAR_STATS,
+    IDX_CHAR_STATS_VAL,
+    IDX_CHAR_STATS_DESC,
+    IDX_CHAR_HOST,
+    IDX_CHAR_HOST_VAL,
+    IDX_CHAR_HOST_CCC,    /* Client Characteristic Configuration */
+    IDX_CHAR_HOST_DESC,
+    IDX_CHAR_TRACE,
+    IDX_CHAR_TRACE_VAL,
+    IDX_CHAR_TRACE_DESC,
+#if CONFIG_PENTA_OTA
+    IDX_CHAR_OTA_CTRL,
+    IDX_CHAR_OTA_CTRL_VAL,
+    IDX_CHAR_OTA_CTRL_CCC,
+    IDX_CHAR_OTA_CTRL_DESC,
+    IDX_CHAR_OTA_DATA,
+    IDX_CHAR_OTA_DATA_VAL,
+    IDX_CHAR_OTA_DATA_DESC,
+#endif
+#if CONFIG_PENTA_TUNING
+    IDX_CHAR_TUNE,
+    IDX_CHAR_TUNE_VAL,
+    IDX_CHAR_TUNE_DESC,
+#endif
     IDX_TABLE_SIZE,
 };
 
@@ -76,15 +197,92 @@ static uint16_t handle_table[IDX_TABLE_SIZE];
 static const uint16_t primary_service_uuid     = ESP_GATT_UUID_PRI_SERVICE;
 static const uint16_t char_decl_uuid           = ESP_GATT_UUID_CHAR_DECLARE;
 static const uint16_t char_user_desc_uuid      = ESP_GATT_UUID_CHAR_DESCRIPTION;
+static const uint16_t char_client_config_uuid  = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
 
-static const uint8_t char_prop_write = ESP_GATT_CHAR_PROP_BIT_WRITE |
-                                       ESP_GATT_CHAR_PROP_BIT_WRITE_NR;
+static const uint8_t char_prop_wake  = ESP_GATT_CHAR_PROP_BIT_WRITE |
+                                       ESP_GATT_CHAR_PROP_BIT_WRITE_NR |
+                                       ESP_GATT_CHAR_PROP_BIT_READ;
+static const uint8_t char_prop_read  = ESP_GATT_CHAR_PROP_BIT_READ;
+static const uint8_t char_prop_notify = ESP_GATT_CHAR_PROP_BIT_READ |
+                                        ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t char_prop_rw    = ESP_GATT_CHAR_PROP_BIT_READ |
+                                       ESP_GATT_CHAR_PROP_BIT_WRITE;
+#if CONFIG_PENTA_OTA
+static const uint8_t char_prop_ota_ctrl = ESP_GATT_CHAR_PROP_BIT_WRITE |
+                                          ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t char_prop_ota_data = ESP_GATT_CHAR_PROP_BIT_WRITE_NR;
+#endif
 
 static const uint16_t wake_service_uuid  = WAKE_SERVICE_UUID;
 static const uint16_t wake_char_uuid     = WAKE_CHAR_UUID;
-static const uint8_t  wake_char_value[]  = {0x00};
+static const uint16_t stats_char_uuid    = STATS_CHAR_UUID;
+static const uint16_t host_char_uuid     = HOST_CHAR_UUID;
+static const uint16_t trace_char_uuid    = TRACE_CHAR_UUID;
+#if CONFIG_PENTA_OTA
+static const uint16_t ota_ctrl_char_uuid = OTA_CTRL_CHAR_UUID;
+static const uint16_t ota_data_char_uuid = OTA_DATA_CHAR_UUID;
+#endif
+#if CONFIG_PENTA_TUNING
+static const uint16_t tune_char_uuid     = TUNE_CHAR_UUID;
+#endif
+
+static const char user_desc[]  = "Power button Penta";
+static const char stats_desc[] = "Wake statistics";
+static const char host_desc[]  = "Host state";
+static const char trace_desc[] = "Trace";
+static uint8_t host_ccc[2];         /* template; per-link state in conn_table */
+#if CONFIG_PENTA_OTA
+static const char ota_ctrl_desc[] = "Firmware update";
+static const char ota_data_desc[] = "Firmware data";
+static uint8_t ota_ccc[2];          /* template, as host_ccc */
+#endif
+#if CONFIG_PENTA_TUNING
+static const char tune_desc[] = "Tuning";
+#endif
+
+/* All values are answered by the app (ESP_GATT_RSP_BY_APP); stats and
+ * tuning from a snapshot taken on the first chunk of a (long) read.  The
+ * snapshot is shared: while one link is partway through reading it,
+ * another link starting a read gets the same snapshot instead of
+ * rebuilding it under the first (for at most LONG_READ_HOLD_US). */
+#define LONG_READ_HOLD_US       1000000
+
+typedef struct {
+    uint8_t *buf;
+    size_t   cap;
+    size_t   len;
+    size_t (*build)(uint8_t *buf, size_t cap);
+    uint16_t reader;            /* link partway through, or CONN_TABLE_NONE */
+    int64_t  built_us;
+} long_value_t;
+
+static esp_gatt_rsp_t read_rsp;     /* ~600 bytes: keep off the BTC stack */
+static uint8_t  stats_buf[STATS_MAX_LEN];
+static long_value_t stats_value = {
+    stats_buf, sizeof(stats_buf), 0, stats_build, CONN_TABLE_NONE, 0,
+};
+#if CONFIG_PENTA_TUNING
+static uint8_t  tune_buf[TUNING_VALUE_MAX];
+static long_value_t tune_value = {
+    tune_buf, sizeof(tune_buf), 0, tuning_build_value, CONN_TABLE_NONE, 0,
+};
+#endif
+
+static esp_gatt_if_t server_if = ESP_GATT_IF_NONE;
 
-static const char user_desc[] = "Power button Penta";
+/* Bonded-peer filter: values need an encrypted, hence bonded, link, since
+ * a peer address alone is easy to spoof */
+#if CONFIG_PENTA_BOND_FILTER
+#define VALUE_PERM_READ         ESP_GATT_PERM_READ_ENCRYPTED
+#define VALUE_PERM_WRITE        ESP_GATT_PERM_WRITE_ENCRYPTED
+#define MAX_FILTER_PEERS        8
+static bool pairing_open;
+static int  bond_count = -1;    /* -1 until the first refresh */
+static esp_ble_bond_dev_t bond_list[MAX_FILTER_PEERS];
+#else
+#define VALUE_PERM_READ         ESP_GATT_PERM_READ
+#define VALUE_PERM_WRITE        ESP_GATT_PERM_WRITE
+#endif
 
 static const esp_gatts_attr_db_t gatt_db[IDX_TABLE_SIZE] = {
 
@@ -102,17 +300,16 @@ static const esp_gatts_attr_db_t gatt_db[IDX_TABLE_SIZE] = {
         { ESP_GATT_AUTO_RSP },
         { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
           ESP_GATT_PERM_READ,
-          sizeof(char_prop_write), sizeof(char_prop_write),
-          (uint8_t *)&char_prop_write }
+          sizeof(char_prop_wake), sizeof(char_prop_wake),
+          (uint8_t *)&char_prop_wake }
     },
 
-    /* Characteristic value */
+    /* Characteristic value – opcode writes, reply reads (wake_proto.h) */
     [IDX_CHAR_WAKE_VAL] = {
-        { ESP_GATT_AUTO_RSP },
+        { ESP_GATT_RSP_BY_APP },
         { ESP_UUID_LEN_16, (uint8_t *)&wake_char_uuid,
-          ESP_GATT_PERM_WRITE,
-          sizeof(wake_char_value), sizeof(wake_char_value),
-          (uint8_t *)wake_char_value }
+          VALUE_PERM_WRITE | VALUE_PERM_READ,
+          WAKE_PROTO_MAX_LEN, 0, NULL }
     },
 
     /* User Description descriptor */
@@ -123,8 +320,579 @@ static const esp_gatts_attr_db_t gatt_db[IDX_TABLE_SIZE] = {
           sizeof(user_desc) - 1, sizeof(user_desc) - 1,
           (uint8_t *)user_desc }
     },
+
+    /* Stats characteristic declaration */
+    [IDX_CHAR_STATS] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_read), sizeof(char_prop_read),
+          (uint8_t *)&char_prop_read }
+    },
+
+    /* Stats characteristic value – built on demand */
+    [IDX_CHAR_STATS_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&stats_char_uuid,
+          VALUE_PERM_READ,
+          STATS_MAX_LEN, 0, NULL }
+    },
+
+    [IDX_CHAR_STATS_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(stats_desc) - 1, sizeof(stats_desc) - 1,
+          (uint8_t *)stats_desc }
+    },
+
+    /* Host-state characteristic declaration */
+    [IDX_CHAR_HOST] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_notify), sizeof(char_prop_notify),
+          (uint8_t *)&char_prop_notify }
+    },
+
+    /* Host-state value – built on demand, notified on every transition */
+    [IDX_CHAR_HOST_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&host_char_uuid,
+          VALUE_PERM_READ,
+          HOST_STATE_VALUE_LEN, 0, NULL }
+    },
+
+    [IDX_CHAR_HOST_CCC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+          ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+          sizeof(host_ccc), sizeof(host_ccc), host_ccc }
+    },
+
+    [IDX_CHAR_HOST_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(host_desc) - 1, sizeof(host_desc) - 1,
+          (uint8_t *)host_desc }
+    },
+
+    /* Trace characteristic declaration */
+    [IDX_CHAR_TRACE] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_rw), sizeof(char_prop_rw),
+          (uint8_t *)&char_prop_rw }
+    },
+
+    /* Trace value – cursor writes, record reads (trace.h) */
+    [IDX_CHAR_TRACE_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&trace_char_uuid,
+          VALUE_PERM_READ | VALUE_PERM_WRITE,
+          TRACE_VALUE_MAX, 0, NULL }
+    },
+
+    [IDX_CHAR_TRACE_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(trace_desc) - 1, sizeof(trace_desc) - 1,
+          (uint8_t *)trace_desc }
+    },
+
+#if CONFIG_PENTA_OTA
+    /* Update control – commands in, status notifications out */
+    [IDX_CHAR_OTA_CTRL] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_ota_ctrl), sizeof(char_prop_ota_ctrl),
+          (uint8_t *)&char_prop_ota_ctrl }
+    },
+
+    [IDX_CHAR_OTA_CTRL_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&ota_ctrl_char_uuid,
+          VALUE_PERM_WRITE,
+          8, 0, NULL }
+    },
+
+    [IDX_CHAR_OTA_CTRL_CCC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_client_config_uuid,
+          ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+          sizeof(ota_ccc), sizeof(ota_ccc), ota_ccc }
+    },
+
+    [IDX_CHAR_OTA_CTRL_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(ota_ctrl_desc) - 1, sizeof(ota_ctrl_desc) - 1,
+          (uint8_t *)ota_ctrl_desc }
+    },
+
+    /* Update data – offset u32 | image bytes, streamed without response */
+    [IDX_CHAR_OTA_DATA] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_ota_data), sizeof(char_prop_ota_data),
+          (uint8_t *)&char_prop_ota_data }
+    },
+
+    [IDX_CHAR_OTA_DATA_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&ota_data_char_uuid,
+          VALUE_PERM_WRITE,
+          OTA_DATA_MAX_LEN, 0, NULL }
+    },
+
+    [IDX_CHAR_OTA_DATA_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(ota_data_desc) - 1, sizeof(ota_data_desc) - 1,
+          (uint8_t *)ota_data_desc }
+    },
+#endif
+
+#if CONFIG_PENTA_TUNING
+    /* Tuning – parameter pairs in both directions (tuning.h) */
+    [IDX_CHAR_TUNE] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_decl_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(char_prop_rw), sizeof(char_prop_rw),
+          (uint8_t *)&char_prop_rw }
+    },
+
+    [IDX_CHAR_TUNE_VAL] = {
+        { ESP_GATT_RSP_BY_APP },
+        { ESP_UUID_LEN_16, (uint8_t *)&tune_char_uuid,
+          VALUE_PERM_READ | VALUE_PERM_WRITE,
+          TUNING_VALUE_MAX, 0, NULL }
+    },
+
+    [IDX_CHAR_TUNE_DESC] = {
+        { ESP_GATT_AUTO_RSP },
+        { ESP_UUID_LEN_16, (uint8_t *)&char_user_desc_uuid,
+          ESP_GATT_PERM_READ,
+          sizeof(tune_desc) - 1, sizeof(tune_desc) - 1,
+          (uint8_t *)tune_desc }
+    },
+#endif
 };
 
+/* ── Advertising control ─────────────────────────────────────────────────── */
+/* STOP_COMPLETE normally follows within a few ms; a restart pending for
+ * longer than this is stuck, and the supervisor may step in */
+#define ADV_RESTART_GRACE_US    1000000
+
+static void start_advertising(void)
+{
+    /* A pending restart will start advertising with the new parameters;
+     * with every client slot taken, DISCONNECT_EVT starts it again */
+    if (!adv_restart_pending && !conn_table_full()) {
+        esp_ble_gap_start_advertising(&adv_params);
+    }
+}
+
+/* Stop now, start again from ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT */
+static void restart_advertising(void)
+{
+    adv_restart_us      = esp_timer_get_time();
+    adv_restart_pending = true;
+    esp_ble_gap_stop_advertising();
+}
+
+void ble_server_set_adv_interval(uint16_t itvl_min, uint16_t itvl_max)
+{
+    adv_params.adv_int_min = itvl_min;
+    adv_params.adv_int_max = itvl_max;
+
+    /* Bluedroid cannot change the interval of a running advertising set:
+     * stop it and start again from ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT. */
+    if (adv_data_ready) {
+        restart_advertising();
+    }
+}
+
+/* ── Bonded-peer filter ──────────────────────────────────────────────────── */
+#if CONFIG_PENTA_BOND_FILTER
+/* Load the bonded peers into the filter accept list and pick the advertising
+ * filter.  Bluedroid pauses advertising itself while it edits the list.
+ * Returns true if a peer bonded since the last call. */
+static bool refresh_filter(void)
+{
+    int n = MAX_FILTER_PEERS;
+    if (esp_ble_get_bond_device_list(&n, bond_list) != ESP_OK) {
+        n = 0;
+    }
+
+    esp_ble_gap_clear_whitelist();
+    for (int i = 0; i < n; i++) {
+        /* bd_addr is the identity address; RPAs are resolved by the
+         * controller from the IRK stored with the bond */
+        esp_ble_wl_addr_type_t type = BLE_WL_ADDR_TYPE_PUBLIC;
+        if ((bond_list[i].bond_key.key_mask & ESP_BLE_ID_KEY_MASK) &&
+            (bond_list[i].bond_key.pid_key.addr_type & 1)) {
+            type = BLE_WL_ADDR_TYPE_RANDOM;
+        }
+        esp_ble_gap_update_whitelist(true, bond_list[i].bd_addr, type);
+    }
+
+    esp_ble_adv_filter_t filter = (!pairing_open && n > 0)
+        ? ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST
+        : ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    if (filter != adv_params.adv_filter_policy) {
+        adv_params.adv_filter_policy = filter;
+        if (adv_data_ready) {
+            restart_advertising();
+        }
+    }
+
+    bool new_bond = bond_count >= 0 && n > bond_count;
+    bond_count = n;
+    pair_window_on_bond_count((uint8_t)n);
+#if CONFIG_PENTA_PROXIMITY_WAKE
+    proximity_wake_on_bonds();
+#endif
+    return new_bond;
+}
+
+static void init_security(void)
+{
+    esp_ble_auth_req_t auth = ESP_LE_AUTH_REQ_SC_BOND;
+    esp_ble_io_cap_t iocap  = ESP_IO_CAP_NONE;  /* the button is the proof */
+    uint8_t key_size = 16;
+    uint8_t keys = ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK;
+
+    esp_ble_gap_set_security_param(ESP_BLE_SM_AUTHEN_REQ_MODE,
+                                   &auth, sizeof(auth));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_IOCAP_MODE,
+                                   &iocap, sizeof(iocap));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_MAX_KEY_SIZE,
+                                   &key_size, sizeof(key_size));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_INIT_KEY,
+                                   &keys, sizeof(keys));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY,
+                                   &keys, sizeof(keys));
+}
+
+void ble_server_set_pairing(bool open)
+{
+    pairing_open = open;
+    refresh_filter();
+}
+
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max)
+{
+    static esp_ble_bond_dev_t list[MAX_FILTER_PEERS];
+    int n = MAX_FILTER_PEERS;
+
+    if (esp_ble_get_bond_device_list(&n, list) != ESP_OK) {
+        return 0;
+    }
+    if (n > max) {
+        n = max;
+    }
+    for (int i = 0; i < n; i++) {
+        /* bd_addr is already most significant byte first */
+        memcpy(out[i].addr, list[i].bd_addr, sizeof(out[i].addr));
+        out[i].has_irk =
+            (list[i].bond_key.key_mask & ESP_BLE_ID_KEY_MASK) != 0;
+        memcpy(out[i].irk, list[i].bond_key.pid_key.irk, sizeof(out[i].irk));
+    }
+    return n;
+}
+#else
+void ble_server_set_pairing(bool open)
+{
+    (void)open;
+}
+
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max)
+{
+    (void)out; (void)max;
+    return 0;
+}
+#endif
+
+/* ── Connection parameters ───────────────────────────────────────────────── */
+/* Parameter updates are addressed by peer address, conn_policy.c uses the
+ * GATTS conn_id; conn_table keeps both */
+static bool peer_bda(uint16_t conn_id, esp_bd_addr_t bda)
+{
+    conn_ctx_t ctx;
+
+    if (!conn_table_get(conn_table_slot(conn_id), &ctx)) {
+        return false;
+    }
+    memcpy(bda, ctx.addr, sizeof(esp_bd_addr_t));
+    return true;
+}
+
+void ble_server_request_conn_params(uint16_t conn, uint16_t itvl_min,
+                                    uint16_t itvl_max, uint16_t latency,
+                                    uint16_t timeout)
+{
+    esp_ble_conn_update_params_t p = {
+        .min_int = itvl_min,
+        .max_int = itvl_max,
+        .latency = latency,
+        .timeout = timeout,
+    };
+
+    if (!peer_bda(conn, p.bda)) {
+        return;
+    }
+    esp_err_t err = esp_ble_gap_update_conn_params(&p);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Connection update request failed: %s",
+                 esp_err_to_name(err));
+    }
+}
+
+/* ── Host-state notifications ────────────────────────────────────────────── */
+void ble_server_notify_host_state(void)
+{
+    uint8_t val[HOST_STATE_VALUE_LEN];
+    size_t len = host_state_build_value(val, sizeof(val));
+
+    if (server_if == ESP_GATT_IF_NONE) {
+        return;
+    }
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        conn_ctx_t ctx;
+        if (conn_table_get(i, &ctx) && (ctx.subs & CONN_SUB_HOST_STATE)) {
+            esp_ble_gatts_send_indicate(server_if, ctx.conn,
+                                        handle_table[IDX_CHAR_HOST_VAL],
+                                        (uint16_t)len, val, false);
+        }
+    }
+}
+
+/* AUTO_RSP stores one CCC value for everybody; the table keeps each link's */
+static void handle_ccc_write(const esp_ble_gatts_cb_param_t *param,
+                             uint8_t sub)
+{
+    if (param->write.len == 2) {
+        conn_table_set_sub(param->write.conn_id, sub,
+                           (param->write.value[0] & 0x01) != 0);
+    }
+}
+
+/* ── Reads and writes ────────────────────────────────────────────────────── */
+static void send_long_value(esp_gatt_if_t gatts_if,
+                            const esp_ble_gatts_cb_param_t *param,
+                            long_value_t *v)
+{
+    esp_gatt_rsp_t *rsp = &read_rsp;
+    uint16_t conn = param->read.conn_id;
+    uint16_t offset = param->read.offset;
+    size_t chunk = conn_table_mtu(conn) - 1;
+    esp_gatt_status_t status = ESP_GATT_OK;
+    int64_t now = esp_timer_get_time();
+
+    if (offset == 0 &&
+        (v->reader == CONN_TABLE_NONE || v->reader == conn ||
+         now - v->built_us > LONG_READ_HOLD_US)) {
+        v->len = v->build(v->buf, v->cap);
+        v->built_us = now;
+    }
+
+    memset(rsp, 0, sizeof(*rsp));
+    rsp->attr_value.handle = param->read.handle;
+    rsp->attr_value.offset = offset;
+    if (offset > v->len) {
+        status = ESP_GATT_INVALID_OFFSET;
+    } else {
+        size_t len = v->len - offset;
+        if (len > chunk) {
+            len = chunk;
+        }
+        memcpy(rsp->attr_value.value, &v->buf[offset], len);
+        rsp->attr_value.len = (uint16_t)len;
+        /* A full chunk means the client reads on */
+        if (len == chunk) {
+            v->reader = conn;
+        } else if (v->reader == conn) {
+            v->reader = CONN_TABLE_NONE;
+        }
+    }
+    esp_ble_gatts_send_response(gatts_if, param->read.conn_id,
+                                param->read.trans_id, status, rsp);
+}
+
+static void release_long_reads(uint16_t conn)
+{
+    if (stats_value.reader == conn) {
+        stats_value.reader = CONN_TABLE_NONE;
+    }
+#if CONFIG_PENTA_TUNING
+    if (tune_value.reader == conn) {
+        tune_value.reader = CONN_TABLE_NONE;
+    }
+#endif
+}
+
+/* Short values are built to fit one read at the current MTU (the trace
+ * just returns fewer records), so offsets are always 0 */
+static void send_short_value(esp_gatt_if_t gatts_if,
+                             const esp_ble_gatts_cb_param_t *param,
+                             size_t (*build)(uint8_t *buf, size_t cap))
+{
+    esp_gatt_rsp_t *rsp = &read_rsp;
+
+    memset(rsp, 0, sizeof(*rsp));
+    rsp->attr_value.handle = param->read.handle;
+    rsp->attr_value.len = (uint16_t)build(rsp->attr_value.value,
+                                          conn_table_mtu(param->read.conn_id)
+                                          - 1);
+    esp_ble_gatts_send_response(gatts_if, param->read.conn_id,
+                                param->read.trans_id, ESP_GATT_OK, rsp);
+}
+
+/* The wake reply is the reading client's own (wake_proto.h) */
+static void send_wake_reply(esp_gatt_if_t gatts_if,
+                            const esp_ble_gatts_cb_param_t *param)
+{
+    esp_gatt_rsp_t *rsp = &read_rsp;
+
+    memset(rsp, 0, sizeof(*rsp));
+    rsp->attr_value.handle = param->read.handle;
+    rsp->attr_value.len = (uint16_t)wake_proto_build_reply(
+        param->read.conn_id, rsp->attr_value.value,
+        conn_table_mtu(param->read.conn_id) - 1);
+    esp_ble_gatts_send_response(gatts_if, param->read.conn_id,
+                                param->read.trans_id, ESP_GATT_OK, rsp);
+}
+
+static void handle_wake_write(esp_gatt_if_t gatts_if,
+                              const esp_ble_gatts_cb_param_t *param)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+
+    if (param->write.is_prep) {
+        /* A sequence must fit in one ATT write (WAKE_PROTO_MAX_LEN) */
+        status = ESP_GATT_REQ_NOT_SUPPORTED;
+    } else {
+        esp_err_t err = wake_proto_handle_write(param->write.conn_id,
+                                                param->write.value,
+                                                param->write.len);
+        conn_table_on_write(param->write.conn_id, err == ESP_OK);
+        conn_policy_on_activity(param->write.conn_id);
+        trace_log(TRACE_EVT_WAKE_WRITE, param->write.conn_id,
+                  param->write.len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Wake write rejected: %s", esp_err_to_name(err));
+            trace_log(TRACE_EVT_WAKE_REJECT, param->write.conn_id,
+                      (uint32_t)err);
+            status = (esp_gatt_status_t)wake_proto_att_error(err);
+        }
+    }
+    if (param->write.need_rsp) {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id,
+                                    param->write.trans_id, status, NULL);
+    }
+}
+
+/* seq u32: where the next read of the trace starts */
+static void handle_trace_write(esp_gatt_if_t gatts_if,
+                               const esp_ble_gatts_cb_param_t *param)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+    const uint8_t *v = param->write.value;
+
+    if (param->write.is_prep || param->write.len != 4) {
+        status = ESP_GATT_INVALID_ATTR_LEN;
+    } else {
+        trace_set_cursor((uint32_t)v[0] | (uint32_t)v[1] << 8 |
+                         (uint32_t)v[2] << 16 | (uint32_t)v[3] << 24);
+    }
+    if (param->write.need_rsp) {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id,
+                                    param->write.trans_id, status, NULL);
+    }
+}
+
+#if CONFIG_PENTA_TUNING
+/* Applied in the callback, stored later from the timer task (tuning.c) */
+static void handle_tune_write(esp_gatt_if_t gatts_if,
+                              const esp_ble_gatts_cb_param_t *param)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+
+    if (param->write.is_prep) {
+        status = ESP_GATT_REQ_NOT_SUPPORTED;
+    } else {
+        esp_err_t err = tuning_handle_write(param->write.value,
+                                            param->write.len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Tuning write rejected: %s", esp_err_to_name(err));
+            status = (esp_gatt_status_t)TUNING_ATT_ERR_INVALID;
+        }
+    }
+    if (param->write.need_rsp) {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id,
+                                    param->write.trans_id, status, NULL);
+    }
+}
+#endif
+
+/* ── Firmware update ─────────────────────────────────────────────────────── */
+#if CONFIG_PENTA_OTA
+static void handle_ota_write(esp_gatt_if_t gatts_if,
+                             const esp_ble_gatts_cb_param_t *param)
+{
+    esp_gatt_status_t status = ESP_GATT_OK;
+
+    if (param->write.is_prep) {
+        status = ESP_GATT_REQ_NOT_SUPPORTED;
+    } else if (param->write.handle == handle_table[IDX_CHAR_OTA_DATA_VAL]) {
+        /* Copied into the update task's buffer; no flash access here */
+        ota_update_on_data(param->write.conn_id, param->write.value,
+                           param->write.len);
+    } else {
+        esp_err_t err = ota_update_on_control(param->write.conn_id,
+                                              param->write.value,
+                                              param->write.len);
+        if (err != ESP_OK) {
+            status = (esp_gatt_status_t)ota_update_att_error(err);
+        }
+    }
+    if (param->write.need_rsp) {
+        esp_ble_gatts_send_response(gatts_if, param->write.conn_id,
+                                    param->write.trans_id, status, NULL);
+    }
+}
+
+void ble_server_notify_ota(uint16_t conn, const uint8_t *value, size_t len)
+{
+    if (server_if != ESP_GATT_IF_NONE &&
+        conn_table_subscribed(conn, CONN_SUB_OTA)) {
+        esp_ble_gatts_send_indicate(server_if, conn,
+                                    handle_table[IDX_CHAR_OTA_CTRL_VAL],
+                                    (uint16_t)len, (uint8_t *)value, false);
+    }
+}
+
+/* Bluedroid's 2M PHY request is part of the BLE 5 API this backend does
+ * not use (see the file comment) */
+void ble_server_prepare_bulk(uint16_t conn)
+{
+    esp_bd_addr_t bda;
+
+    if (peer_bda(conn, bda)) {
+        esp_ble_gap_set_pkt_data_len(bda, 251);
+    }
+}
+#endif
+
 /* ── GATTS event handler ─────────────────────────────────────────────────── */
 static void gatts_event_handler(esp_gatts_cb_event_t event,
                                 esp_gatt_if_t gatts_if,
@@ -134,6 +902,8 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
 
     case ESP_GATTS_REG_EVT:
         ESP_LOGI(TAG, "GATTS registered, app_id=%d", param->reg.app_id);
+        server_if = gatts_if;
+        boot_time_mark(BOOT_STAGE_BLE_SYNC);
         esp_ble_gap_set_device_name(DEVICE_NAME);
         esp_ble_gap_config_adv_data(&adv_data);
         esp_ble_gatts_create_attr_tab(gatt_db, gatts_if,
@@ -154,22 +924,91 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
         break;
 
     case ESP_GATTS_WRITE_EVT:
-        /* Any write to our characteristic triggers the wake key */
+        /* Validated and queued on the dispatcher, so this callback returns
+         * immediately */
         if (param->write.handle == handle_table[IDX_CHAR_WAKE_VAL]) {
-            ESP_LOGI(TAG, "Wake write received – sending HID key");
-            usb_hid_send_wake_key();
+            handle_wake_write(gatts_if, param);
+        } else if (param->write.handle == handle_table[IDX_CHAR_HOST_CCC]) {
+            /* AUTO_RSP answered already */
+            handle_ccc_write(param, CONN_SUB_HOST_STATE);
+        } else if (param->write.handle == handle_table[IDX_CHAR_TRACE_VAL]) {
+            handle_trace_write(gatts_if, param);
+#if CONFIG_PENTA_OTA
+        } else if (param->write.handle == handle_table[IDX_CHAR_OTA_CTRL_CCC]) {
+            handle_ccc_write(param, CONN_SUB_OTA);
+        } else if (param->write.handle == handle_table[IDX_CHAR_OTA_CTRL_VAL] ||
+                   param->write.handle == handle_table[IDX_CHAR_OTA_DATA_VAL]) {
+            handle_ota_write(gatts_if, param);
+#endif
+#if CONFIG_PENTA_TUNING
+        } else if (param->write.handle == handle_table[IDX_CHAR_TUNE_VAL]) {
+            handle_tune_write(gatts_if, param);
+#endif
+        }
+        break;
+
+    case ESP_GATTS_EXEC_WRITE_EVT:
+        /* Prepared writes were refused above; just complete the exchange */
+        esp_ble_gatts_send_response(gatts_if, param->exec_write.conn_id,
+                                    param->exec_write.trans_id,
+                                    ESP_GATT_OK, NULL);
+        break;
+
+    case ESP_GATTS_READ_EVT:
+        if (!param->read.need_rsp) {
+            break;
+        }
+        if (param->read.handle == handle_table[IDX_CHAR_STATS_VAL]) {
+            send_long_value(gatts_if, param, &stats_value);
+        } else if (param->read.handle == handle_table[IDX_CHAR_WAKE_VAL]) {
+            send_wake_reply(gatts_if, param);
+        } else if (param->read.handle == handle_table[IDX_CHAR_HOST_VAL]) {
+            send_short_value(gatts_if, param, host_state_build_value);
+        } else if (param->read.handle == handle_table[IDX_CHAR_TRACE_VAL]) {
+            send_short_value(gatts_if, param, trace_build_value);
+#if CONFIG_PENTA_TUNING
+        } else if (param->read.handle == handle_table[IDX_CHAR_TUNE_VAL]) {
+            send_long_value(gatts_if, param, &tune_value);
+#endif
         }
         break;
 
+    case ESP_GATTS_MTU_EVT:
+        conn_table_set_mtu(param->mtu.conn_id, param->mtu.mtu);
+        break;
+
     case ESP_GATTS_CONNECT_EVT:
-        ESP_LOGI(TAG, "Client connected, conn_id=%d", param->connect.conn_id);
+        adv_running = false;            /* ADV_IND ends with the connection */
+        if (conn_table_add(param->connect.conn_id,
+                           param->connect.remote_bda) < 0) {
+            /* Raced the last slot; DISCONNECT_EVT follows */
+            ESP_LOGW(TAG, "All %d client slots taken, closing link",
+                     CONN_TABLE_MAX);
+            esp_ble_gap_disconnect(param->connect.remote_bda);
+            break;
+        }
+        latency_mark(LAT_STAGE_CONNECT);
+        trace_log(TRACE_EVT_CONNECT, param->connect.conn_id, 0);
+        conn_policy_on_connect(param->connect.conn_id,
+                               param->connect.conn_params.interval,
+                               param->connect.conn_params.latency,
+                               param->connect.conn_params.timeout);
         /* Keep advertising so other clients can still find/connect */
-        esp_ble_gap_start_advertising(&adv_params);
+        start_advertising();
         break;
 
     case ESP_GATTS_DISCONNECT_EVT:
-        ESP_LOGI(TAG, "Client disconnected, restarting advertising");
-        esp_ble_gap_start_advertising(&adv_params);
+        trace_log(TRACE_EVT_DISCONNECT, param->disconnect.conn_id,
+                  param->disconnect.reason);
+        conn_policy_on_disconnect(param->disconnect.conn_id);
+#if CONFIG_PENTA_OTA
+        ota_update_on_disconnect(param->disconnect.conn_id);
+#endif
+        wake_dispatch_on_disconnect(param->disconnect.conn_id);
+        conn_table_remove(param->disconnect.conn_id);
+        release_long_reads(param->disconnect.conn_id);
+        adv_sched_on_event(ADV_EVT_DISCONNECT);
+        start_advertising();
         break;
 
     default:
@@ -177,19 +1016,144 @@ static void gatts_event_handler(esp_gatts_cb_event_t event,
     }
 }
 
+/* ── Passive scan ────────────────────────────────────────────────────────── */
+/* Issue the next scan command, if none is in flight: stop a scan that is
+ * no longer wanted or has stale parameters, or set the parameters, which
+ * starts it from ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT.  Any context. */
+static void scan_step(void)
+{
+    esp_ble_scan_params_t params;
+    bool stop = false, set = false;
+
+    portENTER_CRITICAL(&scan_lock);
+    if (!scan_busy) {
+        if (scan_running && (!scan_wanted || scan_stale)) {
+            stop = true;
+        } else if (!scan_running && scan_wanted) {
+            set        = true;
+            scan_stale = false;
+            params     = scan_params;
+        }
+        scan_busy = stop || set;
+    }
+    portEXIT_CRITICAL(&scan_lock);
+
+    if (stop) {
+        esp_ble_gap_stop_scanning();
+    } else if (set) {
+        esp_ble_gap_set_scan_params(&params);
+    }
+}
+
+/* A scan command completed; running tells where it left the controller.
+ * After a failure nothing is retried until the next ble_server_start_scan
+ * or host reset. */
+static void scan_done(bool running, bool failed)
+{
+    portENTER_CRITICAL(&scan_lock);
+    scan_busy    = false;
+    scan_running = running;
+    portEXIT_CRITICAL(&scan_lock);
+    if (!failed) {
+        scan_step();
+    }
+}
+
 /* ── GAP event handler ───────────────────────────────────────────────────── */
 static void gap_event_handler(esp_gap_ble_cb_event_t event,
                               esp_ble_gap_cb_param_t *param)
 {
     switch (event) {
     case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-        esp_ble_gap_start_advertising(&adv_params);
+        esp_ble_gap_config_adv_data(&scan_rsp_data);
+        break;
+    case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
+#if CONFIG_PENTA_BOND_FILTER
+        refresh_filter();
+#endif
+        adv_data_ready = true;
+        start_advertising();
+        break;
+    case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
+        /* Also reached when nothing was running (all links busy); start
+         * anyway so the new interval is used from now on. */
+        adv_running = false;
+        if (adv_restart_pending) {
+            adv_restart_pending = false;
+            start_advertising();
+        }
         break;
     case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
-        if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+        if (param->adv_start_cmpl.status ==
+            ESP_BT_STATUS_HCI_COMMAND_DISALLOWED) {
+            /* A second start raced the first, e.g. CONNECT, DISCONNECT or
+             * the supervisor against a stop → start restart: the set is
+             * still on the air, so adv_running stays as it was */
+            ESP_LOGD(TAG, "Advertising already on");
+        } else if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
             ESP_LOGE(TAG, "Advertising start failed");
+            adv_running = false;
+            adv_supervisor_on_adv_failed(param->adv_start_cmpl.status);
+        } else {
+            adv_running = true;
+            trace_log(TRACE_EVT_ADV_START, adv_params.adv_int_min, 0);
+            boot_time_mark(BOOT_STAGE_ADV_START);
+        }
+        break;
+    case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+        /* Also reported for updates the central starts on its own */
+        uint16_t conn_id;
+        if (conn_table_find_addr(param->update_conn_params.bda, &conn_id)) {
+            conn_policy_on_params(conn_id,
+                                  param->update_conn_params.status,
+                                  param->update_conn_params.conn_int,
+                                  param->update_conn_params.latency,
+                                  param->update_conn_params.timeout);
+        }
+        break;
+    }
+#if CONFIG_PENTA_BOND_FILTER
+    case ESP_GAP_BLE_SEC_REQ_EVT:
+        /* Pairing (not re-encryption of a bond) needs the window, the
+         * first bond too: pair_window.c opens it after an unbonded boot */
+        esp_ble_gap_security_rsp(param->ble_security.ble_req.bd_addr,
+                                 pairing_open);
+        break;
+    case ESP_GAP_BLE_AUTH_CMPL_EVT:
+        if (!param->ble_security.auth_cmpl.success) {
+            ESP_LOGW(TAG, "Pairing failed, reason 0x%x",
+                     param->ble_security.auth_cmpl.fail_reason);
+        } else if (refresh_filter()) {
+            trace_log(TRACE_EVT_BONDED, (uint16_t)bond_count, 0);
+            pair_window_on_bonded();
+        }
+        break;
+#endif
+    case ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT:
+        if (param->scan_param_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+            esp_ble_gap_start_scanning(0);   /* 0 = scan until stopped */
         } else {
-            ESP_LOGI(TAG, "Advertising started");
+            ESP_LOGE(TAG, "Scan parameters rejected");
+            scan_done(false, true);
+        }
+        break;
+    case ESP_GAP_BLE_SCAN_START_COMPLETE_EVT:
+        if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+            ESP_LOGE(TAG, "Scan start failed");
+            scan_done(false, true);
+        } else {
+            scan_done(true, false);
+        }
+        break;
+    case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
+        scan_done(false, false);
+        break;
+    case ESP_GAP_BLE_SCAN_RESULT_EVT:
+        if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT &&
+            scan_wanted) {
+            adv_report_cb(param->scan_rst.bda, (int8_t)param->scan_rst.rssi,
+                          param->scan_rst.ble_adv,
+                          param->scan_rst.adv_data_len);
         }
         break;
     default:
@@ -197,6 +1161,85 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event,
     }
 }
 
+/* ── Advertising supervision ─────────────────────────────────────────────── */
+bool ble_server_adv_healthy(void)
+{
+    /* With every slot taken advertising is off on purpose; during a stop →
+     * start restart it is off for a moment */
+    if (adv_restart_pending &&
+        esp_timer_get_time() - adv_restart_us < ADV_RESTART_GRACE_US) {
+        return true;
+    }
+    return adv_running || conn_table_full();
+}
+
+void ble_server_restart_advertising(void)
+{
+    if (!adv_data_ready) {
+        /* Data never made it or was lost: SCAN_RSP_DATA_SET_COMPLETE_EVT
+         * starts advertising again */
+        esp_ble_gap_config_adv_data(&adv_data);
+        return;
+    }
+    adv_restart_pending = false;
+    esp_ble_gap_start_advertising(&adv_params);
+}
+
+/* Disabling Bluedroid closes every link and drops the GATT app; the
+ * controller is cycled too in case it is the part that got stuck.  A
+ * failure to come back aborts, and the reboot is the next level. */
+void ble_server_recover(void)
+{
+    adv_data_ready      = false;
+    adv_restart_pending = false;
+    adv_running         = false;
+    portENTER_CRITICAL(&scan_lock);
+    scan_running = false;
+    scan_busy    = false;
+    portEXIT_CRITICAL(&scan_lock);
+
+    if (server_if != ESP_GATT_IF_NONE) {
+        esp_ble_gatts_app_unregister(server_if);
+        server_if = ESP_GATT_IF_NONE;
+    }
+    esp_bluedroid_disable();
+    esp_bt_controller_disable();
+
+    /* Links the stack did not report as disconnected on the way down */
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        conn_ctx_t ctx;
+        if (conn_table_get(i, &ctx)) {
+            conn_policy_on_disconnect(ctx.conn);
+#if CONFIG_PENTA_OTA
+            ota_update_on_disconnect(ctx.conn);
+#endif
+            wake_dispatch_on_disconnect(ctx.conn);
+            conn_table_remove(ctx.conn);
+            release_long_reads(ctx.conn);
+        }
+    }
+    adv_sched_on_event(ADV_EVT_DISCONNECT);
+
+    ESP_ERROR_CHECK(esp_bt_controller_enable(ESP_BT_MODE_BLE));
+    ESP_ERROR_CHECK(esp_bluedroid_enable());
+    ESP_ERROR_CHECK(esp_ble_gatts_app_register(GATTS_APP_ID));
+    ESP_ERROR_CHECK(esp_ble_gatt_set_local_mtu(LOCAL_MTU));
+#if CONFIG_PENTA_BOND_FILTER
+    init_security();
+#endif
+    scan_step();
+}
+
+void ble_server_get_radio(ble_server_radio_t *out)
+{
+    /* Legacy advertising; the PHY of a link is whatever the central
+     * negotiates and is not tracked here */
+    *out = (ble_server_radio_t) {
+        .adv_primary_phy   = 1,
+        .adv_secondary_phy = 1,
+    };
+}
+
 /* ── Public init ─────────────────────────────────────────────────────────── */
 void ble_server_init(void)
 {
@@ -211,7 +1254,33 @@ void ble_server_init(void)
     ESP_ERROR_CHECK(esp_ble_gap_register_callback(gap_event_handler));
     ESP_ERROR_CHECK(esp_ble_gatts_register_callback(gatts_event_handler));
     ESP_ERROR_CHECK(esp_ble_gatts_app_register(GATTS_APP_ID));
-    ESP_ERROR_CHECK(esp_ble_gatt_set_local_mtu(128));
+    ESP_ERROR_CHECK(esp_ble_gatt_set_local_mtu(LOCAL_MTU));
+#if CONFIG_PENTA_BOND_FILTER
+    init_security();
+#endif
 
     ESP_LOGI(TAG, "BLE GATT server initialised");
 }
+
+void ble_server_start_scan(uint16_t interval, uint16_t window,
+                           bool all_reports, ble_server_adv_report_cb_t cb)
+{
+    portENTER_CRITICAL(&scan_lock);
+    adv_report_cb = cb;
+    scan_params.scan_interval = interval;
+    scan_params.scan_window   = window;
+    scan_params.scan_duplicate = all_reports ? BLE_SCAN_DUPLICATE_DISABLE
+                                             : BLE_SCAN_DUPLICATE_ENABLE;
+    scan_wanted = true;
+    scan_stale  = true;
+    portEXIT_CRITICAL(&scan_lock);
+    scan_step();
+}
+
+void ble_server_stop_scan(void)
+{
+    portENTER_CRITICAL(&scan_lock);
+    scan_wanted = false;
+    portEXIT_CRITICAL(&scan_lock);
+    scan_step();
+}
@@ -1,9 +1,129 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * Initialise the BLE GATT server.
  * Registers a custom service with a single "Wake" characteristic.
  * Writing any value to the characteristic triggers a USB HID wake keystroke.
+ *
+ * Implemented by ble_server.c (Bluedroid) or ble_server_nimble.c (NimBLE),
+ * depending on which Bluetooth host is enabled in sdkconfig.
  */
 void ble_server_init(void);
+
+/**
+ * Change the advertising interval (0.625 ms units).
+ * Takes effect immediately if advertising is running, otherwise on the next
+ * start.  May be called before ble_server_init(); driven by adv_sched.c.
+ */
+void ble_server_set_adv_interval(uint16_t itvl_min, uint16_t itvl_max);
+
+/**
+ * Ask the central to update the parameters of connection conn (interval
+ * in 1.25 ms units, timeout in 10 ms units).  Asynchronous: the outcome
+ * reaches conn_policy_on_params().  Driven by conn_policy.c.
+ */
+void ble_server_request_conn_params(uint16_t conn, uint16_t itvl_min,
+                                    uint16_t itvl_max, uint16_t latency,
+                                    uint16_t timeout);
+
+/**
+ * Notify host_state_build_value() on the host-state characteristic to
+ * every client that subscribed to it.  Any task; driven by host_state.c.
+ */
+void ble_server_notify_host_state(void);
+
+/**
+ * Open or close pairing for new peers; driven by pair_window.c with
+ * CONFIG_PENTA_BOND_FILTER.  Closed, the backend advertises with the
+ * controller filter accept list holding the bonded peers (or unfiltered
+ * while there are none); open, any central may connect and bond.
+ */
+void ble_server_set_pairing(bool open);
+
+/**
+ * Receives advertising reports while scanning, in BLE stack context.
+ * addr is the 6-byte advertiser address, most significant byte first (as
+ * printed), data the raw AD structures.
+ */
+typedef void (*ble_server_adv_report_cb_t)(const uint8_t *addr, int8_t rssi,
+                                           const uint8_t *data, uint8_t len);
+
+/**
+ * Start a continuous passive scan next to advertising (0.625 ms units) and
+ * deliver every report to cb.  With all_reports off the controller drops
+ * repeated reports; on, every advertisement heard is reported.  Driven by
+ * scan_sched.c.
+ *
+ * Calling it again while scanning restarts the scan with the new
+ * parameters, which also resets the controller's duplicate filter.  Any
+ * task; if the host is not ready yet the scan starts as soon as it is.
+ */
+void ble_server_start_scan(uint16_t interval, uint16_t window,
+                           bool all_reports, ble_server_adv_report_cb_t cb);
+
+/** Stop the scan; no report reaches the callback afterwards.  Any task. */
+void ble_server_stop_scan(void);
+
+/** Identity of a bonded peer (CONFIG_PENTA_BOND_FILTER). */
+typedef struct {
+    uint8_t addr[6];            /* identity address, most significant first */
+    uint8_t irk[16];            /* as distributed in pairing, LSB first     */
+    bool    has_irk;            /* peer uses resolvable private addresses   */
+} ble_server_peer_id_t;
+
+/**
+ * Copy up to max bonded peers into out and return how many there are.
+ * For resolving the private addresses a peer advertises with.  Task or
+ * BLE stack context, one caller at a time.
+ */
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max);
+
+/* ── Advertising supervision (adv_supervisor.c) ─────────────────────────── */
+
+/**
+ * True if the device is discoverable as it should be: advertising is on,
+ * or it need not be because every connection slot is taken or a restart
+ * with new parameters is under way.  Any task.
+ */
+bool ble_server_adv_healthy(void);
+
+/** Start advertising again with the current parameters.  Any task. */
+void ble_server_restart_advertising(void);
+
+/**
+ * Last resort when restarts do not help: reset the BLE host and the
+ * controller, drop every link and bring the service back up.  Blocks
+ * until the stack is re-enabled (advertising follows asynchronously).
+ * Supervisor task only.
+ */
+void ble_server_recover(void);
+
+/* ── Radio configuration (stats) ────────────────────────────────────────── */
+
+/** PHY values follow HCI: 1 = 1M, 2 = 2M, 3 = LE Coded; 0 = unknown. */
+typedef struct {
+    bool     ext_adv;           /* BLE 5 extended advertising in use        */
+    uint8_t  adv_primary_phy;
+    uint8_t  adv_secondary_phy; /* AUX packets and new connections          */
+    uint8_t  conn_phy_pref;     /* PHY asked for after connect, 0 = none    */
+    uint8_t  last_tx_phy;       /* PHY of the last link update or connect   */
+    uint8_t  last_rx_phy;
+    uint16_t phy_updates;       /* PHY update procedures completed          */
+} ble_server_radio_t;
+
+/** Copy the radio configuration and PHY counters into *out. */
+void ble_server_get_radio(ble_server_radio_t *out);
+
+/* ── Firmware update (ota_update.c, CONFIG_PENTA_OTA) ───────────────────── */
+
+/** Notify value on the update control characteristic to conn.  Any task. */
+void ble_server_notify_ota(uint16_t conn, const uint8_t *value, size_t len);
+
+/**
+ * Ahead of a bulk transfer on conn, ask for the largest LL data length
+ * and, where the backend can, the 2M PHY.  Any task.
+ */
+void ble_server_prepare_bulk(uint16_t conn);
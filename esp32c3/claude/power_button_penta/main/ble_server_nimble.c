@@ -0,0 +1,1163 @@
+/**
+ * ble_server_nimble.c
+ *
+ * NimBLE implementation of ble_server.h, built instead of ble_server.c when
+ * CONFIG_BT_NIMBLE_ENABLED=y (see sdkconfig.defaults.nimble).
+ *
+ * Exposes exactly the same GATT layout as the Bluedroid backend:
+ *   Service UUID  : 0x00FF
+ *   Characteristic: 0xFF01  (WRITE | WRITE_NO_RSP | READ)
+ *   User descriptor: "Power button Penta"
+ *   Characteristic: 0xFF02  (READ)  – wake statistics, see stats.h
+ *   User descriptor: "Wake statistics"
+ *   Characteristic: 0xFF03  (READ | NOTIFY)  – host state, see host_state.h
+ *   User descriptor: "Host state"
+ *   Characteristic: 0xFF05  (WRITE | NOTIFY) – update control, CONFIG_PENTA_OTA
+ *   Characteristic: 0xFF06  (WRITE_NO_RSP)   – update data, see ota_update.h
+ *   Characteristic: 0xFF07  (READ | WRITE)   – tuning, CONFIG_PENTA_TUNING,
+ *                                               see tuning.h
+ *
+ * Writes to 0xFF01 are opcode sequences (wake_proto.h) that are queued
+ * on the dispatcher (wake_dispatch.c) and run in its task; a read returns
+ * the protocol reply.
+ *
+ * The device advertises as "Penta Power Btn" with the same 20–40 ms
+ * interval and keeps advertising after a connection so other clients can
+ * still discover it, up to CONFIG_PENTA_MAX_CONNECTIONS links.  NimBLE
+ * keeps MTU and CCCDs per link itself; conn_table.h mirrors them for the
+ * wake reply, the update notifications and the stats.
+ *
+ * With CONFIG_PENTA_BOND_FILTER both values need an encrypted link and
+ * the advertising set only answers the bonded peers (pair_window.h).
+ * Bonds persist in NVS (CONFIG_BT_NIMBLE_NVS_PERSIST).
+ *
+ * With CONFIG_BT_NIMBLE_EXT_ADV (sdkconfig.defaults.ble5) the device uses
+ * one BLE 5 extended advertising set instead, on the PHYs picked by
+ * CONFIG_PENTA_ADV_PHY_*.  With CONFIG_PENTA_CONN_PHY_2M every new link
+ * asks for the 2M PHY, which halves the air time of each packet.
+ */
+
+#include "ble_server.h"
+#include "wake_proto.h"
+#include "wake_dispatch.h"
+#include "adv_sched.h"
+#include "adv_supervisor.h"
+#include "conn_policy.h"
+#include "conn_table.h"
+#include "latency.h"
+#include "stats.h"
+#include "host_state.h"
+#include "boot_time.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#if CONFIG_PENTA_BOND_FILTER
+#include "pair_window.h"
+#endif
+#if CONFIG_PENTA_PROXIMITY_WAKE
+#include "proximity_wake.h"
+#endif
+#if CONFIG_PENTA_OTA
+#include "ota_update.h"
+#endif
+#if CONFIG_PENTA_TUNING
+#include "tuning.h"
+#endif
+#include <assert.h>
+#include <string.h>
+
+static const char *TAG = "BLE_PWR";
+
+/* ── UUIDs ───────────────────────────────────────────────────────────────── */
+#define WAKE_SERVICE_UUID       0x00FF
+#define WAKE_CHAR_UUID          0xFF01
+#define STATS_CHAR_UUID         0xFF02
+#define HOST_CHAR_UUID          0xFF03
+#define TRACE_CHAR_UUID         0xFF04
+#define OTA_CTRL_CHAR_UUID      0xFF05
+#define OTA_DATA_CHAR_UUID      0xFF06
+#define TUNE_CHAR_UUID          0xFF07
+
+/* A full 512-byte attribute per write for firmware updates; otherwise
+ * one wake sequence */
+#if CONFIG_PENTA_OTA
+#define LOCAL_MTU               517
+#else
+#define LOCAL_MTU               128
+#endif
+
+/* ── GAP advertising payload ─────────────────────────────────────────────── */
+#define DEVICE_NAME             "Penta Power Btn"
+
+/* Interval is owned by adv_sched.c; these are the boot (fast) values */
+static struct ble_gap_adv_params adv_params = {
+    .conn_mode          = BLE_GAP_CONN_MODE_UND,
+    .disc_mode          = BLE_GAP_DISC_MODE_GEN,
+    .itvl_min           = 0x20,   /* 20 ms – snappy discovery */
+    .itvl_max           = 0x40,
+    .channel_map        = 0,      /* 0 = all three channels */
+    .filter_policy      = BLE_HCI_ADV_FILT_NONE,
+};
+
+/* Preferred slave connection interval range, 7.5–20 ms (1.25 ms units) */
+static const uint8_t slave_itvl_range[4] = { 0x06, 0x00, 0x10, 0x00 };
+
+/* ── PHYs ────────────────────────────────────────────────────────────────── */
+#if CONFIG_BT_NIMBLE_EXT_ADV
+#define ADV_EXT                 1
+#define ADV_INSTANCE            0
+#if CONFIG_PENTA_ADV_PHY_CODED
+#define ADV_PRIMARY_PHY         BLE_HCI_LE_PHY_CODED
+#define ADV_SECONDARY_PHY       BLE_HCI_LE_PHY_CODED
+#elif CONFIG_PENTA_ADV_PHY_1M_2M
+#define ADV_PRIMARY_PHY         BLE_HCI_LE_PHY_1M
+#define ADV_SECONDARY_PHY       BLE_HCI_LE_PHY_2M
+#else
+#define ADV_PRIMARY_PHY         BLE_HCI_LE_PHY_1M
+#define ADV_SECONDARY_PHY       BLE_HCI_LE_PHY_1M
+#endif
+#else
+#define ADV_EXT                 0
+#define ADV_PRIMARY_PHY         BLE_HCI_LE_PHY_1M
+#define ADV_SECONDARY_PHY       BLE_HCI_LE_PHY_1M
+#endif
+
+#if CONFIG_PENTA_CONN_PHY_2M
+#define CONN_PHY_PREF           BLE_HCI_LE_PHY_2M
+#else
+#define CONN_PHY_PREF           0
+#endif
+
+static uint8_t  last_tx_phy;
+static uint8_t  last_rx_phy;
+static uint16_t phy_updates;
+static struct ble_npl_event adv_restart_ev;
+
+
+/* Passive scan (scan_sched.c); interval, window and duplicate filter set
+ * by ble_server_start_scan, applied in the host task through scan_ev */
+static struct ble_gap_disc_params disc_params = {
+    .passive           = 1,
+    .filter_duplicates = 1,
+};
+static ble_server_adv_report_cb_t adv_report_cb;
+static portMUX_TYPE scan_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool scan_wanted;                /* started, not stopped since     */
+static bool scan_stale;                 /* parameters changed since       */
+static struct ble_npl_event scan_ev;
+
+/* Bonded-peer filter: values need an encrypted, hence bonded, link, since
+ * a peer address alone is easy to spoof */
+#if CONFIG_PENTA_BOND_FILTER
+#define VALUE_F_READ_ENC        BLE_GATT_CHR_F_READ_ENC
+#define VALUE_F_WRITE_ENC       BLE_GATT_CHR_F_WRITE_ENC
+#define MAX_FILTER_PEERS        8
+static bool pairing_open;
+static int  bond_count = -1;    /* -1 until the first refresh */
+
+void ble_store_config_init(void);
+#else
+#define VALUE_F_READ_ENC        0
+#define VALUE_F_WRITE_ENC       0
+#endif
+
+/* ── GATT service table ──────────────────────────────────────────────────── */
+static uint16_t wake_chr_val_handle;
+static uint16_t host_chr_val_handle;
+
+static const char user_desc[]  = "Power button Penta";
+static const char stats_desc[] = "Wake statistics";
+static const char host_desc[]  = "Host state";
+static const char trace_desc[] = "Trace";
+#if CONFIG_PENTA_OTA
+static uint16_t ota_chr_val_handle;
+static const char ota_ctrl_desc[] = "Firmware update";
+static const char ota_data_desc[] = "Firmware data";
+#endif
+#if CONFIG_PENTA_TUNING
+static const char tune_desc[] = "Tuning";
+#endif
+
+static int wake_chr_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)attr_handle; (void)arg;
+    uint8_t buf[WAKE_PROTO_MAX_LEN];
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        len = (uint16_t)wake_proto_build_reply(conn_handle, buf,
+                                               sizeof(buf));
+        rc = os_mbuf_append(ctxt->om, buf, len);
+        return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        /* Validated and queued on the dispatcher, so the NimBLE host task
+         * returns immediately */
+        if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        esp_err_t err = wake_proto_handle_write(conn_handle, buf, len);
+        conn_table_on_write(conn_handle, err == ESP_OK);
+        conn_policy_on_activity(conn_handle);
+        trace_log(TRACE_EVT_WAKE_WRITE, conn_handle, len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Wake write rejected: %s", esp_err_to_name(err));
+            trace_log(TRACE_EVT_WAKE_REJECT, conn_handle, (uint32_t)err);
+            return wake_proto_att_error(err);
+        }
+        return 0;
+
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+/* NimBLE applies the offset of long reads itself, so build the whole
+ * payload on every call */
+static int stats_chr_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)conn_handle; (void)attr_handle; (void)arg;
+    static uint8_t buf[STATS_MAX_LEN];
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    size_t len = stats_build(buf, sizeof(buf));
+    int rc = os_mbuf_append(ctxt->om, buf, len);
+    return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static int host_chr_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)conn_handle; (void)attr_handle; (void)arg;
+    uint8_t buf[HOST_STATE_VALUE_LEN];
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    size_t len = host_state_build_value(buf, sizeof(buf));
+    int rc = os_mbuf_append(ctxt->om, buf, len);
+    return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/* Sized to one read at the link's MTU, so a long read never sees the ring
+ * move under it; writes set the cursor (seq u32) */
+static int trace_chr_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)attr_handle; (void)arg;
+    uint8_t buf[TRACE_VALUE_MAX];
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        len = (uint16_t)trace_build_value(buf, ble_att_mtu(conn_handle) - 1);
+        rc = os_mbuf_append(ctxt->om, buf, len);
+        return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0 ||
+            len != 4) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        trace_set_cursor((uint32_t)buf[0] | (uint32_t)buf[1] << 8 |
+                         (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24);
+        return 0;
+
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+
+#if CONFIG_PENTA_OTA
+/* Commands; status goes back as notifications (ble_server_notify_ota) */
+static int ota_ctrl_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)attr_handle; (void)arg;
+    uint8_t buf[8];
+    uint16_t len;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    esp_err_t err = ota_update_on_control(conn_handle, buf, len);
+    return err == ESP_OK ? 0 : ota_update_att_error(err);
+}
+
+/* Copied into the update task's buffer; no flash access in the host task */
+static int ota_data_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)attr_handle; (void)arg;
+    static uint8_t buf[OTA_DATA_MAX_LEN];   /* host task only */
+    uint16_t len;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    ota_update_on_data(conn_handle, buf, len);
+    return 0;
+}
+#endif
+
+#if CONFIG_PENTA_TUNING
+/* Applied here, stored later from the timer task (tuning.c).  Reads are
+ * long reads at the default MTU; NimBLE applies the offset. */
+static int tune_chr_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)conn_handle; (void)attr_handle; (void)arg;
+    uint8_t buf[TUNING_VALUE_MAX];
+    uint16_t len;
+    int rc;
+
+    switch (ctxt->op) {
+    case BLE_GATT_ACCESS_OP_READ_CHR:
+        len = (uint16_t)tuning_build_value(buf, sizeof(buf));
+        rc = os_mbuf_append(ctxt->om, buf, len);
+        return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+
+    case BLE_GATT_ACCESS_OP_WRITE_CHR:
+        if (ble_hs_mbuf_to_flat(ctxt->om, buf, TUNING_WRITE_MAX, &len) != 0) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        esp_err_t err = tuning_handle_write(buf, len);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Tuning write rejected: %s", esp_err_to_name(err));
+            return TUNING_ATT_ERR_INVALID;
+        }
+        return 0;
+
+    default:
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+}
+#endif
+
+/* 0x2901 User Description; arg is the NUL-terminated text */
+static int user_desc_access_cb(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    (void)conn_handle; (void)attr_handle;
+    const char *text = arg;
+
+    int rc = os_mbuf_append(ctxt->om, text, strlen(text));
+    return (rc == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+static const struct ble_gatt_svc_def gatt_services[] = {
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = BLE_UUID16_DECLARE(WAKE_SERVICE_UUID),
+        .characteristics = (struct ble_gatt_chr_def[]) {
+            {
+                .uuid        = BLE_UUID16_DECLARE(WAKE_CHAR_UUID),
+                .access_cb   = wake_chr_access_cb,
+                .flags       = BLE_GATT_CHR_F_WRITE |
+                               BLE_GATT_CHR_F_WRITE_NO_RSP |
+                               BLE_GATT_CHR_F_READ |
+                               VALUE_F_WRITE_ENC | VALUE_F_READ_ENC,
+                .val_handle  = &wake_chr_val_handle,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        /* 0x2901 = Characteristic User Description */
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)user_desc,
+                    },
+                    { 0 }
+                },
+            },
+            {
+                .uuid        = BLE_UUID16_DECLARE(STATS_CHAR_UUID),
+                .access_cb   = stats_chr_access_cb,
+                .flags       = BLE_GATT_CHR_F_READ | VALUE_F_READ_ENC,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)stats_desc,
+                    },
+                    { 0 }
+                },
+            },
+            {
+                /* NimBLE adds the CCC descriptor for NOTIFY itself */
+                .uuid        = BLE_UUID16_DECLARE(HOST_CHAR_UUID),
+                .access_cb   = host_chr_access_cb,
+                .flags       = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY |
+                               VALUE_F_READ_ENC,
+                .val_handle  = &host_chr_val_handle,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)host_desc,
+                    },
+                    { 0 }
+                },
+            },
+            {
+                .uuid        = BLE_UUID16_DECLARE(TRACE_CHAR_UUID),
+                .access_cb   = trace_chr_access_cb,
+                .flags       = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                               VALUE_F_READ_ENC | VALUE_F_WRITE_ENC,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)trace_desc,
+                    },
+                    { 0 }
+                },
+            },
+#if CONFIG_PENTA_OTA
+            {
+                .uuid        = BLE_UUID16_DECLARE(OTA_CTRL_CHAR_UUID),
+                .access_cb   = ota_ctrl_access_cb,
+                .flags       = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY |
+                               VALUE_F_WRITE_ENC,
+                .val_handle  = &ota_chr_val_handle,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)ota_ctrl_desc,
+                    },
+                    { 0 }
+                },
+            },
+            {
+                .uuid        = BLE_UUID16_DECLARE(OTA_DATA_CHAR_UUID),
+                .access_cb   = ota_data_access_cb,
+                .flags       = BLE_GATT_CHR_F_WRITE_NO_RSP | VALUE_F_WRITE_ENC,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)ota_data_desc,
+                    },
+                    { 0 }
+                },
+            },
+#endif
+#if CONFIG_PENTA_TUNING
+            {
+                .uuid        = BLE_UUID16_DECLARE(TUNE_CHAR_UUID),
+                .access_cb   = tune_chr_access_cb,
+                .flags       = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE |
+                               VALUE_F_READ_ENC | VALUE_F_WRITE_ENC,
+                .descriptors = (struct ble_gatt_dsc_def[]) {
+                    {
+                        .uuid      = BLE_UUID16_DECLARE(0x2901),
+                        .att_flags = BLE_ATT_F_READ,
+                        .access_cb = user_desc_access_cb,
+                        .arg       = (void *)tune_desc,
+                    },
+                    { 0 }
+                },
+            },
+#endif
+            { 0 }
+        },
+    },
+    { 0 }
+};
+
+/* ── Host-state notifications ────────────────────────────────────────────── */
+void ble_server_notify_host_state(void)
+{
+    /* Notifies every subscribed client, reading through host_chr_access_cb */
+    if (ble_hs_synced()) {
+        ble_gatts_chr_updated(host_chr_val_handle);
+    }
+}
+
+/* ── Firmware update ─────────────────────────────────────────────────────── */
+#if CONFIG_PENTA_OTA
+void ble_server_notify_ota(uint16_t conn, const uint8_t *value, size_t len)
+{
+    /* ble_gatts_notify_custom() ignores the CCCD and consumes om */
+    if (!conn_table_subscribed(conn, CONN_SUB_OTA)) {
+        return;
+    }
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(value, (uint16_t)len);
+    if (om != NULL) {
+        ble_gatts_notify_custom(conn, ota_chr_val_handle, om);
+    }
+}
+
+void ble_server_prepare_bulk(uint16_t conn)
+{
+    /* 251 octets in 2120 µs, the longest LL packet on 1M */
+    int rc = ble_gap_set_data_len(conn, 251, 2120);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Data length update failed, rc=%d", rc);
+    }
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    ble_gap_set_prefered_le_phy(conn, BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_CODED_ANY);
+#endif
+}
+#endif
+
+/* ── Bonded-peer filter ──────────────────────────────────────────────────── */
+static void start_advertising(void);
+static bool adv_active(void);
+static void adv_stop(void);
+
+#if CONFIG_PENTA_BOND_FILTER
+/* Load the bonded peers into the filter accept list and pick the advertising
+ * filter.  The controller refuses list edits while an advertising set uses
+ * the list, so advertising is stopped around them.  Returns true if a peer
+ * bonded since the last call. */
+static bool refresh_filter(void)
+{
+    ble_addr_t peers[MAX_FILTER_PEERS];
+    int n = 0;
+
+    if (ble_store_util_bonded_peers(peers, &n, MAX_FILTER_PEERS) != 0) {
+        n = 0;
+    }
+
+    bool restart = adv_active();
+    if (restart) {
+        adv_stop();
+    }
+    /* Identity addresses; RPAs are resolved by the controller from the
+     * IRKs NimBLE loads into its resolving list when a peer bonds */
+    if (n > 0 && ble_gap_wl_set(peers, (uint8_t)n) != 0) {
+        ESP_LOGE(TAG, "Filter accept list rejected");
+        n = 0;
+    }
+    adv_params.filter_policy = (!pairing_open && n > 0)
+        ? BLE_HCI_ADV_FILT_BOTH
+        : BLE_HCI_ADV_FILT_NONE;
+    if (restart) {
+        start_advertising();
+    }
+
+    bool new_bond = bond_count >= 0 && n > bond_count;
+    bond_count = n;
+    pair_window_on_bond_count((uint8_t)n);
+#if CONFIG_PENTA_PROXIMITY_WAKE
+    proximity_wake_on_bonds();
+#endif
+    return new_bond;
+}
+
+/* NimBLE has no hook to refuse Just Works pairing up front, so a bond
+ * made outside the window is undone as soon as it is reported: keys
+ * deleted, link dropped, filter rebuilt without it */
+static void refuse_bond(uint16_t conn)
+{
+    struct ble_gap_conn_desc desc;
+
+    ESP_LOGW(TAG, "Pairing outside the window refused");
+    if (ble_gap_conn_find(conn, &desc) == 0) {
+        ble_store_util_delete_peer(&desc.peer_id_addr);
+    }
+    ble_gap_terminate(conn, BLE_ERR_AUTH_FAIL);
+    refresh_filter();
+}
+
+void ble_server_set_pairing(bool open)
+{
+    pairing_open = open;
+    if (ble_hs_synced()) {
+        refresh_filter();
+    }
+}
+
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max)
+{
+    ble_addr_t peers[MAX_FILTER_PEERS];
+    int n = 0;
+
+    if (ble_store_util_bonded_peers(peers, &n, MAX_FILTER_PEERS) != 0) {
+        return 0;
+    }
+    if (n > max) {
+        n = max;
+    }
+    for (int i = 0; i < n; i++) {
+        struct ble_store_key_sec key = { .peer_addr = peers[i] };
+        struct ble_store_value_sec sec;
+
+        for (int b = 0; b < 6; b++) {
+            out[i].addr[b] = peers[i].val[5 - b];
+        }
+        out[i].has_irk = ble_store_read_peer_sec(&key, &sec) == 0 &&
+                         sec.irk_present;
+        if (out[i].has_irk) {
+            memcpy(out[i].irk, sec.irk, sizeof(out[i].irk));
+        } else {
+            memset(out[i].irk, 0, sizeof(out[i].irk));
+        }
+    }
+    return n;
+}
+#else
+void ble_server_set_pairing(bool open)
+{
+    (void)open;
+}
+
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max)
+{
+    (void)out; (void)max;
+    return 0;
+}
+#endif
+
+/* ── Connection parameters ───────────────────────────────────────────────── */
+void ble_server_request_conn_params(uint16_t conn, uint16_t itvl_min,
+                                    uint16_t itvl_max, uint16_t latency,
+                                    uint16_t timeout)
+{
+    const struct ble_gap_upd_params p = {
+        .itvl_min            = itvl_min,
+        .itvl_max            = itvl_max,
+        .latency             = latency,
+        .supervision_timeout = timeout,
+    };
+    int rc = ble_gap_update_params(conn, &p);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Connection update request failed, rc=%d", rc);
+    }
+}
+
+/* Report the parameters now in effect on conn to conn_policy.c */
+static void report_conn_params(uint16_t conn, int status, bool connected)
+{
+    struct ble_gap_conn_desc desc;
+
+    if (ble_gap_conn_find(conn, &desc) != 0) {
+        return;
+    }
+    if (connected) {
+        conn_policy_on_connect(conn, desc.conn_itvl, desc.conn_latency,
+                               desc.supervision_timeout);
+    } else {
+        conn_policy_on_params(conn, status, desc.conn_itvl,
+                              desc.conn_latency, desc.supervision_timeout);
+    }
+}
+
+/* Record the PHY a new link came up on and ask for 2M if configured */
+static void link_phy_init(uint16_t conn)
+{
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    uint8_t tx, rx;
+
+    if (ble_gap_read_le_phy(conn, &tx, &rx) == 0) {
+        last_tx_phy = tx;
+        last_rx_phy = rx;
+    }
+#if CONFIG_PENTA_CONN_PHY_2M
+    /* Only a preference: a central without 2M keeps the link on 1M */
+    int rc = ble_gap_set_prefered_le_phy(conn, BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_2M_MASK,
+                                         BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "PHY update request failed, rc=%d", rc);
+    }
+#endif
+#else
+    (void)conn;
+#endif
+}
+
+/* ── GAP event handler / advertising ─────────────────────────────────────── */
+
+static int gap_event_handler(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_CONNECT:
+        if (event->connect.status == 0) {
+            struct ble_gap_conn_desc desc;
+            uint16_t conn = event->connect.conn_handle;
+            if (ble_gap_conn_find(conn, &desc) != 0 ||
+                conn_table_add(conn, desc.peer_id_addr.val) < 0) {
+                /* Raced the last slot; the disconnect event follows */
+                ESP_LOGW(TAG, "All %d client slots taken, closing link",
+                         CONN_TABLE_MAX);
+                ble_gap_terminate(conn, BLE_ERR_RD_CONN_TERM_RESRCS);
+                break;
+            }
+            latency_mark(LAT_STAGE_CONNECT);
+            trace_log(TRACE_EVT_CONNECT, conn, 0);
+            report_conn_params(conn, 0, true);
+            link_phy_init(conn);
+        }
+        /* Keep advertising so other clients can still find/connect */
+        start_advertising();
+        break;
+
+    case BLE_GAP_EVENT_DISCONNECT:
+        trace_log(TRACE_EVT_DISCONNECT, event->disconnect.conn.conn_handle,
+                  (uint32_t)event->disconnect.reason);
+        conn_policy_on_disconnect(event->disconnect.conn.conn_handle);
+#if CONFIG_PENTA_OTA
+        ota_update_on_disconnect(event->disconnect.conn.conn_handle);
+#endif
+        wake_dispatch_on_disconnect(event->disconnect.conn.conn_handle);
+        conn_table_remove(event->disconnect.conn.conn_handle);
+        adv_sched_on_event(ADV_EVT_DISCONNECT);
+        start_advertising();
+        break;
+
+    case BLE_GAP_EVENT_MTU:
+        conn_table_set_mtu(event->mtu.conn_handle, event->mtu.value);
+        break;
+
+    case BLE_GAP_EVENT_SUBSCRIBE:
+        if (event->subscribe.attr_handle == host_chr_val_handle) {
+            conn_table_set_sub(event->subscribe.conn_handle,
+                               CONN_SUB_HOST_STATE,
+                               event->subscribe.cur_notify);
+#if CONFIG_PENTA_OTA
+        } else if (event->subscribe.attr_handle == ota_chr_val_handle) {
+            conn_table_set_sub(event->subscribe.conn_handle, CONN_SUB_OTA,
+                               event->subscribe.cur_notify);
+#endif
+        }
+        break;
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+        /* Also reported for updates the central starts on its own */
+        report_conn_params(event->conn_update.conn_handle,
+                           event->conn_update.status, false);
+        break;
+
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        if (event->phy_updated.status == 0) {
+            last_tx_phy = event->phy_updated.tx_phy;
+            last_rx_phy = event->phy_updated.rx_phy;
+            phy_updates++;
+            trace_log(TRACE_EVT_PHY_UPDATE, event->phy_updated.conn_handle,
+                      last_tx_phy | (uint32_t)last_rx_phy << 8);
+        }
+        break;
+#endif
+
+#if CONFIG_PENTA_BOND_FILTER
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        if (event->enc_change.status != 0) {
+            ESP_LOGW(TAG, "Encryption failed, status=%d",
+                     event->enc_change.status);
+        } else if (refresh_filter()) {
+            if (!pairing_open) {
+                refuse_bond(event->enc_change.conn_handle);
+                break;
+            }
+            trace_log(TRACE_EVT_BONDED, (uint16_t)bond_count, 0);
+            pair_window_on_bonded();
+        }
+        break;
+
+    case BLE_GAP_EVENT_REPEAT_PAIRING: {
+        /* A bonded peer lost its keys.  Replace the bond only inside the
+         * pairing window. */
+        struct ble_gap_conn_desc desc;
+        if (!pairing_open ||
+            ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) != 0) {
+            return BLE_GAP_REPEAT_PAIRING_IGNORE;
+        }
+        ble_store_util_delete_peer(&desc.peer_id_addr);
+        return BLE_GAP_REPEAT_PAIRING_RETRY;
+    }
+#endif
+
+    case BLE_GAP_EVENT_ADV_COMPLETE:
+        start_advertising();
+        break;
+
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* Name, flags and TX power; the service UUID is added by the caller */
+static void adv_fields_init(struct ble_hs_adv_fields *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->flags                 = BLE_HS_ADV_F_DISC_GEN |
+                               BLE_HS_ADV_F_BREDR_UNSUP;
+    f->name                  = (uint8_t *)DEVICE_NAME;
+    f->name_len              = sizeof(DEVICE_NAME) - 1;
+    f->name_is_complete      = 1;
+    f->tx_pwr_lvl_is_present = 1;
+    f->tx_pwr_lvl            = BLE_HS_ADV_TX_PWR_LVL_AUTO;
+    f->slave_itvl_range      = slave_itvl_range;
+}
+
+static const ble_uuid16_t service_uuid16 = BLE_UUID16_INIT(WAKE_SERVICE_UUID);
+
+#if ADV_EXT
+static bool adv_active(void)
+{
+    return ble_gap_ext_adv_active(ADV_INSTANCE);
+}
+
+static void adv_stop(void)
+{
+    ble_gap_ext_adv_stop(ADV_INSTANCE);
+}
+
+/* A connectable extended set cannot also be scannable, so everything,
+ * service UUID included, goes in one AUX payload; it must fit in
+ * CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE.  Returns a NimBLE error code. */
+static int adv_start_set(void)
+{
+    const struct ble_gap_ext_adv_params p = {
+        .connectable   = 1,
+        .own_addr_type = BLE_OWN_ADDR_PUBLIC,
+        .itvl_min      = adv_params.itvl_min,
+        .itvl_max      = adv_params.itvl_max,
+        .filter_policy = adv_params.filter_policy,
+        .primary_phy   = ADV_PRIMARY_PHY,
+        .secondary_phy = ADV_SECONDARY_PHY,
+        .tx_power      = 127,   /* no preference */
+        .sid           = ADV_INSTANCE,
+    };
+    struct ble_hs_adv_fields fields;
+    struct os_mbuf *data;
+
+    if (adv_active()) {
+        return BLE_HS_EALREADY;
+    }
+    int rc = ble_gap_ext_adv_configure(ADV_INSTANCE, &p, NULL,
+                                       gap_event_handler, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Extended advertising set rejected, rc=%d", rc);
+        return rc;
+    }
+
+    adv_fields_init(&fields);
+    fields.uuids16             = &service_uuid16;
+    fields.num_uuids16         = 1;
+    fields.uuids16_is_complete = 1;
+    data = os_msys_get_pkthdr(CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE, 0);
+    if (data == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    rc = ble_hs_adv_set_fields_mbuf(&fields, data);
+    if (rc != 0) {
+        os_mbuf_free_chain(data);
+        ESP_LOGE(TAG, "Advertising data rejected, rc=%d", rc);
+        return rc;
+    }
+    rc = ble_gap_ext_adv_set_data(ADV_INSTANCE, data);  /* consumes data */
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Advertising data rejected, rc=%d", rc);
+        return rc;
+    }
+
+    rc = ble_gap_ext_adv_start(ADV_INSTANCE, 0, 0);     /* until stopped */
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Advertising start failed, rc=%d", rc);
+    }
+    return rc;
+}
+#else
+static bool adv_active(void)
+{
+    return ble_gap_adv_active();
+}
+
+static void adv_stop(void)
+{
+    ble_gap_adv_stop();
+}
+
+/* Returns a NimBLE error code */
+static int adv_start_set(void)
+{
+    struct ble_hs_adv_fields fields;
+
+    adv_fields_init(&fields);
+    int rc = ble_gap_adv_set_fields(&fields);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Advertising data rejected, rc=%d", rc);
+        return rc;
+    }
+
+    /* The advertising packet is full; the service UUID goes in the scan
+     * response so fleet tools can find every dongle by UUID */
+    struct ble_hs_adv_fields rsp_fields = {
+        .uuids16             = &service_uuid16,
+        .num_uuids16         = 1,
+        .uuids16_is_complete = 1,
+    };
+    rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Scan response data rejected, rc=%d", rc);
+        return rc;
+    }
+
+    rc = ble_gap_adv_start(BLE_OWN_ADDR_PUBLIC, NULL, BLE_HS_FOREVER,
+                           &adv_params, gap_event_handler, NULL);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        /* BLE_HS_ENOMEM here just means every connection slot is in use */
+        ESP_LOGE(TAG, "Advertising start failed, rc=%d", rc);
+    }
+    return rc;
+}
+#endif
+
+static void start_advertising(void)
+{
+    if (conn_table_full()) {
+        return;         /* the next disconnect starts it again */
+    }
+    int rc = adv_start_set();
+    if (rc == BLE_HS_EALREADY) {
+        return;
+    }
+    if (rc != 0) {
+        adv_supervisor_on_adv_failed(rc);
+        return;
+    }
+
+    trace_log(TRACE_EVT_ADV_START, adv_params.itvl_min, 0);
+    boot_time_mark(BOOT_STAGE_ADV_START);
+}
+
+void ble_server_set_adv_interval(uint16_t itvl_min, uint16_t itvl_max)
+{
+    adv_params.itvl_min = itvl_min;
+    adv_params.itvl_max = itvl_max;
+
+    /* Restart a running advertising set so the new interval applies now */
+    if (ble_hs_synced() && adv_active()) {
+        adv_stop();
+        start_advertising();
+    }
+}
+
+/* ── Advertising supervision ─────────────────────────────────────────────── */
+bool ble_server_adv_healthy(void)
+{
+    if (!ble_hs_synced()) {
+        return false;
+    }
+    /* With every slot taken advertising is off on purpose */
+    return adv_active() || conn_table_full();
+}
+
+/* Runs in the host task, like every other start_advertising() call */
+static void adv_restart_ev_cb(struct ble_npl_event *ev)
+{
+    (void)ev;
+    if (ble_hs_synced()) {
+        start_advertising();
+    }
+}
+
+void ble_server_restart_advertising(void)
+{
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &adv_restart_ev);
+}
+
+/* BLE_HS_ECONTROLLER makes the host drop every link, send HCI Reset to the
+ * controller and sync again; ble_host_on_sync() restarts advertising. */
+void ble_server_recover(void)
+{
+    ble_hs_sched_reset(BLE_HS_ECONTROLLER);
+}
+
+void ble_server_get_radio(ble_server_radio_t *out)
+{
+    *out = (ble_server_radio_t) {
+        .ext_adv           = ADV_EXT,
+        .adv_primary_phy   = ADV_PRIMARY_PHY,
+        .adv_secondary_phy = ADV_SECONDARY_PHY,
+        .conn_phy_pref     = CONN_PHY_PREF,
+        .last_tx_phy       = last_tx_phy,
+        .last_rx_phy       = last_rx_phy,
+        .phy_updates       = phy_updates,
+    };
+}
+
+/* ── Passive scan ────────────────────────────────────────────────────────── */
+static void start_scan(void);
+
+static int disc_event_handler(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_DISC: {
+        /* NimBLE keeps addresses least significant byte first */
+        uint8_t addr[6];
+        for (int i = 0; i < 6; i++) {
+            addr[i] = event->disc.addr.val[5 - i];
+        }
+        adv_report_cb(addr, event->disc.rssi,
+                      event->disc.data, event->disc.length_data);
+        break;
+    }
+
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+        /* Pre-empted by the host (e.g. reset) – keep scanning */
+        start_scan();
+        break;
+
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* Host task only.  A scan with stale parameters is cancelled and started
+ * again, which also resets the controller's duplicate filter. */
+static void start_scan(void)
+{
+    struct ble_gap_disc_params params;
+    bool wanted, stale;
+
+    if (!ble_hs_synced()) {
+        return;     /* ble_host_on_sync() will call us again */
+    }
+    portENTER_CRITICAL(&scan_lock);
+    wanted     = scan_wanted;
+    stale      = scan_stale;
+    params     = disc_params;
+    scan_stale = false;
+    portEXIT_CRITICAL(&scan_lock);
+
+    if (ble_gap_disc_active() && (!wanted || stale)) {
+        ble_gap_disc_cancel();
+    }
+    if (!wanted) {
+        return;
+    }
+    int rc = ble_gap_disc(BLE_OWN_ADDR_PUBLIC, BLE_HS_FOREVER, &params,
+                          disc_event_handler, NULL);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        ESP_LOGE(TAG, "Scan start failed, rc=%d", rc);
+    }
+}
+
+static void scan_ev_cb(struct ble_npl_event *ev)
+{
+    (void)ev;
+    start_scan();
+}
+
+void ble_server_start_scan(uint16_t interval, uint16_t window,
+                           bool all_reports, ble_server_adv_report_cb_t cb)
+{
+    portENTER_CRITICAL(&scan_lock);
+    disc_params.itvl              = interval;
+    disc_params.window            = window;
+    disc_params.filter_duplicates = all_reports ? 0 : 1;
+    adv_report_cb = cb;
+    scan_wanted   = true;
+    scan_stale    = true;
+    portEXIT_CRITICAL(&scan_lock);
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &scan_ev);
+}
+
+void ble_server_stop_scan(void)
+{
+    portENTER_CRITICAL(&scan_lock);
+    scan_wanted = false;
+    portEXIT_CRITICAL(&scan_lock);
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &scan_ev);
+}
+
+/* ── NimBLE host ─────────────────────────────────────────────────────────── */
+static void nimble_host_task(void *param)
+{
+    nimble_port_run();          /* blocks until nimble_port_stop() */
+    nimble_port_freertos_deinit();
+}
+
+static void ble_host_on_reset(int reason)
+{
+    ESP_LOGW(TAG, "BLE host reset, reason=%d", reason);
+    adv_supervisor_on_host_reset(reason);
+}
+
+static void ble_host_on_sync(void)
+{
+    boot_time_mark(BOOT_STAGE_BLE_SYNC);
+    int rc = ble_hs_util_ensure_addr(0);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "No usable BLE address, rc=%d", rc);
+        return;
+    }
+#if CONFIG_PENTA_BOND_FILTER
+    refresh_filter();
+#endif
+    start_advertising();
+    start_scan();
+}
+
+/* ── Public init ─────────────────────────────────────────────────────────── */
+void ble_server_init(void)
+{
+    ESP_ERROR_CHECK(nimble_port_init());
+    ble_npl_event_init(&adv_restart_ev, adv_restart_ev_cb, NULL);
+    ble_npl_event_init(&scan_ev, scan_ev_cb, NULL);
+
+    ble_hs_cfg.reset_cb        = ble_host_on_reset;
+    ble_hs_cfg.sync_cb         = ble_host_on_sync;
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+#if CONFIG_PENTA_BOND_FILTER
+    /* Just Works bonding; the BOOT button window is the proof of presence */
+    ble_hs_cfg.sm_io_cap         = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding        = 1;
+    ble_hs_cfg.sm_sc             = 1;
+    ble_hs_cfg.sm_our_key_dist   = BLE_SM_PAIR_KEY_DIST_ENC |
+                                   BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC |
+                                   BLE_SM_PAIR_KEY_DIST_ID;
+    ble_store_config_init();
+#endif
+
+    ble_svc_gap_init();
+    ble_svc_gatt_init();
+
+    int rc = ble_gatts_count_cfg(gatt_services);
+    assert(rc == 0);
+    rc = ble_gatts_add_svcs(gatt_services);
+    assert(rc == 0);
+    rc = ble_svc_gap_device_name_set(DEVICE_NAME);
+    assert(rc == 0);
+    rc = ble_att_set_preferred_mtu(LOCAL_MTU);
+    assert(rc == 0);
+
+    nimble_port_freertos_init(nimble_host_task);
+
+    ESP_LOGI(TAG, "BLE GATT server initialised (NimBLE)");
+}
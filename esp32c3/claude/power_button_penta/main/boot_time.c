@@ -0,0 +1,107 @@
+/**
+ * boot_time.c
+ *
+ * Power-on to first advertisement, per milestone.
+ *
+ * esp_timer starts counting only once the app is running, so it misses the
+ * ROM loader, the second-stage bootloader and the image load – which is
+ * most of what the fast-boot profile (sdkconfig.defaults.fastboot) trims.
+ * The RTC counter runs from power-on reset, so boot_time_init() reads it
+ * once and keeps the difference; every mark after that is a plain
+ * esp_timer_get_time() plus that offset.
+ *
+ * After a software or watchdog reset the RTC counter keeps running, so the
+ * timeline then also includes the previous run; the reset reason is kept
+ * with it so readers can tell.
+ */
+
+#include "boot_time.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_private/esp_clk.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "BOOT";
+
+#if CONFIG_BT_NIMBLE_ENABLED
+#define BLE_HOST_NAME   "nimble"
+#else
+#define BLE_HOST_NAME   "bluedroid"
+#endif
+
+static const char *const stage_name[] = {
+    [BOOT_STAGE_APP_START]   = "app_start",
+    [BOOT_STAGE_NVS_READY]   = "nvs",
+    [BOOT_STAGE_BLE_INIT]    = "ble_init",
+    [BOOT_STAGE_BLE_SYNC]    = "ble_sync",
+    [BOOT_STAGE_ADV_START]   = "adv",
+    [BOOT_STAGE_USB_READY]   = "usb",
+    [BOOT_STAGE_USB_MOUNTED] = "usb_mount",
+};
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static boot_time_t timeline;
+static int64_t offset_us;           /* RTC time at esp_timer zero */
+
+static void log_report(void)
+{
+    static boot_time_t t;           /* called from BLE stack callbacks */
+    boot_time_get(&t);
+
+    uint32_t adv_ms = t.stage_us[BOOT_STAGE_ADV_START] / 1000;
+    ESP_LOGW(TAG, "[" BLE_HOST_NAME "] boot→adv %u ms (target %u ms%s), "
+                  "heap free %u, min free %u",
+             (unsigned)adv_ms, t.target_ms,
+             adv_ms > t.target_ms ? ", MISSED" : "",
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        if (t.stage_us[i] != 0) {
+            ESP_LOGW(TAG, "  %-9s %6u.%u ms", stage_name[i],
+                     (unsigned)(t.stage_us[i] / 1000),
+                     (unsigned)(t.stage_us[i] % 1000 / 100));
+        }
+    }
+    if (t.reset_reason != ESP_RST_POWERON) {
+        ESP_LOGW(TAG, "  reset reason %u: times include the previous run",
+                 t.reset_reason);
+    }
+}
+
+void boot_time_init(void)
+{
+    offset_us = (int64_t)esp_clk_rtc_time() - esp_timer_get_time();
+    timeline.reset_reason = (uint8_t)esp_reset_reason();
+    timeline.target_ms    = CONFIG_PENTA_BOOT_TARGET_MS;
+    boot_time_mark(BOOT_STAGE_APP_START);
+}
+
+void boot_time_mark(boot_stage_t stage)
+{
+    if (timeline.stage_us[stage] != 0) {
+        return;                     /* fast path: already recorded */
+    }
+    uint32_t now = (uint32_t)(esp_timer_get_time() + offset_us);
+
+    portENTER_CRITICAL(&lock);
+    bool first = timeline.stage_us[stage] == 0;
+    if (first) {
+        timeline.stage_us[stage] = now ? now : 1;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (first && stage == BOOT_STAGE_ADV_START) {
+        log_report();
+    }
+}
+
+void boot_time_get(boot_time_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = timeline;
+    portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+/** Boot milestones, in the order a cold boot normally reaches them. */
+typedef enum {
+    BOOT_STAGE_APP_START = 0,   /* app_main() entered: ROM + bootloader done */
+    BOOT_STAGE_NVS_READY,       /* nvs_flash_init() returned                 */
+    BOOT_STAGE_BLE_INIT,        /* ble_server_init() returned                */
+    BOOT_STAGE_BLE_SYNC,        /* host stack synced with the controller     */
+    BOOT_STAGE_ADV_START,       /* first advertising set is on air           */
+    BOOT_STAGE_USB_READY,       /* tinyusb_driver_install() returned         */
+    BOOT_STAGE_USB_MOUNTED,     /* first configuration by the USB host       */
+    BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+/** First time each stage was reached, µs since power-on (0 = not yet). */
+typedef struct {
+    uint8_t  reset_reason;      /* esp_reset_reason_t                        */
+    uint16_t target_ms;         /* CONFIG_PENTA_BOOT_TARGET_MS               */
+    uint32_t stage_us[BOOT_STAGE_COUNT];
+} boot_time_t;
+
+/**
+ * Anchor the boot timeline to the RTC counter, which starts at power-on
+ * and so also covers the ROM and the bootloader.  First call in
+ * app_main(); marks BOOT_STAGE_APP_START.
+ */
+void boot_time_init(void);
+
+/**
+ * Record the first time a stage is reached; later calls for the same stage
+ * are ignored, so hooks on paths that repeat (advertising restart, USB
+ * re-mount) cost one load and compare.  Any task or callback context.
+ * BOOT_STAGE_ADV_START logs the boot-to-advertising time against the
+ * target.
+ */
+void boot_time_mark(boot_stage_t stage);
+
+/** Copy the timeline into *out. */
+void boot_time_get(boot_time_t *out);
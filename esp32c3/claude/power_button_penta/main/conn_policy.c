@@ -0,0 +1,271 @@
+/**
+ * conn_policy.c
+ *
+ * Connection-parameter policy.
+ *
+ * Without it the central alone picks the connection interval, so the
+ * radio duty cycle and the command latency are whatever the phone or the
+ * Pi defaults to.  The policy asks for:
+ *
+ *   FAST  15–30 ms, no slave latency      right after connect and on
+ *                                         every wake write
+ *   IDLE  CONFIG_PENTA_CONN_IDLE_INTERVAL_MS (+25 %), slave latency
+ *         CONFIG_PENTA_CONN_IDLE_LATENCY   after CONFIG_PENTA_CONN_IDLE_AFTER_S
+ *                                         without a wake write
+ *
+ *   BULK  7.5–15 ms, no slave latency     while ota_update.c streams an
+ *                                         image; the idle timer leaves
+ *                                         it alone
+ *
+ * The three IDLE settings are tuning parameters (tuning.h) with these
+ * Kconfig values as defaults; a change re-requests IDLE on the idle links
+ * through conn_policy_refresh().
+ *
+ * FAST stays inside Apple's accessory guidelines (min ≥ 15 ms) so iOS
+ * centrals accept it; IDLE keeps a persistent client such as penta_waked
+ * connected for a fraction of the radio time.  The supervision timeout is
+ * derived so it always exceeds the spec minimum for the chosen latency;
+ * where a long interval would push that minimum past the 32 s maximum,
+ * the latency is lowered instead.
+ *
+ * The BLE backend feeds connect / parameter-update / disconnect events in
+ * and sends the requests out through ble_server_request_conn_params().
+ */
+
+#include "conn_policy.h"
+#include "ble_server.h"
+#include "trace.h"
+#include "tuning.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+
+static const char *TAG = "CONN_POLICY";
+
+/* 1.25 ms units */
+#define FAST_ITVL_MIN           12
+#define FAST_ITVL_MAX           24
+#define FAST_TIMEOUT            200     /* 2 s, 10 ms units */
+#define MIN_TIMEOUT             200     /* 2 s */
+#define MAX_TIMEOUT             3200    /* 32 s, the spec maximum */
+#define BULK_ITVL_MIN           6
+#define BULK_ITVL_MAX           12
+
+#define MS_TO_ITVL(ms)          ((uint16_t)((ms) * 4 / 5))
+
+typedef struct {
+    bool               in_use;
+    conn_policy_link_t info;
+    esp_timer_handle_t idle_timer;
+} link_t;
+
+static SemaphoreHandle_t lock;
+static StaticSemaphore_t lock_buf;
+static link_t links[CONN_POLICY_MAX_LINKS];
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+
+/* Highest latency whose spec minimum timeout, (1 + latency) * interval * 2,
+ * stays below MAX_TIMEOUT.  In 10 ms units that minimum is
+ * (1 + latency) * itvl_max / 4. */
+static uint16_t latency_cap(uint16_t itvl_max)
+{
+    return (uint16_t)((MAX_TIMEOUT * 4 - 1) / itvl_max - 1);
+}
+
+/* Supervision timeout (10 ms units) with 3x margin over the spec minimum,
+ * at least 2 s, at most 32 s.  latency must not exceed latency_cap(). */
+static uint16_t timeout_for(uint16_t itvl_max, uint16_t latency)
+{
+    uint32_t t = (1u + latency) * itvl_max * 3 / 4;
+    if (t < MIN_TIMEOUT) {
+        t = MIN_TIMEOUT;
+    } else if (t > MAX_TIMEOUT) {
+        t = MAX_TIMEOUT;
+    }
+    return (uint16_t)t;
+}
+
+/* Caller holds the lock */
+static link_t *find(uint16_t conn)
+{
+    for (int i = 0; i < CONN_POLICY_MAX_LINKS; i++) {
+        if (links[i].in_use && links[i].info.conn == conn) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+/* Caller holds the lock */
+static void request_phase(link_t *l, conn_phase_t phase)
+{
+    l->info.phase = phase;
+    if (phase == CONN_PHASE_FAST) {
+        ble_server_request_conn_params(l->info.conn, FAST_ITVL_MIN,
+                                       FAST_ITVL_MAX, 0, FAST_TIMEOUT);
+    } else if (phase == CONN_PHASE_BULK) {
+        ble_server_request_conn_params(l->info.conn, BULK_ITVL_MIN,
+                                       BULK_ITVL_MAX, 0, FAST_TIMEOUT);
+    } else {
+        uint32_t ms, latency;
+        tuning_get_pair(TUNE_CONN_IDLE_ITVL_MS, TUNE_CONN_IDLE_LATENCY,
+                        &ms, &latency);
+        uint16_t itvl_max = MS_TO_ITVL(ms * 5 / 4);
+        if (latency > latency_cap(itvl_max)) {
+            latency = latency_cap(itvl_max);
+        }
+        ble_server_request_conn_params(l->info.conn, MS_TO_ITVL(ms),
+                                       itvl_max, (uint16_t)latency,
+                                       timeout_for(itvl_max,
+                                                   (uint16_t)latency));
+    }
+    trace_log(TRACE_EVT_CONN_PHASE, l->info.conn, (uint32_t)phase);
+}
+
+/* Caller holds the lock */
+static void arm_idle(link_t *l)
+{
+    esp_timer_stop(l->idle_timer);   /* ESP_ERR_INVALID_STATE if idle: fine */
+    esp_timer_start_once(l->idle_timer,
+                         tuning_get(TUNE_CONN_IDLE_AFTER_S) * 1000000LL);
+}
+
+static void idle_cb(void *arg)
+{
+    link_t *l = arg;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (l->in_use && l->info.phase == CONN_PHASE_FAST) {
+        request_phase(l, CONN_PHASE_IDLE);
+    }
+    xSemaphoreGive(lock);
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void conn_policy_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buf);
+
+    for (int i = 0; i < CONN_POLICY_MAX_LINKS; i++) {
+        const esp_timer_create_args_t args = {
+            .callback = idle_cb,
+            .arg      = &links[i],
+            .name     = "conn_idle",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &links[i].idle_timer));
+    }
+}
+
+void conn_policy_on_connect(uint16_t conn, uint16_t interval,
+                            uint16_t latency, uint16_t timeout)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    link_t *l = NULL;
+    for (int i = 0; i < CONN_POLICY_MAX_LINKS && l == NULL; i++) {
+        if (!links[i].in_use) {
+            l = &links[i];
+        }
+    }
+    if (l == NULL) {
+        ESP_LOGW(TAG, "conn %u not tracked: table full", conn);
+    } else {
+        l->in_use = true;
+        l->info = (conn_policy_link_t){
+            .conn = conn, .phase = CONN_PHASE_FAST,
+            .interval = interval, .latency = latency, .timeout = timeout,
+        };
+        /* The central's choice may already be fast enough */
+        if (interval > FAST_ITVL_MAX || latency != 0) {
+            request_phase(l, CONN_PHASE_FAST);
+        }
+        arm_idle(l);
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_on_params(uint16_t conn, int status, uint16_t interval,
+                           uint16_t latency, uint16_t timeout)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    link_t *l = find(conn);
+    if (l != NULL) {
+        if (status == 0) {
+            l->info.interval = interval;
+            l->info.latency  = latency;
+            l->info.timeout  = timeout;
+            l->info.updates++;
+        } else {
+            l->info.rejected++;
+            ESP_LOGW(TAG, "conn %u: parameter update refused (%d)",
+                     conn, status);
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_on_activity(uint16_t conn)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    link_t *l = find(conn);
+    if (l != NULL) {
+        if (l->info.phase == CONN_PHASE_IDLE) {
+            request_phase(l, CONN_PHASE_FAST);
+        }
+        arm_idle(l);
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_on_disconnect(uint16_t conn)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    link_t *l = find(conn);
+    if (l != NULL) {
+        esp_timer_stop(l->idle_timer);
+        l->in_use = false;
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_set_bulk(uint16_t conn, bool on)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    link_t *l = find(conn);
+    if (l != NULL) {
+        if (on) {
+            request_phase(l, CONN_PHASE_BULK);
+        } else if (l->info.phase == CONN_PHASE_BULK) {
+            request_phase(l, CONN_PHASE_FAST);
+            arm_idle(l);
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_refresh(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < CONN_POLICY_MAX_LINKS; i++) {
+        if (links[i].in_use && links[i].info.phase == CONN_PHASE_IDLE) {
+            request_phase(&links[i], CONN_PHASE_IDLE);
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void conn_policy_get_state(conn_policy_state_t *out)
+{
+    out->n_links = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (int i = 0; i < CONN_POLICY_MAX_LINKS; i++) {
+        if (links[i].in_use) {
+            out->link[out->n_links++] = links[i].info;
+        }
+    }
+    xSemaphoreGive(lock);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "conn_table.h"
+
+/** Parameter set the policy is currently asking for on a link. */
+typedef enum {
+    CONN_PHASE_FAST = 0,    /* short interval: discovery, commands       */
+    CONN_PHASE_IDLE,        /* long interval + slave latency             */
+    CONN_PHASE_BULK,        /* shortest interval: firmware update        */
+} conn_phase_t;
+
+#define CONN_POLICY_MAX_LINKS   CONN_TABLE_MAX
+
+/** One tracked link.  Interval in 1.25 ms units, timeout in 10 ms units. */
+typedef struct {
+    uint16_t     conn;          /* backend connection handle / id      */
+    conn_phase_t phase;
+    uint16_t     interval;      /* as last reported by the controller   */
+    uint16_t     latency;
+    uint16_t     timeout;
+    uint16_t     updates;       /* parameter updates that took effect   */
+    uint16_t     rejected;      /* requests the central turned down     */
+} conn_policy_link_t;
+
+typedef struct {
+    uint8_t            n_links;
+    conn_policy_link_t link[CONN_POLICY_MAX_LINKS];
+} conn_policy_state_t;
+
+/**
+ * Create the idle timers.  Must be called before ble_server_init().
+ *
+ * Policy: right after connect ask for a short interval so discovery and
+ * the first write complete quickly; once the link has seen no wake write
+ * for CONFIG_PENTA_CONN_IDLE_AFTER_S, switch to a long interval with
+ * slave latency.  A wake write on an idle link goes back to the short
+ * interval.  Requests go out through ble_server_request_conn_params().
+ */
+void conn_policy_init(void);
+
+/** Backend hooks; BLE stack context.  Parameters as reported by the stack. */
+void conn_policy_on_connect(uint16_t conn, uint16_t interval,
+                            uint16_t latency, uint16_t timeout);
+void conn_policy_on_params(uint16_t conn, int status, uint16_t interval,
+                           uint16_t latency, uint16_t timeout);
+void conn_policy_on_activity(uint16_t conn);
+void conn_policy_on_disconnect(uint16_t conn);
+
+/**
+ * Hold conn in CONN_PHASE_BULK (7.5–15 ms, no slave latency) for a bulk
+ * transfer, or release it back to FAST and the idle timer.  Any task;
+ * driven by ota_update.c.
+ */
+void conn_policy_set_bulk(uint16_t conn, bool on);
+
+/**
+ * Re-read the idle settings from tuning and ask for them again on every
+ * idle link; FAST links use them when they next go idle.
+ * Any task; called by tuning.c.
+ */
+void conn_policy_refresh(void);
+
+/** Copy the tracked links into *out. */
+void conn_policy_get_state(conn_policy_state_t *out);
@@ -0,0 +1,254 @@
+/**
+ * conn_table.c
+ *
+ * Table of the connected centrals (conn_table.h).
+ *
+ * Several clients may be connected at once – the Pi daemon, a phone, a
+ * monitoring node – and each gets its own slot: MTU, notification
+ * subscriptions, wake protocol tokens and write counters.  Before this
+ * table the backends kept one MTU and one reply for everyone, so a PING
+ * from one client could answer another's.
+ *
+ * The number of slots is a build-time budget.  Every link costs the
+ * controller one activity next to advertising (and the passive scan) and
+ * the host one control block, so the checks below keep
+ * CONFIG_PENTA_MAX_CONNECTIONS within what sdkconfig reserves for both.
+ */
+
+#include "conn_table.h"
+
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+#if defined(CONFIG_BT_CTRL_BLE_MAX_ACT)
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+#define ADV_SCAN_ACTIVITIES     2       /* one scan, shared (scan_sched.c) */
+#else
+#define ADV_SCAN_ACTIVITIES     1
+#endif
+#if CONN_TABLE_MAX + ADV_SCAN_ACTIVITIES > CONFIG_BT_CTRL_BLE_MAX_ACT
+#error "CONFIG_PENTA_MAX_CONNECTIONS: raise CONFIG_BT_CTRL_BLE_MAX_ACT"
+#endif
+#endif
+#if defined(CONFIG_BT_NIMBLE_MAX_CONNECTIONS)
+#if CONN_TABLE_MAX > CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#error "CONFIG_PENTA_MAX_CONNECTIONS: raise CONFIG_BT_NIMBLE_MAX_CONNECTIONS"
+#endif
+#elif defined(CONFIG_BT_ACL_CONNECTIONS)
+#if CONN_TABLE_MAX > CONFIG_BT_ACL_CONNECTIONS
+#error "CONFIG_PENTA_MAX_CONNECTIONS: raise CONFIG_BT_ACL_CONNECTIONS"
+#endif
+#endif
+
+typedef struct {
+    bool       in_use;
+    conn_ctx_t ctx;
+} slot_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static slot_t slots[CONN_TABLE_MAX];
+
+/* Caller holds the lock */
+static conn_ctx_t *find(uint16_t conn)
+{
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (slots[i].in_use && slots[i].ctx.conn == conn) {
+            return &slots[i].ctx;
+        }
+    }
+    return NULL;
+}
+
+int conn_table_add(uint16_t conn, const uint8_t addr[6])
+{
+    int slot = -1;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX && slot < 0; i++) {
+        if (!slots[i].in_use) {
+            slots[i].in_use = true;
+            slots[i].ctx = (conn_ctx_t) {
+                .conn        = conn,
+                .mtu         = CONN_TABLE_DEFAULT_MTU,
+                .last_result = ESP_OK,
+            };
+            memcpy(slots[i].ctx.addr, addr, sizeof(slots[i].ctx.addr));
+            slot = i;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return slot;
+}
+
+void conn_table_remove(uint16_t conn)
+{
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (slots[i].in_use && slots[i].ctx.conn == conn) {
+            slots[i].in_use = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+int conn_table_slot(uint16_t conn)
+{
+    int slot = -1;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX && slot < 0; i++) {
+        if (slots[i].in_use && slots[i].ctx.conn == conn) {
+            slot = i;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return slot;
+}
+
+bool conn_table_full(void)
+{
+    bool full = true;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (!slots[i].in_use) {
+            full = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return full;
+}
+
+bool conn_table_get(int slot, conn_ctx_t *out)
+{
+    bool used = false;
+
+    if (slot < 0 || slot >= CONN_TABLE_MAX) {
+        return false;
+    }
+    portENTER_CRITICAL(&lock);
+    if (slots[slot].in_use) {
+        *out = slots[slot].ctx;
+        used = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    return used;
+}
+
+bool conn_table_find_addr(const uint8_t addr[6], uint16_t *conn)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX && !found; i++) {
+        if (slots[i].in_use &&
+            memcmp(slots[i].ctx.addr, addr, sizeof(slots[i].ctx.addr)) == 0) {
+            *conn = slots[i].ctx.conn;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
+
+/* ── Per-link fields ─────────────────────────────────────────────────────── */
+void conn_table_set_mtu(uint16_t conn, uint16_t mtu)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->mtu = mtu;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void conn_table_set_sub(uint16_t conn, uint8_t sub, bool on)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->subs = on ? (uint8_t)(c->subs | sub) : (uint8_t)(c->subs & ~sub);
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void conn_table_on_write(uint16_t conn, bool accepted)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->writes++;
+        if (!accepted) {
+            c->rejected++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void conn_table_set_ping(uint16_t conn, uint8_t token)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->ping_token = token;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void conn_table_set_query(uint16_t conn, uint8_t token)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->query_token = token;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void conn_table_set_result(uint16_t conn, esp_err_t err)
+{
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        c->last_result = err;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+uint16_t conn_table_mtu(uint16_t conn)
+{
+    uint16_t mtu = CONN_TABLE_DEFAULT_MTU;
+
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        mtu = c->mtu;
+    }
+    portEXIT_CRITICAL(&lock);
+    return mtu;
+}
+
+bool conn_table_subscribed(uint16_t conn, uint8_t sub)
+{
+    bool on = false;
+
+    portENTER_CRITICAL(&lock);
+    conn_ctx_t *c = find(conn);
+    if (c != NULL) {
+        on = (c->subs & sub) != 0;
+    }
+    portEXIT_CRITICAL(&lock);
+    return on;
+}
+
+void conn_table_get_state(conn_table_state_t *out)
+{
+    out->n_links = 0;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (slots[i].in_use) {
+            out->link[out->n_links++] = slots[i].ctx;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
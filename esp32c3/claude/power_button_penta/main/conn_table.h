@@ -0,0 +1,84 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+/**
+ * Per-connection context shared by the BLE backend and the modules above
+ * it.  The backend adds a link on connect and removes it on disconnect;
+ * everything else looks it up by the backend's connection handle.
+ *
+ * At most CONN_TABLE_MAX centrals are connected at once
+ * (CONFIG_PENTA_MAX_CONNECTIONS).  A connection beyond that is closed
+ * right away, and the backends stop advertising while the table is full.
+ * The slot of a link (0 .. CONN_TABLE_MAX - 1) stays the same while it is
+ * connected; the wake dispatcher keeps one queue per slot.
+ */
+#define CONN_TABLE_MAX          CONFIG_PENTA_MAX_CONNECTIONS
+#define CONN_TABLE_NONE         0xFFFF  /* no link: beacon, proximity, timers */
+#define CONN_TABLE_DEFAULT_MTU  23
+
+/* Notifications a client subscribed to (CCC writes) */
+#define CONN_SUB_HOST_STATE     0x01    /* host-state value, 0xFF03  */
+#define CONN_SUB_OTA            0x02    /* update control, 0xFF05    */
+
+/** One connected central.  Wake protocol fields as in wake_proto.h. */
+typedef struct {
+    uint16_t  conn;             /* backend connection handle / id     */
+    uint8_t   addr[6];          /* peer address as the stack reports it */
+    uint16_t  mtu;
+    uint8_t   subs;             /* CONN_SUB_*                         */
+    uint8_t   ping_token;       /* last PING from this client         */
+    uint8_t   query_token;      /* last QUERY of its sequences that ran */
+    esp_err_t last_result;      /* its last command the dispatcher ran */
+    uint32_t  writes;           /* wake writes received               */
+    uint32_t  rejected;         /* of those, refused                  */
+} conn_ctx_t;
+
+typedef struct {
+    uint8_t    n_links;
+    conn_ctx_t link[CONN_TABLE_MAX];
+} conn_table_state_t;
+
+/**
+ * Add a new link and return its slot, or -1 if every slot is taken and
+ * the backend should close the connection.  BLE stack context.
+ */
+int conn_table_add(uint16_t conn, const uint8_t addr[6]);
+
+/** Forget a link; unknown handles are ignored.  BLE stack context. */
+void conn_table_remove(uint16_t conn);
+
+/** Slot of conn, or -1 if it is not a tracked link.  Any task. */
+int conn_table_slot(uint16_t conn);
+
+/** True while every slot is taken.  Any task. */
+bool conn_table_full(void);
+
+/**
+ * Copy the context of the link in slot into *out.  For walking the
+ * table: false for a free slot.  Any task.
+ */
+bool conn_table_get(int slot, conn_ctx_t *out);
+
+/** Handle of the link to a peer address; false if there is none. */
+bool conn_table_find_addr(const uint8_t addr[6], uint16_t *conn);
+
+/* Setters for one link; all ignore a handle that is not in the table.
+ * Any task. */
+void conn_table_set_mtu(uint16_t conn, uint16_t mtu);
+void conn_table_set_sub(uint16_t conn, uint8_t sub, bool on);
+void conn_table_on_write(uint16_t conn, bool accepted);
+void conn_table_set_ping(uint16_t conn, uint8_t token);
+void conn_table_set_query(uint16_t conn, uint8_t token);
+void conn_table_set_result(uint16_t conn, esp_err_t err);
+
+/** MTU of conn, CONN_TABLE_DEFAULT_MTU if it is not a tracked link. */
+uint16_t conn_table_mtu(uint16_t conn);
+
+/** True if conn subscribed to sub (one CONN_SUB_* bit). */
+bool conn_table_subscribed(uint16_t conn, uint8_t sub);
+
+/** Copy the connected links, in slot order, into *out. */
+void conn_table_get_state(conn_table_state_t *out);
@@ -0,0 +1,89 @@
+/**
+ * counter_rsv.c
+ *
+ * NVS reservation for the replay counters (see counter_rsv.h).
+ */
+
+#include "counter_rsv.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/timers.h"
+#include <stdbool.h>
+
+static const char *TAG = "COUNTER_RSV";
+
+#define NVS_NAMESPACE           "penta"
+
+/* Runs in the FreeRTOS timer task so the flash write never blocks the
+ * BLE stack.  On failure the target falls back to what flash holds, so
+ * the next accepted counter queues the reservation again. */
+static void persist(void *arg1, uint32_t reserved)
+{
+    counter_rsv_t *rsv = arg1;
+    nvs_handle_t nvs;
+    bool ok = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK;
+    if (ok) {
+        ok = nvs_set_u32(nvs, rsv->nvs_key, reserved) == ESP_OK &&
+             nvs_commit(nvs) == ESP_OK;
+        nvs_close(nvs);
+    }
+
+    portENTER_CRITICAL(rsv->lock);
+    if (ok) {
+        *rsv->reserved = reserved;
+        (*rsv->nvs_writes)++;
+    } else {
+        (*rsv->nvs_errors)++;
+        if (rsv->target == reserved) {
+            rsv->target = *rsv->reserved;
+        }
+    }
+    portEXIT_CRITICAL(rsv->lock);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "%s: reservation %u not stored",
+                 rsv->nvs_key, (unsigned)reserved);
+    }
+}
+
+uint32_t counter_rsv_load(counter_rsv_t *rsv)
+{
+    uint32_t reserved = 0;
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u32(nvs, rsv->nvs_key, &reserved);
+        nvs_close(nvs);
+    }
+    portENTER_CRITICAL(rsv->lock);
+    *rsv->reserved = reserved;
+    rsv->target    = reserved;
+    portEXIT_CRITICAL(rsv->lock);
+    return reserved;
+}
+
+void counter_rsv_accept(counter_rsv_t *rsv, uint32_t counter)
+{
+    portENTER_CRITICAL(rsv->lock);
+    uint32_t target = rsv->target;
+    uint32_t errors = *rsv->nvs_errors;
+    portEXIT_CRITICAL(rsv->lock);
+
+    if (counter < target && target - counter >= rsv->block / 2) {
+        return;                 /* well inside the stored reservation */
+    }
+    uint32_t next = counter > UINT32_MAX - rsv->block
+        ? UINT32_MAX : counter + rsv->block;
+
+    /* The target only moves once the write is queued, and not if the
+     * timer task has already failed it: either way the next accepted
+     * counter tries again */
+    bool queued = xTimerPendFunctionCall(persist, rsv, next, 0) == pdPASS;
+    portENTER_CRITICAL(rsv->lock);
+    if (!queued) {
+        (*rsv->pend_errors)++;
+    } else if (*rsv->nvs_errors == errors) {
+        rsv->target = next;
+    }
+    portEXIT_CRITICAL(rsv->lock);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/**
+ * Replay-counter reservation in NVS, shared by beacon wake (beacon_wake.c)
+ * and authenticated GATT wake (wake_auth.c).
+ *
+ * Flash holds a reservation, not every accepted counter: accepting one
+ * within half a block of the queued reservation queues a new one, block
+ * counters ahead, for the FreeRTOS timer task.  After a reboot only
+ * counters above the stored reservation may be accepted.
+ *
+ * The counters live in the owner's stats struct and are updated under
+ * the owner's stats lock, so its get_stats() copy stays consistent.
+ */
+typedef struct {
+    const char   *nvs_key;      /* key in the "penta" namespace            */
+    uint32_t      block;        /* counters reserved per NVS write         */
+    portMUX_TYPE *lock;         /* guards the fields below                 */
+    uint32_t     *reserved;     /* reservation last stored in NVS          */
+    uint32_t     *nvs_writes;   /* reservations stored since boot          */
+    uint32_t     *pend_errors;  /* reservations not queued: queue full     */
+    uint32_t     *nvs_errors;   /* reservations queued but not stored      */
+    uint32_t      target;       /* last reservation queued; *lock          */
+} counter_rsv_t;
+
+/**
+ * Read the stored reservation into *rsv->reserved and return it: the
+ * highest counter that may have been accepted before the reset.
+ */
+uint32_t counter_rsv_load(counter_rsv_t *rsv);
+
+/**
+ * Note an accepted counter; never writes flash itself, so it is safe in
+ * the BLE stack context.  rsv must stay valid (static) since the timer
+ * task holds on to it.
+ */
+void counter_rsv_accept(counter_rsv_t *rsv, uint32_t counter);
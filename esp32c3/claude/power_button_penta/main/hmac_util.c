@@ -0,0 +1,42 @@
+/**
+ * hmac_util.c
+ *
+ * Key parsing and tag comparison for the HMAC checks (see hmac_util.h).
+ */
+
+#include "hmac_util.h"
+
+#include <string.h>
+
+static int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool hmac_util_parse_key(const char *hex, uint8_t *key, size_t len)
+{
+    if (strlen(hex) != len * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        int hi = hex_nibble(hex[2 * i]);
+        int lo = hex_nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        key[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+bool hmac_util_tag_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
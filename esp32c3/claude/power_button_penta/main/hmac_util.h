@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Helpers shared by the HMAC checks of beacon wake (beacon_wake.c) and
+ * authenticated GATT wake (wake_auth.c).
+ */
+
+/**
+ * Parse a key of exactly 2 * len hex digits (either case) from sdkconfig
+ * into key.  Returns false, with key partly written, on any other input.
+ */
+bool hmac_util_parse_key(const char *hex, uint8_t *key, size_t len);
+
+/**
+ * Compare two tags in time independent of where they differ, so a forger
+ * cannot find the right tag byte by byte.
+ */
+bool hmac_util_tag_equal(const uint8_t *a, const uint8_t *b, size_t len);
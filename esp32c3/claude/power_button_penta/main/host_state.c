@@ -0,0 +1,70 @@
+/**
+ * host_state.c
+ *
+ * Host sleep-state tracker.
+ *
+ * usb_hid.c feeds the TinyUSB mount / unmount / suspend / resume callbacks
+ * in; every transition is pushed to BLE clients subscribed to the
+ * host-state characteristic, so a client that sent a wake learns that it
+ * worked from a single notification instead of polling the network.
+ */
+
+#include "host_state.h"
+#include "ble_server.h"
+#include "trace.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static host_state_t state = HOST_STATE_UNPOWERED;
+static uint16_t transitions;
+static uint32_t since_ms;
+
+void host_state_set(host_state_t s)
+{
+    portENTER_CRITICAL(&lock);
+    bool changed = s != state;
+    if (changed) {
+        state = s;
+        transitions++;
+        since_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    }
+    uint16_t n = transitions;
+    portEXIT_CRITICAL(&lock);
+
+    if (changed) {
+        trace_log(TRACE_EVT_HOST_STATE, (uint16_t)s, n);
+        ble_server_notify_host_state();
+    }
+}
+
+host_state_t host_state_get(void)
+{
+    portENTER_CRITICAL(&lock);
+    host_state_t s = state;
+    portEXIT_CRITICAL(&lock);
+    return s;
+}
+
+bool host_state_is_awake(void)
+{
+    host_state_t s = host_state_get();
+    return s == HOST_STATE_MOUNTED || s == HOST_STATE_RESUMED;
+}
+
+size_t host_state_build_value(uint8_t *buf, size_t cap)
+{
+    if (cap < HOST_STATE_VALUE_LEN) {
+        return 0;
+    }
+    portENTER_CRITICAL(&lock);
+    buf[0] = (uint8_t)state;
+    buf[1] = (uint8_t)transitions;
+    buf[2] = (uint8_t)(transitions >> 8);
+    for (int i = 0; i < 4; i++) {
+        buf[3 + i] = (uint8_t)(since_ms >> (8 * i));
+    }
+    portEXIT_CRITICAL(&lock);
+    return HOST_STATE_VALUE_LEN;
+}
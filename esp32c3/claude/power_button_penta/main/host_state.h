@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** What the USB bus says about the host. */
+typedef enum {
+    HOST_STATE_UNPOWERED = 0,   /* not configured: host off (S4/S5) or no
+                                 * host at all                           */
+    HOST_STATE_MOUNTED,         /* configured by the host, running       */
+    HOST_STATE_SUSPENDED,       /* bus suspended: host asleep (S3)       */
+    HOST_STATE_RESUMED,         /* bus resumed after a suspend, running  */
+} host_state_t;
+
+/**
+ * Value of the host-state characteristic (0xFF03, READ | NOTIFY):
+ *   state u8 (host_state_t) | transitions u16 | since_ms u32
+ * since_ms is the uptime at which the state was entered.  The value is
+ * notified to subscribed clients on every transition.
+ */
+#define HOST_STATE_VALUE_LEN    7
+
+/**
+ * Record a transition and push it to subscribed clients through
+ * ble_server_notify_host_state().  Called from the TinyUSB callbacks in
+ * usb_hid.c (usb_task context).
+ */
+void host_state_set(host_state_t state);
+
+host_state_t host_state_get(void);
+
+/** True while the host is running, i.e. a wake key would be redundant. */
+bool host_state_is_awake(void);
+
+/** Serialise the characteristic value into buf; returns bytes used. */
+size_t host_state_build_value(uint8_t *buf, size_t cap);
@@ -0,0 +1,120 @@
+/**
+ * latency.c
+ *
+ * Per-stage wake latency, recorded into a fixed ring of LAT_RING_LEN
+ * records held in .bss – nothing is allocated at runtime and marking a
+ * stage is a timestamp plus a store under a spinlock.
+ *
+ * Aggregates (min / avg / p99) are only computed when someone reads them,
+ * i.e. when the Pi pulls the stats characteristic.
+ */
+
+#include "latency.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define LAT_UNSET               UINT32_MAX
+#define CONNECT_MAX_AGE_US      (60LL * 1000 * 1000)
+
+typedef struct {
+    uint32_t d_us[LAT_STAGE_COUNT];
+} lat_record_t;
+
+static lat_record_t ring[LAT_RING_LEN];
+static uint32_t committed;            /* total records ever committed */
+
+static lat_record_t current;
+static bool    in_flight;
+static int64_t anchor_us;
+static int64_t last_connect_us = -1;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ── Recording ───────────────────────────────────────────────────────────── */
+void latency_mark(lat_stage_t stage)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&lock);
+    if (stage == LAT_STAGE_CONNECT) {
+        last_connect_us = now;
+    } else if (stage == LAT_STAGE_GATT_WRITE) {
+        if (!in_flight) {
+            in_flight = true;
+            anchor_us = now;
+            memset(&current, 0xFF, sizeof(current));   /* all LAT_UNSET */
+            current.d_us[LAT_STAGE_GATT_WRITE] = 0;
+            if (last_connect_us >= 0 &&
+                now - last_connect_us < CONNECT_MAX_AGE_US) {
+                current.d_us[LAT_STAGE_CONNECT] =
+                    (uint32_t)(now - last_connect_us);
+            }
+        }
+    } else if (in_flight && current.d_us[stage] == LAT_UNSET) {
+        current.d_us[stage] = (uint32_t)(now - anchor_us);
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void latency_finish(void)
+{
+    portENTER_CRITICAL(&lock);
+    if (in_flight) {
+        ring[committed % LAT_RING_LEN] = current;
+        committed++;
+        in_flight = false;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/* ── Aggregates ──────────────────────────────────────────────────────────── */
+static void sort_u32(uint32_t *v, int n)
+{
+    for (int i = 1; i < n; i++) {
+        uint32_t x = v[i];
+        int j = i - 1;
+        while (j >= 0 && v[j] > x) {
+            v[j + 1] = v[j];
+            j--;
+        }
+        v[j + 1] = x;
+    }
+}
+
+void latency_get_summary(lat_summary_t *out)
+{
+    uint32_t samples[LAT_RING_LEN];
+
+    memset(out, 0, sizeof(*out));
+    for (int s = 0; s < LAT_STAGE_COUNT; s++) {
+        int n = 0;
+
+        portENTER_CRITICAL(&lock);
+        out->wakes = committed;
+        int filled = committed < LAT_RING_LEN ? (int)committed : LAT_RING_LEN;
+        for (int i = 0; i < filled; i++) {
+            if (ring[i].d_us[s] != LAT_UNSET) {
+                samples[n++] = ring[i].d_us[s];
+            }
+        }
+        portEXIT_CRITICAL(&lock);
+
+        if (n == 0) {
+            continue;
+        }
+        sort_u32(samples, n);
+
+        uint64_t sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += samples[i];
+        }
+        lat_stage_summary_t *st = &out->stage[s];
+        st->samples = (uint16_t)n;
+        st->min_us  = samples[0];
+        st->avg_us  = (uint32_t)(sum / n);
+        st->p99_us  = samples[(n * 99 + 99) / 100 - 1];
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Wake pipeline stages.  Each wake is one record anchored at
+ * LAT_STAGE_GATT_WRITE; every other stage is stored as the time since that
+ * write, except LAT_STAGE_CONNECT which is the time from the link coming up
+ * to the write (only recorded for links younger than 60 s).
+ */
+typedef enum {
+    LAT_STAGE_CONNECT = 0,      /* BLE link established                    */
+    LAT_STAGE_GATT_WRITE,       /* wake request received (anchor, always 0) */
+    LAT_STAGE_USB_RESUME,       /* tud_resume_cb() after remote wake-up    */
+    LAT_STAGE_HID_READY,        /* tud_hid_ready() wait finished            */
+    LAT_STAGE_REPORT_QUEUED,    /* key-down report handed to TinyUSB        */
+    LAT_STAGE_KEY_RELEASED,     /* key-up report handed to TinyUSB          */
+    LAT_STAGE_COUNT,
+} lat_stage_t;
+
+#define LAT_RING_LEN        64    /* wakes kept for the aggregates */
+
+/** Aggregates for one stage over the records in the ring (µs). */
+typedef struct {
+    uint16_t samples;           /* records in which the stage was reached  */
+    uint32_t min_us;
+    uint32_t avg_us;
+    uint32_t p99_us;
+} lat_stage_summary_t;
+
+typedef struct {
+    uint32_t            wakes;  /* records committed since boot */
+    lat_stage_summary_t stage[LAT_STAGE_COUNT];
+} lat_summary_t;
+
+/**
+ * Timestamp a stage of the in-flight wake with esp_timer_get_time().
+ * LAT_STAGE_GATT_WRITE opens a record if none is in flight; other stages
+ * are ignored when no record is open or the stage is already set.
+ * Safe from any task; a few hundred cycles, no allocation.
+ */
+void latency_mark(lat_stage_t stage);
+
+/** Close the in-flight record and push it into the ring. */
+void latency_finish(void);
+
+/** Compute min / avg / p99 per stage over the ring. */
+void latency_get_summary(lat_summary_t *out);
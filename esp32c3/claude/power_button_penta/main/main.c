@@ -2,15 +2,33 @@
  * main.c  –  Power Button Penta
  *
  * Flow:
- *   1. Initialise NVS (required by BT stack).
+ *   1. Initialise NVS (required by BT stack) and load the tuning
+ *      parameters (tuning.c) the later steps read.
  *   2. Initialise TinyUSB HID keyboard.
- *   3. Initialise BLE GATT server ("Penta Power Btn").
- *   4. Configure automatic light sleep so idle current is minimal while
- *      still keeping the BLE radio and USB controller alive.
+ *   3. Start the wake dispatcher task and the advertising scheduler.
+ *   4. Initialise BLE GATT server ("Penta Power Btn").
+ *   5. Configure automatic light sleep so idle current is minimal while
+ *      still keeping the BLE radio and USB controller alive; the PM
+ *      governor (pm_gov.c) lifts the CPU to full speed only while a
+ *      command runs.
+ *   6. Log the heap and stack headroom (mem_report.c) and return: the main
+ *      task and its stack are freed, everything else runs in statically
+ *      allocated tasks (mem_budget.h), BLE callbacks and esp_timer.
+ *
+ * With CONFIG_PENTA_OTA the firmware update task starts after the BLE
+ * server; a freshly updated image confirms itself from there
+ * (ota_update.c) or rolls back.
+ *
+ * With CONFIG_PENTA_FAST_BOOT steps 2 and 4 swap: the BLE stack is brought
+ * up first and TinyUSB is installed while the BT tasks sync with the
+ * controller and start advertising.  boot_time.c timestamps each milestone
+ * from power-on either way.
  *
  * When a BLE client (phone / Raspberry Pi) writes to the Wake characteristic,
- * ble_server.c calls usb_hid_send_wake_key() which sends a Space keypress
- * over USB to resume the host PC from S3 sleep.
+ * ble_server.c posts a wake command to wake_dispatch.c, whose task calls
+ * wake_path_run(): USB remote wake-up and a wake report resume the host
+ * PC from S3 sleep, and with CONFIG_PENTA_PWR_SW a pulse on the PWR_SW
+ * header starts it from S5 when USB cannot.
  *
  * Light sleep notes for ESP32-C3:
  *   - The BLE LL uses its own sleep/wakeup schedule; light sleep is
@@ -26,16 +44,68 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_sleep.h"
-#include "esp_pm.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
+#include "boot_time.h"
+#include "trace.h"
+#include "tuning.h"
 #include "usb_hid.h"
+#include "wake_path.h"
+#include "wake_dispatch.h"
+#include "adv_sched.h"
+#include "conn_policy.h"
 #include "ble_server.h"
+#include "adv_supervisor.h"
+#include "mem_report.h"
+#include "pm_gov.h"
+#if CONFIG_PENTA_BOND_FILTER
+#include "pair_window.h"
+#endif
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+#include "scan_sched.h"
+#endif
+#if CONFIG_PENTA_BEACON_WAKE
+#include "beacon_wake.h"
+#endif
+#if CONFIG_PENTA_PROXIMITY_WAKE
+#include "proximity_wake.h"
+#endif
+#if CONFIG_PENTA_WAKE_AUTH
+#include "wake_auth.h"
+#endif
+#if CONFIG_PENTA_OTA
+#include "ota_update.h"
+#endif
+#if CONFIG_PENTA_POWER_STATS
+#include "power_stats.h"
+#endif
 
 static const char *TAG = "MAIN";
 
+#if CONFIG_PENTA_IDLE_STATS
+#define IDLE_STATS_PERIOD_US    (10LL * 1000 * 1000)
+
+static void idle_stats_cb(void *arg)
+{
+    static usb_hid_stats_t prev;
+    (void)arg;
+
+    usb_hid_stats_t now;
+    usb_hid_get_stats(&now);
+    uint32_t wakeups = now.task_wakeups - prev.task_wakeups;
+    ESP_LOGW(TAG, "usb_task wake-ups: %u.%u/s  suspends=%u resumes=%u",
+             (unsigned)(wakeups / 10), (unsigned)(wakeups % 10),
+             (unsigned)now.suspends, (unsigned)now.resumes);
+    prev = now;
+}
+#endif
+
 void app_main(void)
 {
+    boot_time_init();
+    trace_init();
+
     /* ── NVS ───────────────────────────────────────────────────────────── */
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -44,35 +114,104 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_time_mark(BOOT_STAGE_NVS_READY);
+
+    /* ── Tuning parameters (before anything that reads one) ────────────── */
+    tuning_init();
+
+#if CONFIG_PENTA_WAKE_AUTH
+    /* ── Wake authentication (after NVS: counter reservation) ──────────── */
+    wake_auth_init();
+#endif
+
+    /* ── Advertising scheduler (before USB: bus events feed it) ────────── */
+    adv_sched_init();
 
+#if !CONFIG_PENTA_FAST_BOOT
     /* ── USB HID ───────────────────────────────────────────────────────── */
     usb_hid_init();
+#endif
+
+    /* ── Wake paths (before the dispatcher: it runs them) ──────────────── */
+    wake_path_init();
+
+    /* ── PM governor (before the dispatcher: it brackets commands) ─────── */
+    pm_gov_init();
+
+    /* ── Wake dispatcher ───────────────────────────────────────────────── */
+    wake_dispatch_init();
+
+    /* ── Connection-parameter policy (before BLE: link events feed it) ─── */
+    conn_policy_init();
+
+#if CONFIG_PENTA_BOND_FILTER
+    /* ── Pairing button (before BLE: the backend reports bonds to it) ──── */
+    pair_window_init();
+#endif
 
     /* ── BLE GATT server ───────────────────────────────────────────────── */
     ble_server_init();
+    boot_time_mark(BOOT_STAGE_BLE_INIT);
+
+    /* ── Advertising supervisor (after BLE: restarts and resets it) ────── */
+    adv_supervisor_init();
+
+#if CONFIG_PENTA_OTA
+    /* ── Firmware update (after BLE: probation watches advertising) ────── */
+    ota_update_init();
+#endif
+
+#if CONFIG_PENTA_FAST_BOOT
+    /* ── USB HID (after BLE: runs while the BT tasks start advertising) ── */
+    usb_hid_init();
+#endif
+
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+    /* ── Shared passive scan (after BLE: starts it in the backend) ─────── */
+    scan_sched_init();
+#endif
+
+#if CONFIG_PENTA_BEACON_WAKE
+    /* ── Connectionless beacon wake (optional) ─────────────────────────── */
+    beacon_wake_init();
+#endif
+
+#if CONFIG_PENTA_PROXIMITY_WAKE
+    /* ── Proximity pre-wake (optional) ─────────────────────────────────── */
+    proximity_wake_init();
+#endif
 
     /* ── Power management – automatic light sleep ──────────────────────── *
-     * CPU runs at up to 160 MHz when active, drops to the minimum clock
-     * (and enters light sleep) whenever FreeRTOS is idle.               */
-    esp_pm_config_t pm_config = {
-        .max_freq_mhz  = 80,   /* Lower max saves more power; 80 is safe */
-        .min_freq_mhz  = 10,
-        .light_sleep_enable = true,
-    };
-    ret = esp_pm_configure(&pm_config);
+     * CPU runs at pm_max_mhz (80 by default) while pm_gov.c holds its
+     * locks for a wake or command, and drops to pm_min_mhz (and enters
+     * light sleep) whenever FreeRTOS is idle.  Both are tuning
+     * parameters.                                                        */
+    ret = tuning_configure_pm();
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Power management config failed (may need sdkconfig "
                       "options): %s", esp_err_to_name(ret));
     } else {
         ESP_LOGI(TAG, "Light sleep enabled");
+#if CONFIG_PENTA_POWER_STATS
+        power_stats_init();     /* residency / wake causes on 0xFF02 */
+#endif
     }
 
     ESP_LOGI(TAG, "Power Button Penta ready – advertising as 'Penta Power Btn'");
 
-    /* Main loop – nothing to do; events are handled in BLE callbacks and
-     * the TinyUSB task.  We vTaskDelay to let the idle task run (and
-     * thus enter light sleep). */
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(10000));
-    }
+#if CONFIG_PENTA_IDLE_STATS
+    const esp_timer_create_args_t idle_args = {
+        .callback = idle_stats_cb,
+        .name     = "idle_stats",
+    };
+    esp_timer_handle_t idle_timer;
+    ESP_ERROR_CHECK(esp_timer_create(&idle_args, &idle_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(idle_timer,
+                                             IDLE_STATS_PERIOD_US));
+#endif
+
+    /* Nothing left to do here: events are handled in BLE callbacks, the
+     * TinyUSB and dispatcher tasks and esp_timer.  Returning deletes the
+     * main task and frees its stack. */
+    mem_report_log();
 }
@@ -0,0 +1,40 @@
+#pragma once
+
+/**
+ * Memory budget of the firmware's own tasks and queues.
+ *
+ * Every task, queue, event group and mutex created here is statically
+ * allocated (xTaskCreateStatic and friends), so the budget is fixed at link
+ * time, shows up in `idf.py size`, and cannot fragment the heap left to the
+ * BT stack.  Stack depths are in bytes (StackType_t is uint8_t on ESP-IDF).
+ *
+ * To re-measure after a change: run a few plain wakes and one long KEYS
+ * sequence, then read the memory section of the stats characteristic
+ * (python/penta_stats.py).  It lists each task's stack headroom, the
+ * lowest it has been since boot.  Keep at least MEM_STACK_MARGIN free;
+ * mem_report_log() warns when a task drops below that.
+ */
+#define MEM_STACK_MARGIN        512
+
+/* TinyUSB device task: tud_task_ext() plus the descriptor and HID
+ * callbacks, which log */
+#define USB_TASK_STACK          4096
+#define USB_TASK_PRIO           5
+
+/* Wake dispatcher: runs wake_proto sequences and the HID report path */
+#define WAKE_TASK_STACK         3072
+#define WAKE_TASK_PRIO          4     /* below usb_task so tud_task() keeps up */
+/* Commands waiting per client (conn_table.h slot) and for beacon and
+ * proximity wakes; the dispatcher takes the clients in turn */
+#define WAKE_QUEUE_LEN          4
+
+/* Advertising supervisor: health checks and ble_server_recover(), which
+ * runs the BT enable/disable calls on this stack */
+#define ADV_SUP_TASK_STACK      3072
+#define ADV_SUP_TASK_PRIO       2     /* below the BLE host and wake tasks */
+
+/* Firmware update (CONFIG_PENTA_OTA): esp_ota_write() and esp_ota_end(),
+ * which verify the image on this stack.  Chunks wait in a message buffer
+ * of two windows (CONFIG_PENTA_OTA_WINDOW_KB). */
+#define OTA_TASK_STACK          4096
+#define OTA_TASK_PRIO           3     /* a wake still goes out first */
@@ -0,0 +1,76 @@
+/**
+ * mem_report.c
+ *
+ * Heap and stack headroom report.
+ *
+ * Logged once at boot from app_main() and served on demand in the memory
+ * section of the stats characteristic, so stack sizes in mem_budget.h can
+ * be set from measured high-water marks instead of guesses.  Tasks are
+ * looked up by name; the ones a build does not have (Bluedroid vs NimBLE)
+ * are skipped.
+ */
+
+#include "mem_report.h"
+#include "mem_budget.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "MEM";
+
+/* First MEM_REPORT_MAX_TASKS that exist are reported */
+static const char *const task_names[] = {
+    "usb_task",
+    "wake_disp",
+    "adv_sup",
+    "ota",              /* CONFIG_PENTA_OTA */
+    "BTC_TASK",         /* Bluedroid */
+    "BTU_TASK",
+    "nimble_host",      /* NimBLE */
+    "esp_timer",
+    "IDLE",
+    "Tmr Svc",
+};
+
+void mem_report_get(mem_report_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->heap_free    = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    out->heap_min     = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    out->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    for (size_t i = 0; i < sizeof(task_names) / sizeof(task_names[0]) &&
+                       out->n_tasks < MEM_REPORT_MAX_TASKS; i++) {
+        TaskHandle_t h = xTaskGetHandle(task_names[i]);
+        if (h == NULL) {
+            continue;
+        }
+        strncpy(out->task[out->n_tasks].name, task_names[i],
+                MEM_REPORT_NAME_LEN);
+        out->task[out->n_tasks].stack_free =
+            (uint16_t)uxTaskGetStackHighWaterMark(h);
+        out->n_tasks++;
+    }
+}
+
+void mem_report_log(void)
+{
+    static mem_report_t r;      /* called from small stacks */
+    mem_report_get(&r);
+
+    ESP_LOGW(TAG, "heap free %u, min free %u, largest block %u",
+             (unsigned)r.heap_free, (unsigned)r.heap_min,
+             (unsigned)r.heap_largest);
+    for (int i = 0; i < r.n_tasks; i++) {
+        if (r.task[i].stack_free < MEM_STACK_MARGIN) {
+            ESP_LOGE(TAG, "  %-8.8s stack free %5u  < %u margin",
+                     r.task[i].name, r.task[i].stack_free, MEM_STACK_MARGIN);
+        } else {
+            ESP_LOGW(TAG, "  %-8.8s stack free %5u",
+                     r.task[i].name, r.task[i].stack_free);
+        }
+    }
+}
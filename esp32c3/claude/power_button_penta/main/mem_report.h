@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+#define MEM_REPORT_MAX_TASKS    8
+#define MEM_REPORT_NAME_LEN     8
+
+/** Heap state and stack headroom of the tasks that matter here. */
+typedef struct {
+    uint32_t heap_free;         /* bytes, internal 8-bit capable heap     */
+    uint32_t heap_min;          /* lowest heap_free since boot            */
+    uint32_t heap_largest;      /* largest free block: fragmentation      */
+    uint8_t  n_tasks;
+    struct {
+        char     name[MEM_REPORT_NAME_LEN];  /* not NUL-terminated if full */
+        uint16_t stack_free;    /* bytes never used since the task started */
+    } task[MEM_REPORT_MAX_TASKS];
+} mem_report_t;
+
+/**
+ * Snapshot the heap and the stack high-water marks of the firmware tasks
+ * (mem_budget.h) and of the BT host, esp_timer and idle tasks that exist in
+ * this build.
+ */
+void mem_report_get(mem_report_t *out);
+
+/** Log the snapshot at WARN; flags tasks below MEM_STACK_MARGIN. */
+void mem_report_log(void);
@@ -0,0 +1,481 @@
+/**
+ * ota_update.c
+ *
+ * Firmware update over BLE (see ota_update.h).
+ *
+ * The BLE callbacks never touch flash.  A data write is copied into a
+ * message buffer and the callback returns; the update task drains the
+ * buffer into esp_ota_write().  The slot is opened with
+ * OTA_WITH_SEQUENTIAL_WRITES, so each sector is erased just before it is
+ * written and the erase overlaps the transfer instead of stalling BEGIN
+ * for the whole slot.
+ *
+ * Flow control is credit based.  The sender keeps at most one window
+ * (CONFIG_PENTA_OTA_WINDOW_KB) unacknowledged and the task acknowledges
+ * every half window it has written.  The buffer holds two windows, so a
+ * sender that follows the protocol never overruns it, and the link keeps
+ * streaming while flash is busy with the previous half.
+ *
+ * Every chunk carries its image offset.  A gap (a chunk dropped on an
+ * overrun) is answered with one NAK holding the offset the task expects;
+ * chunks are discarded until the sender has rewound to it.
+ *
+ * During a session the task holds a CPU_FREQ_MAX PM lock and the link is
+ * switched to the bulk connection interval (conn_policy.h) with the
+ * largest data length and, on NimBLE, the 2M PHY.
+ *
+ * Rollback (CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE): a new image boots in
+ * ESP_OTA_IMG_PENDING_VERIFY.  Once advertising has been healthy for
+ * CONFIG_PENTA_OTA_PROBATION_S it is marked valid.  A reset before then
+ * makes the bootloader return to the previous slot, and an image that
+ * has not got there after four probation periods rolls itself back: an
+ * image that cannot advertise could never be replaced over the air.
+ */
+
+#include "ota_update.h"
+#include "ble_server.h"
+#include "conn_policy.h"
+#include "mem_budget.h"
+#include "trace.h"
+
+#include "esp_app_desc.h"
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/message_buffer.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "OTA";
+
+#define WINDOW_BYTES            (CONFIG_PENTA_OTA_WINDOW_KB * 1024)
+#define DATA_BUF_BYTES          (WINDOW_BYTES * 2)
+#define CMD_QUEUE_LEN           4
+#define DATA_POLL_MS            20
+#define IDLE_TIMEOUT_US         (CONFIG_PENTA_OTA_IDLE_S * 1000000LL)
+#define PROBATION_US            (CONFIG_PENTA_OTA_PROBATION_S * 1000000LL)
+#define PROBATION_CHECK_MS      1000
+#define REBOOT_DELAY_MS         500     /* lets DONE reach the sender */
+
+/* The app description follows the image and first segment headers */
+#define DESC_OFFSET             (sizeof(esp_image_header_t) + \
+                                 sizeof(esp_image_segment_header_t))
+#define HEAD_LEN                (DESC_OFFSET + sizeof(esp_app_desc_t))
+
+#define OP_DISCONNECT           0xFF    /* internal: the link went down */
+
+typedef struct {
+    uint8_t  op;                /* ota_op_t or OP_DISCONNECT */
+    uint16_t conn;
+    uint32_t size;              /* OTA_OP_BEGIN only */
+} ota_cmd_t;
+
+static QueueHandle_t cmd_queue;
+static StaticQueue_t cmd_queue_buf;
+static uint8_t cmd_queue_storage[CMD_QUEUE_LEN * sizeof(ota_cmd_t)];
+
+static MessageBufferHandle_t data_buf;
+static StaticMessageBuffer_t data_buf_struct;
+static uint8_t data_buf_storage[DATA_BUF_BYTES + 1];
+
+/* Session; written by the task, the first two also read by the callbacks */
+static volatile bool     receiving;
+static volatile uint16_t session_conn;
+static esp_ota_handle_t  ota_handle;
+static const esp_partition_t *target;
+static uint32_t image_size;
+static uint32_t written;
+static uint32_t acked;
+static bool     nak_sent;
+static int64_t  started_us;
+static int64_t  last_data_us;
+static uint8_t  head[HEAD_LEN];
+static esp_pm_lock_handle_t pm_lock;    /* NULL when PM is disabled */
+
+static bool    probation;
+static int64_t healthy_since;           /* 0 = advertising not healthy */
+
+static ota_update_stats_t stats = { .last_err = ESP_OK };
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void count(uint32_t *field)
+{
+    portENTER_CRITICAL(&stats_lock);
+    (*field)++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void set_state(ota_state_t state)
+{
+    portENTER_CRITICAL(&stats_lock);
+    stats.state = (uint8_t)state;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void notify(ota_evt_t evt, uint32_t value, uint16_t extra)
+{
+    const uint8_t v[OTA_NOTIFY_LEN] = {
+        (uint8_t)evt,
+        (uint8_t)value, (uint8_t)(value >> 8),
+        (uint8_t)(value >> 16), (uint8_t)(value >> 24),
+        (uint8_t)extra, (uint8_t)(extra >> 8),
+    };
+    ble_server_notify_ota(session_conn, v, sizeof(v));
+}
+
+/* Refuse an image built for another project before most of it is sent */
+static esp_err_t check_head(void)
+{
+    static esp_app_desc_t desc;     /* 256 bytes: keep off the task stack */
+
+    memcpy(&desc, &head[DESC_OFFSET], sizeof(desc));
+    if (desc.magic_word != ESP_APP_DESC_MAGIC_WORD ||
+        strncmp(desc.project_name, esp_app_get_description()->project_name,
+                sizeof(desc.project_name)) != 0) {
+        ESP_LOGE(TAG, "Image is not a %s build",
+                 esp_app_get_description()->project_name);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    ESP_LOGW(TAG, "Receiving version %.32s", desc.version);
+    return ESP_OK;
+}
+
+/* ── Session ─────────────────────────────────────────────────────────────── */
+
+/* End the session with err; tell decides whether the sender still hears
+ * about it (not after ABORT or a disconnect). */
+static void finish(esp_err_t err, bool tell)
+{
+    receiving = false;
+    if (ota_handle != 0) {
+        esp_ota_abort(ota_handle);
+        ota_handle = 0;
+    }
+    if (pm_lock) {
+        esp_pm_lock_release(pm_lock);
+    }
+    conn_policy_set_bulk(session_conn, false);
+
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - started_us) / 1000);
+    portENTER_CRITICAL(&stats_lock);
+    stats.state      = OTA_STATE_IDLE;
+    stats.last_err   = err;
+    stats.last_bytes = written;
+    stats.last_ms    = ms;
+    if (err == ESP_OK) {
+        stats.completed++;
+    } else {
+        stats.failed++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+    trace_log(TRACE_EVT_OTA_END, (uint16_t)(ms ? written / ms : 0),
+              (uint32_t)err);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Update failed after %u bytes: %s",
+                 (unsigned)written, esp_err_to_name(err));
+    }
+    if (tell) {
+        notify(err == ESP_OK ? OTA_EVT_DONE : OTA_EVT_ERROR,
+               (uint32_t)err, 0);
+    }
+}
+
+static void begin(const ota_cmd_t *cmd)
+{
+    if (receiving) {
+        finish(ESP_ERR_INVALID_STATE, false);   /* same link started over */
+    }
+    session_conn = cmd->conn;
+    started_us   = esp_timer_get_time();
+    written      = 0;
+    acked        = 0;
+    nak_sent     = false;
+    count(&stats.sessions);
+    /* Undone by finish() whatever happens next */
+    if (pm_lock) {
+        esp_pm_lock_acquire(pm_lock);
+    }
+    ble_server_prepare_bulk(session_conn);
+    conn_policy_set_bulk(session_conn, true);
+
+    target = esp_ota_get_next_update_partition(NULL);
+    if (target == NULL || cmd->size > target->size) {
+        ESP_LOGE(TAG, "No OTA slot for %u bytes", (unsigned)cmd->size);
+        finish(ESP_ERR_INVALID_SIZE, true);
+        return;
+    }
+    esp_err_t err = esp_ota_begin(target, OTA_WITH_SEQUENTIAL_WRITES,
+                                  &ota_handle);
+    if (err != ESP_OK) {
+        ota_handle = 0;
+        finish(err, true);
+        return;
+    }
+
+    image_size   = cmd->size;
+    last_data_us = started_us;
+    xMessageBufferReset(data_buf);  /* nothing writes while !receiving */
+    receiving    = true;
+    set_state(OTA_STATE_RECEIVING);
+    trace_log(TRACE_EVT_OTA_BEGIN, session_conn, image_size);
+    ESP_LOGW(TAG, "Update of %u bytes into %s", (unsigned)image_size,
+             target->label);
+    notify(OTA_EVT_READY, WINDOW_BYTES, OTA_CHUNK_MAX);
+}
+
+static void end(void)
+{
+    if (written != image_size) {
+        finish(ESP_ERR_INVALID_SIZE, true);
+        return;
+    }
+    receiving = false;
+
+    /* Hash and, with CONFIG_SECURE_SIGNED_ON_UPDATE, signature */
+    esp_err_t err = esp_ota_end(ota_handle);
+    ota_handle = 0;                 /* released by esp_ota_end() either way */
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(target);
+    }
+    finish(err, true);
+    if (err == ESP_OK) {
+        ESP_LOGW(TAG, "Rebooting into %s", target->label);
+        vTaskDelay(pdMS_TO_TICKS(REBOOT_DELAY_MS));
+        esp_restart();
+    }
+}
+
+static void on_chunk(const uint8_t *chunk, size_t n)
+{
+    uint32_t offset = get_u32(chunk);
+    const uint8_t *data = &chunk[4];
+    size_t len = n - 4;
+
+    last_data_us = esp_timer_get_time();
+    if (offset != written) {
+        if (!nak_sent) {
+            nak_sent = true;
+            count(&stats.naks);
+            trace_log(TRACE_EVT_OTA_NAK, session_conn, written);
+            notify(OTA_EVT_NAK, written, 0);
+        }
+        return;
+    }
+    nak_sent = false;
+    if (len > image_size - written) {
+        finish(ESP_ERR_INVALID_SIZE, true);
+        return;
+    }
+
+    if (written < HEAD_LEN) {
+        size_t take = HEAD_LEN - written < len ? HEAD_LEN - written : len;
+        memcpy(&head[written], data, take);
+        if (written + take == HEAD_LEN && check_head() != ESP_OK) {
+            finish(ESP_ERR_INVALID_VERSION, true);
+            return;
+        }
+    }
+    esp_err_t err = esp_ota_write(ota_handle, data, len);
+    if (err != ESP_OK) {
+        finish(err, true);
+        return;
+    }
+    written += len;
+
+    if (written - acked >= WINDOW_BYTES / 2 || written == image_size) {
+        acked = written;
+        notify(OTA_EVT_ACK, written, 0);
+    }
+}
+
+static void run_cmd(const ota_cmd_t *cmd)
+{
+    switch (cmd->op) {
+    case OTA_OP_BEGIN:
+        begin(cmd);
+        break;
+    case OTA_OP_END:
+        if (receiving && cmd->conn == session_conn) {
+            end();
+        }
+        break;
+    case OTA_OP_ABORT:
+    case OP_DISCONNECT:
+        if (receiving && cmd->conn == session_conn) {
+            finish(ESP_ERR_INVALID_STATE, false);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* ── Probation ───────────────────────────────────────────────────────────── */
+static void check_probation(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (!ble_server_adv_healthy()) {
+        healthy_since = 0;
+    } else if (healthy_since == 0) {
+        healthy_since = now;
+    }
+
+    if (healthy_since != 0 && now - healthy_since >= PROBATION_US) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        probation = false;
+        set_state(OTA_STATE_IDLE);
+        trace_log(TRACE_EVT_OTA_CONFIRM, 1, 0);
+        ESP_LOGW(TAG, "New image confirmed");
+    } else if (now >= PROBATION_US * 4) {
+        trace_log(TRACE_EVT_OTA_CONFIRM, 0, 0);
+        ESP_LOGE(TAG, "Advertising never settled, rolling back");
+        esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+}
+
+/* ── Update task ─────────────────────────────────────────────────────────── */
+static void ota_task(void *arg)
+{
+    static uint8_t chunk[OTA_DATA_MAX_LEN];
+    (void)arg;
+
+    while (1) {
+        ota_cmd_t cmd;
+        TickType_t wait = receiving ? 0
+                        : probation ? pdMS_TO_TICKS(PROBATION_CHECK_MS)
+                        : portMAX_DELAY;
+        if (xQueueReceive(cmd_queue, &cmd, wait) == pdTRUE) {
+            run_cmd(&cmd);
+        }
+
+        if (receiving) {
+            size_t n = xMessageBufferReceive(data_buf, chunk, sizeof(chunk),
+                                             pdMS_TO_TICKS(DATA_POLL_MS));
+            if (n > 4) {
+                on_chunk(chunk, n);
+            } else if (esp_timer_get_time() - last_data_us >
+                       IDLE_TIMEOUT_US) {
+                finish(ESP_ERR_TIMEOUT, true);
+            }
+        }
+        if (probation) {
+            check_probation();
+        }
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void ota_update_init(void)
+{
+    cmd_queue = xQueueCreateStatic(CMD_QUEUE_LEN, sizeof(ota_cmd_t),
+                                   cmd_queue_storage, &cmd_queue_buf);
+    data_buf = xMessageBufferCreateStatic(sizeof(data_buf_storage) - 1,
+                                          data_buf_storage,
+                                          &data_buf_struct);
+
+    esp_err_t err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "ota",
+                                       &pm_lock);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "OTA PM lock unavailable: %s", esp_err_to_name(err));
+        pm_lock = NULL;
+    }
+
+    esp_ota_img_states_t img_state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(),
+                                    &img_state) == ESP_OK &&
+        img_state == ESP_OTA_IMG_PENDING_VERIFY) {
+        probation = true;
+        stats.state = OTA_STATE_PROBATION;
+        ESP_LOGW(TAG, "New image on probation for %d s",
+                 CONFIG_PENTA_OTA_PROBATION_S);
+    }
+
+    static StackType_t ota_stack[OTA_TASK_STACK];
+    static StaticTask_t ota_tcb;
+    xTaskCreateStatic(ota_task, "ota", OTA_TASK_STACK, NULL, OTA_TASK_PRIO,
+                      ota_stack, &ota_tcb);
+}
+
+esp_err_t ota_update_on_control(uint16_t conn, const uint8_t *data,
+                                size_t len)
+{
+    ota_cmd_t cmd = { .conn = conn };
+
+    if (len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    cmd.op = data[0];
+    switch (cmd.op) {
+    case OTA_OP_BEGIN:
+        if (len != 5) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        cmd.size = get_u32(&data[1]);
+        if (cmd.size == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+    case OTA_OP_END:
+    case OTA_OP_ABORT:
+        if (len != 1) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (receiving && conn != session_conn) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return xQueueSend(cmd_queue, &cmd, 0) == pdTRUE ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void ota_update_on_data(uint16_t conn, const uint8_t *data, size_t len)
+{
+    if (!receiving || conn != session_conn ||
+        len <= 4 || len > OTA_DATA_MAX_LEN) {
+        return;
+    }
+    if (xMessageBufferSend(data_buf, data, len, 0) == 0) {
+        count(&stats.overruns);     /* the offset check turns it into a NAK */
+    }
+}
+
+void ota_update_on_disconnect(uint16_t conn)
+{
+    const ota_cmd_t cmd = { .op = OP_DISCONNECT, .conn = conn };
+
+    if (receiving && conn == session_conn) {
+        xQueueSend(cmd_queue, &cmd, 0);
+    }
+}
+
+uint8_t ota_update_att_error(esp_err_t err)
+{
+    return err == ESP_ERR_INVALID_ARG ? OTA_ATT_ERR_INVALID
+                                      : OTA_ATT_ERR_BUSY;
+}
+
+void ota_update_get_stats(ota_update_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Firmware update over BLE (CONFIG_PENTA_OTA).
+ *
+ * Two characteristics in the wake service:
+ *   0xFF05 control  WRITE | NOTIFY    commands in, status notifications out
+ *   0xFF06 data     WRITE_NO_RSP      offset u32 | image bytes
+ *
+ * Control writes:
+ *   0x01 BEGIN  size u32              open the next OTA slot for size bytes
+ *   0x02 END                          verify the image, boot it
+ *   0x03 ABORT                        drop the session
+ *
+ * Notifications, each  evt u8 | value u32 | extra u16 :
+ *   0x01 READY  window u32, chunk u16 send data; keep at most window bytes
+ *                                     unacknowledged, chunk bytes per write
+ *   0x02 ACK    offset u32            everything below offset is in flash
+ *   0x03 NAK    offset u32            a chunk went missing: resend from
+ *                                     offset (also an ACK up to it)
+ *   0x04 DONE                         image selected, rebooting into it
+ *   0x05 ERROR  esp_err_t u32         session ended, nothing was selected
+ *
+ * Integers are little-endian.  One session at a time, bound to the link
+ * that sent BEGIN; its disconnect or CONFIG_PENTA_OTA_IDLE_S without data
+ * ends it.  The image must carry this firmware's project name and pass
+ * esp_ota_end(): hash and, with CONFIG_SECURE_SIGNED_ON_UPDATE, signature.
+ *
+ * The new image boots on probation (ESP_OTA_IMG_PENDING_VERIFY) and marks
+ * itself valid once it has kept advertising for CONFIG_PENTA_OTA_PROBATION_S;
+ * see ota_update.c for the rollback rules.  python/penta_ota.py uploads.
+ */
+#define OTA_DATA_MAX_LEN        512     /* ATT attribute value limit      */
+#define OTA_CHUNK_MAX           (OTA_DATA_MAX_LEN - 4)
+#define OTA_NOTIFY_LEN          7
+
+typedef enum {
+    OTA_OP_BEGIN = 0x01,
+    OTA_OP_END   = 0x02,
+    OTA_OP_ABORT = 0x03,
+} ota_op_t;
+
+typedef enum {
+    OTA_EVT_READY = 0x01,
+    OTA_EVT_ACK   = 0x02,
+    OTA_EVT_NAK   = 0x03,
+    OTA_EVT_DONE  = 0x04,
+    OTA_EVT_ERROR = 0x05,
+} ota_evt_t;
+
+typedef enum {
+    OTA_STATE_IDLE = 0,
+    OTA_STATE_RECEIVING,
+    OTA_STATE_PROBATION,        /* running a new image, not yet confirmed */
+} ota_state_t;
+
+/* ATT application error codes returned for rejected control writes */
+#define OTA_ATT_ERR_INVALID     0x80
+#define OTA_ATT_ERR_BUSY        0x81    /* another link owns the session   */
+
+typedef struct {
+    uint8_t   state;            /* ota_state_t                             */
+    uint32_t  sessions;         /* BEGINs accepted                         */
+    uint32_t  completed;        /* images selected for boot                */
+    uint32_t  failed;           /* sessions ended by an error or abort     */
+    uint32_t  naks;             /* gaps reported to the sender             */
+    uint32_t  overruns;         /* chunks dropped with the buffer full     */
+    esp_err_t last_err;         /* result of the last session              */
+    uint32_t  last_bytes;       /* bytes written by the last session       */
+    uint32_t  last_ms;          /* BEGIN to the end of the last session    */
+} ota_update_stats_t;
+
+/**
+ * Create the update task and check whether this image is on probation.
+ * Call after ble_server_init().
+ */
+void ota_update_init(void);
+
+/**
+ * Backend hooks; BLE stack context, never block.  on_control returns
+ * ESP_ERR_INVALID_ARG for a malformed command, ESP_ERR_INVALID_STATE if
+ * another link owns the session and ESP_ERR_NO_MEM if the task cannot
+ * take it.  Data writes outside the session are ignored.
+ */
+esp_err_t ota_update_on_control(uint16_t conn, const uint8_t *data,
+                                size_t len);
+void ota_update_on_data(uint16_t conn, const uint8_t *data, size_t len);
+void ota_update_on_disconnect(uint16_t conn);
+
+/** The ATT error a backend should answer for an on_control() error. */
+uint8_t ota_update_att_error(esp_err_t err);
+
+/** Copy the update counters into *out. */
+void ota_update_get_stats(ota_update_stats_t *out);
@@ -0,0 +1,208 @@
+/**
+ * pair_window.c
+ *
+ * BOOT-button pairing window for the bonded-peer filter.
+ *
+ * Advertising without a filter lets every phone and scanner in range send
+ * scan requests and connect, which wakes the host stack and can take the
+ * connection slot the Pi needs.  With CONFIG_PENTA_BOND_FILTER the backend
+ * fills the controller's filter accept list with the bonded peers and
+ * advertises with a scan + connect filter, so those requests never leave
+ * the link layer.
+ *
+ * Adding a peer needs physical access: pressing BOOT lifts the filter for
+ * CONFIG_PENTA_PAIR_WINDOW_S, and the first new bond (or the timeout)
+ * closes it again.  The backends refuse pairing outside the window, the
+ * first bond included; a dongle that boots with no bonds opens the window
+ * once by itself, so powering it up is the proof of presence there.
+ *
+ * The button is a level interrupt that also wakes the chip from light
+ * sleep.  The ISR masks itself and starts a debounce timer; the timer
+ * confirms the press, then polls until the button is released before
+ * unmasking the interrupt, so a held button does not storm.
+ */
+
+#include "pair_window.h"
+#include "ble_server.h"
+#include "adv_sched.h"
+
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "PAIR";
+
+#define BUTTON_GPIO             CONFIG_PENTA_PAIR_BUTTON_GPIO
+#define DEBOUNCE_US             (50 * 1000)
+#define RELEASE_POLL_US         (100 * 1000)
+#define WINDOW_US               (CONFIG_PENTA_PAIR_WINDOW_S * 1000000LL)
+
+static SemaphoreHandle_t lock;
+static StaticSemaphore_t lock_buf;
+static esp_timer_handle_t button_timer;
+static esp_timer_handle_t window_timer;
+static esp_timer_handle_t unbonded_timer;
+static pair_window_state_t state;
+static bool reported;               /* first bond count seen */
+static bool pressed;                /* button_timer context only */
+
+/* ── Window ──────────────────────────────────────────────────────────────── */
+
+/* Caller holds the lock; returns true if the backend must be told.  The
+ * call itself happens after the lock is released, because the backend
+ * reports back through pair_window_on_bond_count(). */
+static bool set_open(bool open)
+{
+    if (state.open == open) {
+        return false;
+    }
+    state.open = open;
+    ESP_LOGW(TAG, "Pairing window %s", open ? "open" : "closed");
+    return true;
+}
+
+static void close_window(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool changed = set_open(false);
+    xSemaphoreGive(lock);
+
+    if (changed) {
+        ble_server_set_pairing(false);
+    }
+}
+
+static void window_cb(void *arg)
+{
+    (void)arg;
+    close_window();
+}
+
+static void open_window(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool changed = set_open(true);
+    esp_timer_stop(window_timer);   /* restart if already open */
+    esp_timer_start_once(window_timer, WINDOW_US);
+    xSemaphoreGive(lock);
+
+    if (changed) {
+        ble_server_set_pairing(true);
+    }
+    adv_sched_on_event(ADV_EVT_PAIRING);
+}
+
+/* esp_timer task, once per boot: nothing bonded yet */
+static void unbonded_cb(void *arg)
+{
+    (void)arg;
+    ESP_LOGW(TAG, "No bonds – pairing open for %d s",
+             CONFIG_PENTA_PAIR_WINDOW_S);
+    open_window();
+}
+
+/* ── Button ──────────────────────────────────────────────────────────────── */
+static void button_isr(void *arg)
+{
+    (void)arg;
+    gpio_intr_disable(BUTTON_GPIO);
+    esp_timer_start_once(button_timer, DEBOUNCE_US);
+}
+
+static void button_cb(void *arg)
+{
+    (void)arg;
+    if (gpio_get_level(BUTTON_GPIO) == 0) {
+        if (!pressed) {
+            pressed = true;
+            pair_window_open();
+        }
+        esp_timer_start_once(button_timer, RELEASE_POLL_US);
+    } else {
+        pressed = false;
+        gpio_intr_enable(BUTTON_GPIO);
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void pair_window_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buf);
+
+    const esp_timer_create_args_t button_args = {
+        .callback = button_cb,
+        .name     = "pair_button",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&button_args, &button_timer));
+    const esp_timer_create_args_t window_args = {
+        .callback = window_cb,
+        .name     = "pair_window",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&window_args, &window_timer));
+    const esp_timer_create_args_t unbonded_args = {
+        .callback = unbonded_cb,
+        .name     = "pair_unbonded",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&unbonded_args, &unbonded_timer));
+
+    const gpio_config_t io = {
+        .pin_bit_mask = 1ULL << BUTTON_GPIO,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_up_en   = GPIO_PULLUP_ENABLE,
+        .intr_type    = GPIO_INTR_LOW_LEVEL,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io));
+    ESP_ERROR_CHECK(gpio_install_isr_service(0));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(BUTTON_GPIO, button_isr, NULL));
+    ESP_ERROR_CHECK(gpio_wakeup_enable(BUTTON_GPIO, GPIO_INTR_LOW_LEVEL));
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+
+    ESP_LOGI(TAG, "Hold BOOT (GPIO%d) to pair a new client", BUTTON_GPIO);
+}
+
+void pair_window_open(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    state.opened++;
+    xSemaphoreGive(lock);
+
+    open_window();
+}
+
+void pair_window_on_bonded(void)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (state.open) {
+        state.bonded++;
+        esp_timer_stop(window_timer);
+    }
+    xSemaphoreGive(lock);
+
+    close_window();
+}
+
+void pair_window_on_bond_count(uint8_t bonds)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool first = !reported;
+    reported    = true;
+    state.bonds = bonds;
+    xSemaphoreGive(lock);
+
+    /* Opened from the timer task: the backend is inside its filter
+     * refresh here and would be re-entered */
+    if (first && bonds == 0) {
+        esp_timer_start_once(unbonded_timer, 0);
+    }
+}
+
+void pair_window_get_state(pair_window_state_t *out)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = state;
+    xSemaphoreGive(lock);
+}
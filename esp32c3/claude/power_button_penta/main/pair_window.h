@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Counters for the pairing window, for monitoring. */
+typedef struct {
+    bool     open;          /* window currently open                       */
+    uint8_t  bonds;         /* bonded peers as last reported by the backend */
+    uint32_t opened;        /* times the BOOT button opened the window      */
+    uint32_t bonded;        /* new bonds made inside a window               */
+} pair_window_state_t;
+
+/**
+ * Watch the BOOT button (CONFIG_PENTA_PAIR_BUTTON_GPIO).
+ * Only built with CONFIG_PENTA_BOND_FILTER; call before ble_server_init().
+ *
+ * Outside the window the BLE backend advertises with the controller's
+ * filter accept list holding the bonded peers only, so scan and connect
+ * requests from anyone else are dropped in the link layer.  Pressing the
+ * button opens the window for CONFIG_PENTA_PAIR_WINDOW_S: the filter is
+ * lifted and the next central may pair and bond.  The window closes at the
+ * first new bond or when the time is up.  Pairing is refused outside the
+ * window, the first bond included.  While no peer is bonded at all the
+ * backend leaves the filter off, and a boot without bonds opens the window
+ * once by itself, so a fresh or erased device can be paired right after
+ * it is powered up, and only then.
+ *
+ * The backend is told through ble_server_set_pairing().
+ */
+void pair_window_init(void);
+
+/** Open the window as if the button had been pressed.  Task context. */
+void pair_window_open(void);
+
+/** Backend hooks; BLE stack context. */
+void pair_window_on_bonded(void);               /* a new peer bonded     */
+void pair_window_on_bond_count(uint8_t bonds);  /* filter list rebuilt   */
+
+/** Copy the window state into *out. */
+void pair_window_get_state(pair_window_state_t *out);
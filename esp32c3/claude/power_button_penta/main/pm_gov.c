@@ -0,0 +1,108 @@
+/**
+ * pm_gov.c
+ *
+ * Holds ESP_PM_CPU_FREQ_MAX and ESP_PM_NO_LIGHT_SLEEP for exactly as long
+ * as the dongle has work to do (pm_gov.h), so idle time is spent at the
+ * lowest frequency esp_pm is configured for, in light sleep between BLE
+ * events.  A wake request is handled at full speed, and no step of the
+ * key press waits for the chip to come out of light sleep first.
+ *
+ * esp_pm locks count recursively, so every begin/end takes and gives the
+ * locks themselves; the depth kept here only delimits a hold for the
+ * counters and the trace.
+ */
+
+#include "pm_gov.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "PM_GOV";
+
+static esp_pm_lock_handle_t cpu_lock;   /* NULL when PM is disabled */
+static esp_pm_lock_handle_t sleep_lock;
+
+static uint32_t depth;
+static int64_t  hold_start_us;
+static pm_gov_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static esp_pm_lock_handle_t make_lock(esp_pm_lock_type_t type,
+                                      const char *name)
+{
+    esp_pm_lock_handle_t h;
+    esp_err_t err = esp_pm_lock_create(type, 0, name, &h);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "PM lock %s unavailable: %s", name,
+                 esp_err_to_name(err));
+        return NULL;
+    }
+    return h;
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void pm_gov_init(void)
+{
+    cpu_lock   = make_lock(ESP_PM_CPU_FREQ_MAX, "wake_cpu");
+    sleep_lock = make_lock(ESP_PM_NO_LIGHT_SLEEP, "wake_nls");
+}
+
+void pm_gov_begin(void)
+{
+    if (cpu_lock) {
+        esp_pm_lock_acquire(cpu_lock);
+    }
+    if (sleep_lock) {
+        esp_pm_lock_acquire(sleep_lock);
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    if (depth++ == 0) {
+        hold_start_us = esp_timer_get_time();
+        stats.active = true;
+        stats.holds++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void pm_gov_end(void)
+{
+    uint32_t ms = 0;
+    uint32_t holds = 0;
+    bool released = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    if (depth > 0 && --depth == 0) {
+        ms = (uint32_t)((esp_timer_get_time() - hold_start_us) / 1000);
+        stats.active   = false;
+        stats.held_ms += ms;
+        stats.last_ms  = ms;
+        if (ms > stats.max_ms) {
+            stats.max_ms = ms;
+        }
+        holds    = stats.holds;
+        released = true;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (sleep_lock) {
+        esp_pm_lock_release(sleep_lock);
+    }
+    if (cpu_lock) {
+        esp_pm_lock_release(cpu_lock);
+    }
+    if (released) {
+        trace_log(TRACE_EVT_PM_HOLD, (uint16_t)holds, ms);
+    }
+}
+
+void pm_gov_get_stats(pm_gov_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
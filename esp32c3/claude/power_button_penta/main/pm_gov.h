@@ -0,0 +1,42 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Workload-aware PM governor.
+ *
+ * Outside a transaction nothing here holds a PM lock, so esp_pm runs the
+ * CPU at pm_min_mhz (tuning.h) and light-sleeps between radio events.
+ * Between pm_gov_begin() and the matching pm_gov_end() the CPU runs at
+ * pm_max_mhz and light sleep is held off.  The dispatcher brackets every
+ * command with them.  Calls nest: the locks go once the outermost
+ * transaction ends.
+ *
+ * A long wait inside a transaction that needs neither speed nor a quick
+ * wake-up (a host booting after PWR_SW, a DELAY opcode) gives the locks
+ * back with pm_gov_end() and takes them again with pm_gov_begin().
+ */
+
+/** Running totals; one hold runs from the outermost begin to its end. */
+typedef struct {
+    bool     active;            /* locks held right now                    */
+    uint32_t holds;             /* times the locks were taken              */
+    uint32_t held_ms;           /* total time held                         */
+    uint32_t max_ms;            /* longest single hold                     */
+    uint32_t last_ms;           /* most recent hold                        */
+} pm_gov_stats_t;
+
+/**
+ * Create the PM locks.  Call before wake_dispatch_init(); without
+ * CONFIG_PM_ENABLE the governor only counts.
+ */
+void pm_gov_init(void);
+
+/** Enter a transaction.  Any task; not from ISRs. */
+void pm_gov_begin(void);
+
+/** Leave the transaction entered with pm_gov_begin(). */
+void pm_gov_end(void);
+
+/** Copy the counters into *out. */
+void pm_gov_get_stats(pm_gov_stats_t *out);
@@ -0,0 +1,202 @@
+/**
+ * power_stats.c
+ *
+ * On-device power accounting, so "Light sleep enabled" in the log can be
+ * backed by numbers:
+ *
+ *   - actual light-sleep time and entries, and the wake-up cause of every
+ *     exit, from the esp_pm light-sleep callbacks;
+ *   - time per esp_pm mode (≈ CPU frequency residency) and the PM locks
+ *     that were held longest, parsed from esp_pm_dump_locks() – the only
+ *     interface esp_pm offers for its profiling data;
+ *   - per-task run time and stack high-water marks from
+ *     uxTaskGetSystemState(), to spot the task that keeps the chip awake
+ *     (e.g. a ticking usb_task).
+ *
+ * The callbacks only bump counters; everything else is collected when the
+ * stats characteristic is read.
+ */
+
+#include "power_stats.h"
+
+#include "esp_attr.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DUMP_BUF_LEN        1536
+#define MAX_TASKS_SCANNED   20
+
+static const char *const mode_names[PWR_MODE_COUNT] = {
+    [PWR_MODE_SLEEP]   = "SLEEP",
+    [PWR_MODE_APB_MIN] = "APB_MIN",
+    [PWR_MODE_APB_MAX] = "APB_MAX",
+    [PWR_MODE_CPU_MAX] = "CPU_MAX",
+};
+
+/* Written from the light-sleep exit callback, which runs with interrupts
+ * off on this single-core chip; readers take the spinlock to get the same. */
+static uint64_t sleep_us;
+static uint32_t sleep_entries;
+static uint32_t wakeups[PWR_WAKE_COUNT];
+static portMUX_TYPE counters_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Only used from power_stats_get(), i.e. the BLE task reading stats */
+static char dump_buf[DUMP_BUF_LEN];
+static TaskStatus_t task_buf[MAX_TASKS_SCANNED];
+
+/* ── Light-sleep callback ────────────────────────────────────────────────── */
+static esp_err_t IRAM_ATTR on_sleep_exit(int64_t slept_us, void *arg)
+{
+    (void)arg;
+    power_wake_src_t src;
+
+    switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_TIMER: src = PWR_WAKE_TIMER; break;
+    case ESP_SLEEP_WAKEUP_BT:    src = PWR_WAKE_BT;    break;
+    case ESP_SLEEP_WAKEUP_GPIO:  src = PWR_WAKE_GPIO;  break;
+    case ESP_SLEEP_WAKEUP_UART:  src = PWR_WAKE_UART;  break;
+    default:                     src = PWR_WAKE_OTHER; break;
+    }
+    sleep_us += (uint64_t)slept_us;
+    sleep_entries++;
+    wakeups[src]++;
+    return ESP_OK;
+}
+
+/* ── esp_pm_dump_locks() parser ──────────────────────────────────────────── */
+static void copy_name(char dst[POWER_NAME_LEN], const char *src)
+{
+    memset(dst, 0, POWER_NAME_LEN);
+    strncpy(dst, src, POWER_NAME_LEN);
+}
+
+/* Keep the POWER_MAX_LOCKS locks with the longest total hold time */
+static void add_lock(power_stats_t *out, const char *name, int active,
+                     unsigned long taken, long long held_us)
+{
+    power_lock_info_t info = {
+        .active  = (uint8_t)active,
+        .taken   = (uint32_t)taken,
+        .held_ms = (uint32_t)(held_us / 1000),
+    };
+    copy_name(info.name, name);
+
+    int pos = out->n_locks;
+    if (pos == POWER_MAX_LOCKS) {
+        if (info.held_ms <= out->lock[pos - 1].held_ms) {
+            return;
+        }
+        pos--;
+    } else {
+        out->n_locks++;
+    }
+    while (pos > 0 && out->lock[pos - 1].held_ms < info.held_ms) {
+        out->lock[pos] = out->lock[pos - 1];
+        pos--;
+    }
+    out->lock[pos] = info;
+}
+
+/*
+ * The dump is two tables:
+ *   Lock stats:  name type arg active total_count time_us time_%
+ *   Mode stats:  mode cpu_freq(M) time_us time_%
+ * Header lines and anything unexpected simply fail to scan.
+ */
+static void collect_pm(power_stats_t *out)
+{
+    FILE *f = fmemopen(dump_buf, sizeof(dump_buf), "w");
+    if (f == NULL) {
+        return;
+    }
+    esp_pm_dump_locks(f);
+    fclose(f);
+    dump_buf[sizeof(dump_buf) - 1] = '\0';     /* a truncated dump is fine */
+
+    bool in_modes = false;
+    char *save;
+    for (char *line = strtok_r(dump_buf, "\n", &save); line != NULL;
+         line = strtok_r(NULL, "\n", &save)) {
+        char name[16], type[16];
+        int arg, active;
+        unsigned long taken;
+        unsigned freq;
+        long long time_us;
+
+        if (strstr(line, "Mode stats") != NULL) {
+            in_modes = true;
+        } else if (!in_modes) {
+            if (sscanf(line, " %15s %15s %d %d %lu %lld", name, type, &arg,
+                       &active, &taken, &time_us) == 6) {
+                add_lock(out, name, active, taken, time_us);
+            }
+        } else if (sscanf(line, " %15s %u%*[M ] %lld",
+                          name, &freq, &time_us) == 3) {
+            for (int m = 0; m < PWR_MODE_COUNT; m++) {
+                if (strcmp(name, mode_names[m]) == 0) {
+                    out->mode[m].freq_mhz = (uint16_t)freq;
+                    out->mode[m].time_ms  = (uint32_t)(time_us / 1000);
+                }
+            }
+        }
+    }
+}
+
+/* ── Task run time ───────────────────────────────────────────────────────── */
+static void collect_tasks(power_stats_t *out)
+{
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    UBaseType_t n = uxTaskGetSystemState(task_buf, MAX_TASKS_SCANNED, &total);
+
+    out->runtime_total = (uint32_t)total;
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &task_buf[i];
+        int pos = out->n_tasks;
+
+        if (pos == POWER_MAX_TASKS) {
+            if (t->ulRunTimeCounter <= out->task[pos - 1].runtime) {
+                continue;
+            }
+            pos--;
+        } else {
+            out->n_tasks++;
+        }
+        while (pos > 0 && out->task[pos - 1].runtime < t->ulRunTimeCounter) {
+            out->task[pos] = out->task[pos - 1];
+            pos--;
+        }
+        copy_name(out->task[pos].name, t->pcTaskName);
+        out->task[pos].runtime    = (uint32_t)t->ulRunTimeCounter;
+        out->task[pos].stack_free = (uint16_t)t->usStackHighWaterMark;
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void power_stats_init(void)
+{
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = on_sleep_exit,
+    };
+    ESP_ERROR_CHECK(esp_pm_light_sleep_register_cbs(&cbs));
+}
+
+void power_stats_get(power_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+
+    portENTER_CRITICAL(&counters_lock);
+    out->sleep_ms      = (uint32_t)(sleep_us / 1000);
+    out->sleep_entries = sleep_entries;
+    memcpy(out->wakeups, wakeups, sizeof(wakeups));
+    portEXIT_CRITICAL(&counters_lock);
+
+    out->uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    collect_pm(out);
+    collect_tasks(out);
+}
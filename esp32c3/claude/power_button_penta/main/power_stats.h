@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+
+/** Why the chip left light sleep (esp_sleep_get_wakeup_cause()). */
+typedef enum {
+    PWR_WAKE_TIMER = 0,     /* FreeRTOS tick / esp_timer deadline      */
+    PWR_WAKE_BT,            /* BLE controller event                    */
+    PWR_WAKE_GPIO,          /* GPIO (USB bus activity, BOOT pin, …)    */
+    PWR_WAKE_UART,
+    PWR_WAKE_OTHER,
+    PWR_WAKE_COUNT,
+} power_wake_src_t;
+
+/** esp_pm modes, as listed by esp_pm_dump_locks(). */
+typedef enum {
+    PWR_MODE_SLEEP = 0,     /* light sleep allowed                     */
+    PWR_MODE_APB_MIN,
+    PWR_MODE_APB_MAX,
+    PWR_MODE_CPU_MAX,
+    PWR_MODE_COUNT,
+} power_mode_t;
+
+#define POWER_NAME_LEN      8     /* names are truncated, NUL-padded */
+#define POWER_MAX_LOCKS     5     /* longest-held PM locks reported  */
+#define POWER_MAX_TASKS     6     /* busiest tasks reported          */
+
+typedef struct {
+    uint16_t freq_mhz;
+    uint32_t time_ms;
+} power_mode_residency_t;
+
+typedef struct {
+    char     name[POWER_NAME_LEN];
+    uint8_t  active;            /* currently held                  */
+    uint32_t taken;             /* times acquired since boot       */
+    uint32_t held_ms;           /* total time held                 */
+} power_lock_info_t;
+
+typedef struct {
+    char     name[POWER_NAME_LEN];
+    uint32_t runtime;           /* run-time counter ticks          */
+    uint16_t stack_free;        /* high-water mark, bytes          */
+} power_task_info_t;
+
+typedef struct {
+    uint32_t uptime_ms;
+    uint32_t sleep_ms;          /* time actually spent in light sleep */
+    uint32_t sleep_entries;
+    uint32_t wakeups[PWR_WAKE_COUNT];
+    power_mode_residency_t mode[PWR_MODE_COUNT];
+
+    uint8_t           n_locks;
+    power_lock_info_t lock[POWER_MAX_LOCKS];
+
+    uint32_t          runtime_total;    /* sum over all tasks, same ticks */
+    uint8_t           n_tasks;
+    power_task_info_t task[POWER_MAX_TASKS];
+} power_stats_t;
+
+/**
+ * Register the light-sleep callbacks that count sleep time and wake-up
+ * causes.  Only built with CONFIG_PENTA_POWER_STATS; call after
+ * esp_pm_configure().
+ */
+void power_stats_init(void);
+
+/**
+ * Take a snapshot: sleep counters, plus mode residency and the busiest
+ * PM locks parsed from esp_pm_dump_locks(), plus the busiest tasks from
+ * uxTaskGetSystemState().  Formats text internally – several hundred µs,
+ * so only call it when the stats characteristic is read.
+ */
+void power_stats_get(power_stats_t *out);
@@ -0,0 +1,423 @@
+/**
+ * proximity_wake.c
+ *
+ * Pre-wake on approach.  Resuming the Penta from S3 takes seconds of GPU
+ * re-initialisation, usually spent standing next to it.  If the dongle
+ * notices a registered phone or watch coming close, it can start the
+ * resume before anyone asks for it.
+ *
+ * Phones advertise with resolvable private addresses that change every few
+ * minutes.  Each one is checked against the IRKs of the bonded peers:
+ *
+ *   prand = addr[0..2], hash = addr[3..5]  (MSB first, top bits of prand 01)
+ *   match if  AES-128(IRK, 0^13 | prand) ends in hash   (Core spec "ah")
+ *
+ * The AES runs once per new address.  An address that resolved is
+ * remembered per device, one that did not goes into a small miss cache,
+ * so a steady advertiser costs a memcmp per report.
+ *
+ * Scan duty cycle, on the scan shared with beacon wake (scan_sched.c):
+ *
+ *   SPARSE ──(any sighting)──▶ DENSE ──(nobody heard for linger)──▶ SPARSE
+ *
+ * SPARSE leaves the controller's duplicate filter on, so a crowd of
+ * strangers costs next to nothing; DENSE passes every report through to
+ * follow the RSSI.  RSSI is smoothed per device with an exponential
+ * average (weight 1/4).  The pre-wake goes to the dispatcher like a
+ * beacon wake, and only while the host is suspended.
+ *
+ * Report handling never blocks the BLE stack: the switch to DENSE and the
+ * linger timer are pended to the FreeRTOS timer task, as beacon wake does
+ * with its counter.
+ */
+
+#include "proximity_wake.h"
+#include "ble_server.h"
+#include "scan_sched.h"
+#include "host_state.h"
+#include "wake_dispatch.h"
+#include "conn_table.h"
+#include "latency.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/aes.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+static const char *TAG = "PROX";
+
+#define MAX_DEVICES             8       /* MAX_FILTER_PEERS of the backends */
+#define MISS_CACHE              8
+#define SMOOTH_SHIFT            2       /* new sample weighs 1/4 */
+
+#define SPARSE_ITVL     SCAN_MS_TO_UNITS(CONFIG_PENTA_PROX_SPARSE_INTERVAL_MS)
+#define SPARSE_WINDOW   SCAN_MS_TO_UNITS(CONFIG_PENTA_PROX_SPARSE_WINDOW_MS)
+#define DENSE_ITVL      SCAN_MS_TO_UNITS(CONFIG_PENTA_PROX_DENSE_INTERVAL_MS)
+#define DENSE_WINDOW    SCAN_MS_TO_UNITS(CONFIG_PENTA_PROX_DENSE_WINDOW_MS)
+#define HOLD_US         ((int64_t)CONFIG_PENTA_PROX_HOLD_MS * 1000)
+#define LINGER_US       ((int64_t)CONFIG_PENTA_PROX_LINGER_S * 1000000)
+#define REARM_DBM       (CONFIG_PENTA_PROX_RSSI_DBM - \
+                         CONFIG_PENTA_PROX_HYSTERESIS_DB)
+
+typedef struct {
+    ble_server_peer_id_t id;
+    uint8_t  rpa[6];            /* last private address resolved to it   */
+    bool     rpa_valid;
+    bool     seen;              /* heard within the linger time          */
+    bool     armed;
+    int16_t  rssi_x16;          /* smoothed RSSI, dBm × 16               */
+    int64_t  above_since_us;    /* at or above the threshold since, 0 = not */
+    int64_t  last_seen_us;
+} device_t;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+/* Serialises reloads and scan requests, so the last request pushed always
+ * matches the state it was made for */
+static SemaphoreHandle_t update_lock;
+static StaticSemaphore_t update_lock_buf;
+static esp_timer_handle_t linger_timer;
+
+/* Under lock */
+static device_t devices[MAX_DEVICES];
+static int      n_devices;
+static uint32_t generation;     /* bumped by every reload */
+static uint8_t  misses[MISS_CACHE][6];
+static int      n_misses, next_miss;
+static bool     dense;
+static proximity_wake_state_t stats;
+
+/* ── Address resolution ──────────────────────────────────────────────────── */
+static bool is_rpa(const uint8_t *addr)
+{
+    return (addr[0] & 0xC0) == 0x40;
+}
+
+static bool rpa_matches(const uint8_t irk[16], const uint8_t *addr)
+{
+    uint8_t key[16], in[16] = { 0 }, out[16];
+    mbedtls_aes_context aes;
+    bool match = false;
+
+    /* Keys travel LSB first in pairing; e() takes them MSB first */
+    for (int i = 0; i < 16; i++) {
+        key[i] = irk[15 - i];
+    }
+    memcpy(&in[13], addr, 3);
+
+    mbedtls_aes_init(&aes);
+    if (mbedtls_aes_setkey_enc(&aes, key, 128) == 0 &&
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, in, out) == 0) {
+        match = memcmp(&out[13], &addr[3], 3) == 0;
+    }
+    mbedtls_aes_free(&aes);
+    return match;
+}
+
+/* Index of the registered device that sent from addr, or -1; *gen is the
+ * table generation the index belongs to */
+static int match(const uint8_t *addr, uint32_t *gen)
+{
+    uint8_t  irks[MAX_DEVICES][16];
+    bool     has_irk[MAX_DEVICES];
+    int      n;
+
+    portENTER_CRITICAL(&lock);
+    *gen = generation;
+    for (int i = 0; i < n_devices; i++) {
+        if (memcmp(devices[i].id.addr, addr, 6) == 0 ||
+            (devices[i].rpa_valid && memcmp(devices[i].rpa, addr, 6) == 0)) {
+            portEXIT_CRITICAL(&lock);
+            return i;
+        }
+    }
+    bool known_miss = !is_rpa(addr);
+    for (int i = 0; i < n_misses && !known_miss; i++) {
+        known_miss = memcmp(misses[i], addr, 6) == 0;
+    }
+    n = known_miss ? 0 : n_devices;
+    for (int i = 0; i < n; i++) {
+        has_irk[i] = devices[i].id.has_irk;
+        memcpy(irks[i], devices[i].id.irk, 16);
+    }
+    portEXIT_CRITICAL(&lock);
+
+    /* AES outside the spinlock, on a copy of the keys */
+    int found = -1;
+    for (int i = 0; i < n && found < 0; i++) {
+        if (has_irk[i] && rpa_matches(irks[i], addr)) {
+            found = i;
+        }
+    }
+    if (n == 0) {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&lock);
+    stats.resolves++;
+    if (*gen != generation) {
+        found = -1;             /* table reloaded meanwhile; next report */
+    } else if (found >= 0) {
+        memcpy(devices[found].rpa, addr, 6);
+        devices[found].rpa_valid = true;
+    } else {
+        memcpy(misses[next_miss], addr, 6);
+        next_miss = (next_miss + 1) % MISS_CACHE;
+        if (n_misses < MISS_CACHE) {
+            n_misses++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
+
+/* ── Scan duty cycle ─────────────────────────────────────────────────────── */
+static void on_adv_report(const uint8_t *addr, int8_t rssi,
+                          const uint8_t *data, uint8_t len);
+
+/* Caller holds update_lock.  No devices, no scan.  Task context. */
+static void request_scan(void)
+{
+    portENTER_CRITICAL(&lock);
+    bool dense_scan = dense;
+    int  n = n_devices;
+    portEXIT_CRITICAL(&lock);
+
+    if (n == 0) {
+        scan_sched_release(SCAN_CLIENT_PROXIMITY);
+    } else if (dense_scan) {
+        scan_sched_request(SCAN_CLIENT_PROXIMITY, DENSE_ITVL, DENSE_WINDOW,
+                           true, on_adv_report);
+    } else {
+        scan_sched_request(SCAN_CLIENT_PROXIMITY, SPARSE_ITVL, SPARSE_WINDOW,
+                           false, on_adv_report);
+    }
+    trace_log(TRACE_EVT_PROX_SCAN, dense_scan, (uint32_t)n);
+}
+
+static void push_scan(void)
+{
+    xSemaphoreTake(update_lock, portMAX_DELAY);
+    request_scan();
+    xSemaphoreGive(update_lock);
+}
+
+/* Caller holds lock */
+static void forget(device_t *d)
+{
+    d->seen           = false;
+    d->armed          = true;
+    d->above_since_us = 0;
+}
+
+/* esp_timer task: devices unheard for the linger time are gone and armed
+ * again; with none left the scan goes sparse */
+static void linger_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next_us = 0;
+    bool    sparse = false;
+
+    (void)arg;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < n_devices; i++) {
+        device_t *d = &devices[i];
+        if (!d->seen) {
+            continue;
+        }
+        int64_t left = d->last_seen_us + LINGER_US - now;
+        if (left <= 0) {
+            forget(d);
+        } else if (next_us == 0 || left < next_us) {
+            next_us = left;
+        }
+    }
+    if (next_us == 0 && dense) {
+        dense  = false;
+        sparse = true;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (next_us > 0) {
+        esp_timer_start_once(linger_timer, next_us);
+    }
+    if (sparse) {
+        push_scan();
+    }
+}
+
+/* Timer task, pended by the first sighting */
+static void go_dense(void *arg1, uint32_t arg2)
+{
+    (void)arg1; (void)arg2;
+    esp_timer_stop(linger_timer);
+    esp_timer_start_once(linger_timer, LINGER_US);
+    push_scan();
+}
+
+/* ── Advertising reports (BLE stack context) ─────────────────────────────── */
+static void pre_wake(int idx, int rssi)
+{
+    bool asleep = host_state_get() == HOST_STATE_SUSPENDED;
+
+    portENTER_CRITICAL(&lock);
+    if (asleep) {
+        stats.prewakes++;
+    } else {
+        stats.skipped++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    trace_log(TRACE_EVT_PREWAKE, (uint16_t)(idx | (!asleep) << 8),
+              (uint32_t)(int32_t)rssi);
+    if (!asleep) {
+        return;         /* already up, or off: not ours to power on */
+    }
+    latency_mark(LAT_STAGE_GATT_WRITE);     /* request received */
+    if (!wake_dispatch_post(CONN_TABLE_NONE, WAKE_CMD_WAKE)) {
+        ESP_LOGW(TAG, "Wake queue full – pre-wake dropped");
+    }
+}
+
+static void on_adv_report(const uint8_t *addr, int8_t rssi,
+                          const uint8_t *data, uint8_t len)
+{
+    (void)data; (void)len;
+
+    uint32_t gen;
+    int idx = rssi == 127 ? -1 : match(addr, &gen);    /* 127: no RSSI */
+    if (idx < 0) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    bool alert = false, trigger = false;
+    int  smoothed;
+
+    portENTER_CRITICAL(&lock);
+    if (gen != generation) {
+        portEXIT_CRITICAL(&lock);
+        return;                 /* table reloaded since the match */
+    }
+    device_t *d = &devices[idx];
+    if (!d->seen) {
+        d->seen     = true;
+        d->rssi_x16 = (int16_t)(rssi * 16);
+    } else {
+        d->rssi_x16 += (int16_t)((rssi * 16 - d->rssi_x16) >> SMOOTH_SHIFT);
+    }
+    d->last_seen_us = now;
+    smoothed = d->rssi_x16 / 16;
+
+    if (smoothed >= CONFIG_PENTA_PROX_RSSI_DBM) {
+        if (d->above_since_us == 0) {
+            d->above_since_us = now;
+        }
+        if (d->armed && now - d->above_since_us >= HOLD_US) {
+            d->armed = false;
+            trigger  = true;
+        }
+    } else {
+        d->above_since_us = 0;
+        if (smoothed < REARM_DBM) {
+            d->armed = true;
+        }
+    }
+    if (!dense) {
+        dense = true;
+        alert = true;
+        stats.alerts++;
+    }
+    stats.sightings++;
+    portEXIT_CRITICAL(&lock);
+
+    if (alert && xTimerPendFunctionCall(go_dense, NULL, 0, 0) != pdPASS) {
+        portENTER_CRITICAL(&lock);
+        dense = false;          /* timer queue full; the next report retries */
+        stats.alerts--;
+        portEXIT_CRITICAL(&lock);
+    }
+    if (trigger) {
+        pre_wake(idx, smoothed);
+    }
+}
+
+/* ── Registered devices ──────────────────────────────────────────────────── */
+static void reload(void)
+{
+    /* Static: reloads are serialised by update_lock */
+    static ble_server_peer_id_t ids[MAX_DEVICES];
+    static device_t old[MAX_DEVICES];
+
+    xSemaphoreTake(update_lock, portMAX_DELAY);
+    int n = ble_server_get_peer_ids(ids, MAX_DEVICES);
+
+    portENTER_CRITICAL(&lock);
+    int n_old = n_devices;
+    memcpy(old, devices, sizeof(old));
+    for (int i = 0; i < n; i++) {
+        /* A device that stays registered keeps its RSSI and arming */
+        device_t *d = &devices[i];
+        *d = (device_t) { .id = ids[i], .armed = true };
+        for (int j = 0; j < n_old; j++) {
+            if (memcmp(old[j].id.addr, ids[i].addr, 6) == 0) {
+                *d    = old[j];
+                d->id = ids[i];
+            }
+        }
+    }
+    n_devices = n;
+    n_misses  = 0;              /* a new IRK may resolve them */
+    generation++;
+    if (n == 0) {
+        dense = false;          /* the next bond starts sparse */
+    }
+    portEXIT_CRITICAL(&lock);
+
+    request_scan();
+    xSemaphoreGive(update_lock);
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void proximity_wake_init(void)
+{
+    update_lock = xSemaphoreCreateMutexStatic(&update_lock_buf);
+
+    const esp_timer_create_args_t args = {
+        .callback = linger_cb,
+        .name     = "prox_linger",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &linger_timer));
+
+    reload();
+    ESP_LOGI(TAG, "%d registered device(s), pre-wake at %d dBm for %d ms",
+             n_devices, CONFIG_PENTA_PROX_RSSI_DBM, CONFIG_PENTA_PROX_HOLD_MS);
+}
+
+void proximity_wake_on_bonds(void)
+{
+    if (update_lock != NULL) {
+        reload();
+    }
+}
+
+void proximity_wake_get_state(proximity_wake_state_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    out->dense        = dense;
+    out->devices      = (uint8_t)n_devices;
+    out->armed        = 0;
+    out->nearest_rssi = INT8_MIN;
+    for (int i = 0; i < n_devices; i++) {
+        out->armed += devices[i].armed;
+        if (devices[i].seen && devices[i].rssi_x16 / 16 > out->nearest_rssi) {
+            out->nearest_rssi = (int8_t)(devices[i].rssi_x16 / 16);
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Snapshot of proximity wake, for monitoring. */
+typedef struct {
+    bool     dense;         /* a registered device was heard lately        */
+    uint8_t  devices;       /* registered (bonded) devices                 */
+    uint8_t  armed;         /* of those, ready to trigger a pre-wake       */
+    int8_t   nearest_rssi;  /* highest smoothed RSSI heard, INT8_MIN: none */
+    uint32_t sightings;     /* reports from a registered device            */
+    uint32_t resolves;      /* private addresses checked against the IRKs  */
+    uint32_t alerts;        /* sparse → dense scan switches                */
+    uint32_t prewakes;      /* wakes posted                                */
+    uint32_t skipped;       /* came close while the host was not asleep    */
+} proximity_wake_state_t;
+
+/**
+ * Pre-wake the host when a registered phone or watch comes close.
+ * Only built with CONFIG_PENTA_PROXIMITY_WAKE; call after
+ * scan_sched_init().
+ *
+ * Registered devices are the bonded peers (CONFIG_PENTA_BOND_FILTER):
+ * pair the phone once inside the pairing window.  Its advertisements are
+ * recognised by identity address or, for private addresses, with the IRK
+ * it handed over when bonding.
+ *
+ * While no registered device is heard the shared scan runs sparse, with
+ * repeats filtered in the controller.  The first sighting switches it
+ * dense with every report passed through, to follow the RSSI.  With the
+ * smoothed RSSI at or above CONFIG_PENTA_PROX_RSSI_DBM for
+ * CONFIG_PENTA_PROX_HOLD_MS, a sleeping host is woken.  A device then
+ * has to step back by CONFIG_PENTA_PROX_HYSTERESIS_DB, or go unheard for
+ * CONFIG_PENTA_PROX_LINGER_S, before it can trigger again, so a host put
+ * to sleep by someone sitting at it stays asleep.  Once no registered
+ * device has been heard for the linger time the scan goes sparse again.
+ */
+void proximity_wake_init(void);
+
+/** The bonded peers changed: reload them.  BLE stack context. */
+void proximity_wake_on_bonds(void);
+
+/** Copy the proximity state and counters into *out. */
+void proximity_wake_get_state(proximity_wake_state_t *out);
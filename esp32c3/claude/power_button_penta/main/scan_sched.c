@@ -0,0 +1,140 @@
+/**
+ * scan_sched.c
+ *
+ * One passive scan for every module that listens to advertisements.
+ *
+ * The controller runs a single scan, so beacon wake and proximity wake
+ * cannot each set their own interval and window.  Each of them states
+ * what it needs here; the scheduler merges the requests and pushes the
+ * result to the backend through ble_server_start_scan():
+ *
+ *   interval     the shortest one asked for, so no client waits longer
+ *                than it allowed for;
+ *   window       long enough for the highest duty cycle asked for;
+ *   all_reports  on if any client wants every report (RSSI tracking).
+ *
+ * Every report is handed to every client, which ignores what is not its
+ * own.  A parameter change restarts the scan in the backend, which also
+ * resets the controller's duplicate filter.
+ */
+
+#include "scan_sched.h"
+#include "ble_server.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+typedef struct {
+    bool     active;
+    bool     all_reports;
+    uint16_t interval;
+    uint16_t window;
+} request_t;
+
+static SemaphoreHandle_t lock;
+static StaticSemaphore_t lock_buf;
+static request_t requests[SCAN_CLIENT_COUNT];
+static ble_server_adv_report_cb_t volatile cbs[SCAN_CLIENT_COUNT];
+static scan_sched_state_t state;
+
+/* BLE stack context */
+static void on_adv_report(const uint8_t *addr, int8_t rssi,
+                          const uint8_t *data, uint8_t len)
+{
+    state.reports++;
+    for (int i = 0; i < SCAN_CLIENT_COUNT; i++) {
+        ble_server_adv_report_cb_t cb = cbs[i];
+        if (cb != NULL) {
+            cb(addr, rssi, data, len);
+        }
+    }
+}
+
+/* Caller holds the lock */
+static void apply(void)
+{
+    scan_sched_state_t next = { 0 };
+
+    for (int i = 0; i < SCAN_CLIENT_COUNT; i++) {
+        if (requests[i].active &&
+            (!next.active || requests[i].interval < next.interval)) {
+            next.interval = requests[i].interval;
+        }
+        next.active |= requests[i].active;
+    }
+    for (int i = 0; i < SCAN_CLIENT_COUNT; i++) {
+        if (!requests[i].active) {
+            continue;
+        }
+        /* Same duty cycle at the merged interval, rounded up */
+        uint32_t window = ((uint32_t)requests[i].window * next.interval +
+                           requests[i].interval - 1) / requests[i].interval;
+        if (window > next.window) {
+            next.window = (uint16_t)window;
+        }
+        next.all_reports |= requests[i].all_reports;
+    }
+    if (next.window > next.interval) {
+        next.window = next.interval;
+    }
+
+    if (next.active == state.active &&
+        (!next.active || (next.interval == state.interval &&
+                          next.window == state.window &&
+                          next.all_reports == state.all_reports))) {
+        return;
+    }
+    state.active      = next.active;
+    state.all_reports = next.all_reports;
+    state.interval    = next.interval;
+    state.window      = next.window;
+    state.changes++;
+
+    if (state.active) {
+        ble_server_start_scan(state.interval, state.window,
+                              state.all_reports, on_adv_report);
+    } else {
+        ble_server_stop_scan();
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void scan_sched_init(void)
+{
+    lock = xSemaphoreCreateMutexStatic(&lock_buf);
+}
+
+void scan_sched_request(scan_client_t who, uint16_t interval,
+                        uint16_t window, bool all_reports,
+                        ble_server_adv_report_cb_t cb)
+{
+    if (interval == 0) {
+        interval = 1;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    requests[who] = (request_t) {
+        .active      = true,
+        .all_reports = all_reports,
+        .interval    = interval,
+        .window      = window < interval ? window : interval,
+    };
+    cbs[who] = cb;
+    apply();
+    xSemaphoreGive(lock);
+}
+
+void scan_sched_release(scan_client_t who)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    requests[who].active = false;
+    cbs[who] = NULL;
+    apply();
+    xSemaphoreGive(lock);
+}
+
+void scan_sched_get_state(scan_sched_state_t *out)
+{
+    xSemaphoreTake(lock, portMAX_DELAY);
+    *out = state;
+    xSemaphoreGive(lock);
+}
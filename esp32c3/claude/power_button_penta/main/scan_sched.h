@@ -0,0 +1,48 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "ble_server.h"
+
+/** Modules sharing the passive scan. */
+typedef enum {
+    SCAN_CLIENT_BEACON = 0,     /* signed wake beacons (beacon_wake.h)     */
+    SCAN_CLIENT_PROXIMITY,      /* registered phones (proximity_wake.h)    */
+    SCAN_CLIENT_COUNT,
+} scan_client_t;
+
+/* ms → 0.625 ms scan units */
+#define SCAN_MS_TO_UNITS(ms)    ((uint16_t)((ms) * 8 / 5))
+
+/** Snapshot of the shared scan, for monitoring. */
+typedef struct {
+    bool     active;            /* scanning for at least one client        */
+    bool     all_reports;       /* controller duplicate filter off         */
+    uint16_t interval;          /* 0.625 ms units                          */
+    uint16_t window;
+    uint32_t changes;           /* parameter sets pushed to the backend    */
+    uint32_t reports;           /* advertising reports handed out          */
+} scan_sched_state_t;
+
+/** Create the lock.  Call after ble_server_init(), before the clients. */
+void scan_sched_init(void);
+
+/**
+ * Ask for a passive scan of at least window every interval (0.625 ms
+ * units) and have every advertising report passed to cb, in BLE stack
+ * context.  all_reports turns the controller's duplicate filter off, for
+ * clients that track RSSI rather than look for new payloads.
+ *
+ * A client calls this again to change its duty cycle.  The scan that
+ * runs serves every client: the shortest interval, with a window long
+ * enough for the highest duty cycle asked for.  Task context only: it
+ * takes a mutex, so a report callback that needs a change pends it.
+ */
+void scan_sched_request(scan_client_t who, uint16_t interval,
+                        uint16_t window, bool all_reports,
+                        ble_server_adv_report_cb_t cb);
+
+/** Withdraw a client; the scan stops once none is left. */
+void scan_sched_release(scan_client_t who);
+
+/** Copy the current scan parameters and counters into *out. */
+void scan_sched_get_state(scan_sched_state_t *out);
@@ -0,0 +1,472 @@
+/**
+ * stats.c
+ *
+ * Builds the stats characteristic payload from the counters each module
+ * keeps (see stats.h for the wire format).  Called by the BLE backend on a
+ * read; nothing here runs in the wake path.
+ */
+
+#include "stats.h"
+#include "latency.h"
+#include "wake_dispatch.h"
+#include "adv_sched.h"
+#include "adv_supervisor.h"
+#include "ble_server.h"
+#include "boot_time.h"
+#include "conn_policy.h"
+#include "conn_table.h"
+#include "mem_report.h"
+#include "pm_gov.h"
+#include "usb_hid.h"
+#include "wake_path.h"
+#include "sdkconfig.h"
+#if CONFIG_PENTA_POWER_STATS
+#include "power_stats.h"
+#endif
+#if CONFIG_PENTA_BOND_FILTER
+#include "pair_window.h"
+#endif
+#if CONFIG_PENTA_WAKE_AUTH
+#include "wake_auth.h"
+#endif
+#if CONFIG_PENTA_OTA
+#include "ota_update.h"
+#endif
+#if CONFIG_PENTA_TUNING
+#include "tuning.h"
+#endif
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+#include "scan_sched.h"
+#endif
+#if CONFIG_PENTA_PROXIMITY_WAKE
+#include "proximity_wake.h"
+#endif
+
+#include <string.h>
+
+typedef struct {
+    uint8_t *buf;
+    size_t   cap;
+    size_t   len;
+    size_t   sec_start;         /* offset of the open section's header */
+} writer_t;
+
+/* ── Little-endian writer ────────────────────────────────────────────────── */
+static void put(writer_t *w, const void *p, size_t n)
+{
+    if (w->len + n <= w->cap) {
+        memcpy(&w->buf[w->len], p, n);
+    }
+    w->len += n;                /* overflow detected in section_end() */
+}
+
+static void put_u8(writer_t *w, uint8_t v)   { put(w, &v, 1); }
+
+static void put_u16(writer_t *w, uint16_t v)
+{
+    uint8_t b[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    put(w, b, sizeof(b));
+}
+
+static void put_u32(writer_t *w, uint32_t v)
+{
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8),
+                     (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    put(w, b, sizeof(b));
+}
+
+static void section_begin(writer_t *w, stats_section_t id)
+{
+    w->sec_start = w->len;
+    put_u8(w, (uint8_t)id);
+    put_u8(w, 0);               /* length, patched in section_end() */
+}
+
+static void section_end(writer_t *w)
+{
+    size_t body = w->len - w->sec_start - 2;
+    if (w->len > w->cap || body > UINT8_MAX) {
+        w->len = w->sec_start;  /* drop a section that does not fit */
+        return;
+    }
+    w->buf[w->sec_start + 1] = (uint8_t)body;
+}
+
+/* ── Sections ────────────────────────────────────────────────────────────── */
+static void add_latency(writer_t *w)
+{
+    lat_summary_t lat;
+    latency_get_summary(&lat);
+
+    section_begin(w, STATS_SEC_LATENCY);
+    put_u32(w, lat.wakes);
+    for (int s = 0; s < LAT_STAGE_COUNT; s++) {
+        put_u16(w, lat.stage[s].samples);
+        put_u32(w, lat.stage[s].min_us);
+        put_u32(w, lat.stage[s].avg_us);
+        put_u32(w, lat.stage[s].p99_us);
+    }
+    section_end(w);
+}
+
+static void add_dispatch(writer_t *w)
+{
+    wake_dispatch_stats_t d;
+    wake_dispatch_get_stats(&d);
+
+    section_begin(w, STATS_SEC_DISPATCH);
+    put_u32(w, d.received);
+    put_u32(w, d.dropped);
+    put_u32(w, d.coalesced);
+    put_u32(w, d.executed);
+    put_u32(w, d.failed);
+    put_u32(w, (uint32_t)d.last_result);
+    section_end(w);
+}
+
+static void add_adv(writer_t *w)
+{
+    adv_sched_state_t a;
+    adv_sched_get_state(&a);
+
+    section_begin(w, STATS_SEC_ADV);
+    put_u8(w, (uint8_t)a.mode);
+    put_u16(w, a.itvl_min);
+    put_u16(w, a.itvl_max);
+    put_u32(w, a.transitions);
+    section_end(w);
+}
+
+static void add_usb(writer_t *w)
+{
+    usb_hid_stats_t u;
+    usb_hid_get_stats(&u);
+
+    section_begin(w, STATS_SEC_USB);
+    put_u32(w, u.task_wakeups);
+    put_u32(w, u.suspends);
+    put_u32(w, u.resumes);
+    put_u32(w, u.remote_wakeups);
+    put_u32(w, u.wakes_skipped);
+    section_end(w);
+}
+
+static void add_conn(writer_t *w)
+{
+    conn_policy_state_t c;
+    conn_policy_get_state(&c);
+
+    section_begin(w, STATS_SEC_CONN);
+    for (int i = 0; i < c.n_links; i++) {
+        put_u16(w, c.link[i].conn);
+        put_u8(w, (uint8_t)c.link[i].phase);
+        put_u16(w, c.link[i].interval);
+        put_u16(w, c.link[i].latency);
+        put_u16(w, c.link[i].timeout);
+        put_u16(w, c.link[i].updates);
+        put_u16(w, c.link[i].rejected);
+    }
+    section_end(w);
+}
+
+static void add_clients(writer_t *w)
+{
+    conn_table_state_t t;
+    conn_table_get_state(&t);
+
+    section_begin(w, STATS_SEC_CLIENTS);
+    for (int i = 0; i < t.n_links; i++) {
+        put_u16(w, t.link[i].conn);
+        put_u16(w, t.link[i].mtu);
+        put_u8(w, t.link[i].subs);
+        put_u32(w, t.link[i].writes);
+        put_u32(w, t.link[i].rejected);
+        put_u32(w, (uint32_t)t.link[i].last_result);
+    }
+    section_end(w);
+}
+
+#if CONFIG_PENTA_BOND_FILTER
+static void add_pairing(writer_t *w)
+{
+    pair_window_state_t p;
+    pair_window_get_state(&p);
+
+    section_begin(w, STATS_SEC_PAIRING);
+    put_u8(w, p.open);
+    put_u8(w, p.bonds);
+    put_u32(w, p.opened);
+    put_u32(w, p.bonded);
+    section_end(w);
+}
+#endif
+
+#if CONFIG_PENTA_WAKE_AUTH
+static void add_auth(writer_t *w)
+{
+    wake_auth_stats_t a;
+    wake_auth_get_stats(&a);
+
+    section_begin(w, STATS_SEC_AUTH);
+    put_u32(w, a.accepted);
+    put_u32(w, a.malformed);
+    put_u32(w, a.replayed);
+    put_u32(w, a.bad_tag);
+    put_u32(w, a.last_counter);
+    put_u32(w, a.reserved);
+    put_u32(w, a.nvs_writes);
+    put_u32(w, a.pend_errors);
+    put_u32(w, a.nvs_errors);
+    section_end(w);
+}
+#endif
+
+#if CONFIG_PENTA_OTA
+static void add_ota(writer_t *w)
+{
+    ota_update_stats_t o;
+    ota_update_get_stats(&o);
+
+    section_begin(w, STATS_SEC_OTA);
+    put_u8(w, o.state);
+    put_u32(w, o.sessions);
+    put_u32(w, o.completed);
+    put_u32(w, o.failed);
+    put_u32(w, o.naks);
+    put_u32(w, o.overruns);
+    put_u32(w, (uint32_t)o.last_err);
+    put_u32(w, o.last_bytes);
+    put_u32(w, o.last_ms);
+    section_end(w);
+}
+#endif
+
+#if CONFIG_PENTA_TUNING
+static void add_tuning(writer_t *w)
+{
+    tuning_stats_t t;
+    tuning_get_stats(&t);
+
+    section_begin(w, STATS_SEC_TUNING);
+    put_u8(w, t.pending);
+    put_u32(w, t.writes);
+    put_u32(w, t.rejected);
+    put_u32(w, t.changes);
+    put_u32(w, t.commits);
+    put_u32(w, t.commit_errors);
+    section_end(w);
+}
+#endif
+
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+static void add_scan(writer_t *w)
+{
+    scan_sched_state_t s;
+    scan_sched_get_state(&s);
+
+    section_begin(w, STATS_SEC_SCAN);
+    put_u8(w, s.active);
+    put_u8(w, s.all_reports);
+    put_u16(w, s.interval);
+    put_u16(w, s.window);
+    put_u32(w, s.changes);
+    put_u32(w, s.reports);
+    section_end(w);
+}
+#endif
+
+#if CONFIG_PENTA_PROXIMITY_WAKE
+static void add_proximity(writer_t *w)
+{
+    proximity_wake_state_t p;
+    proximity_wake_get_state(&p);
+
+    section_begin(w, STATS_SEC_PROXIMITY);
+    put_u8(w, p.dense);
+    put_u8(w, p.devices);
+    put_u8(w, p.armed);
+    put_u8(w, (uint8_t)p.nearest_rssi);
+    put_u32(w, p.sightings);
+    put_u32(w, p.resolves);
+    put_u32(w, p.alerts);
+    put_u32(w, p.prewakes);
+    put_u32(w, p.skipped);
+    section_end(w);
+}
+#endif
+
+static void add_wake_path(writer_t *w)
+{
+    wake_path_stats_t p;
+    wake_path_get_stats(&p);
+
+    section_begin(w, STATS_SEC_WAKE_PATH);
+    put_u8(w, p.last_path);
+    put_u32(w, p.guarded);
+    for (int i = 0; i < WAKE_PATH_COUNT; i++) {
+        put_u32(w, p.path[i].attempts);
+        put_u32(w, p.path[i].ok);
+        put_u32(w, p.path[i].fallbacks);
+        put_u16(w, p.path[i].avg_ms);
+        put_u16(w, p.path[i].max_ms);
+        put_u16(w, p.path[i].last_ms);
+        put_u32(w, (uint32_t)p.path[i].last_err);
+    }
+    section_end(w);
+}
+
+static void add_pm_gov(writer_t *w)
+{
+    pm_gov_stats_t g;
+    pm_gov_get_stats(&g);
+
+    section_begin(w, STATS_SEC_PM_GOV);
+    put_u8(w, g.active);
+    put_u32(w, g.holds);
+    put_u32(w, g.held_ms);
+    put_u32(w, g.max_ms);
+    put_u32(w, g.last_ms);
+    section_end(w);
+}
+
+static void add_boot(writer_t *w)
+{
+    boot_time_t b;
+    boot_time_get(&b);
+
+    section_begin(w, STATS_SEC_BOOT);
+    put_u8(w, b.reset_reason);
+    put_u16(w, b.target_ms);
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        put_u32(w, b.stage_us[i]);
+    }
+    section_end(w);
+}
+
+static void add_supervisor(writer_t *w)
+{
+    adv_supervisor_stats_t s;
+    adv_supervisor_get_stats(&s);
+
+    section_begin(w, STATS_SEC_ADV_SUP);
+    put_u32(w, s.checks);
+    put_u32(w, s.down);
+    put_u32(w, s.retries);
+    put_u32(w, s.recoveries);
+    put_u32(w, s.host_resets);
+    section_end(w);
+}
+
+static void add_radio(writer_t *w)
+{
+    ble_server_radio_t r;
+    ble_server_get_radio(&r);
+
+    section_begin(w, STATS_SEC_RADIO);
+    put_u8(w, r.ext_adv);
+    put_u8(w, r.adv_primary_phy);
+    put_u8(w, r.adv_secondary_phy);
+    put_u8(w, r.conn_phy_pref);
+    put_u8(w, r.last_tx_phy);
+    put_u8(w, r.last_rx_phy);
+    put_u16(w, r.phy_updates);
+    section_end(w);
+}
+
+static void add_memory(writer_t *w)
+{
+    mem_report_t m;
+    mem_report_get(&m);
+
+    section_begin(w, STATS_SEC_MEMORY);
+    put_u32(w, m.heap_free);
+    put_u32(w, m.heap_min);
+    put_u32(w, m.heap_largest);
+    for (int i = 0; i < m.n_tasks; i++) {
+        put(w, m.task[i].name, MEM_REPORT_NAME_LEN);
+        put_u16(w, m.task[i].stack_free);
+    }
+    section_end(w);
+}
+
+#if CONFIG_PENTA_POWER_STATS
+static void add_power(writer_t *w)
+{
+    static power_stats_t p;     /* ~250 bytes; keep it off the BLE stack */
+    power_stats_get(&p);
+
+    section_begin(w, STATS_SEC_POWER);
+    put_u32(w, p.uptime_ms);
+    put_u32(w, p.sleep_ms);
+    put_u32(w, p.sleep_entries);
+    for (int i = 0; i < PWR_WAKE_COUNT; i++) {
+        put_u32(w, p.wakeups[i]);
+    }
+    for (int m = 0; m < PWR_MODE_COUNT; m++) {
+        put_u16(w, p.mode[m].freq_mhz);
+        put_u32(w, p.mode[m].time_ms);
+    }
+    section_end(w);
+
+    section_begin(w, STATS_SEC_PM_LOCKS);
+    for (int i = 0; i < p.n_locks; i++) {
+        put(w, p.lock[i].name, POWER_NAME_LEN);
+        put_u8(w, p.lock[i].active);
+        put_u32(w, p.lock[i].taken);
+        put_u32(w, p.lock[i].held_ms);
+    }
+    section_end(w);
+
+    section_begin(w, STATS_SEC_TASKS);
+    put_u32(w, p.runtime_total);
+    for (int i = 0; i < p.n_tasks; i++) {
+        put(w, p.task[i].name, POWER_NAME_LEN);
+        put_u32(w, p.task[i].runtime);
+        put_u16(w, p.task[i].stack_free);
+    }
+    section_end(w);
+}
+#endif
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+size_t stats_build(uint8_t *buf, size_t cap)
+{
+    writer_t w = { .buf = buf, .cap = cap };
+
+    put_u8(&w, STATS_VERSION);
+    add_latency(&w);
+    add_dispatch(&w);
+    add_adv(&w);
+    add_usb(&w);
+    add_wake_path(&w);
+    add_pm_gov(&w);
+    add_conn(&w);
+    add_clients(&w);
+#if CONFIG_PENTA_BOND_FILTER
+    add_pairing(&w);
+#endif
+#if CONFIG_PENTA_WAKE_AUTH
+    add_auth(&w);
+#endif
+#if CONFIG_PENTA_OTA
+    add_ota(&w);
+#endif
+#if CONFIG_PENTA_TUNING
+    add_tuning(&w);
+#endif
+#if CONFIG_PENTA_BEACON_WAKE || CONFIG_PENTA_PROXIMITY_WAKE
+    add_scan(&w);
+#endif
+#if CONFIG_PENTA_PROXIMITY_WAKE
+    add_proximity(&w);
+#endif
+    add_boot(&w);
+    add_supervisor(&w);
+    add_radio(&w);
+    add_memory(&w);
+#if CONFIG_PENTA_POWER_STATS
+    add_power(&w);
+#endif
+
+    return w.len <= cap ? w.len : cap;
+}
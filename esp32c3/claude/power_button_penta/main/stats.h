@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Stats characteristic payload (0xFF02, READ).
+ *
+ *   version u8 (= STATS_VERSION)
+ *   then a sequence of sections:  id u8 | len u8 | body[len]
+ *
+ * All integers are little-endian.  Readers must skip unknown section IDs,
+ * so new sections can be appended without breaking older clients.
+ * python/penta_stats.py decodes every section listed here.
+ */
+#define STATS_VERSION           1
+#define STATS_MAX_LEN           512     /* ATT attribute value limit */
+
+typedef enum {
+    /* per stage (latency.h order): samples u16, min u32, avg u32, p99 u32;
+     * preceded by wakes u32 */
+    STATS_SEC_LATENCY   = 0x01,
+    /* received, dropped, coalesced, executed, failed u32; last_result i32 */
+    STATS_SEC_DISPATCH  = 0x02,
+    /* mode u8, itvl_min u16, itvl_max u16, transitions u32 */
+    STATS_SEC_ADV       = 0x03,
+    /* task_wakeups, suspends, resumes, remote_wakeups, wakes_skipped u32 */
+    STATS_SEC_USB       = 0x04,
+    /* CONFIG_PENTA_POWER_STATS only.  uptime_ms, sleep_ms, sleep_entries
+     * u32; wake-ups per power_wake_src_t u32; per power_mode_t freq_mhz u16,
+     * time_ms u32 */
+    STATS_SEC_POWER     = 0x05,
+    /* CONFIG_PENTA_POWER_STATS only.  per lock, longest held first:
+     * name[8], active u8, taken u32, held_ms u32 */
+    STATS_SEC_PM_LOCKS  = 0x06,
+    /* CONFIG_PENTA_POWER_STATS only.  runtime_total u32, then per task,
+     * busiest first: name[8], runtime u32, stack_free u16 */
+    STATS_SEC_TASKS     = 0x07,
+    /* per tracked link (conn_policy.h): conn u16, phase u8, interval u16,
+     * latency u16, timeout u16, updates u16, rejected u16 */
+    STATS_SEC_CONN      = 0x08,
+    /* CONFIG_PENTA_BOND_FILTER only.  open u8, bonds u8, opened u32,
+     * bonded u32 */
+    STATS_SEC_PAIRING   = 0x09,
+    /* heap_free, heap_min, heap_largest u32; per task (mem_report.h):
+     * name[8], stack_free u16 */
+    STATS_SEC_MEMORY    = 0x0A,
+    /* reset_reason u8, target_ms u16; per boot_stage_t µs since power-on
+     * u32 (0 = not reached) */
+    STATS_SEC_BOOT      = 0x0B,
+    /* checks, down, retries, recoveries, host_resets u32
+     * (adv_supervisor.h) */
+    STATS_SEC_ADV_SUP   = 0x0C,
+    /* ext_adv u8, adv_primary_phy u8, adv_secondary_phy u8,
+     * conn_phy_pref u8, last_tx_phy u8, last_rx_phy u8, phy_updates u16
+     * (ble_server.h; PHY 1 = 1M, 2 = 2M, 3 = Coded, 0 = unknown) */
+    STATS_SEC_RADIO     = 0x0D,
+    /* CONFIG_PENTA_WAKE_AUTH only.  accepted, malformed, replayed,
+     * bad_tag, last_counter, reserved, nvs_writes, pend_errors,
+     * nvs_errors u32 (wake_auth.h) */
+    STATS_SEC_AUTH      = 0x0E,
+    /* CONFIG_PENTA_OTA only.  state u8, sessions, completed, failed, naks,
+     * overruns u32, last_err i32, last_bytes, last_ms u32 (ota_update.h) */
+    STATS_SEC_OTA       = 0x0F,
+    /* last_path u8, guarded u32; per wake_path_t: attempts, ok, fallbacks
+     * u32, avg_ms, max_ms, last_ms u16, last_err i32 (wake_path.h) */
+    STATS_SEC_WAKE_PATH = 0x10,
+    /* CONFIG_PENTA_TUNING only.  pending u8, writes, rejected, changes,
+     * commits, commit_errors u32 (tuning.h) */
+    STATS_SEC_TUNING    = 0x11,
+    /* active u8, holds, held_ms, max_ms, last_ms u32 (pm_gov.h) */
+    STATS_SEC_PM_GOV    = 0x12,
+    /* per connected client (conn_table.h): conn u16, mtu u16, subs u8,
+     * writes u32, rejected u32, last_result i32 */
+    STATS_SEC_CLIENTS   = 0x13,
+    /* CONFIG_PENTA_BEACON_WAKE or _PROXIMITY_WAKE only.  active u8,
+     * all_reports u8, interval u16, window u16 (0.625 ms units), changes,
+     * reports u32 (scan_sched.h) */
+    STATS_SEC_SCAN      = 0x14,
+    /* CONFIG_PENTA_PROXIMITY_WAKE only.  dense u8, devices u8, armed u8,
+     * nearest_rssi i8 (-128 = none), sightings, resolves, alerts,
+     * prewakes, skipped u32 (proximity_wake.h) */
+    STATS_SEC_PROXIMITY = 0x15,
+} stats_section_t;
+
+/** Serialise a fresh snapshot into buf; returns the number of bytes used. */
+size_t stats_build(uint8_t *buf, size_t cap);
@@ -0,0 +1,191 @@
+/**
+ * trace.c
+ *
+ * Deferred binary trace.
+ *
+ * ESP_LOGI on the connect and wake paths formats a string and pushes it
+ * out of the UART while the BLE callback or the dispatcher waits, which is
+ * why sdkconfig.defaults runs at WARN.  Those call sites record an event ID
+ * and two integers here instead.  Nothing is formatted until someone asks:
+ * python/penta_trace.py over the trace characteristic, or the console dump
+ * of the previous run after a crash.
+ *
+ * The ring lives in RTC memory that the startup code does not clear, so a
+ * panic or watchdog reset keeps the records that led up to it.  A power-on
+ * reset, a ring of a different size or a bad header starts it afresh.
+ */
+
+#include "trace.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "TRACE";
+
+#define TRACE_LEN           CONFIG_PENTA_TRACE_ENTRIES
+#define TRACE_MAGIC         0x54524331u     /* "TRC1" */
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t  evt;
+    uint8_t  boot;
+    uint16_t a;
+    uint32_t b;
+} trace_entry_t;
+
+typedef struct {
+    uint32_t      magic;
+    uint16_t      len;          /* TRACE_LEN of the build that wrote it */
+    uint16_t      boot;         /* resets survived                      */
+    uint32_t      next_seq;
+    trace_entry_t entry[TRACE_LEN];
+} trace_ring_t;
+
+static RTC_NOINIT_ATTR trace_ring_t ring;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t cursor;
+
+static const char *const evt_name[] = {
+    [TRACE_EVT_BOOT]        = "boot",
+    [TRACE_EVT_CONNECT]     = "connect",
+    [TRACE_EVT_DISCONNECT]  = "disconnect",
+    [TRACE_EVT_ADV_START]   = "adv_start",
+    [TRACE_EVT_ADV_MODE]    = "adv_mode",
+    [TRACE_EVT_CONN_PHASE]  = "conn_phase",
+    [TRACE_EVT_WAKE_WRITE]  = "wake_write",
+    [TRACE_EVT_WAKE_REJECT] = "wake_reject",
+    [TRACE_EVT_WAKE_SENT]   = "wake_sent",
+    [TRACE_EVT_CMD_DONE]    = "cmd_done",
+    [TRACE_EVT_HOST_STATE]  = "host_state",
+    [TRACE_EVT_BONDED]      = "bonded",
+    [TRACE_EVT_ADV_FAILED]  = "adv_failed",
+    [TRACE_EVT_ADV_RETRY]   = "adv_retry",
+    [TRACE_EVT_ADV_RECOVER] = "adv_recover",
+    [TRACE_EVT_HOST_RESET]  = "host_reset",
+    [TRACE_EVT_PHY_UPDATE]  = "phy_update",
+};
+
+/* Sequence number of the oldest record still in the ring */
+static uint32_t oldest_seq(void)
+{
+    return ring.next_seq > TRACE_LEN ? ring.next_seq - TRACE_LEN : 0;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        p[i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/* ── Console dump ────────────────────────────────────────────────────────── */
+#if CONFIG_PENTA_TRACE_DUMP_AT_BOOT
+static bool abnormal_reset(esp_reset_reason_t r)
+{
+    return r == ESP_RST_PANIC || r == ESP_RST_INT_WDT ||
+           r == ESP_RST_TASK_WDT || r == ESP_RST_WDT ||
+           r == ESP_RST_BROWNOUT;
+}
+
+/* Runs before anything else is up, so plain reads without the lock */
+static void dump_previous_run(void)
+{
+    uint8_t prev = (uint8_t)(ring.boot - 1);
+
+    ESP_LOGW(TAG, "Records before the reset:");
+    for (uint32_t seq = oldest_seq(); seq != ring.next_seq; seq++) {
+        const trace_entry_t *e = &ring.entry[seq % TRACE_LEN];
+        if (e->boot != prev) {
+            continue;
+        }
+        const char *name = e->evt < sizeof(evt_name) / sizeof(evt_name[0]) &&
+                           evt_name[e->evt] ? evt_name[e->evt] : "?";
+        ESP_LOGW(TAG, "  %10u us  %-11s a=%u b=%d", (unsigned)e->time_us,
+                 name, e->a, (int)e->b);
+    }
+}
+#endif
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void trace_init(void)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+
+    if (reason == ESP_RST_POWERON || ring.magic != TRACE_MAGIC ||
+        ring.len != TRACE_LEN) {
+        memset(&ring, 0, sizeof(ring));
+        ring.magic = TRACE_MAGIC;
+        ring.len   = TRACE_LEN;
+    } else {
+        ring.boot++;
+#if CONFIG_PENTA_TRACE_DUMP_AT_BOOT
+        if (abnormal_reset(reason)) {
+            dump_previous_run();
+        }
+#endif
+    }
+    cursor = oldest_seq();
+    trace_log(TRACE_EVT_BOOT, (uint16_t)reason, 0);
+}
+
+void trace_log(trace_evt_t evt, uint16_t a, uint32_t b)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&lock);
+    trace_entry_t *e = &ring.entry[ring.next_seq % TRACE_LEN];
+    e->time_us = now;
+    e->evt     = (uint8_t)evt;
+    e->boot    = (uint8_t)ring.boot;
+    e->a       = a;
+    e->b       = b;
+    ring.next_seq++;
+    portEXIT_CRITICAL_SAFE(&lock);
+}
+
+void trace_set_cursor(uint32_t seq)
+{
+    cursor = seq;
+}
+
+size_t trace_build_value(uint8_t *buf, size_t cap)
+{
+    if (cap > TRACE_VALUE_MAX) {
+        cap = TRACE_VALUE_MAX;
+    }
+    if (cap < TRACE_VALUE_HDR_LEN) {
+        return 0;
+    }
+    size_t max = (cap - TRACE_VALUE_HDR_LEN) / TRACE_ENTRY_LEN;
+    size_t len = TRACE_VALUE_HDR_LEN;
+
+    portENTER_CRITICAL(&lock);
+    uint32_t first = cursor;
+    if (first < oldest_seq() || first > ring.next_seq) {
+        first = oldest_seq();
+    }
+    buf[0] = TRACE_VALUE_VERSION;
+    buf[1] = (uint8_t)ring.boot;
+    buf[2] = (uint8_t)(ring.boot >> 8);
+    put_u32(&buf[3], ring.next_seq);
+    put_u32(&buf[7], first);
+    for (uint32_t seq = first; seq != ring.next_seq && max > 0; seq++, max--) {
+        const trace_entry_t *e = &ring.entry[seq % TRACE_LEN];
+        uint8_t *p = &buf[len];
+        put_u32(&p[0], e->time_us);
+        p[4] = e->evt;
+        p[5] = e->boot;
+        p[6] = (uint8_t)e->a;
+        p[7] = (uint8_t)(e->a >> 8);
+        put_u32(&p[8], e->b);
+        len += TRACE_ENTRY_LEN;
+    }
+    portEXIT_CRITICAL(&lock);
+    return len;
+}
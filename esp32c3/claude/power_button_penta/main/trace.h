@@ -0,0 +1,83 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Trace events.  Each record is  evt | a u16 | b u32  plus a timestamp;
+ * the meaning of a and b is listed per event.  Append new IDs at the end:
+ * python/penta_trace.py names them by number.
+ */
+typedef enum {
+    TRACE_EVT_BOOT = 1,         /* a: esp_reset_reason_t                   */
+    TRACE_EVT_CONNECT,          /* a: conn                                 */
+    TRACE_EVT_DISCONNECT,       /* a: conn, b: HCI reason                  */
+    TRACE_EVT_ADV_START,        /* a: itvl_min (0.625 ms units)            */
+    TRACE_EVT_ADV_MODE,         /* a: adv_mode_t, b: itvl_min              */
+    TRACE_EVT_CONN_PHASE,       /* a: conn, b: conn_phase_t                */
+    TRACE_EVT_WAKE_WRITE,       /* a: conn, b: length                      */
+    TRACE_EVT_WAKE_REJECT,      /* a: conn, b: esp_err_t                   */
+    TRACE_EVT_WAKE_SENT,        /* a: trace_wake_t, b: esp_err_t           */
+    TRACE_EVT_CMD_DONE,         /* a: cmd | merged << 8, b: esp_err_t      */
+    TRACE_EVT_HOST_STATE,       /* a: host_state_t, b: transitions         */
+    TRACE_EVT_BONDED,           /* a: bonded peers now                     */
+    TRACE_EVT_ADV_FAILED,       /* b: backend error code                   */
+    TRACE_EVT_ADV_RETRY,        /* a: attempt, b: backoff ms               */
+    TRACE_EVT_ADV_RECOVER,      /* a: recoveries                           */
+    TRACE_EVT_HOST_RESET,       /* a: reason, b: host resets               */
+    TRACE_EVT_PHY_UPDATE,       /* a: conn, b: tx_phy | rx_phy << 8        */
+    TRACE_EVT_OTA_BEGIN,        /* a: conn, b: image size                  */
+    TRACE_EVT_OTA_NAK,          /* a: conn, b: offset expected             */
+    TRACE_EVT_OTA_END,          /* a: bytes per ms, b: esp_err_t           */
+    TRACE_EVT_OTA_CONFIRM,      /* a: 1 marked valid, 0 rolled back        */
+    TRACE_EVT_WAKE_PATH,        /* a: wake_path_t | failed << 8, b: ms     */
+    TRACE_EVT_TUNE_SET,         /* a: tune_id_t, b: new value              */
+    TRACE_EVT_TUNE_COMMIT,      /* a: parameters stored, b: esp_err_t      */
+    TRACE_EVT_PM_HOLD,          /* a: holds, b: ms the PM locks were held  */
+    TRACE_EVT_PROX_SCAN,        /* a: 1 dense, 0 sparse, b: devices        */
+    TRACE_EVT_PREWAKE,          /* a: device | skipped << 8, b: RSSI dBm   */
+} trace_evt_t;
+
+/** How TRACE_EVT_WAKE_SENT woke the host. */
+typedef enum {
+    TRACE_WAKE_KEY = 0,         /* Space key tap                           */
+    TRACE_WAKE_SYSTEM,          /* System Wake Up report                   */
+    TRACE_WAKE_SKIPPED,         /* host already awake, nothing sent        */
+    TRACE_WAKE_PWR_SW,          /* pulse on the PWR_SW header              */
+} trace_wake_t;
+
+/**
+ * Trace characteristic value (0xFF04, READ | WRITE):
+ *   version u8 | boot u16 | next_seq u32 | first_seq u32 |
+ *   entries, each  time_us u32 | evt u8 | boot u8 | a u16 | b u32
+ *
+ * Entries are consecutive, oldest first, from the cursor set by writing
+ * seq u32 (or from the oldest retained one if the cursor is older); as
+ * many as fit in one ATT read.  A reader advances the cursor to first_seq
+ * plus the entries it got until none come back.  boot counts resets that
+ * kept the ring, its low byte tags each entry; time_us restarts at every
+ * boot and wraps after 71 minutes.
+ */
+#define TRACE_VALUE_VERSION     1
+#define TRACE_VALUE_HDR_LEN     11
+#define TRACE_ENTRY_LEN         12
+#define TRACE_VALUE_MAX         125     /* one ATT read at MTU 128 */
+
+/**
+ * Set up the ring, keeping the previous run's records across a software,
+ * panic or watchdog reset (RTC memory), and log TRACE_EVT_BOOT.  Call
+ * right after boot_time_init().  With CONFIG_PENTA_TRACE_DUMP_AT_BOOT the
+ * previous run is printed on the console after an abnormal reset.
+ */
+void trace_init(void);
+
+/**
+ * Append one record.  A timestamp and a 12-byte copy under a spinlock: no
+ * formatting, no console, safe from any task or callback.
+ */
+void trace_log(trace_evt_t evt, uint16_t a, uint32_t b);
+
+/** Where the next trace_build_value() starts.  BLE stack context. */
+void trace_set_cursor(uint32_t seq);
+
+/** Serialise the characteristic value into buf; returns bytes used. */
+size_t trace_build_value(uint8_t *buf, size_t cap);
@@ -0,0 +1,426 @@
+/**
+ * tuning.c
+ *
+ * Runtime tuning parameters (see tuning.h).
+ *
+ * The table below is the only place a parameter's range and default live.
+ * Values are held in RAM; the modules read them with tuning_get() where
+ * they use them, and for those that cache a value or have already handed
+ * it to the stack (the advertising interval, a link's idle parameters,
+ * the PM limits) a change calls the module's refresh hook right away, so
+ * nothing needs a reboot.
+ *
+ * Writes never touch flash in the BLE callback.  Each applied change
+ * (re)starts a one-shot FreeRTOS timer; when the writes have been quiet
+ * for CONFIG_PENTA_TUNING_COMMIT_MS, or at the latest four times that
+ * after the first change, the timer task stores every parameter that
+ * differs from its default as one blob and commits once.  A burst of
+ * writes from a tuning session therefore costs one NVS write, and one
+ * that ends where it started costs none.  Keeping only the differences
+ * lets untouched parameters follow new defaults after an update.
+ */
+
+#include "tuning.h"
+#include "adv_sched.h"
+#include "conn_policy.h"
+#include "usb_hid.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "sdkconfig.h"
+#include <string.h>
+#if CONFIG_PENTA_TUNING
+#include "nvs.h"
+#endif
+
+static const char *TAG = "TUNING";
+
+#if CONFIG_PENTA_SYSTEM_WAKE
+#define DEFAULT_WAKE_REPORT     1
+#else
+#define DEFAULT_WAKE_REPORT     0
+#endif
+#define HID_KEY_SPACE_USAGE     0x2C
+#define ADV_ITVL_MIN            0x0020  /* 20 ms, the spec minimum */
+#define ADV_ITVL_MAX            0x4000  /* 10.24 s */
+
+typedef struct {
+    uint32_t def;
+    uint32_t min;
+    uint32_t max;
+    void   (*apply)(void);      /* re-applies a change; NULL = read at use */
+} param_t;
+
+static void apply_hold(void);
+static void apply_pm(void);
+
+#define ADV_PARAM(d)    { (d), ADV_ITVL_MIN, ADV_ITVL_MAX, adv_sched_refresh }
+
+static const param_t params[TUNE_COUNT] = {
+    [TUNE_WAKE_REPORT]       = { DEFAULT_WAKE_REPORT, 0, 1, NULL },
+    [TUNE_WAKE_KEY]          = { HID_KEY_SPACE_USAGE, 0x04, 0xE7, NULL },
+    [TUNE_HOLD_MS]           = { 20, 1, 1000, apply_hold },
+    [TUNE_ADV_FAST_MIN]      = ADV_PARAM(0x0020),
+    [TUNE_ADV_FAST_MAX]      = ADV_PARAM(0x0040),
+    [TUNE_ADV_MEDIUM_MIN]    = ADV_PARAM(0x00F4),
+    [TUNE_ADV_MEDIUM_MAX]    = ADV_PARAM(0x0152),
+    [TUNE_ADV_SLOW_MIN]      = ADV_PARAM(0x0320),
+    [TUNE_ADV_SLOW_MAX]      = ADV_PARAM(0x0640),
+    [TUNE_ADV_AWAKE_MIN]     = ADV_PARAM(0x0C80),
+    [TUNE_ADV_AWAKE_MAX]     = ADV_PARAM(0x0FA0),
+    [TUNE_ADV_BURST_S]       = { CONFIG_PENTA_ADV_FAST_BURST_S, 1, 600, NULL },
+    [TUNE_PM_MAX_MHZ]        = { 80, 80, 160, apply_pm },
+    [TUNE_PM_MIN_MHZ]        = { 10, 10, 80, apply_pm },
+    [TUNE_CONN_IDLE_AFTER_S] = { CONFIG_PENTA_CONN_IDLE_AFTER_S, 1, 3600,
+                                 conn_policy_refresh },
+    [TUNE_CONN_IDLE_ITVL_MS] = { CONFIG_PENTA_CONN_IDLE_INTERVAL_MS, 30, 3200,
+                                 conn_policy_refresh },
+    [TUNE_CONN_IDLE_LATENCY] = { CONFIG_PENTA_CONN_IDLE_LATENCY, 0, 30,
+                                 conn_policy_refresh },
+};
+
+static uint32_t values[TUNE_COUNT];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ── Validation ──────────────────────────────────────────────────────────── */
+static void load_defaults(uint32_t *v)
+{
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        v[i] = params[i].def;
+    }
+}
+
+#if CONFIG_PENTA_TUNING
+static bool pm_freq_ok(uint32_t max_mhz, uint32_t min_mhz)
+{
+    /* The CPU PLL gives 80 or 160 MHz; light sleep drops to the 40 MHz
+     * crystal or an integer divider of it */
+    return (max_mhz == 80 || max_mhz == 160) &&
+           (min_mhz == 10 || min_mhz == 20 || min_mhz == 40 ||
+            min_mhz == 80) &&
+           min_mhz <= max_mhz;
+}
+
+/* Limits between parameters, checked on the whole candidate set */
+static bool consistent(const uint32_t *v)
+{
+    for (int i = TUNE_ADV_FAST_MIN; i <= TUNE_ADV_AWAKE_MIN; i += 2) {
+        if (v[i] > v[i + 1]) {
+            return false;
+        }
+    }
+    return pm_freq_ok(v[TUNE_PM_MAX_MHZ], v[TUNE_PM_MIN_MHZ]);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+           (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* id u8 | value u32 pairs into v.  Strict for writes; the stored blob
+ * skips IDs and values this firmware does not know instead. */
+static esp_err_t parse(const uint8_t *data, size_t len, uint32_t *v,
+                       bool strict)
+{
+    if (len == 0 || len % TUNING_PAIR_LEN != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t off = 0; off < len; off += TUNING_PAIR_LEN) {
+        uint8_t  id    = data[off];
+        uint32_t value = get_u32(&data[off + 1]);
+
+        if (id >= TUNE_COUNT) {
+            if (strict) {
+                return ESP_ERR_NOT_FOUND;
+            }
+        } else if (value < params[id].min || value > params[id].max) {
+            if (strict) {
+                return ESP_ERR_INVALID_ARG;
+            }
+        } else {
+            v[id] = value;
+        }
+    }
+    return ESP_OK;
+}
+#endif
+
+/* ── Hooks ───────────────────────────────────────────────────────────────── */
+static void apply_hold(void)
+{
+    usb_hid_set_hold_ms((uint16_t)values[TUNE_HOLD_MS]);
+}
+
+static void apply_pm(void)
+{
+    esp_err_t err = tuning_configure_pm();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "PM limits not applied: %s", esp_err_to_name(err));
+    }
+}
+
+#if CONFIG_PENTA_TUNING
+/* ── Debounced commit ────────────────────────────────────────────────────── */
+#define COMMIT_MS               CONFIG_PENTA_TUNING_COMMIT_MS
+#define COMMIT_MAX_US           (4LL * COMMIT_MS * 1000)
+#define NVS_NAMESPACE           "penta"
+#define NVS_KEY_TUNING          "tuning"
+/* Room for the parameters of a newer image, after a downgrade */
+#define BLOB_MAX                (2 * TUNING_WRITE_MAX)
+
+static uint32_t committed[TUNE_COUNT];  /* what NVS holds; timer task */
+static TimerHandle_t commit_timer;
+static StaticTimer_t commit_timer_buf;
+static int64_t first_change_us;        /* -1: after a failed commit */
+static tuning_stats_t stats;
+
+/* Pairs for the parameters that differ from their default */
+static size_t encode_changed(const uint32_t *v, uint8_t *out)
+{
+    size_t len = 0;
+
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        if (v[i] != params[i].def) {
+            out[len++] = (uint8_t)i;
+            for (int b = 0; b < 4; b++) {
+                out[len++] = (uint8_t)(v[i] >> (8 * b));
+            }
+        }
+    }
+    return len;
+}
+
+/* Runs in the FreeRTOS timer task so the flash write never blocks the
+ * BLE stack */
+static void commit_cb(TimerHandle_t timer)
+{
+    (void)timer;
+    uint32_t snap[TUNE_COUNT];
+    uint8_t blob[TUNING_WRITE_MAX];
+
+    portENTER_CRITICAL(&lock);
+    memcpy(snap, values, sizeof(snap));
+    stats.pending = false;      /* a write from here on pends again */
+    portEXIT_CRITICAL(&lock);
+
+    if (memcmp(snap, committed, sizeof(snap)) == 0) {
+        return;                 /* changed and changed back */
+    }
+
+    size_t len = encode_changed(snap, blob);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        if (len > 0) {
+            err = nvs_set_blob(nvs, NVS_KEY_TUNING, blob, len);
+        } else {
+            err = nvs_erase_key(nvs, NVS_KEY_TUNING);
+            if (err == ESP_ERR_NVS_NOT_FOUND) {
+                err = ESP_OK;
+            }
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+
+    portENTER_CRITICAL(&lock);
+    if (err == ESP_OK) {
+        stats.commits++;
+    } else {
+        stats.commit_errors++;
+        /* The next write tries again, in a window of its own: against
+         * the old first change the cap would be past and the timer would
+         * never restart */
+        stats.pending   = true;
+        first_change_us = -1;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (err == ESP_OK) {
+        memcpy(committed, snap, sizeof(snap));
+    } else {
+        ESP_LOGW(TAG, "Commit failed: %s", esp_err_to_name(err));
+    }
+    trace_log(TRACE_EVT_TUNE_COMMIT, (uint16_t)(len / TUNING_PAIR_LEN),
+              (uint32_t)err);
+}
+
+/* Caller holds the lock.  Returns whether the timer should (re)start:
+ * past the cap it keeps its deadline, so a steady trickle of writes still
+ * reaches flash. */
+static bool mark_pending(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (!stats.pending || first_change_us < 0) {
+        stats.pending   = true;
+        first_change_us = now;
+    }
+    return now - first_change_us < COMMIT_MAX_US;
+}
+
+static void load_stored(void)
+{
+    uint8_t blob[BLOB_MAX];
+    size_t len = sizeof(blob);
+    nvs_handle_t nvs;
+
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    esp_err_t err = nvs_get_blob(nvs, NVS_KEY_TUNING, blob, &len);
+    nvs_close(nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return;
+    }
+
+    uint32_t cand[TUNE_COUNT];
+    load_defaults(cand);
+    if (err != ESP_OK || parse(blob, len, cand, false) != ESP_OK ||
+        !consistent(cand)) {
+        ESP_LOGW(TAG, "Stored tuning unusable, using the defaults");
+        return;
+    }
+    memcpy(values, cand, sizeof(values));
+    memcpy(committed, cand, sizeof(committed));
+    ESP_LOGI(TAG, "%u stored parameters", (unsigned)(len / TUNING_PAIR_LEN));
+}
+#endif /* CONFIG_PENTA_TUNING */
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void tuning_init(void)
+{
+    load_defaults(values);
+#if CONFIG_PENTA_TUNING
+    memcpy(committed, values, sizeof(committed));
+    load_stored();
+    commit_timer = xTimerCreateStatic("tune_commit", pdMS_TO_TICKS(COMMIT_MS),
+                                      pdFALSE, NULL, commit_cb,
+                                      &commit_timer_buf);
+#endif
+}
+
+uint32_t tuning_get(tune_id_t id)
+{
+    return values[id];
+}
+
+void tuning_get_pair(tune_id_t a, tune_id_t b, uint32_t *va, uint32_t *vb)
+{
+    portENTER_CRITICAL(&lock);
+    *va = values[a];
+    *vb = values[b];
+    portEXIT_CRITICAL(&lock);
+}
+
+esp_err_t tuning_configure_pm(void)
+{
+    uint32_t max_mhz, min_mhz;
+    tuning_get_pair(TUNE_PM_MAX_MHZ, TUNE_PM_MIN_MHZ, &max_mhz, &min_mhz);
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz       = (int)max_mhz,
+        .min_freq_mhz       = (int)min_mhz,
+        .light_sleep_enable = true,
+    };
+    return esp_pm_configure(&pm_config);
+}
+
+#if CONFIG_PENTA_TUNING
+esp_err_t tuning_handle_write(const uint8_t *data, size_t len)
+{
+    uint32_t cand[TUNE_COUNT];
+    esp_err_t err = ESP_OK;
+
+    if (len == 1 && data[0] == TUNING_OP_RESET) {
+        load_defaults(cand);
+    } else {
+        /* Only the BLE host task writes, so the copy cannot go stale */
+        memcpy(cand, values, sizeof(cand));
+        err = parse(data, len, cand, true);
+        if (err == ESP_OK && !consistent(cand)) {
+            err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    if (err != ESP_OK) {
+        portENTER_CRITICAL(&lock);
+        stats.rejected++;
+        portEXIT_CRITICAL(&lock);
+        return err;
+    }
+
+    bool changed[TUNE_COUNT];
+    bool restart = false;
+    uint32_t n = 0;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        changed[i] = cand[i] != values[i];
+        n += changed[i];
+    }
+    memcpy(values, cand, sizeof(values));
+    stats.writes++;
+    stats.changes += n;
+    if (n > 0) {
+        restart = mark_pending();
+    }
+    portEXIT_CRITICAL(&lock);
+    if (restart) {
+        xTimerReset(commit_timer, 0);
+    }
+
+    /* Each hook once, however many of its parameters changed */
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        if (!changed[i]) {
+            continue;
+        }
+        trace_log(TRACE_EVT_TUNE_SET, (uint16_t)i, values[i]);
+        bool done = params[i].apply == NULL;
+        for (int j = 0; j < i && !done; j++) {
+            done = changed[j] && params[j].apply == params[i].apply;
+        }
+        if (!done) {
+            params[i].apply();
+        }
+    }
+    return ESP_OK;
+}
+
+size_t tuning_build_value(uint8_t *buf, size_t cap)
+{
+    uint32_t snap[TUNE_COUNT];
+    bool pending;
+
+    if (cap < TUNING_VALUE_MAX) {
+        return 0;
+    }
+    portENTER_CRITICAL(&lock);
+    memcpy(snap, values, sizeof(snap));
+    pending = stats.pending;
+    portEXIT_CRITICAL(&lock);
+
+    size_t len = 0;
+    buf[len++] = TUNING_VALUE_VERSION;
+    buf[len++] = pending ? TUNING_FLAG_PENDING : 0;
+    for (int i = 0; i < TUNE_COUNT; i++) {
+        buf[len++] = (uint8_t)i;
+        for (int b = 0; b < 4; b++) {
+            buf[len++] = (uint8_t)(snap[i] >> (8 * b));
+        }
+    }
+    return len;
+}
+
+void tuning_get_stats(tuning_stats_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = stats;
+    portEXIT_CRITICAL(&lock);
+}
+#endif /* CONFIG_PENTA_TUNING */
@@ -0,0 +1,115 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Runtime tuning parameters.
+ *
+ * Values live in RAM and the modules read them where they use them, so a
+ * change takes effect without a reboot.  IDs are part of the wire format
+ * and of the stored blob: append new ones, never renumber.
+ *
+ *   id  name               range                  default
+ *    0  wake_report        0 key, 1 System Wake   CONFIG_PENTA_SYSTEM_WAKE
+ *    1  wake_key           HID usage 0x04–0xE7    0x2C (Space)
+ *    2  hold_ms            1–1000                 20
+ *    3  adv_fast_min       0x20–0x4000            0x20    (0.625 ms units,
+ *    4  adv_fast_max                              0x40     min ≤ max)
+ *    5  adv_medium_min                            0xF4
+ *    6  adv_medium_max                            0x152
+ *    7  adv_slow_min                              0x320
+ *    8  adv_slow_max                              0x640
+ *    9  adv_awake_min                             0xC80
+ *   10  adv_awake_max                             0xFA0
+ *   11  adv_burst_s        1–600                  CONFIG_PENTA_ADV_FAST_BURST_S
+ *   12  pm_max_mhz         80, 160                80
+ *   13  pm_min_mhz         10, 20, 40, 80 (≤ max) 10
+ *   14  conn_idle_after_s  1–3600                 CONFIG_PENTA_CONN_IDLE_*
+ *   15  conn_idle_itvl_ms  30–3200                  (AFTER_S, INTERVAL_MS,
+ *   16  conn_idle_latency  0–30                      LATENCY)
+ *
+ * Characteristic value (0xFF07, CONFIG_PENTA_TUNING):
+ *   read   version u8 | flags u8 | n × (id u8 | value u32)
+ *   write  1..n × (id u8 | value u32)   set these parameters
+ *          0xFF                         back to the defaults
+ *
+ * flags bit 0: changes not yet in flash.  Integers are little-endian.  A
+ * write is checked as a whole and either applied completely or refused
+ * with TUNING_ATT_ERR_INVALID; a pair whose limits depend on each other
+ * (adv min/max, pm min/max) may have to change in one write.  Applied
+ * changes are stored in NVS CONFIG_PENTA_TUNING_COMMIT_MS after the last
+ * one, in a single commit.
+ */
+typedef enum {
+    TUNE_WAKE_REPORT = 0,
+    TUNE_WAKE_KEY,
+    TUNE_HOLD_MS,
+    TUNE_ADV_FAST_MIN,          /* min, max per adv_mode_t, in that order */
+    TUNE_ADV_FAST_MAX,
+    TUNE_ADV_MEDIUM_MIN,
+    TUNE_ADV_MEDIUM_MAX,
+    TUNE_ADV_SLOW_MIN,
+    TUNE_ADV_SLOW_MAX,
+    TUNE_ADV_AWAKE_MIN,
+    TUNE_ADV_AWAKE_MAX,
+    TUNE_ADV_BURST_S,
+    TUNE_PM_MAX_MHZ,
+    TUNE_PM_MIN_MHZ,
+    TUNE_CONN_IDLE_AFTER_S,
+    TUNE_CONN_IDLE_ITVL_MS,
+    TUNE_CONN_IDLE_LATENCY,
+    TUNE_COUNT,
+} tune_id_t;
+
+#define TUNING_VALUE_VERSION    1
+#define TUNING_PAIR_LEN         5
+#define TUNING_VALUE_MAX        (2 + TUNE_COUNT * TUNING_PAIR_LEN)
+#define TUNING_WRITE_MAX        (TUNE_COUNT * TUNING_PAIR_LEN)
+#define TUNING_OP_RESET         0xFF
+#define TUNING_FLAG_PENDING     0x01
+
+/* ATT application error code returned for refused writes */
+#define TUNING_ATT_ERR_INVALID  0x80
+
+typedef struct {
+    bool     pending;           /* applied, not yet committed              */
+    uint32_t writes;            /* accepted writes                         */
+    uint32_t rejected;          /* refused writes                          */
+    uint32_t changes;           /* parameters changed by them              */
+    uint32_t commits;           /* NVS commits                             */
+    uint32_t commit_errors;
+} tuning_stats_t;
+
+/**
+ * Load the defaults, then with CONFIG_PENTA_TUNING the stored values.
+ * Call right after NVS is up, before anything reads a parameter.
+ */
+void tuning_init(void);
+
+/** Current value; any task or callback. */
+uint32_t tuning_get(tune_id_t id);
+
+/** Two values from the same write, e.g. a min/max pair. */
+void tuning_get_pair(tune_id_t a, tune_id_t b, uint32_t *va, uint32_t *vb);
+
+/**
+ * Apply the power-management limits (pm_min/max_mhz, light sleep on).
+ * app_main calls it once; a write that changes them calls it again.
+ */
+esp_err_t tuning_configure_pm(void);
+
+/**
+ * Validate and apply a write on the tuning characteristic and schedule the
+ * commit.  BLE stack context; never touches flash.  Returns
+ * ESP_ERR_INVALID_SIZE for a malformed write, ESP_ERR_NOT_FOUND for an
+ * unknown ID and ESP_ERR_INVALID_ARG for a value out of range.
+ */
+esp_err_t tuning_handle_write(const uint8_t *data, size_t len);
+
+/** Serialise the characteristic value into buf; returns bytes used. */
+size_t tuning_build_value(uint8_t *buf, size_t cap);
+
+/** Copy the counters into *out. */
+void tuning_get_stats(tuning_stats_t *out);
@@ -2,27 +2,74 @@
  * usb_hid.c
  *
  * Configures TinyUSB as a minimal USB HID keyboard.
- * usb_hid_send_wake_key() presses and releases the Space bar (HID keycode
- * 0x2C) which reliably wakes a PC from S3 suspend over USB.
  *
- * The USB remote wake-up feature is also enabled in the descriptor so the
- * host PC keeps the bus powered during suspend and the device can signal
- * a wake even without a software keystroke – but the keystroke ensures the
- * desktop is also un-locked/un-blanked.
+ * The configuration descriptor advertises the remote wake-up attribute, so
+ * a host that arms it (Windows: "Allow this device to wake the computer")
+ * keeps the port powered in S3 and accepts resume signalling from us.
+ * usb_hid_send_wake_key() therefore resumes a suspended bus with
+ * tud_remote_wakeup() first, waits for tud_resume_cb(), and only then
+ * sends one System Wake Up report or presses and releases the wake key
+ * (Space, HID keycode 0x2C, by default), so the desktop is also
+ * un-blanked.  On a bus that is already active it just sends the report.
+ * Report or key, the key and its hold time are tuning parameters
+ * (tuning.h).
+ * usb_hid_tap_key() does the same for any key, which is what the KEYS
+ * operation of the wake protocol (wake_proto.h) types with, and
+ * usb_hid_tap_consumer() for Consumer Control usages.
+ *
+ * The TinyUSB task is event driven: it blocks inside tud_task_ext() until
+ * the USB interrupt posts an event, so an idle or suspended bus costs no
+ * CPU wake-ups.  While the bus is active (mounted and not suspended) a
+ * NO_LIGHT_SLEEP PM lock keeps the USB peripheral clocked; it is dropped
+ * as soon as the host suspends the port, letting the chip light-sleep
+ * between BLE connection events while the host is in S3.
  */
 
 #include "usb_hid.h"
+#include "adv_sched.h"
+#include "boot_time.h"
+#include "trace.h"
+#include "latency.h"
+#include "host_state.h"
+#include "tuning.h"
+#include "mem_budget.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_pm.h"
 #include "tinyusb.h"
 #include "class/hid/hid_device.h"
 
 static const char *TAG = "USB_HID";
 
-/* ── HID report descriptor – boot-compatible keyboard ─────────────────── */
+/* Covers the host waking its controller and driving resume, the 20 ms of
+ * resume signalling and recovery USB requires before traffic, and
+ * scheduling slack on both sides */
+#define RESUME_TIMEOUT_MS       500
+#define HID_READY_TIMEOUT_MS    1000
+#define KEY_HOLD_MS             20    /* until usb_hid_init() reads tuning */
+#define KEY_HOLD_MAX_MS         1000
+
+/* ── HID report descriptor – keyboard, system and consumer control ─────── *
+ * One interface, three top-level collections told apart by report ID.
+ * The keyboard stays boot-compatible: in boot protocol (BIOS setup) its
+ * reports go out without the ID and the other collections are unused. */
+enum {
+    REPORT_ID_KEYBOARD = 1,
+    REPORT_ID_SYSTEM,
+    REPORT_ID_CONSUMER,
+};
+
+/* Array values of TUD_HID_REPORT_DESC_SYSTEM_CONTROL: sleep, power down,
+ * wake up, from logical minimum 1 */
+#define SYSTEM_CTRL_WAKE_UP     3
+#define CONSUMER_USAGE_MAX      0x03FF  /* logical max of the descriptor */
+
 static const uint8_t hid_report_descriptor[] = {
-    TUD_HID_REPORT_DESC_KEYBOARD()
+    TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_ID_KEYBOARD)),
+    TUD_HID_REPORT_DESC_SYSTEM_CONTROL(HID_REPORT_ID(REPORT_ID_SYSTEM)),
+    TUD_HID_REPORT_DESC_CONSUMER(HID_REPORT_ID(REPORT_ID_CONSUMER)),
 };
 
 /* ── TinyUSB string descriptors ─────────────────────────────────────────── */
@@ -31,6 +78,7 @@ static const char *string_desc[] = {
     "Anthropic-DIY",               /* 1: manufacturer */
     "Penta Power Button",          /* 2: product */
     "PB-001",                      /* 3: serial */
+    "Penta Wake Keyboard",         /* 4: HID interface */
 };
 
 /* ── TinyUSB device descriptor ──────────────────────────────────────────── */
@@ -51,6 +99,24 @@ static const tusb_desc_device_t device_descriptor = {
     .bNumConfigurations = 0x01,
 };
 
+/* ── TinyUSB configuration descriptor ──────────────────────────────────── *
+ * One boot-keyboard HID interface, bus powered, remote wake-up capable.
+ * The endpoint holds the 8-byte keyboard report plus its report ID.    */
+#define HID_ITF_NUM             0
+#define HID_EP_IN               0x81
+#define CONFIG_TOTAL_LEN        (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN)
+
+static const uint8_t configuration_descriptor[] = {
+    /* config number, interface count, string index, total length,
+     * attributes, power in mA */
+    TUD_CONFIG_DESCRIPTOR(1, 1, 0, CONFIG_TOTAL_LEN,
+                          TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+    /* interface number, string index, boot protocol, report descriptor
+     * length, EP IN address, EP size, polling interval (ms) */
+    TUD_HID_DESCRIPTOR(HID_ITF_NUM, 4, HID_ITF_PROTOCOL_KEYBOARD,
+                       sizeof(hid_report_descriptor), HID_EP_IN, 16, 10),
+};
+
 /* ── TinyUSB HID callbacks (required by TinyUSB) ────────────────────────── */
 uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
 {
@@ -75,12 +141,78 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
     (void)buffer;   (void)bufsize;
 }
 
+/* ── Bus state / PM lock ────────────────────────────────────────────────── */
+static esp_pm_lock_handle_t usb_pm_lock;   /* NULL when PM is disabled */
+static bool bus_active;
+static volatile bool remote_wakeup_armed;  /* host enabled remote wake-up */
+static volatile uint16_t key_hold_ms = KEY_HOLD_MS;
+static usb_hid_stats_t stats;
+static volatile bool usb_ready;            /* usb_hid_init() has finished */
+
+/* Mirrors bus_active for tasks that need to wait for a resume */
+static EventGroupHandle_t bus_events;
+static StaticEventGroup_t bus_events_buf;
+#define BUS_EVT_ACTIVE          BIT0
+
+/* Called from the TinyUSB device callbacks, i.e. in usb_task context */
+static void bus_set_active(bool active)
+{
+    if (active == bus_active) {
+        return;
+    }
+    bus_active = active;
+    if (active) {
+        xEventGroupSetBits(bus_events, BUS_EVT_ACTIVE);
+    } else {
+        xEventGroupClearBits(bus_events, BUS_EVT_ACTIVE);
+    }
+    if (usb_pm_lock) {
+        if (active) {
+            esp_pm_lock_acquire(usb_pm_lock);
+        } else {
+            esp_pm_lock_release(usb_pm_lock);
+        }
+    }
+    adv_sched_on_event(active ? ADV_EVT_HOST_AWAKE : ADV_EVT_HOST_SUSPEND);
+}
+
+void tud_mount_cb(void)
+{
+    bus_set_active(true);
+    host_state_set(HOST_STATE_MOUNTED);
+    boot_time_mark(BOOT_STAGE_USB_MOUNTED);
+}
+
+void tud_umount_cb(void)
+{
+    bus_set_active(false);
+    host_state_set(HOST_STATE_UNPOWERED);
+}
+
+void tud_suspend_cb(bool remote_wakeup_en)
+{
+    remote_wakeup_armed = remote_wakeup_en;
+    stats.suspends++;
+    bus_set_active(false);
+    host_state_set(HOST_STATE_SUSPENDED);
+}
+
+void tud_resume_cb(void)
+{
+    latency_mark(LAT_STAGE_USB_RESUME);
+    stats.resumes++;
+    bus_set_active(true);
+    host_state_set(HOST_STATE_RESUMED);
+}
+
 /* ── TinyUSB task ────────────────────────────────────────────────────────── */
 static void usb_task(void *arg)
 {
     while (1) {
-        tud_task();   /* TinyUSB device task */
-        vTaskDelay(1);
+        /* Blocks on the TinyUSB event queue until the USB ISR posts work;
+         * no periodic polling, so no tick wake-ups while the bus is idle. */
+        tud_task_ext(UINT32_MAX, false);
+        stats.task_wakeups++;
     }
 }
 
@@ -92,34 +224,236 @@ void usb_hid_init(void)
         .string_descriptor      = string_desc,
         .string_descriptor_count = sizeof(string_desc) / sizeof(string_desc[0]),
         .external_phy           = false,
-        .configuration_descriptor = NULL,  /* use class-default */
+        .configuration_descriptor = configuration_descriptor,
     };
 
+    bus_events = xEventGroupCreateStatic(&bus_events_buf);
+    usb_hid_set_hold_ms((uint16_t)tuning_get(TUNE_HOLD_MS));
+
+    esp_err_t err = esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "usb_bus",
+                                       &usb_pm_lock);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "USB PM lock unavailable: %s", esp_err_to_name(err));
+        usb_pm_lock = NULL;
+    }
+
     ESP_ERROR_CHECK(tinyusb_driver_install(&tusb_cfg));
+    boot_time_mark(BOOT_STAGE_USB_READY);
 
-    /* Run the TinyUSB stack in its own task */
-    xTaskCreate(usb_task, "usb_task", 4096, NULL, 5, NULL);
+    /* Run the TinyUSB stack in its own task.  The esp_tinyusb default task
+     * is disabled in sdkconfig.defaults (CONFIG_TINYUSB_NO_DEFAULT_TASK) so
+     * this is the only caller of tud_task_ext(). */
+    static StackType_t usb_stack[USB_TASK_STACK];
+    static StaticTask_t usb_tcb;
+    xTaskCreateStatic(usb_task, "usb_task", USB_TASK_STACK, NULL,
+                      USB_TASK_PRIO, usb_stack, &usb_tcb);
+    usb_ready = true;
     ESP_LOGI(TAG, "USB HID keyboard initialised");
 }
 
-void usb_hid_send_wake_key(void)
+/* ── Wake path ───────────────────────────────────────────────────────────── */
+
+/* Drive resume signalling on a suspended bus and wait for the host to
+ * finish resuming.  Called from the dispatcher task. */
+static esp_err_t resume_bus(void)
+{
+    if (!remote_wakeup_armed) {
+        ESP_LOGW(TAG, "Bus suspended but host did not arm remote wake-up");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* Keep the USB peripheral clocked while we signal resume */
+    if (usb_pm_lock) {
+        esp_pm_lock_acquire(usb_pm_lock);
+    }
+    bool signalled = tud_remote_wakeup();
+    EventBits_t bits = 0;
+    if (signalled) {
+        stats.remote_wakeups++;
+        bits = xEventGroupWaitBits(bus_events, BUS_EVT_ACTIVE, pdFALSE,
+                                   pdTRUE, pdMS_TO_TICKS(RESUME_TIMEOUT_MS));
+    }
+    if (usb_pm_lock) {
+        esp_pm_lock_release(usb_pm_lock);
+    }
+
+    if (!signalled) {
+        ESP_LOGW(TAG, "tud_remote_wakeup() refused");
+        return ESP_FAIL;
+    }
+    if (!(bits & BUS_EVT_ACTIVE)) {
+        ESP_LOGW(TAG, "Host did not resume within %d ms", RESUME_TIMEOUT_MS);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static bool wait_hid_ready(uint32_t timeout_ms)
 {
-    /* Wait until the USB host is ready */
-    int retries = 100;
-    while (!tud_hid_ready() && retries-- > 0) {
+    for (uint32_t waited = 0; !tud_hid_ready(); waited += 10) {
+        if (waited >= timeout_ms) {
+            return false;
+        }
         vTaskDelay(pdMS_TO_TICKS(10));
     }
-    if (!tud_hid_ready()) {
+    return true;
+}
+
+/* Resume a suspended bus and wait until a report can be queued */
+static esp_err_t bus_ready(void)
+{
+    /* CONFIG_PENTA_FAST_BOOT: BLE may take a wake before USB is installed */
+    if (!usb_ready) {
+        ESP_LOGW(TAG, "USB not initialised yet – skipping key press");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* First-line wake action: resume signalling on a suspended bus */
+    if (tud_suspended()) {
+        esp_err_t err = resume_bus();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    /* Bus is up – the endpoint is normally ready right away */
+    if (!wait_hid_ready(HID_READY_TIMEOUT_MS)) {
         ESP_LOGW(TAG, "USB HID not ready – skipping key press");
-        return;
+        return ESP_ERR_TIMEOUT;
+    }
+    latency_mark(LAT_STAGE_HID_READY);
+    return ESP_OK;
+}
+
+/* Boot protocol reports carry no ID */
+static bool boot_protocol(void)
+{
+    return tud_hid_get_protocol() == HID_PROTOCOL_BOOT;
+}
+
+esp_err_t usb_hid_tap_key(uint8_t modifier, uint8_t keycode)
+{
+    esp_err_t err = bus_ready();
+    if (err != ESP_OK) {
+        return err;
+    }
+    uint8_t id = boot_protocol() ? 0 : REPORT_ID_KEYBOARD;
+
+    uint8_t keys[6] = {keycode, 0, 0, 0, 0, 0};
+    tud_hid_keyboard_report(id, modifier, keys);
+    latency_mark(LAT_STAGE_REPORT_QUEUED);
+    vTaskDelay(pdMS_TO_TICKS(key_hold_ms));
+
+    /* Release all keys; with a hold shorter than the polling interval the
+     * press may still be waiting in the endpoint */
+    wait_hid_ready(HID_READY_TIMEOUT_MS);
+    tud_hid_keyboard_report(id, 0x00, NULL);
+    latency_mark(LAT_STAGE_KEY_RELEASED);
+    return ESP_OK;
+}
+
+esp_err_t usb_hid_tap_consumer(uint16_t usage)
+{
+    if (usage == 0 || usage > CONSUMER_USAGE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = bus_ready();
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (boot_protocol()) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    tud_hid_report(REPORT_ID_CONSUMER, &usage, sizeof(usage));
+    latency_mark(LAT_STAGE_REPORT_QUEUED);
+    vTaskDelay(pdMS_TO_TICKS(key_hold_ms));
+
+    const uint16_t none = 0;
+    wait_hid_ready(HID_READY_TIMEOUT_MS);
+    tud_hid_report(REPORT_ID_CONSUMER, &none, sizeof(none));
+    latency_mark(LAT_STAGE_KEY_RELEASED);
+    return ESP_OK;
+}
+
+/* System Wake Up is an event, not a key: the host acts on the report
+ * itself, so the release follows as soon as the endpoint has been polled
+ * instead of after a hold time. */
+static esp_err_t send_system_wake(void)
+{
+    esp_err_t err = bus_ready();
+    if (err != ESP_OK) {
+        return err;
     }
 
-    /* Press Space (keycode 0x2C) with no modifiers */
-    uint8_t keycode[6] = {HID_KEY_SPACE, 0, 0, 0, 0, 0};
-    tud_hid_keyboard_report(0, 0x00, keycode);
-    vTaskDelay(pdMS_TO_TICKS(20));
+    const uint8_t wake = SYSTEM_CTRL_WAKE_UP;
+    tud_hid_report(REPORT_ID_SYSTEM, &wake, sizeof(wake));
+    latency_mark(LAT_STAGE_REPORT_QUEUED);
 
-    /* Release all keys */
-    tud_hid_keyboard_report(0, 0x00, NULL);
-    ESP_LOGI(TAG, "Wake key sent");
+    const uint8_t none = 0;
+    wait_hid_ready(HID_READY_TIMEOUT_MS);
+    tud_hid_report(REPORT_ID_SYSTEM, &none, sizeof(none));
+    latency_mark(LAT_STAGE_KEY_RELEASED);
+    return ESP_OK;
+}
+
+esp_err_t usb_hid_send_wake_key(void)
+{
+#if CONFIG_PENTA_SKIP_WAKE_WHEN_AWAKE
+    if (host_state_is_awake()) {
+        stats.wakes_skipped++;
+        trace_log(TRACE_EVT_WAKE_SENT, TRACE_WAKE_SKIPPED, ESP_OK);
+        return ESP_OK;
+    }
+#endif
+
+    /* Boot protocol has no system control collection: use the key */
+    if (tuning_get(TUNE_WAKE_REPORT) && usb_ready && !boot_protocol()) {
+        esp_err_t err = send_system_wake();
+        trace_log(TRACE_EVT_WAKE_SENT, TRACE_WAKE_SYSTEM, (uint32_t)err);
+        return err;
+    }
+
+    /* Press the wake key with no modifiers */
+    esp_err_t err = usb_hid_tap_key(0x00, (uint8_t)tuning_get(TUNE_WAKE_KEY));
+    trace_log(TRACE_EVT_WAKE_SENT, TRACE_WAKE_KEY, (uint32_t)err);
+    return err;
+}
+
+void usb_hid_set_hold_ms(uint16_t ms)
+{
+    if (ms < 1) {
+        ms = 1;
+    } else if (ms > KEY_HOLD_MAX_MS) {
+        ms = KEY_HOLD_MAX_MS;
+    }
+    key_hold_ms = ms;
+}
+
+uint16_t usb_hid_get_hold_ms(void)
+{
+    return key_hold_ms;
+}
+
+void usb_hid_get_bus(usb_hid_bus_t *out)
+{
+    out->mounted    = tud_mounted();
+    out->suspended  = tud_suspended();
+    out->wake_armed = remote_wakeup_armed;
+}
+
+bool usb_hid_wait_active(uint32_t timeout_ms)
+{
+    if (!usb_ready) {
+        return false;
+    }
+    EventBits_t bits = xEventGroupWaitBits(bus_events, BUS_EVT_ACTIVE,
+                                           pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(timeout_ms));
+    return (bits & BUS_EVT_ACTIVE) != 0;
+}
+
+void usb_hid_get_stats(usb_hid_stats_t *out)
+{
+    *out = stats;
 }
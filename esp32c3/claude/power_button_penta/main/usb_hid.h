@@ -1,14 +1,79 @@
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/** Counters maintained by the TinyUSB task, for idle-power checks. */
+typedef struct {
+    uint32_t task_wakeups;   /* times usb_task returned from tud_task_ext() */
+    uint32_t suspends;       /* host suspended the bus (S3 entry)           */
+    uint32_t resumes;        /* bus resumed                                 */
+    uint32_t remote_wakeups; /* resume signalling driven by this device     */
+    uint32_t wakes_skipped;  /* wake keys not sent: host was already awake  */
+} usb_hid_stats_t;
+
+/** Bus state as seen by TinyUSB right now. */
+typedef struct {
+    bool mounted;            /* configured by the host                      */
+    bool suspended;          /* host suspended the bus                      */
+    bool wake_armed;         /* host enabled remote wake-up at suspend      */
+} usb_hid_bus_t;
 
 /**
  * Initialise TinyUSB as a HID keyboard device.
- * Must be called before ble_server_init().
+ * Called before ble_server_init(), or right after it with
+ * CONFIG_PENTA_FAST_BOOT; until then key presses fail with
+ * ESP_ERR_INVALID_STATE.
  */
 void usb_hid_init(void);
 
 /**
- * Send a single key press + release that wakes a sleeping PC.
- * Uses the "Wake" key (HID usage 0x00 / modifier only pulse is enough on most
- * hosts; we send a short Space press as a universal fallback).
+ * Wake a sleeping PC.
+ * If the bus is suspended, signal USB remote wake-up and wait for the host
+ * to resume it; then send one System Wake Up report (report protocol
+ * only) or a short press + release of the wake key, so the desktop is
+ * un-blanked too.  Report or key, and which key, are tuning parameters
+ * (tuning.h); CONFIG_PENTA_SYSTEM_WAKE and Space are the defaults.
+ *
+ * With CONFIG_PENTA_SKIP_WAKE_WHEN_AWAKE nothing is sent while the host is
+ * already running (host_state.h); that counts as success.
+ *
+ * Blocks for up to ~1.5 s while waiting for the host; call it from the wake
+ * dispatcher task, never from a BLE callback.
+ * Returns ESP_OK once the key was released, ESP_ERR_INVALID_STATE if the
+ * host did not arm remote wake-up, ESP_ERR_TIMEOUT if the bus did not
+ * resume or the HID interface never became ready.
+ */
+esp_err_t usb_hid_send_wake_key(void);
+
+/**
+ * Press and release one key (HID usage ID, with modifier bits), resuming a
+ * suspended bus first like usb_hid_send_wake_key().  The key is held for
+ * usb_hid_get_hold_ms().  Dispatcher task only; same return codes.
+ */
+esp_err_t usb_hid_tap_key(uint8_t modifier, uint8_t keycode);
+
+/**
+ * Press and release one Consumer Control usage (1–0x3FF, e.g. 0xE9 Volume
+ * Up), held for usb_hid_get_hold_ms().  Dispatcher task only; same return
+ * codes as usb_hid_tap_key(), plus ESP_ERR_INVALID_ARG for a usage out of
+ * range and ESP_ERR_NOT_SUPPORTED while the host uses boot protocol.
  */
-void usb_hid_send_wake_key(void);
+esp_err_t usb_hid_tap_consumer(uint16_t usage);
+
+/** Key hold time for later presses, 1–1000 ms (default: tuning hold_ms). */
+void usb_hid_set_hold_ms(uint16_t ms);
+uint16_t usb_hid_get_hold_ms(void);
+
+/** Copy the current bus state into *out. */
+void usb_hid_get_bus(usb_hid_bus_t *out);
+
+/**
+ * Block until the host has mounted or resumed the bus (host_state.h
+ * awake), for at most timeout_ms.  Sleeps on the bus event instead of
+ * polling.  Returns true if the bus is active.  Dispatcher task only.
+ */
+bool usb_hid_wait_active(uint32_t timeout_ms);
+
+/** Copy the USB task counters into *out. */
+void usb_hid_get_stats(usb_hid_stats_t *out);
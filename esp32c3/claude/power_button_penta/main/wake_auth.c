@@ -0,0 +1,147 @@
+/**
+ * wake_auth.c
+ *
+ * HMAC check for writes on the wake characteristic (see wake_auth.h).
+ *
+ * Without it anyone in radio range can power up the server.  The check
+ * runs in the BLE callback, before wake_proto.c parses the operations,
+ * and has to stay cheap on the wake path:
+ *
+ *   - the counter is compared before the HMAC, so a replayed frame costs
+ *     a few instructions;
+ *   - the HMAC context is keyed once at boot and only reset per frame,
+ *     so a check hashes four or five SHA-256 blocks and allocates
+ *     nothing.  mbedtls runs them on the SHA peripheral
+ *     (CONFIG_MBEDTLS_HARDWARE_SHA), which holds no PM lock;
+ *   - the tag is compared in constant time;
+ *   - NVS is never written in the callback.  Accepting a counter that
+ *     comes within half a block of the stored reservation queues a new
+ *     reservation for the timer task (counter_rsv.c), so in steady state
+ *     every accepted counter is already covered by flash.
+ */
+
+#include "wake_auth.h"
+#include "hmac_util.h"
+#include "counter_rsv.h"
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "mbedtls/md.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "WAKE_AUTH";
+
+#define WAKE_KEY_LEN            32
+#define NVS_KEY_RESERVED        "auth_rsv"
+
+static mbedtls_md_context_t hmac;   /* keyed once; BLE stack context only */
+static bool key_ok;
+static uint8_t own_mac[6];
+static wake_auth_stats_t stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static counter_rsv_t rsv = {
+    .nvs_key     = NVS_KEY_RESERVED,
+    .block       = CONFIG_PENTA_WAKE_AUTH_COUNTER_BLOCK,
+    .lock        = &stats_lock,
+    .reserved    = &stats.reserved,
+    .nvs_writes  = &stats.nvs_writes,
+    .pend_errors = &stats.pend_errors,
+    .nvs_errors  = &stats.nvs_errors,
+};
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+static void count(uint32_t *field)
+{
+    portENTER_CRITICAL(&stats_lock);
+    (*field)++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/* HMAC over  counter | ops  (the frame minus its tag) and our BT MAC */
+static bool compute_tag(const uint8_t *msg, size_t len, uint8_t *out)
+{
+    return mbedtls_md_hmac_reset(&hmac) == 0 &&
+           mbedtls_md_hmac_update(&hmac, msg, len) == 0 &&
+           mbedtls_md_hmac_update(&hmac, own_mac, sizeof(own_mac)) == 0 &&
+           mbedtls_md_hmac_finish(&hmac, out) == 0;
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void wake_auth_init(void)
+{
+    uint8_t key[WAKE_KEY_LEN];
+
+    /* Anything up to the reservation may have been accepted before the
+     * reset */
+    stats.last_counter = counter_rsv_load(&rsv);
+
+    if (!hmac_util_parse_key(CONFIG_PENTA_WAKE_KEY, key, sizeof(key))) {
+        ESP_LOGE(TAG, "CONFIG_PENTA_WAKE_KEY must be %d hex digits – "
+                      "every wake write will be refused", WAKE_KEY_LEN * 2);
+        return;
+    }
+    ESP_ERROR_CHECK(esp_read_mac(own_mac, ESP_MAC_BT));
+
+    mbedtls_md_init(&hmac);
+    const mbedtls_md_info_t *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    key_ok = mbedtls_md_setup(&hmac, md, 1) == 0 &&
+             mbedtls_md_hmac_starts(&hmac, key, sizeof(key)) == 0;
+    memset(key, 0, sizeof(key));    /* the context keeps the padded key */
+    if (!key_ok) {
+        ESP_LOGE(TAG, "HMAC setup failed – every wake write will be refused");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Authenticated wake on, counters above %u",
+             (unsigned)stats.last_counter);
+}
+
+esp_err_t wake_auth_open(const uint8_t **ops, size_t *len)
+{
+    const uint8_t *f = *ops;
+
+    if (*len <= WAKE_AUTH_OVERHEAD) {
+        count(&stats.malformed);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t   ops_len = *len - WAKE_AUTH_OVERHEAD;
+    uint32_t counter = (uint32_t)f[0] | ((uint32_t)f[1] << 8) |
+                       ((uint32_t)f[2] << 16) | ((uint32_t)f[3] << 24);
+
+    /* Cheap checks first: a replayed frame never reaches the HMAC */
+    if (counter <= stats.last_counter) {
+        count(&stats.replayed);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t mac[32];
+    if (!key_ok || !compute_tag(f, 4 + ops_len, mac) ||
+        !hmac_util_tag_equal(mac, &f[4 + ops_len], WAKE_AUTH_TAG_LEN)) {
+        count(&stats.bad_tag);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.last_counter = counter;
+    stats.accepted++;
+    portEXIT_CRITICAL(&stats_lock);
+    counter_rsv_accept(&rsv, counter);
+    *ops = &f[4];
+    *len = ops_len;
+    return ESP_OK;
+}
+
+uint32_t wake_auth_last_counter(void)
+{
+    return stats.last_counter;
+}
+
+void wake_auth_get_stats(wake_auth_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
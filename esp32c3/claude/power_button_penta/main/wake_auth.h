@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Authenticated frames on the wake characteristic (CONFIG_PENTA_WAKE_AUTH).
+ *
+ * Every write must be
+ *   counter u32 LE | ops[n] | tag[WAKE_AUTH_TAG_LEN]
+ * where ops is a wake_proto.h sequence and
+ *   tag = HMAC-SHA256(key, counter | ops | dongle BT MAC)[0..15]
+ * with the 32-byte key from CONFIG_PENTA_WAKE_KEY.  The MAC binds a frame
+ * to one dongle, so dongles sharing a key cannot replay each other's.
+ *
+ * A frame is accepted only if its counter is above the last accepted one,
+ * which the wake reply reports (wake_proto.h) so a signer that lost its
+ * own count can catch up.  Counters are reserved in NVS in blocks of
+ * CONFIG_PENTA_WAKE_AUTH_COUNTER_BLOCK: flash is written about once per
+ * block of wakes, and a reboot resumes above every counter ever accepted.
+ */
+#define WAKE_AUTH_TAG_LEN       16
+#define WAKE_AUTH_OVERHEAD      (4 + WAKE_AUTH_TAG_LEN)
+
+/** Counters for the authentication check. */
+typedef struct {
+    uint32_t accepted;      /* frames that passed                          */
+    uint32_t malformed;     /* rejected: too short for counter and tag     */
+    uint32_t replayed;      /* rejected: counter not above the last one    */
+    uint32_t bad_tag;       /* rejected: HMAC mismatch                     */
+    uint32_t last_counter;  /* highest accepted counter                    */
+    uint32_t reserved;      /* counter reservation last written to NVS     */
+    uint32_t nvs_writes;    /* reservations written since boot             */
+    uint32_t pend_errors;   /* reservations not queued: timer queue full   */
+    uint32_t nvs_errors;    /* reservations queued but not stored          */
+} wake_auth_stats_t;
+
+/**
+ * Parse the key, load the counter reservation and set up the HMAC
+ * context.  Call after nvs_flash_init() and before ble_server_init().
+ * Without a valid key every write is refused.
+ */
+void wake_auth_init(void);
+
+/**
+ * Check one write.  On success *ops and *len are narrowed to the
+ * operations inside the frame.  BLE stack context; never blocks.
+ * Returns ESP_ERR_INVALID_SIZE for a frame too short to hold a counter
+ * and a tag, ESP_ERR_INVALID_STATE for a replayed counter and
+ * ESP_ERR_INVALID_CRC for a bad tag (or no key).
+ */
+esp_err_t wake_auth_open(const uint8_t **ops, size_t *len);
+
+/** Highest accepted counter; a signer must use a larger one. */
+uint32_t wake_auth_last_counter(void);
+
+/** Copy the counters into *out. */
+void wake_auth_get_stats(wake_auth_stats_t *out);
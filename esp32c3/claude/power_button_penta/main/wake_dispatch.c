@@ -0,0 +1,337 @@
+/**
+ * wake_dispatch.c
+ *
+ * Decouples the BLE stack from the wake paths (wake_path.h).
+ *
+ * The GATT write handler only posts a command into a small static queue
+ * and returns, so the Bluedroid callback context is never stalled by the
+ * tud_hid_ready() wait loop, the key hold delay in usb_hid.c or a PWR_SW
+ * pulse waiting for the host to boot.
+ *
+ * Each connected client (conn_table.h slot) has its own small queue, and
+ * beacon and proximity wakes share one more.  The task serves the queues round-robin, one
+ * command at a time, so a client sending a long run of sequences cannot
+ * hold back another client's wake for more than the command in flight.
+ *
+ * The dispatcher merges bursts of duplicate wake requests (clients
+ * retrying, several phones pressing at once) into a single HID action: a
+ * plain wake at the head of any queue is satisfied by the one running.
+ * Requests that arrive while an action is in flight are treated as
+ * satisfied by that action as well; every client merged in gets its result.
+ *
+ * Opcode sequences from wake_proto.c travel as WAKE_CMD_MACRO: the bytes
+ * sit in one of WAKE_MACRO_SLOTS static slots and the queue entry only
+ * carries the slot number, so the queue stays a few bytes per entry.  A
+ * client holds at most WAKE_MACRO_PER_CONN of the slots.
+ *
+ * Each command runs as one pm_gov.h transaction: the CPU is at full speed
+ * and kept out of light sleep from the moment the task picks a request up
+ * until the last duplicate has been merged, and idles at the minimum
+ * frequency again right after.
+ */
+
+#include "wake_dispatch.h"
+#include "wake_proto.h"
+#include "conn_table.h"
+#include "wake_path.h"
+#include "latency.h"
+#include "mem_budget.h"
+#include "pm_gov.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "WAKE_DISP";
+
+/* One queue per conn_table slot, the last one for requests without a link */
+#define SOURCES             (CONN_TABLE_MAX + 1)
+#define SOURCE_LOCAL        CONN_TABLE_MAX
+#define SOURCE_GONE         0xFF    /* slot still running for a lost link */
+
+typedef struct {
+    wake_cmd_t cmd;
+    uint8_t    slot;            /* WAKE_CMD_MACRO only */
+    uint16_t   conn;            /* result goes to this client */
+} wake_req_t;
+
+typedef struct {
+    wake_req_t req[WAKE_QUEUE_LEN];
+    uint8_t    head;
+    uint8_t    count;
+} source_queue_t;
+
+typedef struct {
+    uint8_t len;
+    uint8_t source;             /* queue that holds the slot */
+    uint8_t ops[WAKE_PROTO_MAX_LEN];
+} macro_slot_t;
+
+static TaskHandle_t task;
+static source_queue_t queues[SOURCES];  /* under stats_lock */
+static uint8_t next_source;             /* round-robin position */
+static macro_slot_t macro_slots[WAKE_MACRO_SLOTS];
+static uint8_t macro_busy;      /* bit per slot, under stats_lock */
+static wake_dispatch_stats_t stats = { .last_result = ESP_OK };
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+
+static uint8_t source_of(uint16_t conn)
+{
+    int slot = conn_table_slot(conn);
+    return slot < 0 ? SOURCE_LOCAL : (uint8_t)slot;
+}
+
+/* Caller holds stats_lock */
+static void pop(source_queue_t *q, wake_req_t *out)
+{
+    *out = q->req[q->head];
+    q->head = (uint8_t)((q->head + 1) % WAKE_QUEUE_LEN);
+    q->count--;
+}
+
+/* Next request, taking the queues in turn; false if all are empty. */
+static bool take_next(wake_req_t *out)
+{
+    bool found = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    for (int i = 0; i < SOURCES && !found; i++) {
+        uint8_t s = (uint8_t)((next_source + i) % SOURCES);
+        if (queues[s].count > 0) {
+            pop(&queues[s], out);
+            next_source = (uint8_t)((s + 1) % SOURCES);
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+    return found;
+}
+
+/* Discard the plain wakes at the head of every queue, noting whose they
+ * were in served[]; return how many. */
+static uint32_t drain_duplicates(const wake_req_t *req, uint16_t *served)
+{
+    uint32_t merged = 0;
+    wake_req_t next;
+
+    if (req->cmd != WAKE_CMD_WAKE) {
+        return 0;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    for (int s = 0; s < SOURCES; s++) {
+        source_queue_t *q = &queues[s];
+        while (q->count > 0 && q->req[q->head].cmd == WAKE_CMD_WAKE) {
+            pop(q, &next);
+            served[s] = next.conn;
+            merged++;
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+    return merged;
+}
+
+static void release_slot(uint8_t slot)
+{
+    portENTER_CRITICAL(&stats_lock);
+    macro_busy &= (uint8_t)~(1u << slot);
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static esp_err_t execute(const wake_req_t *req)
+{
+    esp_err_t err;
+
+    switch (req->cmd) {
+    case WAKE_CMD_WAKE:
+        return wake_path_run(false);
+    case WAKE_CMD_MACRO:
+        err = wake_proto_run(req->conn, macro_slots[req->slot].ops,
+                             macro_slots[req->slot].len);
+        release_slot(req->slot);
+        return err;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static bool enqueue(uint8_t source, wake_req_t req)
+{
+    source_queue_t *q = &queues[source];
+    bool queued = false;
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.received++;
+    if (q->count < WAKE_QUEUE_LEN) {
+        q->req[(q->head + q->count) % WAKE_QUEUE_LEN] = req;
+        q->count++;
+        queued = true;
+    } else {
+        stats.dropped++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (queued) {
+        xTaskNotifyGive(task);
+    }
+    return queued;
+}
+
+/* ── Dispatcher task ─────────────────────────────────────────────────────── */
+static void wake_dispatch_task(void *arg)
+{
+    wake_req_t req;
+    uint16_t served[SOURCES];
+
+    while (1) {
+        if (!take_next(&req)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        pm_gov_begin();
+        wake_cmd_t cmd = req.cmd;
+        for (int s = 0; s < SOURCES; s++) {
+            served[s] = CONN_TABLE_NONE;
+        }
+
+        /* Burst already waiting next to the first request */
+        uint32_t merged = drain_duplicates(&req, served);
+
+        esp_err_t err = execute(&req);
+
+        /* Anything that piled up while the key was held is already served */
+        merged += drain_duplicates(&req, served);
+        pm_gov_end();
+        latency_finish();
+
+        conn_table_set_result(req.conn, err);
+        for (int s = 0; s < SOURCES; s++) {
+            if (served[s] != CONN_TABLE_NONE) {
+                conn_table_set_result(served[s], err);
+            }
+        }
+
+        portENTER_CRITICAL(&stats_lock);
+        stats.coalesced  += merged;
+        stats.executed++;
+        stats.last_result = err;
+        if (err != ESP_OK) {
+            stats.failed++;
+        }
+        portEXIT_CRITICAL(&stats_lock);
+
+        trace_log(TRACE_EVT_CMD_DONE,
+                  (uint16_t)(cmd | (merged > 0xFF ? 0xFF : merged) << 8),
+                  (uint32_t)err);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "cmd %d failed: %s (%u duplicate(s) merged)",
+                     cmd, esp_err_to_name(err), (unsigned)merged);
+        }
+    }
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void wake_dispatch_init(void)
+{
+    static StackType_t stack[WAKE_TASK_STACK];
+    static StaticTask_t tcb;
+    task = xTaskCreateStatic(wake_dispatch_task, "wake_disp",
+                             WAKE_TASK_STACK, NULL, WAKE_TASK_PRIO, stack,
+                             &tcb);
+    ESP_LOGI(TAG, "Wake dispatcher started");
+}
+
+bool wake_dispatch_post(uint16_t conn, wake_cmd_t cmd)
+{
+    return enqueue(source_of(conn),
+                   (wake_req_t){ .cmd = cmd, .conn = conn });
+}
+
+bool wake_dispatch_post_macro(uint16_t conn, const uint8_t *ops, size_t len)
+{
+    uint8_t source = source_of(conn);
+    int slot = -1;
+    int held = 0;
+
+    if (len > WAKE_PROTO_MAX_LEN) {
+        return false;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    for (int i = 0; i < WAKE_MACRO_SLOTS; i++) {
+        if ((macro_busy & (1u << i)) && macro_slots[i].source == source) {
+            held++;
+        }
+    }
+    for (int i = 0; i < WAKE_MACRO_SLOTS && held < WAKE_MACRO_PER_CONN; i++) {
+        if (!(macro_busy & (1u << i))) {
+            macro_busy |= (uint8_t)(1u << i);
+            macro_slots[i].source = source;
+            slot = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (slot < 0) {
+        portENTER_CRITICAL(&stats_lock);
+        stats.received++;
+        stats.dropped++;
+        portEXIT_CRITICAL(&stats_lock);
+        return false;
+    }
+    memcpy(macro_slots[slot].ops, ops, len);
+    macro_slots[slot].len = (uint8_t)len;
+
+    if (!enqueue(source, (wake_req_t){ .cmd  = WAKE_CMD_MACRO,
+                                       .slot = (uint8_t)slot,
+                                       .conn = conn })) {
+        release_slot((uint8_t)slot);
+        return false;
+    }
+    return true;
+}
+
+void wake_dispatch_on_disconnect(uint16_t conn)
+{
+    int source = conn_table_slot(conn);
+    uint8_t purged = 0;
+
+    if (source < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    source_queue_t *q = &queues[source];
+    while (q->count > 0) {
+        wake_req_t req;
+        pop(q, &req);
+        if (req.cmd == WAKE_CMD_MACRO) {
+            macro_busy &= (uint8_t)~(1u << req.slot);
+        }
+        purged++;
+    }
+    q->head = 0;
+    stats.dropped += purged;
+    /* What is left is the sequence in flight: it keeps its slot until it
+     * finishes but no longer counts against the next client here */
+    for (int i = 0; i < WAKE_MACRO_SLOTS; i++) {
+        if ((macro_busy & (1u << i)) && macro_slots[i].source == source) {
+            macro_slots[i].source = SOURCE_GONE;
+        }
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    if (purged > 0) {
+        ESP_LOGI(TAG, "conn %u gone, %u queued request(s) dropped",
+                 conn, purged);
+    }
+}
+
+void wake_dispatch_get_stats(wake_dispatch_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/** Commands accepted by the wake dispatcher. */
+typedef enum {
+    WAKE_CMD_WAKE = 0,      /* wake the host (wake_path.h)               */
+    WAKE_CMD_MACRO,         /* run a wake_proto.h sequence               */
+} wake_cmd_t;
+
+#define WAKE_MACRO_SLOTS    4     /* sequences that can be queued at once */
+#define WAKE_MACRO_PER_CONN 2     /* of those, taken by one client at most  */
+
+/** Running totals kept by the dispatcher task. */
+typedef struct {
+    uint32_t received;      /* requests posted by BLE callbacks            */
+    uint32_t dropped;       /* requests lost to a full client queue        */
+    uint32_t coalesced;     /* duplicates merged into an in-flight action  */
+    uint32_t executed;      /* HID actions actually performed              */
+    uint32_t failed;        /* HID actions that returned an error          */
+    esp_err_t last_result;  /* result of the most recent HID action        */
+} wake_dispatch_stats_t;
+
+/**
+ * Create the dispatcher queue and task.
+ * Must be called after usb_hid_init() and before ble_server_init().
+ */
+void wake_dispatch_init(void);
+
+/**
+ * Queue a command from connection conn (conn_table.h; CONN_TABLE_NONE for
+ * a beacon or proximity wake) for the dispatcher task and return immediately.
+ * Safe to call from BLE stack callbacks; never blocks.
+ * Returns false if that client's queue was full and the request was
+ * dropped.
+ *
+ * Every client has its own queue of WAKE_QUEUE_LEN (mem_budget.h) and the
+ * task takes one command from each in turn, so a client that floods the
+ * dongle only delays itself.  The result goes to conn's table entry.
+ */
+bool wake_dispatch_post(uint16_t conn, wake_cmd_t cmd);
+
+/**
+ * Copy a validated wake_proto.h sequence (at most WAKE_PROTO_MAX_LEN bytes)
+ * into a free slot and queue it as WAKE_CMD_MACRO.  Same context rules as
+ * wake_dispatch_post(); returns false if no slot or queue entry was free,
+ * or conn already holds WAKE_MACRO_PER_CONN slots.
+ * Sequences are never merged with each other.
+ */
+bool wake_dispatch_post_macro(uint16_t conn, const uint8_t *ops, size_t len);
+
+/**
+ * Forget what conn (conn_table.h) still has queued, counting it as
+ * dropped, and release its macro slots, so the next client in the same
+ * conn_table slot starts with an empty queue and its full share of slots.
+ * A sequence already running finishes.  Call from the disconnect handler,
+ * before conn_table_remove().
+ */
+void wake_dispatch_on_disconnect(uint16_t conn);
+
+/** Copy the current dispatcher counters into *out. */
+void wake_dispatch_get_stats(wake_dispatch_stats_t *out);
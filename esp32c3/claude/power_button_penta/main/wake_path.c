@@ -0,0 +1,286 @@
+/**
+ * wake_path.c
+ *
+ * Picks how to wake the host from what the USB bus says about it
+ * (host_state.h) and falls back to the next path when one fails.
+ *
+ * USB resume and the HID report both go through usb_hid_send_wake_key();
+ * the engine only decides whether they can work.  Both need a port that
+ * stays powered and a board that honours USB wake.  When the bus is dead
+ * (host off in S5, or asleep without remote wake-up armed) the PWR_SW
+ * path (CONFIG_PENTA_PWR_SW) closes the front-panel power switch through
+ * an optocoupler for CONFIG_PENTA_PWR_SW_PULSE_MS, like a finger on the
+ * case button.  It then waits for the host to enumerate the dongle again,
+ * outside the dispatcher's PM transaction (pm_gov.h): a boot takes
+ * seconds in which the dongle has nothing to do.
+ * That only helps if the dongle itself stays powered while the host is
+ * off: from a port the board keeps live in S5, or from the 5VSB rail.
+ *
+ * A dead bus does not prove the host is off, and a press on a running
+ * host shuts it down.  So PWR_SW is only chosen with a power-sense input
+ * (CONFIG_PENTA_PWR_SENSE) that reads the host as not running, or, with
+ * none fitted, when the client opted in with the POWER opcode.
+ *
+ * Each path keeps its own attempt, success, fallback and latency counters
+ * for the stats characteristic, and every attempt is traced.
+ */
+
+#include "wake_path.h"
+#include "host_state.h"
+#include "pm_gov.h"
+#include "usb_hid.h"
+#include "trace.h"
+#include "sdkconfig.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#if CONFIG_PENTA_PWR_SW
+#include "driver/gpio.h"
+#endif
+
+static const char *TAG = "WAKE_PATH";
+
+#if CONFIG_PENTA_PWR_SW
+#define HAVE_PWR_SW             true
+#else
+#define HAVE_PWR_SW             false
+#endif
+#if CONFIG_PENTA_PWR_SENSE
+#define HAVE_PWR_SENSE          true
+#else
+#define HAVE_PWR_SENSE          false
+#endif
+#define MAX_STEPS               2
+
+static const char *const path_name[WAKE_PATH_COUNT] = {
+    "USB resume", "HID report", "PWR_SW",
+};
+
+static wake_path_stats_t stats;
+static uint32_t ok_ms_total[WAKE_PATH_COUNT];
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* ── PWR_SW header ───────────────────────────────────────────────────────── */
+#if CONFIG_PENTA_PWR_SW
+#define PWR_SW_GPIO             CONFIG_PENTA_PWR_SW_GPIO
+#if CONFIG_PENTA_PWR_SW_ACTIVE_LOW
+#define PWR_SW_PRESSED          0
+#else
+#define PWR_SW_PRESSED          1
+#endif
+#if CONFIG_PENTA_PWR_SENSE
+#define PWR_SENSE_GPIO          CONFIG_PENTA_PWR_SENSE_GPIO
+#if CONFIG_PENTA_PWR_SENSE_ACTIVE_LOW
+#define PWR_SENSE_RUNNING       0
+#define PWR_SENSE_PULL_UP       GPIO_PULLUP_DISABLE
+#define PWR_SENSE_PULL_DOWN     GPIO_PULLDOWN_ENABLE
+#else
+#define PWR_SENSE_RUNNING       1
+#define PWR_SENSE_PULL_UP       GPIO_PULLUP_ENABLE
+#define PWR_SENSE_PULL_DOWN     GPIO_PULLDOWN_DISABLE
+#endif
+#endif
+#define BOOT_SETTLE_US          (5 * 1000000LL) /* host enumerates us */
+#define HOLDOFF_US              (CONFIG_PENTA_PWR_SW_HOLDOFF_S * 1000000LL)
+
+static int64_t pending_pulse_us = -1;   /* unanswered pulse; dispatcher */
+
+static void pwr_sw_init(void)
+{
+    /* Latch the released level before the pin becomes an output */
+    gpio_set_level(PWR_SW_GPIO, !PWR_SW_PRESSED);
+    const gpio_config_t io = {
+        .pin_bit_mask = 1ULL << PWR_SW_GPIO,
+        .mode         = GPIO_MODE_OUTPUT,
+        .pull_up_en   = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type    = GPIO_INTR_DISABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io));
+    /* Keep driving it through light sleep, the pulse included */
+    gpio_sleep_sel_dis(PWR_SW_GPIO);
+    ESP_LOGI(TAG, "PWR_SW on GPIO%d", PWR_SW_GPIO);
+#if CONFIG_PENTA_PWR_SENSE
+    /* Pulled toward "running": an open input never allows a press */
+    const gpio_config_t sense = {
+        .pin_bit_mask = 1ULL << PWR_SENSE_GPIO,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_up_en   = PWR_SENSE_PULL_UP,
+        .pull_down_en = PWR_SENSE_PULL_DOWN,
+        .intr_type    = GPIO_INTR_DISABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&sense));
+    ESP_LOGI(TAG, "Power sense on GPIO%d", PWR_SENSE_GPIO);
+#endif
+}
+
+/* A short press shuts a running host down; booting ones may ignore it or
+ * power off.  Only press when nobody could be on the other end. */
+static bool pwr_sw_allowed(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (host_state_is_awake() || now < BOOT_SETTLE_US) {
+        return false;
+    }
+#if CONFIG_PENTA_PWR_SENSE
+    if (gpio_get_level(PWR_SENSE_GPIO) == PWR_SENSE_RUNNING) {
+        return false;       /* running, only not talking to us over USB */
+    }
+#endif
+    return pending_pulse_us < 0 || now - pending_pulse_us >= HOLDOFF_US;
+}
+
+static esp_err_t pwr_sw_pulse(void)
+{
+    if (!pwr_sw_allowed()) {
+        portENTER_CRITICAL(&stats_lock);
+        stats.guarded++;
+        portEXIT_CRITICAL(&stats_lock);
+        ESP_LOGW(TAG, "PWR_SW pulse held back");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    gpio_set_level(PWR_SW_GPIO, PWR_SW_PRESSED);
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_PENTA_PWR_SW_PULSE_MS));
+    gpio_set_level(PWR_SW_GPIO, !PWR_SW_PRESSED);
+    pending_pulse_us = esp_timer_get_time();
+    trace_log(TRACE_EVT_WAKE_SENT, TRACE_WAKE_PWR_SW, ESP_OK);
+
+    /* The pulse worked once the host has enumerated us again */
+    pm_gov_end();
+    bool up = usb_hid_wait_active(CONFIG_PENTA_PWR_SW_VERIFY_S * 1000u);
+    pm_gov_begin();
+    if (!up) {
+        ESP_LOGW(TAG, "Host not up %d s after PWR_SW",
+                 CONFIG_PENTA_PWR_SW_VERIFY_S);
+        return ESP_ERR_TIMEOUT;
+    }
+    pending_pulse_us = -1;
+    return ESP_OK;
+}
+#endif /* CONFIG_PENTA_PWR_SW */
+
+/* ── Path selection ──────────────────────────────────────────────────────── */
+
+/* Paths to try for the current host state, best first; returns the count */
+static int plan(wake_path_t *steps, bool power_on)
+{
+    /* Without a sense input only the client can vouch for the host */
+    bool pwr_sw = HAVE_PWR_SW && (HAVE_PWR_SENSE || power_on);
+    usb_hid_bus_t bus;
+    int n = 0;
+
+    usb_hid_get_bus(&bus);
+    switch (host_state_get()) {
+    case HOST_STATE_MOUNTED:
+    case HOST_STATE_RESUMED:
+        steps[n++] = WAKE_PATH_HID_REPORT;
+        break;
+    case HOST_STATE_SUSPENDED:
+        if (bus.wake_armed || !pwr_sw) {
+            steps[n++] = WAKE_PATH_USB_RESUME;
+        }
+        if (pwr_sw) {
+            steps[n++] = WAKE_PATH_PWR_SW;
+        }
+        break;
+    case HOST_STATE_UNPOWERED:
+    default:
+        steps[n++] = pwr_sw ? WAKE_PATH_PWR_SW : WAKE_PATH_HID_REPORT;
+        break;
+    }
+    return n;
+}
+
+static esp_err_t try_path(wake_path_t path)
+{
+    switch (path) {
+    case WAKE_PATH_USB_RESUME:
+    case WAKE_PATH_HID_REPORT:
+        return usb_hid_send_wake_key();
+#if CONFIG_PENTA_PWR_SW
+    case WAKE_PATH_PWR_SW:
+        return pwr_sw_pulse();
+#endif
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static void record(wake_path_t path, esp_err_t err, uint32_t ms,
+                   bool fell_back)
+{
+    uint16_t ms16 = ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms;
+    wake_path_counters_t *c = &stats.path[path];
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.last_path = (uint8_t)path;
+    c->attempts++;
+    c->last_ms  = ms16;
+    c->last_err = err;
+    if (err == ESP_OK) {
+        c->ok++;
+        ok_ms_total[path] += ms;
+        uint32_t avg = ok_ms_total[path] / c->ok;
+        c->avg_ms = avg > UINT16_MAX ? UINT16_MAX : (uint16_t)avg;
+        if (ms16 > c->max_ms) {
+            c->max_ms = ms16;
+        }
+    } else if (fell_back) {
+        c->fallbacks++;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+
+    trace_log(TRACE_EVT_WAKE_PATH,
+              (uint16_t)(path | (err != ESP_OK ? 0x100 : 0)), ms);
+}
+
+/* ── Public API ──────────────────────────────────────────────────────────── */
+void wake_path_init(void)
+{
+    for (int i = 0; i < WAKE_PATH_COUNT; i++) {
+        stats.path[i].last_err = ESP_OK;
+    }
+#if CONFIG_PENTA_PWR_SW
+    pwr_sw_init();
+#endif
+}
+
+esp_err_t wake_path_run(bool power_on)
+{
+    wake_path_t steps[MAX_STEPS];
+    int n = plan(steps, power_on);
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+
+    for (int i = 0; i < n; i++) {
+        int64_t t0 = esp_timer_get_time();
+        err = try_path(steps[i]);
+        uint32_t ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+        bool more = err != ESP_OK && i + 1 < n;
+
+        if (more && host_state_is_awake()) {
+            /* It came up late after all; the next path would only
+             * disturb it */
+            record(steps[i], err, ms, false);
+            return ESP_OK;
+        }
+        record(steps[i], err, ms, more);
+        if (!more) {
+            break;
+        }
+        ESP_LOGW(TAG, "%s failed (%s), trying %s", path_name[steps[i]],
+                 esp_err_to_name(err), path_name[steps[i + 1]]);
+    }
+    return err;
+}
+
+void wake_path_get_stats(wake_path_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
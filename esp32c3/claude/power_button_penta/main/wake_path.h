@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/** Ways of waking the host, in the order they are preferred. */
+typedef enum {
+    WAKE_PATH_USB_RESUME = 0,   /* remote wake-up on a suspended bus       */
+    WAKE_PATH_HID_REPORT,       /* wake report to a host that is running   */
+    WAKE_PATH_PWR_SW,           /* pulse on the motherboard PWR_SW header  */
+    WAKE_PATH_COUNT,
+} wake_path_t;
+
+/** Per-path counters.  Latencies are ms from the start of the action. */
+typedef struct {
+    uint32_t  attempts;
+    uint32_t  ok;
+    uint32_t  fallbacks;        /* failures handed on to the next path     */
+    uint16_t  avg_ms;           /* of the successful attempts              */
+    uint16_t  max_ms;
+    uint16_t  last_ms;          /* last attempt, successful or not         */
+    esp_err_t last_err;
+} wake_path_counters_t;
+
+typedef struct {
+    uint8_t              last_path;     /* wake_path_t of the last wake    */
+    uint32_t             guarded;       /* PWR_SW pulses held back         */
+    wake_path_counters_t path[WAKE_PATH_COUNT];
+} wake_path_stats_t;
+
+/**
+ * Set up the paths; with CONFIG_PENTA_PWR_SW this drives the header GPIO
+ * to its released level.  Call early in app_main, before
+ * wake_dispatch_init().
+ */
+void wake_path_init(void);
+
+/**
+ * Wake the host the fastest way its state allows, falling back when a
+ * path fails:
+ *   suspended, remote wake-up armed   USB resume, then PWR_SW
+ *   suspended, not armed              PWR_SW
+ *   mounted or resumed                HID report only
+ *   unpowered (S5, off, no host)      PWR_SW
+ * Without CONFIG_PENTA_PWR_SW the USB paths are tried as before.  Without
+ * CONFIG_PENTA_PWR_SENSE, PWR_SW is only in the plan when power_on is set,
+ * i.e. the client vouched that the host is off or asleep (WAKE_OP_POWER);
+ * otherwise the USB paths are tried as without PWR_SW.
+ *
+ * A running host never gets a PWR_SW pulse, because a short press would
+ * shut it down or suspend it.  The pulse is held back, and counted in
+ * `guarded`, while the host is mounted or the sense input reads it as
+ * running, during the first seconds after boot, before the host has had a
+ * chance to enumerate us, and for CONFIG_PENTA_PWR_SW_HOLDOFF_S after a
+ * pulse the host has not answered yet.
+ *
+ * Blocks: ~1.5 s on the USB paths, up to CONFIG_PENTA_PWR_SW_VERIFY_S on
+ * PWR_SW while it waits for the host to enumerate.  Dispatcher task only.
+ * Returns the result of the last path tried.
+ */
+esp_err_t wake_path_run(bool power_on);
+
+/** Copy the counters into *out. */
+void wake_path_get_stats(wake_path_stats_t *out);
@@ -0,0 +1,248 @@
+/**
+ * wake_proto.c
+ *
+ * Parses the opcode protocol on the wake characteristic (see wake_proto.h)
+ * and runs the sequences the dispatcher hands back.
+ *
+ * Validation happens in the BLE callback so a bad write is refused with
+ * an ATT error before anything is queued.  Execution happens later in the
+ * dispatcher task, where blocking on the USB host is allowed.  A write
+ * that is just WAKE still goes through WAKE_CMD_WAKE, so bursts of them
+ * keep being merged into one key press.
+ *
+ * The reply belongs to the client reading it: PING and QUERY tokens and
+ * the last result are kept per link in conn_table.h, so two clients
+ * driving the dongle at once never see each other's answers.
+ */
+
+#include "wake_proto.h"
+#include "wake_dispatch.h"
+#include "conn_table.h"
+#include "wake_path.h"
+#include "usb_hid.h"
+#include "latency.h"
+#include "pm_gov.h"
+#include "sdkconfig.h"
+#if CONFIG_PENTA_WAKE_AUTH
+#include "wake_auth.h"
+#endif
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+
+static const char *TAG = "WAKE_PROTO";
+
+#define HOLD_MIN_MS         1
+#define HOLD_MAX_MS         1000
+#define DELAY_MAX_MS        10000
+#define CONSUMER_MAX_USAGE  0x03FF
+
+static const uint8_t wake_only[] = { WAKE_OP_WAKE };
+
+static volatile bool     busy;
+static volatile uint32_t ops_run;
+
+/* ── Helpers ─────────────────────────────────────────────────────────────── */
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* Length of the operation at ops[0] including the opcode, or 0 if it is
+ * unknown, truncated or out of range. */
+static size_t op_len(const uint8_t *ops, size_t avail)
+{
+    size_t len;
+
+    switch (ops[0]) {
+    case WAKE_OP_WAKE:
+    case WAKE_OP_POWER: len = 1; break;
+    case WAKE_OP_PING:
+    case WAKE_OP_QUERY: len = 2; break;
+    case WAKE_OP_HOLD:
+    case WAKE_OP_DELAY:
+    case WAKE_OP_CONSUMER: len = 3; break;
+    case WAKE_OP_KEYS:
+        if (avail < 2 || ops[1] == 0) {
+            return 0;
+        }
+        len = 2 + 2 * (size_t)ops[1];
+        break;
+    default:
+        return 0;
+    }
+    if (len > avail) {
+        return 0;
+    }
+    if (ops[0] == WAKE_OP_HOLD &&
+        (get_u16(&ops[1]) < HOLD_MIN_MS || get_u16(&ops[1]) > HOLD_MAX_MS)) {
+        return 0;
+    }
+    if (ops[0] == WAKE_OP_DELAY && get_u16(&ops[1]) > DELAY_MAX_MS) {
+        return 0;
+    }
+    if (ops[0] == WAKE_OP_CONSUMER &&
+        (get_u16(&ops[1]) == 0 || get_u16(&ops[1]) > CONSUMER_MAX_USAGE)) {
+        return 0;
+    }
+    return len;
+}
+
+/* ── BLE side ────────────────────────────────────────────────────────────── */
+esp_err_t wake_proto_handle_write(uint16_t conn, const uint8_t *data,
+                                  size_t len)
+{
+    if (len == 0 || len > WAKE_PROTO_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_PENTA_WAKE_AUTH
+    esp_err_t err = wake_auth_open(&data, &len);
+    if (err != ESP_OK) {
+        return err;
+    }
+#endif
+
+    /* Single byte: WAKE, or a legacy "any write wakes" client */
+    if (len == 1 && op_len(data, 1) != 1) {
+        data = wake_only;
+    }
+
+    bool only_ping = true;
+    for (size_t pos = 0; pos < len; ) {
+        size_t n = op_len(&data[pos], len - pos);
+        if (n == 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (data[pos] != WAKE_OP_PING) {
+            only_ping = false;
+        }
+        pos += n;
+    }
+
+    /* Valid: answer pings now, queue the rest */
+    for (size_t pos = 0; pos < len; pos += op_len(&data[pos], len - pos)) {
+        if (data[pos] == WAKE_OP_PING) {
+            conn_table_set_ping(conn, data[pos + 1]);
+        }
+    }
+    if (only_ping) {
+        return ESP_OK;
+    }
+
+    latency_mark(LAT_STAGE_GATT_WRITE);
+    bool queued = (len == 1 && data[0] == WAKE_OP_WAKE)
+        ? wake_dispatch_post(conn, WAKE_CMD_WAKE)
+        : wake_dispatch_post_macro(conn, data, len);
+    return queued ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+uint8_t wake_proto_att_error(esp_err_t err)
+{
+    switch (err) {
+    case ESP_ERR_NO_MEM:        return WAKE_PROTO_ATT_ERR_BUSY;
+    case ESP_ERR_INVALID_CRC:   return WAKE_PROTO_ATT_ERR_AUTH;
+    case ESP_ERR_INVALID_STATE: return WAKE_PROTO_ATT_ERR_REPLAY;
+    default:                    return WAKE_PROTO_ATT_ERR_INVALID;
+    }
+}
+
+size_t wake_proto_build_reply(uint16_t conn, uint8_t *buf, size_t cap)
+{
+    if (cap < WAKE_PROTO_REPLY_LEN) {
+        return 0;
+    }
+
+    usb_hid_bus_t bus;
+    usb_hid_get_bus(&bus);
+    conn_ctx_t ctx = { .last_result = ESP_OK };
+    int slot = conn_table_slot(conn);
+    if (slot >= 0) {
+        conn_table_get(slot, &ctx);
+    }
+
+    uint8_t flags = (bus.mounted    ? WAKE_PROTO_FLAG_MOUNTED    : 0) |
+                    (bus.suspended  ? WAKE_PROTO_FLAG_SUSPENDED  : 0) |
+                    (bus.wake_armed ? WAKE_PROTO_FLAG_WAKE_ARMED : 0) |
+                    (busy           ? WAKE_PROTO_FLAG_BUSY       : 0);
+    uint16_t hold   = usb_hid_get_hold_ms();
+    uint32_t result = (uint32_t)ctx.last_result;
+    uint32_t ops    = ops_run;
+#if CONFIG_PENTA_WAKE_AUTH
+    uint32_t auth   = wake_auth_last_counter();
+#else
+    uint32_t auth   = 0;
+#endif
+
+    buf[0]  = WAKE_PROTO_VERSION;
+    buf[1]  = ctx.ping_token;
+    buf[2]  = ctx.query_token;
+    buf[3]  = flags;
+    buf[4]  = (uint8_t)hold;
+    buf[5]  = (uint8_t)(hold >> 8);
+    for (int i = 0; i < 4; i++) {
+        buf[6 + i]  = (uint8_t)(result >> (8 * i));
+        buf[10 + i] = (uint8_t)(ops >> (8 * i));
+        buf[14 + i] = (uint8_t)(auth >> (8 * i));
+    }
+    return WAKE_PROTO_REPLY_LEN;
+}
+
+/* ── Dispatcher side ─────────────────────────────────────────────────────── */
+static esp_err_t run_op(uint16_t conn, const uint8_t *op)
+{
+    switch (op[0]) {
+    case WAKE_OP_WAKE:
+        return wake_path_run(false);
+    case WAKE_OP_POWER:
+        return wake_path_run(true);
+    case WAKE_OP_KEYS:
+        for (int i = 0; i < op[1]; i++) {
+            esp_err_t err = usb_hid_tap_key(op[2 + 2 * i], op[3 + 2 * i]);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+        return ESP_OK;
+    case WAKE_OP_HOLD:
+        usb_hid_set_hold_ms(get_u16(&op[1]));
+        return ESP_OK;
+    case WAKE_OP_QUERY:
+        conn_table_set_query(conn, op[1]);
+        return ESP_OK;
+    case WAKE_OP_DELAY:
+        /* Waiting on the host: idle at the minimum frequency meanwhile */
+        pm_gov_end();
+        vTaskDelay(pdMS_TO_TICKS(get_u16(&op[1])));
+        pm_gov_begin();
+        return ESP_OK;
+    case WAKE_OP_CONSUMER:
+        return usb_hid_tap_consumer(get_u16(&op[1]));
+    default:                    /* PING was answered on receipt */
+        return ESP_OK;
+    }
+}
+
+esp_err_t wake_proto_run(uint16_t conn, const uint8_t *ops, size_t len)
+{
+    esp_err_t err = ESP_OK;
+
+    busy = true;
+    for (size_t pos = 0; pos < len && err == ESP_OK; ) {
+        size_t n = op_len(&ops[pos], len - pos);
+        if (n == 0) {
+            err = ESP_ERR_INVALID_ARG;      /* validated on receipt */
+            break;
+        }
+        err = run_op(conn, &ops[pos]);
+        ops_run++;
+        pos += n;
+    }
+    busy = false;
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Sequence stopped: %s", esp_err_to_name(err));
+    }
+    return err;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * Command protocol on the wake characteristic (0xFF01).
+ *
+ * A write carries one or more operations back to back, each  op u8 | args:
+ *
+ *   0x01 WAKE                         resume the host, tap the wake key
+ *   0x02 PING   token u8              echoed in the reply right away
+ *   0x03 KEYS   n u8, n × (mod u8, keycode u8)
+ *                                     tap each HID key in turn
+ *   0x04 HOLD   ms u16                key hold time for later taps
+ *   0x05 QUERY  token u8              echoed once every earlier op has run
+ *   0x06 DELAY  ms u16                pause the sequence
+ *   0x07 CONSUMER usage u16           tap a Consumer Control usage
+ *   0x08 POWER                        WAKE, and the client vouches that the
+ *                                     host is off or asleep: without a power
+ *                                     sense input PWR_SW may only be pressed
+ *                                     for this (wake_path.h)
+ *
+ * Integers are little-endian.  The whole write is checked before anything
+ * runs and rejected if any operation is malformed.  A one-byte write that
+ * is not an opcode is a plain wake, as it was before the protocol existed.
+ *
+ * Apart from PING, operations run in order in the dispatcher task, so one
+ * write-without-response can carry "wake, wait, type the unlock sequence"
+ * and the BLE callback still returns at once.  A failing operation ends
+ * its sequence.
+ *
+ * With CONFIG_PENTA_WAKE_AUTH every write is wrapped in an authenticated
+ * frame (wake_auth.h) and anything else, plain wakes included, is refused.
+ *
+ * Reading the characteristic returns the reply (WAKE_PROTO_REPLY_LEN):
+ *   version u8 | ping_token u8 | query_token u8 | flags u8 |
+ *   hold_ms u16 | last_result i32 | ops_run u32 | auth_counter u32
+ * flags are WAKE_PROTO_FLAG_*, sampled at read time.  The tokens and
+ * last_result belong to the client that reads: its last PING, the last
+ * QUERY of its sequences that ran, and the dispatcher's (wake_dispatch.h)
+ * result for the last of its commands that finished.  Since a failure
+ * ends a sequence, a QUERY token echoed back also means every operation
+ * before it succeeded.  auth_counter is the highest accepted
+ * frame counter (0 without authentication).
+ */
+#define WAKE_PROTO_VERSION      1
+#define WAKE_PROTO_MAX_LEN      125     /* one ATT write at MTU 128 */
+#define WAKE_PROTO_REPLY_LEN    18
+
+typedef enum {
+    WAKE_OP_WAKE     = 0x01,
+    WAKE_OP_PING     = 0x02,
+    WAKE_OP_KEYS     = 0x03,
+    WAKE_OP_HOLD     = 0x04,
+    WAKE_OP_QUERY    = 0x05,
+    WAKE_OP_DELAY    = 0x06,
+    WAKE_OP_CONSUMER = 0x07,
+    WAKE_OP_POWER    = 0x08,
+} wake_op_t;
+
+#define WAKE_PROTO_FLAG_MOUNTED     0x01    /* USB configured by the host */
+#define WAKE_PROTO_FLAG_SUSPENDED   0x02    /* bus suspended (host asleep) */
+#define WAKE_PROTO_FLAG_WAKE_ARMED  0x04    /* host enabled remote wake-up */
+#define WAKE_PROTO_FLAG_BUSY        0x08    /* a sequence is running       */
+
+/* ATT application error codes returned for rejected writes */
+#define WAKE_PROTO_ATT_ERR_INVALID  0x80
+#define WAKE_PROTO_ATT_ERR_BUSY     0x81
+#define WAKE_PROTO_ATT_ERR_AUTH     0x82    /* bad tag, or no key set      */
+#define WAKE_PROTO_ATT_ERR_REPLAY   0x83    /* counter not above the last  */
+
+/**
+ * Validate and queue a write from connection conn on the wake
+ * characteristic.  BLE stack context; never blocks.  Returns ESP_ERR_INVALID_ARG for a malformed
+ * write, ESP_ERR_NO_MEM if the dispatcher cannot take it, or one of the
+ * wake_auth_open() errors.
+ */
+esp_err_t wake_proto_handle_write(uint16_t conn, const uint8_t *data,
+                                  size_t len);
+
+/** The ATT error a backend should answer for a wake_proto_handle_write()
+ *  error. */
+uint8_t wake_proto_att_error(esp_err_t err);
+
+/** Serialise conn's reply into buf; returns the number of bytes used. */
+size_t wake_proto_build_reply(uint16_t conn, uint8_t *buf, size_t cap);
+
+/**
+ * Run a validated sequence that conn sent.  Dispatcher task only; blocks
+ * for as long as the keys, delays and the host resume take.
+ */
+esp_err_t wake_proto_run(uint16_t conn, const uint8_t *ops, size_t len);
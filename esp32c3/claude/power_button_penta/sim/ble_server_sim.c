@@ -0,0 +1,429 @@
+/**
+ * ble_server_sim.c
+ *
+ * BLE backend (ble_server.h) for the host simulation, and a model of the
+ * centrals talking to it (sim.h).
+ *
+ * The GATT and GAP handlers do what ble_server_nimble.c does with the
+ * same events – a wake write goes through wake_proto_handle_write(),
+ * conn_policy_on_activity() and the trace, a connect is marked for the
+ * latency breakdown and reported to conn_policy.c, links and
+ * subscriptions go into conn_table.c – so the modules above see the
+ * same calls in the same order.  They run in the world task, standing
+ * in for the NimBLE host task.
+ *
+ * Nothing goes on air, so the radio is accounted instead: advertising
+ * events at the midpoint of the interval range plus the 0–10 ms random
+ * advDelay, and connection events at the interval times (latency + 1) a
+ * peripheral with nothing to send is allowed to skip.
+ */
+
+#include "ble_server.h"
+#include "sim.h"
+
+#include "adv_sched.h"
+#include "adv_supervisor.h"
+#include "boot_time.h"
+#include "conn_policy.h"
+#include "conn_table.h"
+#include "latency.h"
+#include "trace.h"
+#include "tuning.h"
+#include "wake_dispatch.h"
+#include "wake_proto.h"
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "BLE_SIM";
+
+#define SYNC_MS                 20      /* controller enable → host synced */
+#define ADV_DELAY_AVG_US        5000    /* advDelay is 0–10 ms */
+#define CONNECT_ITVL            24      /* 30 ms, a typical phone's choice */
+#define CONNECT_TIMEOUT         400     /* 4 s */
+#define HCI_REMOTE_USER_TERM    0x13
+#define HCI_UNACCEPTABLE_PARAMS 0x3B
+#define ATT_ERR_INVALID_LEN     0x0D
+
+typedef struct {
+    bool     used;
+    uint16_t conn;
+    uint16_t interval;          /* 1.25 ms units */
+    uint16_t latency;
+    uint16_t timeout;
+    int64_t  since_us;          /* start of the current parameter segment */
+    /* connection parameter update in flight */
+    uint32_t update_gen;        /* request the link waits for */
+    uint16_t want_itvl;
+    uint16_t want_latency;
+    uint16_t want_timeout;
+} sim_link_t;
+
+static sim_central_cfg_t central = {
+    .update_ms      = 50,
+    .accept_updates = true,
+};
+
+static sim_ble_stats_t stats;
+static sim_link_t links[CONN_TABLE_MAX];
+static bool synced;
+static bool adv_on;
+static int64_t adv_since_us;
+static uint16_t adv_itvl_min = 32;      /* 20 ms until adv_sched says */
+static uint16_t adv_itvl_max = 64;
+static double adv_events_done;         /* closed segments */
+static double conn_events_done;
+static uint32_t update_gen;             /* last parameter request issued */
+
+/* ── Radio accounting ────────────────────────────────────────────────────── */
+static double adv_events_since(int64_t now)
+{
+    if (!adv_on) {
+        return 0;
+    }
+    double itvl_us = (adv_itvl_min + adv_itvl_max) * 625.0 / 2 +
+                     ADV_DELAY_AVG_US;
+    return (now - adv_since_us) / itvl_us;
+}
+
+static double conn_events_since(const sim_link_t *l, int64_t now)
+{
+    double period_us = l->interval * 1250.0 * (l->latency + 1);
+    return (now - l->since_us) / period_us;
+}
+
+static void adv_close_segment(void)
+{
+    int64_t now = sim_now_us();
+
+    adv_events_done += adv_events_since(now);
+    adv_since_us = now;
+}
+
+static void link_set_params(sim_link_t *l, uint16_t itvl, uint16_t latency,
+                            uint16_t timeout)
+{
+    int64_t now = sim_now_us();
+
+    if (l->interval > 0) {
+        conn_events_done += conn_events_since(l, now);
+    }
+    l->interval = itvl;
+    l->latency  = latency;
+    l->timeout  = timeout;
+    l->since_us = now;
+}
+
+static sim_link_t *find_link(uint16_t conn)
+{
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (links[i].used && links[i].conn == conn) {
+            return &links[i];
+        }
+    }
+    return NULL;
+}
+
+/* ── Advertising ─────────────────────────────────────────────────────────── */
+static void start_advertising(void)
+{
+    if (!synced || adv_on) {
+        return;
+    }
+    if (conn_table_full()) {
+        return;         /* no connection slot left to advertise */
+    }
+    adv_on = true;
+    adv_since_us = sim_now_us();
+    trace_log(TRACE_EVT_ADV_START, adv_itvl_min, 0);
+    boot_time_mark(BOOT_STAGE_ADV_START);
+}
+
+static void adv_stop(void)
+{
+    adv_close_segment();
+    adv_on = false;
+}
+
+static void host_sync(void *arg, int value)
+{
+    (void)arg; (void)value;
+    synced = true;
+    boot_time_mark(BOOT_STAGE_BLE_SYNC);
+    start_advertising();
+}
+
+void ble_server_init(void)
+{
+    sim_world_at(sim_now_us() + SYNC_MS * SIM_MS, host_sync, NULL, 0);
+    ESP_LOGI(TAG, "Simulated BLE server up");
+}
+
+void ble_server_set_adv_interval(uint16_t itvl_min, uint16_t itvl_max)
+{
+    stats.adv_changes++;
+    if (adv_on) {
+        adv_stop();
+        adv_itvl_min = itvl_min;
+        adv_itvl_max = itvl_max;
+        start_advertising();
+    } else {
+        adv_itvl_min = itvl_min;
+        adv_itvl_max = itvl_max;
+    }
+}
+
+bool ble_server_adv_healthy(void)
+{
+    return synced && (adv_on || conn_table_full());
+}
+
+static void restart_ev(void *arg, int value)
+{
+    (void)arg; (void)value;
+    start_advertising();
+}
+
+void ble_server_restart_advertising(void)
+{
+    sim_world_at(sim_now_us(), restart_ev, NULL, 0);
+}
+
+/* Like a host reset: every link drops and the host syncs again */
+void ble_server_recover(void)
+{
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (links[i].used) {
+            sim_ble_disconnect(links[i].conn);
+        }
+    }
+    if (adv_on) {
+        adv_stop();
+    }
+    synced = false;
+    sim_world_at(sim_now_us() + SYNC_MS * SIM_MS, host_sync, NULL, 0);
+}
+
+void ble_server_set_pairing(bool open)
+{
+    (void)open;
+}
+
+void ble_server_start_scan(uint16_t interval, uint16_t window,
+                           bool all_reports, ble_server_adv_report_cb_t cb)
+{
+    (void)interval; (void)window; (void)all_reports; (void)cb;
+    ESP_LOGW(TAG, "Scanning is not simulated");
+}
+
+void ble_server_stop_scan(void)
+{
+}
+
+int ble_server_get_peer_ids(ble_server_peer_id_t *out, int max)
+{
+    (void)out; (void)max;
+    return 0;
+}
+
+void ble_server_get_radio(ble_server_radio_t *out)
+{
+    *out = (ble_server_radio_t) {
+        .ext_adv           = false,
+        .adv_primary_phy   = 1,
+        .adv_secondary_phy = 1,
+        .conn_phy_pref     = 0,
+        .last_tx_phy       = stats.links > 0 ? 1 : 0,
+        .last_rx_phy       = stats.links > 0 ? 1 : 0,
+        .phy_updates       = 0,
+    };
+}
+
+void ble_server_notify_ota(uint16_t conn, const uint8_t *value, size_t len)
+{
+    (void)conn; (void)value; (void)len;
+}
+
+void ble_server_prepare_bulk(uint16_t conn)
+{
+    (void)conn;
+}
+
+void ble_server_notify_host_state(void)
+{
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        conn_ctx_t ctx;
+        if (conn_table_get(i, &ctx) && (ctx.subs & CONN_SUB_HOST_STATE)) {
+            stats.notifications++;
+        }
+    }
+}
+
+/* ── Connection parameters ───────────────────────────────────────────────── */
+static void param_update_done(void *arg, int gen)
+{
+    sim_link_t *l = arg;
+
+    if (!l->used || (uint32_t)gen != l->update_gen) {
+        return;         /* link gone, or a newer request replaced it */
+    }
+    if (central.accept_updates) {
+        link_set_params(l, l->want_itvl, l->want_latency, l->want_timeout);
+        conn_policy_on_params(l->conn, 0, l->interval, l->latency,
+                              l->timeout);
+    } else {
+        conn_policy_on_params(l->conn, HCI_UNACCEPTABLE_PARAMS, l->interval,
+                              l->latency, l->timeout);
+    }
+}
+
+/* The central settles on the shortest interval it was offered */
+void ble_server_request_conn_params(uint16_t conn, uint16_t itvl_min,
+                                    uint16_t itvl_max, uint16_t latency,
+                                    uint16_t timeout)
+{
+    (void)itvl_max;
+    sim_link_t *l = find_link(conn);
+
+    if (l == NULL) {
+        return;
+    }
+    stats.param_requests++;
+    l->update_gen   = ++update_gen;
+    l->want_itvl    = itvl_min;
+    l->want_latency = latency;
+    l->want_timeout = timeout;
+    sim_world_at(sim_now_us() + central.update_ms * SIM_MS,
+                 param_update_done, l, (int)l->update_gen);
+}
+
+/* ── Central model ───────────────────────────────────────────────────────── */
+sim_central_cfg_t *sim_central_cfg(void)
+{
+    return &central;
+}
+
+void sim_ble_get_stats(sim_ble_stats_t *out)
+{
+    int64_t now = sim_now_us();
+    double conn = conn_events_done;
+
+    for (int i = 0; i < CONN_TABLE_MAX; i++) {
+        if (links[i].used) {
+            conn += conn_events_since(&links[i], now);
+        }
+    }
+    *out = stats;
+    out->adv_itvl_min = adv_itvl_min;
+    out->adv_itvl_max = adv_itvl_max;
+    out->adv_events   = (uint32_t)(adv_events_done + adv_events_since(now));
+    out->conn_events  = (uint32_t)conn;
+}
+
+void sim_ble_connect(uint16_t conn)
+{
+    const uint8_t addr[6] = { (uint8_t)conn, (uint8_t)(conn >> 8) };
+    sim_link_t *l = NULL;
+
+    if (!synced || !adv_on || find_link(conn) != NULL ||
+        conn_table_add(conn, addr) < 0) {
+        ESP_LOGW(TAG, "Central %u cannot connect now", conn);
+        stats.refused++;
+        return;
+    }
+    for (int i = 0; i < CONN_TABLE_MAX && l == NULL; i++) {
+        if (!links[i].used) {
+            l = &links[i];
+        }
+    }
+    *l = (sim_link_t) { .used = true, .conn = conn };
+    link_set_params(l, CONNECT_ITVL, 0, CONNECT_TIMEOUT);
+    stats.links++;
+
+    latency_mark(LAT_STAGE_CONNECT);
+    trace_log(TRACE_EVT_CONNECT, conn, 0);
+    conn_policy_on_connect(conn, l->interval, l->latency, l->timeout);
+
+    /* The connectable set ends with the connection; keep advertising so
+     * other clients can still find us */
+    adv_stop();
+    start_advertising();
+}
+
+void sim_ble_disconnect(uint16_t conn)
+{
+    sim_link_t *l = find_link(conn);
+
+    if (l == NULL) {
+        return;
+    }
+    conn_events_done += conn_events_since(l, sim_now_us());
+    l->used = false;
+    stats.links--;
+    wake_dispatch_on_disconnect(conn);
+    conn_table_remove(conn);
+
+    trace_log(TRACE_EVT_DISCONNECT, conn, HCI_REMOTE_USER_TERM);
+    conn_policy_on_disconnect(conn);
+    adv_sched_on_event(ADV_EVT_DISCONNECT);
+    start_advertising();
+}
+
+void sim_ble_write_wake(uint16_t conn, const uint8_t *data, uint16_t len)
+{
+    if (find_link(conn) == NULL) {
+        ESP_LOGW(TAG, "Write from central %u without a link", conn);
+        return;
+    }
+    if (len > WAKE_PROTO_MAX_LEN) {
+        stats.writes++;
+        stats.rejected++;
+        stats.last_att = ATT_ERR_INVALID_LEN;
+        return;
+    }
+    stats.writes++;
+    esp_err_t err = wake_proto_handle_write(conn, data, len);
+    conn_table_on_write(conn, err == ESP_OK);
+    conn_policy_on_activity(conn);
+    trace_log(TRACE_EVT_WAKE_WRITE, conn, len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Wake write rejected: %s", esp_err_to_name(err));
+        trace_log(TRACE_EVT_WAKE_REJECT, conn, (uint32_t)err);
+        stats.rejected++;
+        stats.last_att = wake_proto_att_error(err);
+        return;
+    }
+    stats.last_att = 0;
+}
+
+void sim_ble_subscribe(uint16_t conn, uint8_t sub, bool on)
+{
+    if (find_link(conn) == NULL) {
+        ESP_LOGW(TAG, "Subscription from central %u without a link", conn);
+        return;
+    }
+    conn_table_set_sub(conn, sub, on);
+}
+
+void sim_ble_write_tuning(uint16_t conn, const uint8_t *data, uint16_t len)
+{
+#if CONFIG_PENTA_TUNING
+    if (find_link(conn) == NULL) {
+        ESP_LOGW(TAG, "Write from central %u without a link", conn);
+        return;
+    }
+    stats.writes++;
+    esp_err_t err = len > TUNING_WRITE_MAX ? ESP_ERR_INVALID_SIZE
+                                           : tuning_handle_write(data, len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Tuning write rejected: %s", esp_err_to_name(err));
+        stats.rejected++;
+        stats.last_att = TUNING_ATT_ERR_INVALID;
+        return;
+    }
+    stats.last_att = 0;
+#else
+    (void)conn; (void)data; (void)len;
+    ESP_LOGW(TAG, "Tuning is disabled in this build");
+#endif
+}
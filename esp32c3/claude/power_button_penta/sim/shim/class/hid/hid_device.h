@@ -0,0 +1,35 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    HID_REPORT_TYPE_INVALID = 0,
+    HID_REPORT_TYPE_INPUT,
+    HID_REPORT_TYPE_OUTPUT,
+    HID_REPORT_TYPE_FEATURE,
+} hid_report_type_t;
+
+#define HID_PROTOCOL_BOOT                   0
+#define HID_PROTOCOL_REPORT                 1
+#define HID_ITF_PROTOCOL_KEYBOARD           1
+
+#define HID_REPORT_ID(id)                   0x85, (id),
+#define TUD_HID_REPORT_DESC_KEYBOARD(...)   0x05, 0x01, __VA_ARGS__ 0xC0
+#define TUD_HID_REPORT_DESC_SYSTEM_CONTROL(...) \
+                                            0x05, 0x01, __VA_ARGS__ 0xC0
+#define TUD_HID_REPORT_DESC_CONSUMER(...)   0x05, 0x0C, __VA_ARGS__ 0xC0
+
+bool tud_hid_ready(void);
+bool tud_hid_report(uint8_t report_id, const void *report, uint16_t len);
+bool tud_hid_keyboard_report(uint8_t report_id, uint8_t modifier,
+                             const uint8_t keycode[6]);
+uint8_t tud_hid_get_protocol(void);
+
+/* Implemented by the application (usb_hid.c) */
+uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance);
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id,
+                               hid_report_type_t report_type,
+                               uint8_t *buffer, uint16_t reqlen);
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
+                           hid_report_type_t report_type,
+                           uint8_t const *buffer, uint16_t bufsize);
@@ -0,0 +1,13 @@
+#pragma once
+#include "esp_err.h"
+
+/* Printed with the virtual time; -v shows everything, otherwise only
+ * warnings and errors */
+void sim_log(char level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, ...)      sim_log('E', tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...)      sim_log('W', tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...)      sim_log('I', tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...)      sim_log('D', tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...)      sim_log('V', tag, __VA_ARGS__)
@@ -0,0 +1,5 @@
+#pragma once
+#include <stdint.h>
+
+/** RTC time in µs; equals esp_timer time in the simulation. */
+uint64_t esp_clk_rtc_time(void);
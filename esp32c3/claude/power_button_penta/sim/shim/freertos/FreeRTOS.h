@@ -0,0 +1,57 @@
+#pragma once
+/**
+ * FreeRTOS for the host simulation (sim/sim.h).
+ *
+ * Just enough of the kernel API for the firmware modules, implemented in
+ * sim_kernel.c on a virtual clock.  Tasks are cooperative: one runs until
+ * it blocks, so critical sections have nothing to exclude.
+ *
+ * Like the real header it pulls in sdkconfig.h, which several modules
+ * rely on for their CONFIG_ options.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef int          BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t     TickType_t;
+typedef uint8_t      StackType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+#define configTICK_RATE_HZ      CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES    25
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFu)
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) \
+    ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define configASSERT(x)         ((void)(x))
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    { 0 }
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+#define portENTER_CRITICAL_SAFE(mux)    ((void)(mux))
+#define portEXIT_CRITICAL_SAFE(mux)     ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)     ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)      ((void)(mux))
+
+/* Static buffers are accepted and ignored; the kernel keeps its own */
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+typedef struct { int unused; } StaticSemaphore_t;
+typedef struct { int unused; } StaticEventGroup_t;
+typedef struct { int unused; } StaticTimer_t;
+
+#define BIT0    0x01u
+#define BIT1    0x02u
+#define BIT2    0x04u
+#define BIT3    0x08u
+#define BIT4    0x10u
+#define BIT5    0x20u
+#define BIT6    0x40u
+#define BIT7    0x80u
@@ -0,0 +1,14 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct sim_event_group *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t eg, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t eg, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t eg);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t eg, EventBits_t bits,
+                                BaseType_t clear, BaseType_t all,
+                                TickType_t ticks);
@@ -0,0 +1,22 @@
+#pragma once
+#include "FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t depth,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name,
+                               uint32_t depth, void *arg, UBaseType_t prio,
+                               StackType_t *stack, StaticTask_t *tcb);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TaskHandle_t xTaskGetHandle(const char *name);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#define taskYIELD()             vTaskDelay(0)
@@ -0,0 +1,106 @@
+#pragma once
+/**
+ * Configuration of the simulated build.
+ *
+ * The Kconfig defaults (main/Kconfig.projbuild) and sdkconfig.defaults,
+ * except for what the simulation has no model of: OTA, the bond filter,
+ * beacon wake, wake authentication and power-state accounting are off.
+ * PWR_SW is on, with the power-sense input the host model drives, so the
+ * fallback path runs too.
+ *
+ * Every value can be overridden from the command line, e.g.
+ *   cmake -B build -DCMAKE_C_FLAGS="-DCONFIG_PENTA_SYSTEM_WAKE=0"
+ */
+
+#define CONFIG_IDF_TARGET_ESP32C3                   1
+#define CONFIG_BT_ENABLED                           1
+#define CONFIG_BT_BLUEDROID_ENABLED                 1
+#define CONFIG_PM_ENABLE                            1
+#define CONFIG_FREERTOS_USE_TICKLESS_IDLE           1
+#define CONFIG_FREERTOS_HZ                          100
+
+#ifndef CONFIG_PENTA_IDLE_STATS
+#define CONFIG_PENTA_IDLE_STATS                     0
+#endif
+#ifndef CONFIG_PENTA_POWER_STATS
+#define CONFIG_PENTA_POWER_STATS                    0
+#endif
+#ifndef CONFIG_PENTA_SKIP_WAKE_WHEN_AWAKE
+#define CONFIG_PENTA_SKIP_WAKE_WHEN_AWAKE           1
+#endif
+#ifndef CONFIG_PENTA_ADV_FAST_BURST_S
+#define CONFIG_PENTA_ADV_FAST_BURST_S               30
+#endif
+#ifndef CONFIG_PENTA_ADV_SLOW_WHEN_HOST_AWAKE
+#define CONFIG_PENTA_ADV_SLOW_WHEN_HOST_AWAKE       0
+#endif
+#ifndef CONFIG_PENTA_CONN_IDLE_AFTER_S
+#define CONFIG_PENTA_CONN_IDLE_AFTER_S              5
+#endif
+#ifndef CONFIG_PENTA_CONN_IDLE_INTERVAL_MS
+#define CONFIG_PENTA_CONN_IDLE_INTERVAL_MS          200
+#endif
+#ifndef CONFIG_PENTA_CONN_IDLE_LATENCY
+#define CONFIG_PENTA_CONN_IDLE_LATENCY              4
+#endif
+#ifndef CONFIG_PENTA_MAX_CONNECTIONS
+#define CONFIG_PENTA_MAX_CONNECTIONS                3
+#endif
+#define CONFIG_PENTA_BOND_FILTER                    0
+#define CONFIG_PENTA_BEACON_WAKE                    0
+#ifndef CONFIG_PENTA_SYSTEM_WAKE
+#define CONFIG_PENTA_SYSTEM_WAKE                    1
+#endif
+#ifndef CONFIG_PENTA_TRACE_ENTRIES
+#define CONFIG_PENTA_TRACE_ENTRIES                  256
+#endif
+#define CONFIG_PENTA_TRACE_DUMP_AT_BOOT             1
+#ifndef CONFIG_PENTA_FAST_BOOT
+#define CONFIG_PENTA_FAST_BOOT                      0
+#endif
+#ifndef CONFIG_PENTA_BOOT_TARGET_MS
+#define CONFIG_PENTA_BOOT_TARGET_MS                 300
+#endif
+#ifndef CONFIG_PENTA_ADV_SUPERVISE_MS
+#define CONFIG_PENTA_ADV_SUPERVISE_MS               5000
+#endif
+#ifndef CONFIG_PENTA_ADV_RECOVER_AFTER
+#define CONFIG_PENTA_ADV_RECOVER_AFTER              3
+#endif
+#define CONFIG_PENTA_ADV_PHY_1M_2M                  1
+#define CONFIG_PENTA_CONN_PHY_2M                    1
+#define CONFIG_PENTA_WAKE_AUTH                      0
+#define CONFIG_PENTA_OTA                            0
+#ifndef CONFIG_PENTA_PWR_SW
+#define CONFIG_PENTA_PWR_SW                         1
+#endif
+#ifndef CONFIG_PENTA_PWR_SW_GPIO
+#define CONFIG_PENTA_PWR_SW_GPIO                    4
+#endif
+#ifndef CONFIG_PENTA_PWR_SW_ACTIVE_LOW
+#define CONFIG_PENTA_PWR_SW_ACTIVE_LOW              0
+#endif
+#ifndef CONFIG_PENTA_PWR_SW_PULSE_MS
+#define CONFIG_PENTA_PWR_SW_PULSE_MS                200
+#endif
+#ifndef CONFIG_PENTA_PWR_SW_VERIFY_S
+#define CONFIG_PENTA_PWR_SW_VERIFY_S                30
+#endif
+#ifndef CONFIG_PENTA_PWR_SW_HOLDOFF_S
+#define CONFIG_PENTA_PWR_SW_HOLDOFF_S               90
+#endif
+#ifndef CONFIG_PENTA_PWR_SENSE
+#define CONFIG_PENTA_PWR_SENSE                      1
+#endif
+#ifndef CONFIG_PENTA_PWR_SENSE_GPIO
+#define CONFIG_PENTA_PWR_SENSE_GPIO                 5
+#endif
+#ifndef CONFIG_PENTA_PWR_SENSE_ACTIVE_LOW
+#define CONFIG_PENTA_PWR_SENSE_ACTIVE_LOW           0
+#endif
+#ifndef CONFIG_PENTA_TUNING
+#define CONFIG_PENTA_TUNING                         1
+#endif
+#ifndef CONFIG_PENTA_TUNING_COMMIT_MS
+#define CONFIG_PENTA_TUNING_COMMIT_MS               2000
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+/**
+ * esp_tinyusb and the TinyUSB device API for the host simulation.
+ *
+ * sim_usb.c implements the device side against a model of the USB host
+ * (enumeration, suspend, resume, endpoint polling).  Descriptors are
+ * accepted and not parsed, so the descriptor macros expand to placeholder
+ * bytes only.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define CFG_TUD_ENDPOINT0_SIZE              64
+#define TUSB_DESC_DEVICE                    0x01
+#define TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP  0x20
+
+typedef struct __attribute__((packed)) {
+    uint8_t  bLength;
+    uint8_t  bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t  bDeviceClass;
+    uint8_t  bDeviceSubClass;
+    uint8_t  bDeviceProtocol;
+    uint8_t  bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t  iManufacturer;
+    uint8_t  iProduct;
+    uint8_t  iSerialNumber;
+    uint8_t  bNumConfigurations;
+} tusb_desc_device_t;
+
+typedef struct {
+    const tusb_desc_device_t *device_descriptor;
+    const char              **string_descriptor;
+    int                       string_descriptor_count;
+    bool                      external_phy;
+    const uint8_t            *configuration_descriptor;
+    bool                      self_powered;
+    int                       vbus_monitor_io;
+} tinyusb_config_t;
+
+#define TUD_CONFIG_DESC_LEN                 9
+#define TUD_HID_DESC_LEN                    25
+#define TUD_CONFIG_DESCRIPTOR(...)          0x09, 0x02
+#define TUD_HID_DESCRIPTOR(...)             0x09, 0x04
+
+esp_err_t tinyusb_driver_install(const tinyusb_config_t *config);
+
+/* ── Device stack ────────────────────────────────────────────────────────── */
+void tud_task_ext(uint32_t timeout_ms, bool in_isr);
+bool tud_mounted(void);
+bool tud_suspended(void);
+bool tud_remote_wakeup(void);
+
+/* Implemented by the application (usb_hid.c) */
+void tud_mount_cb(void);
+void tud_umount_cb(void);
+void tud_suspend_cb(bool remote_wakeup_en);
+void tud_resume_cb(void);
@@ -0,0 +1,188 @@
+#pragma once
+/**
+ * Host simulation of the Penta firmware.
+ *
+ * The application modules in main/ are built unmodified for Linux against
+ * the headers in sim/shim/, which stand in for ESP-IDF, FreeRTOS, TinyUSB
+ * and the BLE stack.  Everything runs on one virtual clock:
+ *
+ *   sim_kernel.c     FreeRTOS tasks, queues, semaphores, event groups and
+ *                    timers, plus esp_timer.  Tasks are coroutines; one
+ *                    runs until it blocks, and when none can run the clock
+ *                    jumps to the next deadline.  Code takes no time, so
+ *                    a latency is the sum of the waits on the way.
+ *   sim_platform.c   esp_log, esp_pm (lock and sleep accounting), NVS in
+ *                    RAM with commit faults, GPIO, reset reason, heap figures.
+ *   sim_usb.c        esp_tinyusb and a model of the USB host: enumeration,
+ *                    S3 suspend, remote wake-up, HID endpoint polling and
+ *                    the PWR_SW header.
+ *   ble_server_sim.c BLE backend (ble_server.h) and a model of the
+ *                    central: writes, connection parameter updates,
+ *                    advertising and connection event counts.
+ *   sim_main.c       Scenario scripts (sim/scenarios/), the "world" task
+ *                    that plays them, checks and the report.
+ *
+ * Runs are deterministic: no wall clock, no randomness, no threads.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_MS                  1000LL
+#define SIM_S                   (1000 * SIM_MS)
+
+/* ── Kernel (sim_kernel.c) ──────────────────────────────────────────────── */
+
+typedef bool (*sim_cond_t)(void *arg);
+
+/** Current virtual time, µs. */
+int64_t sim_now_us(void);
+
+/**
+ * Block the calling task until cond(arg) holds or the clock reaches
+ * deadline_us (-1: no deadline).  cond may be NULL for a plain sleep.
+ * Returns true if cond held.  Task context only.
+ */
+bool sim_wait_until(sim_cond_t cond, void *arg, int64_t deadline_us);
+
+/** Convert a FreeRTOS timeout from now into a deadline (-1: forever). */
+int64_t sim_tick_deadline(uint32_t ticks);
+
+/** Create the timer service tasks.  Before sim_run_until(). */
+void sim_kernel_init(void);
+
+/** Run tasks and advance the clock until end_us. */
+void sim_run_until(int64_t end_us);
+
+typedef struct {
+    const char *name;
+    unsigned    prio;
+    uint32_t    runs;           /* times scheduled                       */
+    uint32_t    cpu_wakeups;    /* times it ended an idle period          */
+} sim_task_info_t;
+
+typedef struct {
+    uint32_t cpu_wakeups;       /* idle periods ended by a deadline       */
+    int64_t  idle_us;           /* time no task could run                 */
+} sim_kernel_stats_t;
+
+void sim_kernel_get_stats(sim_kernel_stats_t *out);
+
+/** Task i in creation order; false past the last one. */
+bool sim_task_info(int i, sim_task_info_t *out);
+
+/* ── Power management (sim_platform.c) ──────────────────────────────────── */
+
+/** The kernel found nothing to run from now until end_us. */
+void sim_pm_idle(int64_t end_us);
+
+typedef struct {
+    int      max_mhz;           /* from esp_pm_configure()               */
+    int      min_mhz;
+    bool     light_sleep;
+    int64_t  sleep_us;          /* idle time spent in light sleep        */
+    int64_t  cpu_max_us;        /* time an ESP_PM_CPU_FREQ_MAX lock held */
+    int64_t  no_sleep_us;       /* time an ESP_PM_NO_LIGHT_SLEEP held    */
+    uint32_t sleeps;            /* light-sleep entries                   */
+} sim_pm_stats_t;
+
+void sim_pm_get_stats(sim_pm_stats_t *out);
+
+/** Print log lines below warning level too. */
+void sim_log_set_verbose(bool on);
+
+typedef struct {
+    uint32_t fail_commits;      /* nvs_commit() calls still to fail       */
+} sim_nvs_cfg_t;
+
+sim_nvs_cfg_t *sim_nvs_cfg(void);
+
+/* ── World events (sim_main.c) ──────────────────────────────────────────── */
+
+typedef void (*sim_event_fn_t)(void *arg, int value);
+
+/**
+ * Run fn(arg, value) in the world task at time at_us (not before now).
+ * The world task plays the part of everything outside the chip: the USB
+ * host, the BLE central and the radio: whatever it calls into the
+ * firmware runs as if in an ISR or the BLE host task.
+ */
+void sim_world_at(int64_t at_us, sim_event_fn_t fn, void *arg, int value);
+
+/* ── USB host model (sim_usb.c) ─────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t resume_ms;         /* remote wake-up signalled → bus resumed  */
+    uint32_t poll_ms;           /* HID interrupt endpoint polling interval */
+    uint32_t boot_ms;           /* PWR_SW press → dongle enumerated        */
+    uint32_t shutdown_ms;       /* PWR_SW press on a running host → off    */
+    uint32_t sleep_after_ms;    /* awake host suspends again, 0 = never    */
+    bool     wake_armed;        /* host arms remote wake-up at suspend     */
+    bool     pwr_sw;            /* PWR_SW header wired to the dongle       */
+    bool     port_live;         /* host enumerates the dongle when up; 0:
+                                 * port or hub off, dongle on its own supply */
+    bool     boot_protocol;     /* host selects the boot protocol (BIOS)   */
+} sim_host_cfg_t;
+
+typedef struct {
+    bool     powered;
+    bool     mounted;
+    bool     suspended;
+    uint32_t mounts;
+    uint32_t suspends;
+    uint32_t resumes;           /* bus resumed, by either side             */
+    uint32_t remote_wakeups;    /* resumes the dongle started              */
+    uint32_t key_reports;       /* keyboard reports with a key down        */
+    uint32_t system_reports;    /* System Wake Up reports                  */
+    uint32_t consumer_reports;  /* consumer usages pressed                 */
+    uint32_t pwr_presses;
+    int64_t  last_input_us;     /* time of the last key-down, -1 = none    */
+} sim_host_stats_t;
+
+sim_host_cfg_t *sim_host_cfg(void);
+void sim_host_get_stats(sim_host_stats_t *out);
+
+/* Host-side events, world task */
+void sim_host_power_on(void);   /* boots and enumerates after boot_ms      */
+void sim_host_mount(void);
+void sim_host_power_off(void);
+void sim_host_suspend(void);
+void sim_host_resume(void);     /* host-initiated, e.g. its own keyboard   */
+
+/** PWR_SW GPIO level from gpio_set_level(). */
+void sim_host_pwr_sw(int pin, uint32_t level);
+
+/** Level the host drives on dongle input pin (power sense), -1 for none. */
+int sim_host_gpio_in(int pin);
+
+/* ── BLE central model (ble_server_sim.c) ───────────────────────────────── */
+
+typedef struct {
+    uint32_t update_ms;         /* connection parameter update delay       */
+    bool     accept_updates;    /* central accepts requested parameters    */
+} sim_central_cfg_t;
+
+typedef struct {
+    uint32_t writes;
+    uint32_t rejected;          /* writes answered with an ATT error       */
+    uint8_t  last_att;          /* ATT error of the last write, 0 = none   */
+    uint32_t notifications;     /* host-state notifications                */
+    uint32_t param_requests;
+    uint32_t adv_changes;       /* interval changes pushed                 */
+    uint32_t adv_events;        /* advertising events on air, estimated    */
+    uint32_t conn_events;       /* connection events, estimated            */
+    uint16_t adv_itvl_min;
+    uint16_t adv_itvl_max;
+    uint8_t  links;
+    uint32_t refused;           /* connects with nothing to connect to     */
+} sim_ble_stats_t;
+
+sim_central_cfg_t *sim_central_cfg(void);
+void sim_ble_get_stats(sim_ble_stats_t *out);
+
+/* Central-side events, world task */
+void sim_ble_connect(uint16_t conn);
+void sim_ble_disconnect(uint16_t conn);
+void sim_ble_write_wake(uint16_t conn, const uint8_t *data, uint16_t len);
+void sim_ble_write_tuning(uint16_t conn, const uint8_t *data, uint16_t len);
+/** CCC write; sub is one CONN_SUB_* bit (conn_table.h). */
+void sim_ble_subscribe(uint16_t conn, uint8_t sub, bool on);
@@ -0,0 +1,790 @@
+/**
+ * sim_kernel.c
+ *
+ * FreeRTOS and esp_timer on a virtual clock (sim.h).
+ *
+ * Each task is a ucontext coroutine with its own stack.  The scheduler
+ * runs the highest-priority task that can: one that is not blocked, whose
+ * wait condition now holds or whose deadline has passed, oldest first
+ * within a priority.  It runs until it blocks again.  There is no
+ * preemption: a task that readies a higher-priority one keeps the CPU
+ * until its next wait, which on the chip is a few µs of code later.
+ *
+ * When nothing can run, the clock jumps to the earliest deadline.  That
+ * is a CPU wake-up, charged to the task whose deadline it was.  Timeouts
+ * follow FreeRTOS: a wait of n ticks ends on the n-th tick from now, so
+ * delays keep the 10 ms granularity of the real build.
+ *
+ * FreeRTOS software timers run in a "Tmr Svc" task and esp_timer
+ * callbacks in an "esp_timer" task, at the priorities ESP-IDF gives them.
+ */
+
+#include "sim.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#define MAX_TASKS               24
+#define MAX_TIMERS              32
+#define TASK_STACK_BYTES        (256 * 1024)
+#define TICK_US                 (1000000LL / configTICK_RATE_HZ)
+#define TIMER_TASK_PRIO         1       /* CONFIG_FREERTOS_TIMER_TASK_PRIORITY */
+#define ESP_TIMER_TASK_PRIO     22      /* ESP_TASK_TIMER_PRIO */
+#define LIVELOCK_SWITCHES       1000000 /* without the clock moving */
+
+struct sim_task {
+    const char    *name;
+    unsigned       prio;
+    uint32_t       depth;
+    TaskFunction_t fn;
+    void          *arg;
+    ucontext_t     ctx;
+    void          *stack;
+    bool           done;
+    bool           blocked;
+    sim_cond_t     cond;
+    void          *cond_arg;
+    int64_t        deadline_us;     /* -1 = none */
+    bool           cond_met;        /* why the last wait ended */
+    uint64_t       seq;             /* FIFO order within a priority */
+    uint32_t       notify;
+    uint32_t       runs;
+    uint32_t       cpu_wakeups;
+};
+
+static struct sim_task tasks[MAX_TASKS];
+static int n_tasks;
+static struct sim_task *current;    /* NULL while the scheduler runs */
+static ucontext_t sched_ctx;
+static int64_t now_us;
+static uint64_t next_seq;
+static sim_kernel_stats_t kstats;
+
+/* ── Tasks ───────────────────────────────────────────────────────────────── */
+static struct sim_task *running(const char *what)
+{
+    if (current == NULL) {
+        fprintf(stderr, "sim: %s outside a task\n", what);
+        abort();
+    }
+    return current;
+}
+
+static void trampoline(void)
+{
+    struct sim_task *t = current;
+
+    t->fn(t->arg);
+    /* A FreeRTOS task must not return; treat it as deleting itself */
+    vTaskDelete(NULL);
+}
+
+static struct sim_task *spawn(TaskFunction_t fn, const char *name,
+                              uint32_t depth, void *arg, unsigned prio)
+{
+    if (n_tasks == MAX_TASKS) {
+        fprintf(stderr, "sim: more than %d tasks\n", MAX_TASKS);
+        abort();
+    }
+    struct sim_task *t = &tasks[n_tasks++];
+
+    memset(t, 0, sizeof(*t));
+    t->name        = name;
+    t->prio        = prio;
+    t->depth       = depth;
+    t->fn          = fn;
+    t->arg         = arg;
+    t->deadline_us = -1;
+    t->seq         = next_seq++;
+    t->stack       = malloc(TASK_STACK_BYTES);
+    if (t->stack == NULL) {
+        abort();
+    }
+    getcontext(&t->ctx);
+    t->ctx.uc_stack.ss_sp   = t->stack;
+    t->ctx.uc_stack.ss_size = TASK_STACK_BYTES;
+    t->ctx.uc_link          = &sched_ctx;
+    makecontext(&t->ctx, trampoline, 0);
+    return t;
+}
+
+static bool can_run(struct sim_task *t)
+{
+    if (t->done) {
+        return false;
+    }
+    if (!t->blocked) {
+        return true;
+    }
+    if (t->cond != NULL && t->cond(t->cond_arg)) {
+        return true;
+    }
+    return t->deadline_us >= 0 && t->deadline_us <= now_us;
+}
+
+static struct sim_task *pick(void)
+{
+    struct sim_task *best = NULL;
+
+    for (int i = 0; i < n_tasks; i++) {
+        struct sim_task *t = &tasks[i];
+        if (!can_run(t)) {
+            continue;
+        }
+        if (best == NULL || t->prio > best->prio ||
+            (t->prio == best->prio && t->seq < best->seq)) {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void switch_to(struct sim_task *t)
+{
+    t->cond_met = t->cond != NULL && t->cond(t->cond_arg);
+    t->blocked  = false;
+    t->runs++;
+    current = t;
+    swapcontext(&sched_ctx, &t->ctx);
+    current = NULL;
+}
+
+static void idle_until(int64_t until_us)
+{
+    if (until_us > now_us) {
+        sim_pm_idle(until_us);
+        kstats.idle_us += until_us - now_us;
+        now_us = until_us;
+    }
+}
+
+/* ── Kernel API (sim.h) ──────────────────────────────────────────────────── */
+int64_t sim_now_us(void)
+{
+    return now_us;
+}
+
+int64_t sim_tick_deadline(uint32_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return -1;
+    }
+    return (now_us / TICK_US + (int64_t)ticks) * TICK_US;
+}
+
+bool sim_wait_until(sim_cond_t cond, void *arg, int64_t deadline_us)
+{
+    struct sim_task *t = running("blocking call");
+
+    if (cond != NULL && cond(arg)) {
+        return true;
+    }
+    t->blocked     = true;
+    t->cond        = cond;
+    t->cond_arg    = arg;
+    t->deadline_us = deadline_us;
+    t->seq         = next_seq++;
+    swapcontext(&t->ctx, &sched_ctx);
+
+    t->cond = NULL;
+    t->deadline_us = -1;
+    return t->cond_met;
+}
+
+void sim_run_until(int64_t end_us)
+{
+    uint32_t switches = 0;
+
+    for (;;) {
+        struct sim_task *t = pick();
+        if (t != NULL) {
+            if (++switches > LIVELOCK_SWITCHES) {
+                fprintf(stderr, "sim: livelock at %lld us in %s\n",
+                        (long long)now_us, t->name);
+                abort();
+            }
+            switch_to(t);
+            continue;
+        }
+
+        struct sim_task *cause = NULL;
+        for (int i = 0; i < n_tasks; i++) {
+            struct sim_task *b = &tasks[i];
+            if (b->done || b->deadline_us < 0) {
+                continue;
+            }
+            if (cause == NULL || b->deadline_us < cause->deadline_us ||
+                (b->deadline_us == cause->deadline_us &&
+                 b->prio > cause->prio)) {
+                cause = b;
+            }
+        }
+        if (cause == NULL || cause->deadline_us > end_us) {
+            idle_until(end_us);
+            return;
+        }
+        idle_until(cause->deadline_us);
+        cause->cpu_wakeups++;
+        kstats.cpu_wakeups++;
+        switches = 0;
+    }
+}
+
+void sim_kernel_get_stats(sim_kernel_stats_t *out)
+{
+    *out = kstats;
+}
+
+bool sim_task_info(int i, sim_task_info_t *out)
+{
+    if (i < 0 || i >= n_tasks) {
+        return false;
+    }
+    out->name        = tasks[i].name;
+    out->prio        = tasks[i].prio;
+    out->runs        = tasks[i].runs;
+    out->cpu_wakeups = tasks[i].cpu_wakeups;
+    return true;
+}
+
+/* ── FreeRTOS tasks ──────────────────────────────────────────────────────── */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t depth,
+                       void *arg, UBaseType_t prio, TaskHandle_t *out)
+{
+    struct sim_task *t = spawn(fn, name, depth, arg, prio);
+
+    if (out != NULL) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name,
+                               uint32_t depth, void *arg, UBaseType_t prio,
+                               StackType_t *stack, StaticTask_t *tcb)
+{
+    (void)stack; (void)tcb;
+    return spawn(fn, name, depth, arg, prio);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct sim_task *t = task != NULL ? task : running("vTaskDelete(NULL)");
+
+    t->done = true;
+    if (t == current) {
+        swapcontext(&t->ctx, &sched_ctx);   /* never resumed */
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_wait_until(NULL, NULL, ticks == 0 ? now_us : sim_tick_deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+    for (int i = 0; i < n_tasks; i++) {
+        if (!tasks[i].done && strcmp(tasks[i].name, name) == 0) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+/* Host stacks say nothing about the chip's: report the whole depth free */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    struct sim_task *t = task != NULL ? task : running("stack query");
+    return t->depth;
+}
+
+static bool notified(void *arg)
+{
+    return ((struct sim_task *)arg)->notify > 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task->notify++;
+    return pdPASS;
+}
+
+static bool wait_for(sim_cond_t cond, void *arg, TickType_t ticks)
+{
+    if (cond(arg)) {
+        return true;
+    }
+    if (ticks == 0) {
+        return false;
+    }
+    return sim_wait_until(cond, arg, sim_tick_deadline(ticks));
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct sim_task *t = running("ulTaskNotifyTake");
+
+    if (!wait_for(notified, t, ticks)) {
+        return 0;
+    }
+    uint32_t v = t->notify;
+    t->notify = clear ? 0 : v - 1;
+    return v;
+}
+
+/* ── Queues ──────────────────────────────────────────────────────────────── */
+struct sim_queue {
+    uint8_t    *buf;
+    size_t      item;
+    UBaseType_t len;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static bool q_not_empty(void *arg)
+{
+    return ((struct sim_queue *)arg)->count > 0;
+}
+
+static bool q_not_full(void *arg)
+{
+    struct sim_queue *q = arg;
+    return q->count < q->len;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t item_size)
+{
+    return xQueueCreateStatic(len, item_size, NULL, NULL);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t len, UBaseType_t item_size,
+                                 uint8_t *storage, StaticQueue_t *buf)
+{
+    (void)buf;
+    struct sim_queue *q = calloc(1, sizeof(*q));
+
+    q->item = item_size;
+    q->len  = len;
+    q->buf  = storage != NULL ? storage : calloc(len, item_size);
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    if (!wait_for(q_not_full, q, ticks)) {
+        return pdFALSE;
+    }
+    memcpy(&q->buf[((q->head + q->count) % q->len) * q->item], item,
+           q->item);
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    if (!wait_for(q_not_empty, q, ticks)) {
+        return pdFALSE;
+    }
+    memcpy(item, &q->buf[q->head * q->item], q->item);
+    q->head = (q->head + 1) % q->len;
+    q->count--;
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    if (!wait_for(q_not_empty, q, ticks)) {
+        return pdFALSE;
+    }
+    memcpy(item, &q->buf[q->head * q->item], q->item);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    return q->count;
+}
+
+/* ── Semaphores ──────────────────────────────────────────────────────────── */
+struct sim_sem {
+    UBaseType_t count;
+    UBaseType_t max;
+};
+
+static bool sem_available(void *arg)
+{
+    return ((struct sim_sem *)arg)->count > 0;
+}
+
+static SemaphoreHandle_t sem_create(UBaseType_t count, UBaseType_t max)
+{
+    struct sim_sem *s = calloc(1, sizeof(*s));
+
+    s->count = count;
+    s->max   = max;
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+    (void)buf;
+    return sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(0, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (!wait_for(sem_available, sem, ticks)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->count >= sem->max) {
+        return pdFALSE;
+    }
+    sem->count++;
+    return pdTRUE;
+}
+
+/* ── Event groups ────────────────────────────────────────────────────────── */
+struct sim_event_group {
+    EventBits_t bits;
+};
+
+typedef struct {
+    struct sim_event_group *eg;
+    EventBits_t             want;
+    bool                    all;
+} eg_wait_t;
+
+static bool eg_ready(void *arg)
+{
+    eg_wait_t *w = arg;
+    EventBits_t got = w->eg->bits & w->want;
+    return w->all ? got == w->want : got != 0;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct sim_event_group));
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+    (void)buf;
+    return xEventGroupCreate();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t eg, EventBits_t bits)
+{
+    eg->bits |= bits;
+    return eg->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t eg, EventBits_t bits)
+{
+    EventBits_t before = eg->bits;
+    eg->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t eg)
+{
+    return eg->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t eg, EventBits_t bits,
+                                BaseType_t clear, BaseType_t all,
+                                TickType_t ticks)
+{
+    eg_wait_t w = { .eg = eg, .want = bits, .all = all };
+    bool met = wait_for(eg_ready, &w, ticks);
+    EventBits_t value = eg->bits;
+
+    if (met && clear) {
+        eg->bits &= ~bits;
+    }
+    return value;
+}
+
+/* ── Timer services ──────────────────────────────────────────────────────── */
+typedef struct {
+    const char       *task_name;
+    unsigned          prio;
+    struct sim_timer *list[MAX_TIMERS];
+    int               n;
+    uint32_t          gen;          /* bumped on every arm / disarm */
+    uint32_t          seen;
+} timer_svc_t;
+
+struct sim_timer {
+    timer_svc_t *svc;
+    bool         active;
+    int64_t      expiry_us;
+    int64_t      period_us;         /* esp_timer periodic, 0 = one-shot */
+    /* FreeRTOS software timer */
+    TickType_t              period_ticks;
+    bool                    reload;
+    void                   *id;
+    TimerCallbackFunction_t rtos_cb;
+    /* esp_timer */
+    esp_timer_cb_t cb;
+    void          *arg;
+};
+
+static timer_svc_t rtos_svc = {
+    .task_name = "Tmr Svc",
+    .prio      = TIMER_TASK_PRIO,
+};
+static timer_svc_t esp_svc = {
+    .task_name = "esp_timer",
+    .prio      = ESP_TIMER_TASK_PRIO,
+};
+
+static struct sim_timer *timer_new(timer_svc_t *svc)
+{
+    if (svc->n == MAX_TIMERS) {
+        fprintf(stderr, "sim: more than %d timers\n", MAX_TIMERS);
+        abort();
+    }
+    struct sim_timer *t = calloc(1, sizeof(*t));
+    t->svc = svc;
+    svc->list[svc->n++] = t;
+    return t;
+}
+
+static void timer_arm(struct sim_timer *t, int64_t expiry_us)
+{
+    t->active    = true;
+    t->expiry_us = expiry_us;
+    t->svc->gen++;
+}
+
+static void timer_disarm(struct sim_timer *t)
+{
+    t->active = false;
+    t->svc->gen++;
+}
+
+/* Earliest active timer, creation order on ties */
+static struct sim_timer *timer_next(timer_svc_t *svc)
+{
+    struct sim_timer *next = NULL;
+
+    for (int i = 0; i < svc->n; i++) {
+        struct sim_timer *t = svc->list[i];
+        if (t->active && (next == NULL || t->expiry_us < next->expiry_us)) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+static bool svc_changed(void *arg)
+{
+    timer_svc_t *svc = arg;
+    return svc->gen != svc->seen;
+}
+
+static void fire(struct sim_timer *t)
+{
+    if (t->svc == &rtos_svc) {
+        if (t->reload) {
+            t->expiry_us += (int64_t)t->period_ticks * TICK_US;
+        } else {
+            t->active = false;
+        }
+        t->rtos_cb(t);
+    } else {
+        if (t->period_us > 0) {
+            t->expiry_us += t->period_us;
+        } else {
+            t->active = false;
+        }
+        t->cb(t->arg);
+    }
+}
+
+static void timer_task(void *arg)
+{
+    timer_svc_t *svc = arg;
+
+    for (;;) {
+        svc->seen = svc->gen;
+        struct sim_timer *t = timer_next(svc);
+        if (t == NULL || t->expiry_us > now_us) {
+            sim_wait_until(svc_changed, svc, t != NULL ? t->expiry_us : -1);
+            continue;
+        }
+        fire(t);
+    }
+}
+
+void sim_kernel_init(void)
+{
+    spawn(timer_task, rtos_svc.task_name, 2048, &rtos_svc, rtos_svc.prio);
+    spawn(timer_task, esp_svc.task_name, 4096, &esp_svc, esp_svc.prio);
+}
+
+/* ── FreeRTOS software timers ────────────────────────────────────────────── */
+TimerHandle_t xTimerCreate(const char *name, TickType_t period,
+                           UBaseType_t reload, void *id,
+                           TimerCallbackFunction_t cb)
+{
+    (void)name;
+    struct sim_timer *t = timer_new(&rtos_svc);
+
+    t->period_ticks = period;
+    t->reload       = reload;
+    t->id           = id;
+    t->rtos_cb      = cb;
+    return t;
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period,
+                                 UBaseType_t reload, void *id,
+                                 TimerCallbackFunction_t cb,
+                                 StaticTimer_t *buf)
+{
+    (void)buf;
+    return xTimerCreate(name, period, reload, id, cb);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    timer_arm(timer, sim_tick_deadline(timer->period_ticks));
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks)
+{
+    return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks)
+{
+    (void)ticks;
+    timer_disarm(timer);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period,
+                              TickType_t ticks)
+{
+    timer->period_ticks = period;
+    return xTimerStart(timer, ticks);
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+/* ── esp_timer ───────────────────────────────────────────────────────────── */
+int64_t esp_timer_get_time(void)
+{
+    return now_us;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                           esp_timer_handle_t *out)
+{
+    if (args == NULL || args->callback == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct sim_timer *t = timer_new(&esp_svc);
+    t->cb  = args->callback;
+    t->arg = args->arg;
+    *out = t;
+    return ESP_OK;
+}
+
+/* Like ESP-IDF, starting a running timer or stopping an idle one fails */
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t us)
+{
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = 0;
+    timer_arm(timer, now_us + (int64_t)us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t us)
+{
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = (int64_t)us;
+    timer_arm(timer, now_us + (int64_t)us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer_disarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer_svc_t *svc = timer->svc;
+    for (int i = 0; i < svc->n; i++) {
+        if (svc->list[i] == timer) {
+            svc->list[i] = svc->list[--svc->n];
+            break;
+        }
+    }
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
@@ -0,0 +1,1290 @@
+/**
+ * sim_main.c
+ *
+ * Scenario runner for the host simulation (sim.h).
+ *
+ *   penta_sim [-v] [-t] scenario.sim
+ *
+ *   -v  print every log line, not only warnings and errors
+ *   -t  dump the event trace (trace.h) at the end
+ *
+ * The firmware boots at t = 0 as on the chip: app_main() runs in a "main"
+ * task at priority 1 next to the timer services.  A scenario is a list of
+ * timed events, one per line, played by the world task (sim.h):
+ *
+ *   at <time> [repeat <n> every <time>] <event>
+ *
+ * Times are in ms, or in s with an "s" suffix; '#' starts a comment.
+ *
+ *   mount | poweron | poweroff | suspend | resume    USB host (sim_usb.c)
+ *   host <name>=<value> ...                         host model settings
+ *   connect <c> | disconnect <c>                    central c (any id)
+ *   write <c> <hex>                                 wake characteristic
+ *   subscribe <c> host|ota | unsubscribe <c> ...     CCC writes
+ *   tune <c> <param>=<value> ... | tune <c> reset   tuning characteristic
+ *   central <name>=<value> ...                      central model settings
+ *   nvs <name>=<value> ...                          NVS faults (fail_commits)
+ *   expect <key> <op> <value>                       op: = != < <= > >=
+ *   stats                                           print the stats value
+ *
+ * Keys are <group>.<field> or <group>.<index>.<field>, the fields being
+ * those of the firmware's own stats structures: dispatch, usb, path,
+ * path.<usb_resume|hid_report|pwr_sw>, lat, lat.<stage>, pm, adv, conn,
+ * conn.<n>, client.<slot>, tuning, supervisor; and of the models: host,
+ * radio, power, state.  conn.<n> is the n-th link conn_policy tracks,
+ * client.<slot> the conn_table slot (all zero while it is free).  The run ends with the last event and prints a report: latency
+ * per stage, what each path and the host saw, CPU wake-ups per task and
+ * the share of time spent in light sleep.
+ *
+ * Exit status: 0 when every expectation held, 1 when one did not, 2 when
+ * the scenario could not be read.
+ */
+
+#include "sim.h"
+
+#include "adv_sched.h"
+#include "adv_supervisor.h"
+#include "conn_policy.h"
+#include "conn_table.h"
+#include "host_state.h"
+#include "latency.h"
+#include "pm_gov.h"
+#include "stats.h"
+#include "trace.h"
+#include "tuning.h"
+#include "usb_hid.h"
+#include "wake_dispatch.h"
+#include "wake_path.h"
+#include "wake_proto.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void app_main(void);
+
+#define WORLD_TASK_PRIO         (configMAX_PRIORITIES - 1)
+#define MAIN_TASK_PRIO          1       /* ESP_TASK_MAIN_PRIO */
+#define MAX_LINE                256
+#define MAX_TOKENS              24
+#define MAX_SETTINGS            8
+#define NAME_LEN                32
+
+/* ── World events ────────────────────────────────────────────────────────── */
+typedef struct {
+    int64_t        at_us;
+    uint64_t       seq;             /* FIFO among events due together */
+    sim_event_fn_t fn;
+    void          *arg;
+    int            value;
+} world_event_t;
+
+static world_event_t *events;       /* binary min-heap on (at_us, seq) */
+static size_t n_events, events_cap;
+static uint64_t event_seq;
+static uint32_t world_gen, world_seen;
+
+static bool event_before(const world_event_t *a, const world_event_t *b)
+{
+    return a->at_us < b->at_us || (a->at_us == b->at_us && a->seq < b->seq);
+}
+
+static void event_swap(size_t i, size_t j)
+{
+    world_event_t t = events[i];
+    events[i] = events[j];
+    events[j] = t;
+}
+
+void sim_world_at(int64_t at_us, sim_event_fn_t fn, void *arg, int value)
+{
+    if (n_events == events_cap) {
+        events_cap = events_cap ? 2 * events_cap : 64;
+        events = realloc(events, events_cap * sizeof(*events));
+        if (events == NULL) {
+            abort();
+        }
+    }
+    size_t i = n_events++;
+    events[i] = (world_event_t) {
+        .at_us = at_us > sim_now_us() ? at_us : sim_now_us(),
+        .seq   = event_seq++,
+        .fn    = fn,
+        .arg   = arg,
+        .value = value,
+    };
+    for (; i > 0 && event_before(&events[i], &events[(i - 1) / 2]);
+         i = (i - 1) / 2) {
+        event_swap(i, (i - 1) / 2);
+    }
+    world_gen++;
+}
+
+static world_event_t event_pop(void)
+{
+    world_event_t top = events[0];
+
+    events[0] = events[--n_events];
+    for (size_t i = 0;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n_events && event_before(&events[l], &events[m])) {
+            m = l;
+        }
+        if (r < n_events && event_before(&events[r], &events[m])) {
+            m = r;
+        }
+        if (m == i) {
+            break;
+        }
+        event_swap(i, m);
+        i = m;
+    }
+    return top;
+}
+
+static bool world_changed(void *arg)
+{
+    (void)arg;
+    return world_gen != world_seen;
+}
+
+static void world_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        world_seen = world_gen;
+        if (n_events == 0 || events[0].at_us > sim_now_us()) {
+            sim_wait_until(world_changed, NULL,
+                           n_events > 0 ? events[0].at_us : -1);
+            continue;
+        }
+        world_event_t ev = event_pop();
+        ev.fn(ev.arg, ev.value);
+    }
+}
+
+static void main_task(void *arg)
+{
+    (void)arg;
+    app_main();
+}
+
+/* ── Keys ────────────────────────────────────────────────────────────────── */
+typedef struct {
+    const char *name;
+    size_t      off;
+    uint8_t     size;
+    bool        is_signed;
+} field_t;
+
+#define FIELD(type, f)  { #f, offsetof(type, f), sizeof(((type *)0)->f), false }
+#define SFIELD(type, f) { #f, offsetof(type, f), sizeof(((type *)0)->f), true }
+#define COUNT(a)        (sizeof(a) / sizeof((a)[0]))
+
+/* Model figures that have no firmware structure of their own */
+typedef struct {
+    uint32_t wakeups;               /* idle periods ended by the firmware */
+    uint32_t interrupts;            /* ended by the host or a central     */
+    uint32_t sleeps;
+    uint32_t sleep_ms;
+    uint32_t sleep_permille;        /* of the simulated time              */
+    uint32_t cpu_max_ms;
+    uint32_t no_sleep_ms;
+} power_t;
+
+typedef struct {
+    uint32_t host;                  /* host_state_t                       */
+    uint32_t hold_ms;
+    uint32_t now_ms;
+} state_t;
+
+static const field_t dispatch_fields[] = {
+    FIELD(wake_dispatch_stats_t, received),
+    FIELD(wake_dispatch_stats_t, dropped),
+    FIELD(wake_dispatch_stats_t, coalesced),
+    FIELD(wake_dispatch_stats_t, executed),
+    FIELD(wake_dispatch_stats_t, failed),
+    SFIELD(wake_dispatch_stats_t, last_result),
+};
+
+static const field_t usb_fields[] = {
+    FIELD(usb_hid_stats_t, task_wakeups),
+    FIELD(usb_hid_stats_t, suspends),
+    FIELD(usb_hid_stats_t, resumes),
+    FIELD(usb_hid_stats_t, remote_wakeups),
+    FIELD(usb_hid_stats_t, wakes_skipped),
+};
+
+static const field_t path_fields[] = {
+    FIELD(wake_path_stats_t, last_path),
+    FIELD(wake_path_stats_t, guarded),
+};
+
+static const field_t path_counter_fields[] = {
+    FIELD(wake_path_counters_t, attempts),
+    FIELD(wake_path_counters_t, ok),
+    FIELD(wake_path_counters_t, fallbacks),
+    FIELD(wake_path_counters_t, avg_ms),
+    FIELD(wake_path_counters_t, max_ms),
+    FIELD(wake_path_counters_t, last_ms),
+    SFIELD(wake_path_counters_t, last_err),
+};
+
+static const field_t lat_fields[] = {
+    FIELD(lat_summary_t, wakes),
+};
+
+static const field_t lat_stage_fields[] = {
+    FIELD(lat_stage_summary_t, samples),
+    FIELD(lat_stage_summary_t, min_us),
+    FIELD(lat_stage_summary_t, avg_us),
+    FIELD(lat_stage_summary_t, p99_us),
+};
+
+static const field_t pm_fields[] = {
+    FIELD(pm_gov_stats_t, active),
+    FIELD(pm_gov_stats_t, holds),
+    FIELD(pm_gov_stats_t, held_ms),
+    FIELD(pm_gov_stats_t, max_ms),
+    FIELD(pm_gov_stats_t, last_ms),
+};
+
+static const field_t adv_fields[] = {
+    FIELD(adv_sched_state_t, mode),
+    FIELD(adv_sched_state_t, itvl_min),
+    FIELD(adv_sched_state_t, itvl_max),
+    FIELD(adv_sched_state_t, transitions),
+};
+
+static const field_t conn_fields[] = {
+    FIELD(conn_policy_state_t, n_links),
+};
+
+static const field_t conn_link_fields[] = {
+    FIELD(conn_policy_link_t, conn),
+    FIELD(conn_policy_link_t, phase),
+    FIELD(conn_policy_link_t, interval),
+    FIELD(conn_policy_link_t, latency),
+    FIELD(conn_policy_link_t, timeout),
+    FIELD(conn_policy_link_t, updates),
+    FIELD(conn_policy_link_t, rejected),
+};
+
+static const field_t client_fields[] = {
+    FIELD(conn_ctx_t, conn),
+    FIELD(conn_ctx_t, mtu),
+    FIELD(conn_ctx_t, subs),
+    FIELD(conn_ctx_t, ping_token),
+    FIELD(conn_ctx_t, query_token),
+    SFIELD(conn_ctx_t, last_result),
+    FIELD(conn_ctx_t, writes),
+    FIELD(conn_ctx_t, rejected),
+};
+
+#if CONFIG_PENTA_TUNING
+static const field_t tuning_fields[] = {
+    FIELD(tuning_stats_t, pending),
+    FIELD(tuning_stats_t, writes),
+    FIELD(tuning_stats_t, rejected),
+    FIELD(tuning_stats_t, changes),
+    FIELD(tuning_stats_t, commits),
+    FIELD(tuning_stats_t, commit_errors),
+};
+#endif
+
+static const field_t supervisor_fields[] = {
+    FIELD(adv_supervisor_stats_t, checks),
+    FIELD(adv_supervisor_stats_t, down),
+    FIELD(adv_supervisor_stats_t, retries),
+    FIELD(adv_supervisor_stats_t, recoveries),
+    FIELD(adv_supervisor_stats_t, host_resets),
+};
+
+static const field_t host_fields[] = {
+    FIELD(sim_host_stats_t, powered),
+    FIELD(sim_host_stats_t, mounted),
+    FIELD(sim_host_stats_t, suspended),
+    FIELD(sim_host_stats_t, mounts),
+    FIELD(sim_host_stats_t, suspends),
+    FIELD(sim_host_stats_t, resumes),
+    FIELD(sim_host_stats_t, remote_wakeups),
+    FIELD(sim_host_stats_t, key_reports),
+    FIELD(sim_host_stats_t, system_reports),
+    FIELD(sim_host_stats_t, consumer_reports),
+    FIELD(sim_host_stats_t, pwr_presses),
+};
+
+static const field_t radio_fields[] = {
+    FIELD(sim_ble_stats_t, writes),
+    FIELD(sim_ble_stats_t, rejected),
+    FIELD(sim_ble_stats_t, last_att),
+    FIELD(sim_ble_stats_t, notifications),
+    FIELD(sim_ble_stats_t, param_requests),
+    FIELD(sim_ble_stats_t, adv_changes),
+    FIELD(sim_ble_stats_t, adv_events),
+    FIELD(sim_ble_stats_t, conn_events),
+    FIELD(sim_ble_stats_t, adv_itvl_min),
+    FIELD(sim_ble_stats_t, adv_itvl_max),
+    FIELD(sim_ble_stats_t, links),
+    FIELD(sim_ble_stats_t, refused),
+};
+
+static const field_t power_fields[] = {
+    FIELD(power_t, wakeups),
+    FIELD(power_t, interrupts),
+    FIELD(power_t, sleeps),
+    FIELD(power_t, sleep_ms),
+    FIELD(power_t, sleep_permille),
+    FIELD(power_t, cpu_max_ms),
+    FIELD(power_t, no_sleep_ms),
+};
+
+static const field_t state_fields[] = {
+    FIELD(state_t, host),
+    FIELD(state_t, hold_ms),
+    FIELD(state_t, now_ms),
+};
+
+static const char *const path_names[WAKE_PATH_COUNT] = {
+    [WAKE_PATH_USB_RESUME] = "usb_resume",
+    [WAKE_PATH_HID_REPORT] = "hid_report",
+    [WAKE_PATH_PWR_SW]     = "pwr_sw",
+};
+
+static const char *const stage_names[LAT_STAGE_COUNT] = {
+    [LAT_STAGE_CONNECT]       = "connect",
+    [LAT_STAGE_GATT_WRITE]    = "gatt_write",
+    [LAT_STAGE_USB_RESUME]    = "usb_resume",
+    [LAT_STAGE_HID_READY]     = "hid_ready",
+    [LAT_STAGE_REPORT_QUEUED] = "report_queued",
+    [LAT_STAGE_KEY_RELEASED]  = "key_released",
+};
+
+static void power_get(power_t *out)
+{
+    sim_kernel_stats_t k;
+    sim_pm_stats_t pm;
+    sim_task_info_t t;
+    int64_t now = sim_now_us();
+
+    sim_kernel_get_stats(&k);
+    sim_pm_get_stats(&pm);
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; sim_task_info(i, &t); i++) {
+        if (strcmp(t.name, "world") == 0) {
+            out->interrupts = t.cpu_wakeups;
+        }
+    }
+    out->wakeups        = k.cpu_wakeups - out->interrupts;
+    out->sleeps         = pm.sleeps;
+    out->sleep_ms       = (uint32_t)(pm.sleep_us / 1000);
+    out->sleep_permille = now > 0 ? (uint32_t)(pm.sleep_us * 1000 / now) : 0;
+    out->cpu_max_ms     = (uint32_t)(pm.cpu_max_us / 1000);
+    out->no_sleep_ms    = (uint32_t)(pm.no_sleep_us / 1000);
+}
+
+/* Snapshots; index selects the record of an indexed group */
+static void snap_dispatch(void *out, int i)
+{
+    (void)i;
+    wake_dispatch_get_stats(out);
+}
+
+static void snap_usb(void *out, int i)
+{
+    (void)i;
+    usb_hid_get_stats(out);
+}
+
+static void snap_path(void *out, int i)
+{
+    (void)i;
+    wake_path_get_stats(out);
+}
+
+static void snap_path_counters(void *out, int i)
+{
+    wake_path_stats_t s;
+    wake_path_get_stats(&s);
+    memcpy(out, &s.path[i], sizeof(s.path[i]));
+}
+
+static void snap_lat(void *out, int i)
+{
+    (void)i;
+    latency_get_summary(out);
+}
+
+static void snap_lat_stage(void *out, int i)
+{
+    lat_summary_t s;
+    latency_get_summary(&s);
+    memcpy(out, &s.stage[i], sizeof(s.stage[i]));
+}
+
+static void snap_pm(void *out, int i)
+{
+    (void)i;
+    pm_gov_get_stats(out);
+}
+
+static void snap_adv(void *out, int i)
+{
+    (void)i;
+    adv_sched_get_state(out);
+}
+
+static void snap_conn(void *out, int i)
+{
+    (void)i;
+    conn_policy_get_state(out);
+}
+
+static void snap_conn_link(void *out, int i)
+{
+    conn_policy_state_t s;
+    conn_policy_get_state(&s);
+    memcpy(out, &s.link[i], sizeof(s.link[i]));
+}
+
+static void snap_client(void *out, int i)
+{
+    if (!conn_table_get(i, out)) {
+        memset(out, 0, sizeof(conn_ctx_t));
+    }
+}
+
+#if CONFIG_PENTA_TUNING
+static void snap_tuning(void *out, int i)
+{
+    (void)i;
+    tuning_get_stats(out);
+}
+#endif
+
+static void snap_supervisor(void *out, int i)
+{
+    (void)i;
+    adv_supervisor_get_stats(out);
+}
+
+static void snap_host(void *out, int i)
+{
+    (void)i;
+    sim_host_get_stats(out);
+}
+
+static void snap_radio(void *out, int i)
+{
+    (void)i;
+    sim_ble_get_stats(out);
+}
+
+static void snap_power(void *out, int i)
+{
+    (void)i;
+    power_get(out);
+}
+
+static void snap_state(void *out, int i)
+{
+    (void)i;
+    state_t *s = out;
+    s->host    = host_state_get();
+    s->hold_ms = usb_hid_get_hold_ms();
+    s->now_ms  = (uint32_t)(sim_now_us() / 1000);
+}
+
+typedef struct {
+    const char         *prefix;
+    const char *const  *index_names;    /* named records, or NULL */
+    int                 n_index;        /* records; 0 = not indexed */
+    const field_t      *fields;
+    size_t              n_fields;
+    void              (*snap)(void *out, int index);
+} group_t;
+
+#define GROUP(p, f, s)          { p, NULL, 0, f, COUNT(f), s }
+#define INDEXED(p, n, k, f, s)  { p, n, k, f, COUNT(f), s }
+
+static const group_t groups[] = {
+    GROUP("dispatch", dispatch_fields, snap_dispatch),
+    GROUP("usb", usb_fields, snap_usb),
+    GROUP("path", path_fields, snap_path),
+    INDEXED("path", path_names, WAKE_PATH_COUNT, path_counter_fields,
+            snap_path_counters),
+    GROUP("lat", lat_fields, snap_lat),
+    INDEXED("lat", stage_names, LAT_STAGE_COUNT, lat_stage_fields,
+            snap_lat_stage),
+    GROUP("pm", pm_fields, snap_pm),
+    GROUP("adv", adv_fields, snap_adv),
+    GROUP("conn", conn_fields, snap_conn),
+    INDEXED("conn", NULL, CONN_POLICY_MAX_LINKS, conn_link_fields,
+            snap_conn_link),
+    INDEXED("client", NULL, CONN_TABLE_MAX, client_fields, snap_client),
+#if CONFIG_PENTA_TUNING
+    GROUP("tuning", tuning_fields, snap_tuning),
+#endif
+    GROUP("supervisor", supervisor_fields, snap_supervisor),
+    GROUP("host", host_fields, snap_host),
+    GROUP("radio", radio_fields, snap_radio),
+    GROUP("power", power_fields, snap_power),
+    GROUP("state", state_fields, snap_state),
+};
+
+typedef struct {
+    const group_t *group;
+    const field_t *field;
+    int            index;
+} key_ref_t;
+
+static int find_index(const group_t *g, const char *s)
+{
+    if (g->index_names == NULL) {
+        char *end;
+        long i = strtol(s, &end, 10);
+        return *s != '\0' && *end == '\0' && i >= 0 && i < g->n_index
+               ? (int)i : -1;
+    }
+    for (int i = 0; i < g->n_index; i++) {
+        if (strcmp(g->index_names[i], s) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool key_resolve(const char *text, key_ref_t *out)
+{
+    char buf[3 * NAME_LEN];
+    char *part[3];
+    int n = 0;
+
+    if (strlen(text) >= sizeof(buf)) {
+        return false;
+    }
+    strcpy(buf, text);
+    for (char *p = strtok(buf, "."); p != NULL; p = strtok(NULL, ".")) {
+        if (n == 3) {
+            return false;
+        }
+        part[n++] = p;
+    }
+    if (n < 2) {
+        return false;
+    }
+    for (size_t g = 0; g < COUNT(groups); g++) {
+        const group_t *grp = &groups[g];
+        if (strcmp(grp->prefix, part[0]) != 0 ||
+            (grp->n_index > 0) != (n == 3)) {
+            continue;
+        }
+        int index = n == 3 ? find_index(grp, part[1]) : 0;
+        if (index < 0) {
+            continue;
+        }
+        for (size_t f = 0; f < grp->n_fields; f++) {
+            if (strcmp(grp->fields[f].name, part[n - 1]) == 0) {
+                *out = (key_ref_t) { grp, &grp->fields[f], index };
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int64_t field_read(const field_t *f, const void *base)
+{
+    const uint8_t *p = (const uint8_t *)base + f->off;
+
+    switch (f->size) {
+    case 1: {
+        uint8_t v; memcpy(&v, p, 1);
+        return f->is_signed ? (int8_t)v : v;
+    }
+    case 2: {
+        uint16_t v; memcpy(&v, p, 2);
+        return f->is_signed ? (int16_t)v : v;
+    }
+    case 4: {
+        uint32_t v; memcpy(&v, p, 4);
+        return f->is_signed ? (int64_t)(int32_t)v : (int64_t)v;
+    }
+    default: {
+        int64_t v; memcpy(&v, p, 8);
+        return v;
+    }
+    }
+}
+
+static void field_write(const field_t *f, void *base, int64_t value)
+{
+    uint8_t *p = (uint8_t *)base + f->off;
+
+    switch (f->size) {
+    case 1: { uint8_t v = (uint8_t)value;   memcpy(p, &v, 1); break; }
+    case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); break; }
+    case 4: { uint32_t v = (uint32_t)value; memcpy(p, &v, 4); break; }
+    default: memcpy(p, &value, 8); break;
+    }
+}
+
+static int64_t key_read(const key_ref_t *k)
+{
+    _Alignas(max_align_t) uint8_t buf[1024];
+
+    k->group->snap(buf, k->index);
+    return field_read(k->field, buf);
+}
+
+/* ── Model settings ──────────────────────────────────────────────────────── */
+static const field_t host_cfg_fields[] = {
+    FIELD(sim_host_cfg_t, resume_ms),
+    FIELD(sim_host_cfg_t, poll_ms),
+    FIELD(sim_host_cfg_t, boot_ms),
+    FIELD(sim_host_cfg_t, shutdown_ms),
+    FIELD(sim_host_cfg_t, sleep_after_ms),
+    FIELD(sim_host_cfg_t, wake_armed),
+    FIELD(sim_host_cfg_t, pwr_sw),
+    FIELD(sim_host_cfg_t, port_live),
+    FIELD(sim_host_cfg_t, boot_protocol),
+};
+
+static const field_t central_cfg_fields[] = {
+    FIELD(sim_central_cfg_t, update_ms),
+    FIELD(sim_central_cfg_t, accept_updates),
+};
+
+static const field_t nvs_cfg_fields[] = {
+    FIELD(sim_nvs_cfg_t, fail_commits),
+};
+
+/* penta_tune.py names */
+static const char *const tune_names[TUNE_COUNT] = {
+    [TUNE_WAKE_REPORT]       = "wake_report",
+    [TUNE_WAKE_KEY]          = "wake_key",
+    [TUNE_HOLD_MS]           = "hold_ms",
+    [TUNE_ADV_FAST_MIN]      = "adv_fast_min",
+    [TUNE_ADV_FAST_MAX]      = "adv_fast_max",
+    [TUNE_ADV_MEDIUM_MIN]    = "adv_medium_min",
+    [TUNE_ADV_MEDIUM_MAX]    = "adv_medium_max",
+    [TUNE_ADV_SLOW_MIN]      = "adv_slow_min",
+    [TUNE_ADV_SLOW_MAX]      = "adv_slow_max",
+    [TUNE_ADV_AWAKE_MIN]     = "adv_awake_min",
+    [TUNE_ADV_AWAKE_MAX]     = "adv_awake_max",
+    [TUNE_ADV_BURST_S]       = "adv_burst_s",
+    [TUNE_PM_MAX_MHZ]        = "pm_max_mhz",
+    [TUNE_PM_MIN_MHZ]        = "pm_min_mhz",
+    [TUNE_CONN_IDLE_AFTER_S] = "conn_idle_after_s",
+    [TUNE_CONN_IDLE_ITVL_MS] = "conn_idle_itvl_ms",
+    [TUNE_CONN_IDLE_LATENCY] = "conn_idle_latency",
+};
+
+/* ── Scenario ────────────────────────────────────────────────────────────── */
+typedef enum {
+    CMD_MOUNT,
+    CMD_POWERON,
+    CMD_POWEROFF,
+    CMD_SUSPEND,
+    CMD_RESUME,
+    CMD_HOST,
+    CMD_CONNECT,
+    CMD_DISCONNECT,
+    CMD_WRITE,
+    CMD_SUBSCRIBE,
+    CMD_UNSUBSCRIBE,
+    CMD_TUNE,
+    CMD_CENTRAL,
+    CMD_NVS,
+    CMD_EXPECT,
+    CMD_STATS,
+} cmd_t;
+
+typedef enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE } op_t;
+
+static const char *const op_names[] = { "=", "!=", "<", "<=", ">", ">=" };
+
+typedef struct {
+    int      line;
+    cmd_t    cmd;
+    uint16_t conn;
+    uint8_t  data[WAKE_PROTO_MAX_LEN + 1];
+    uint16_t len;
+    /* expect */
+    char     key_text[3 * NAME_LEN];
+    key_ref_t    key;
+    op_t     op;
+    int64_t  value;
+    /* host / central */
+    const field_t *set[MAX_SETTINGS];
+    int64_t  set_value[MAX_SETTINGS];
+    int      n_set;
+} step_t;
+
+static const char *script_name;
+static int checks_passed, checks_failed;
+
+static void run_step(void *arg, int value)
+{
+    (void)value;
+    step_t *s = arg;
+
+    switch (s->cmd) {
+    case CMD_MOUNT:      sim_host_mount(); break;
+    case CMD_POWERON:    sim_host_power_on(); break;
+    case CMD_POWEROFF:   sim_host_power_off(); break;
+    case CMD_SUSPEND:    sim_host_suspend(); break;
+    case CMD_RESUME:     sim_host_resume(); break;
+    case CMD_CONNECT:    sim_ble_connect(s->conn); break;
+    case CMD_DISCONNECT: sim_ble_disconnect(s->conn); break;
+    case CMD_WRITE:      sim_ble_write_wake(s->conn, s->data, s->len); break;
+    case CMD_SUBSCRIBE:  sim_ble_subscribe(s->conn, s->data[0], true); break;
+    case CMD_UNSUBSCRIBE:
+        sim_ble_subscribe(s->conn, s->data[0], false);
+        break;
+    case CMD_TUNE:       sim_ble_write_tuning(s->conn, s->data, s->len); break;
+    case CMD_HOST:
+    case CMD_CENTRAL:
+    case CMD_NVS: {
+        void *cfg = s->cmd == CMD_HOST    ? (void *)sim_host_cfg()
+                  : s->cmd == CMD_CENTRAL ? (void *)sim_central_cfg()
+                                          : (void *)sim_nvs_cfg();
+        for (int i = 0; i < s->n_set; i++) {
+            field_write(s->set[i], cfg, s->set_value[i]);
+        }
+        break;
+    }
+    case CMD_EXPECT: {
+        int64_t v = key_read(&s->key);
+        bool ok;
+        switch (s->op) {
+        case OP_EQ: ok = v == s->value; break;
+        case OP_NE: ok = v != s->value; break;
+        case OP_LT: ok = v <  s->value; break;
+        case OP_LE: ok = v <= s->value; break;
+        case OP_GT: ok = v >  s->value; break;
+        default:    ok = v >= s->value; break;
+        }
+        if (ok) {
+            checks_passed++;
+        } else {
+            checks_failed++;
+            printf("FAIL %s:%d at %lld ms: %s = %lld, expected %s %lld\n",
+                   script_name, s->line, (long long)(sim_now_us() / 1000),
+                   s->key_text, (long long)v, op_names[s->op],
+                   (long long)s->value);
+        }
+        break;
+    }
+    case CMD_STATS: {
+        uint8_t buf[STATS_MAX_LEN];
+        size_t len = stats_build(buf, sizeof(buf));
+        printf("stats at %lld ms:", (long long)(sim_now_us() / 1000));
+        for (size_t i = 0; i < len; i++) {
+            printf("%s%02x", i % 32 ? "" : "\n  ", buf[i]);
+        }
+        putchar('\n');
+        break;
+    }
+    }
+}
+
+static int parse_error(int line, const char *what, const char *tok)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", script_name, line, what,
+            tok ? ": " : "", tok ? tok : "");
+    return -1;
+}
+
+/* "<ms>" or "<s>s", with decimals */
+static bool parse_time(const char *s, int64_t *us)
+{
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+
+    if (end == s || errno != 0 || v < 0) {
+        return false;
+    }
+    if (strcmp(end, "s") == 0) {
+        v *= 1000;
+    } else if (*end != '\0' && strcmp(end, "ms") != 0) {
+        return false;
+    }
+    *us = llround(v * 1000);
+    return true;
+}
+
+static bool parse_int(const char *s, int64_t *out)
+{
+    char *end;
+    errno = 0;
+    long long v = strtoll(s, &end, 0);
+
+    if (end == s || *end != '\0' || errno != 0) {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+static bool parse_conn(const char *s, uint16_t *out)
+{
+    int64_t v;
+
+    if (!parse_int(s, &v) || v < 0 || v > 0xFFFF) {
+        return false;
+    }
+    *out = (uint16_t)v;
+    return true;
+}
+
+static bool parse_hex(const char *s, uint8_t *out, uint16_t cap,
+                      uint16_t *len)
+{
+    size_t n = strlen(s);
+
+    if (strncmp(s, "0x", 2) == 0) {
+        s += 2;
+        n -= 2;
+    }
+    if (n == 0 || n % 2 != 0 || n / 2 > cap) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!isxdigit((unsigned char)s[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+        unsigned b;
+        sscanf(&s[2 * i], "%2x", &b);
+        out[i] = (uint8_t)b;
+    }
+    *len = (uint16_t)(n / 2);
+    return true;
+}
+
+static const field_t *find_field(const field_t *fields, size_t n,
+                                 const char *name)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(fields[i].name, name) == 0) {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+static int parse_settings(step_t *s, char **tok, int n,
+                          const field_t *fields, size_t n_fields)
+{
+    if (n == 0 || n > MAX_SETTINGS) {
+        return parse_error(s->line, "expected 1 to 8 name=value", NULL);
+    }
+    for (int i = 0; i < n; i++) {
+        char *eq = strchr(tok[i], '=');
+        if (eq == NULL) {
+            return parse_error(s->line, "expected name=value", tok[i]);
+        }
+        *eq = '\0';
+        s->set[i] = find_field(fields, n_fields, tok[i]);
+        if (s->set[i] == NULL) {
+            return parse_error(s->line, "unknown setting", tok[i]);
+        }
+        if (!parse_int(eq + 1, &s->set_value[i])) {
+            return parse_error(s->line, "bad value", eq + 1);
+        }
+    }
+    s->n_set = n;
+    return 0;
+}
+
+static int parse_tune(step_t *s, char **tok, int n)
+{
+    if (n == 1 && strcmp(tok[0], "reset") == 0) {
+        s->data[0] = TUNING_OP_RESET;
+        s->len = 1;
+        return 0;
+    }
+    if (n == 0 || n > TUNE_COUNT) {
+        return parse_error(s->line, "expected param=value or reset", NULL);
+    }
+    s->len = 0;
+    for (int i = 0; i < n; i++) {
+        char *eq = strchr(tok[i], '=');
+        int id = -1;
+        int64_t v;
+
+        if (eq != NULL) {
+            *eq = '\0';
+            for (int p = 0; p < TUNE_COUNT; p++) {
+                if (strcmp(tune_names[p], tok[i]) == 0) {
+                    id = p;
+                }
+            }
+        }
+        if (id < 0) {
+            return parse_error(s->line, "unknown tuning parameter", tok[i]);
+        }
+        if (!parse_int(eq + 1, &v) || v < 0 || v > UINT32_MAX) {
+            return parse_error(s->line, "bad value", eq + 1);
+        }
+        uint8_t *p = &s->data[s->len];
+        p[0] = (uint8_t)id;
+        for (int b = 0; b < 4; b++) {
+            p[1 + b] = (uint8_t)(v >> (8 * b));
+        }
+        s->len += TUNING_PAIR_LEN;
+    }
+    return 0;
+}
+
+static int parse_command(step_t *s, char **tok, int n)
+{
+    static const struct {
+        const char *name;
+        cmd_t       cmd;
+        int         args;           /* -1: variable */
+    } cmds[] = {
+        { "mount", CMD_MOUNT, 0 },       { "poweron", CMD_POWERON, 0 },
+        { "poweroff", CMD_POWEROFF, 0 }, { "suspend", CMD_SUSPEND, 0 },
+        { "resume", CMD_RESUME, 0 },     { "host", CMD_HOST, -1 },
+        { "connect", CMD_CONNECT, 1 },   { "disconnect", CMD_DISCONNECT, 1 },
+        { "write", CMD_WRITE, 2 },       { "tune", CMD_TUNE, -1 },
+        { "central", CMD_CENTRAL, -1 },  { "expect", CMD_EXPECT, 3 },
+        { "stats", CMD_STATS, 0 },       { "subscribe", CMD_SUBSCRIBE, 2 },
+        { "unsubscribe", CMD_UNSUBSCRIBE, 2 },
+        { "nvs", CMD_NVS, -1 },
+    };
+    size_t c = 0;
+
+    while (c < COUNT(cmds) && strcmp(cmds[c].name, tok[0]) != 0) {
+        c++;
+    }
+    if (c == COUNT(cmds)) {
+        return parse_error(s->line, "unknown event", tok[0]);
+    }
+    if (cmds[c].args >= 0 && n - 1 != cmds[c].args) {
+        return parse_error(s->line, "wrong number of arguments", tok[0]);
+    }
+    s->cmd = cmds[c].cmd;
+
+    switch (s->cmd) {
+    case CMD_HOST:
+        return parse_settings(s, &tok[1], n - 1, host_cfg_fields,
+                              COUNT(host_cfg_fields));
+    case CMD_CENTRAL:
+        return parse_settings(s, &tok[1], n - 1, central_cfg_fields,
+                              COUNT(central_cfg_fields));
+    case CMD_NVS:
+        return parse_settings(s, &tok[1], n - 1, nvs_cfg_fields,
+                              COUNT(nvs_cfg_fields));
+    case CMD_CONNECT:
+    case CMD_DISCONNECT:
+        return parse_conn(tok[1], &s->conn)
+               ? 0 : parse_error(s->line, "bad central", tok[1]);
+    case CMD_WRITE:
+        if (!parse_conn(tok[1], &s->conn)) {
+            return parse_error(s->line, "bad central", tok[1]);
+        }
+        return parse_hex(tok[2], s->data, sizeof(s->data), &s->len)
+               ? 0 : parse_error(s->line, "bad hex value", tok[2]);
+    case CMD_SUBSCRIBE:
+    case CMD_UNSUBSCRIBE:
+        if (!parse_conn(tok[1], &s->conn)) {
+            return parse_error(s->line, "bad central", tok[1]);
+        }
+        if (strcmp(tok[2], "host") == 0) {
+            s->data[0] = CONN_SUB_HOST_STATE;
+        } else if (strcmp(tok[2], "ota") == 0) {
+            s->data[0] = CONN_SUB_OTA;
+        } else {
+            return parse_error(s->line, "expected host or ota", tok[2]);
+        }
+        return 0;
+    case CMD_TUNE:
+        if (n < 2 || !parse_conn(tok[1], &s->conn)) {
+            return parse_error(s->line, "bad central", n > 1 ? tok[1] : NULL);
+        }
+        return parse_tune(s, &tok[2], n - 2);
+    case CMD_EXPECT: {
+        size_t o = 0;
+        while (o < COUNT(op_names) && strcmp(op_names[o], tok[2]) != 0) {
+            o++;
+        }
+        if (o == COUNT(op_names)) {
+            return parse_error(s->line, "bad operator", tok[2]);
+        }
+        s->op = (op_t)o;
+        if (!key_resolve(tok[1], &s->key)) {
+            return parse_error(s->line, "unknown key", tok[1]);
+        }
+        snprintf(s->key_text, sizeof(s->key_text), "%s", tok[1]);
+        return parse_int(tok[3], &s->value)
+               ? 0 : parse_error(s->line, "bad value", tok[3]);
+    }
+    default:
+        return 0;
+    }
+}
+
+/* Schedules every event of the script; returns the time of the last */
+static int64_t load_script(FILE *f)
+{
+    char line[MAX_LINE];
+    int64_t end_us = -1;
+
+    for (int ln = 1; fgets(line, sizeof(line), f) != NULL; ln++) {
+        char *tok[MAX_TOKENS];
+        int n = 0;
+
+        line[strcspn(line, "#\r\n")] = '\0';
+        for (char *p = strtok(line, " \t"); p != NULL;
+             p = strtok(NULL, " \t")) {
+            if (n == MAX_TOKENS) {
+                return parse_error(ln, "line too long", NULL);
+            }
+            tok[n++] = p;
+        }
+        if (n == 0) {
+            continue;
+        }
+
+        int64_t at_us, every_us = 0, repeat = 1;
+        int t = 2;
+        if (n < 3 || strcmp(tok[0], "at") != 0 ||
+            !parse_time(tok[1], &at_us)) {
+            return parse_error(ln, "expected: at <time> <event>", NULL);
+        }
+        if (strcmp(tok[2], "repeat") == 0) {
+            if (n < 7 || !parse_int(tok[3], &repeat) || repeat < 1 ||
+                strcmp(tok[4], "every") != 0 ||
+                !parse_time(tok[5], &every_us) || every_us == 0) {
+                return parse_error(ln, "expected: repeat <n> every <time>",
+                                   NULL);
+            }
+            t = 6;
+        }
+
+        step_t *s = calloc(1, sizeof(*s));
+        s->line = ln;
+        if (parse_command(s, &tok[t], n - t) != 0) {
+            return -1;
+        }
+        for (int64_t i = 0; i < repeat; i++) {
+            int64_t when = at_us + i * every_us;
+            sim_world_at(when, run_step, s, 0);
+            if (when > end_us) {
+                end_us = when;
+            }
+        }
+    }
+    if (end_us < 0) {
+        fprintf(stderr, "%s: no events\n", script_name);
+    }
+    return end_us;
+}
+
+/* ── Report ──────────────────────────────────────────────────────────────── */
+static const char *const trace_names[] = {
+    [TRACE_EVT_BOOT]        = "boot",
+    [TRACE_EVT_CONNECT]     = "connect",
+    [TRACE_EVT_DISCONNECT]  = "disconnect",
+    [TRACE_EVT_ADV_START]   = "adv_start",
+    [TRACE_EVT_ADV_MODE]    = "adv_mode",
+    [TRACE_EVT_CONN_PHASE]  = "conn_phase",
+    [TRACE_EVT_WAKE_WRITE]  = "wake_write",
+    [TRACE_EVT_WAKE_REJECT] = "wake_reject",
+    [TRACE_EVT_WAKE_SENT]   = "wake_sent",
+    [TRACE_EVT_CMD_DONE]    = "cmd_done",
+    [TRACE_EVT_HOST_STATE]  = "host_state",
+    [TRACE_EVT_BONDED]      = "bonded",
+    [TRACE_EVT_ADV_FAILED]  = "adv_failed",
+    [TRACE_EVT_ADV_RETRY]   = "adv_retry",
+    [TRACE_EVT_ADV_RECOVER] = "adv_recover",
+    [TRACE_EVT_HOST_RESET]  = "host_reset",
+    [TRACE_EVT_PHY_UPDATE]  = "phy_update",
+    [TRACE_EVT_OTA_BEGIN]   = "ota_begin",
+    [TRACE_EVT_OTA_NAK]     = "ota_nak",
+    [TRACE_EVT_OTA_END]     = "ota_end",
+    [TRACE_EVT_OTA_CONFIRM] = "ota_confirm",
+    [TRACE_EVT_WAKE_PATH]   = "wake_path",
+    [TRACE_EVT_TUNE_SET]    = "tune_set",
+    [TRACE_EVT_TUNE_COMMIT] = "tune_commit",
+    [TRACE_EVT_PM_HOLD]     = "pm_hold",
+};
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+}
+
+/* Reads the trace characteristic value the way penta_trace.py does */
+static void dump_trace(void)
+{
+    uint8_t buf[TRACE_VALUE_MAX];
+    uint32_t cursor = 0;
+
+    printf("\nTrace:\n");
+    for (;;) {
+        trace_set_cursor(cursor);
+        size_t len = trace_build_value(buf, sizeof(buf));
+        uint32_t next = get_u32(&buf[3]);
+        uint32_t first = get_u32(&buf[7]);
+        size_t n = (len - TRACE_VALUE_HDR_LEN) / TRACE_ENTRY_LEN;
+
+        for (size_t i = 0; i < n; i++) {
+            const uint8_t *e = &buf[TRACE_VALUE_HDR_LEN + i * TRACE_ENTRY_LEN];
+            uint8_t evt = e[4];
+            const char *name = evt < COUNT(trace_names) && trace_names[evt]
+                               ? trace_names[evt] : "?";
+            printf("  %10.3f ms  %-12s a=%-5u b=%u\n", get_u32(e) / 1000.0,
+                   name, (unsigned)(e[6] | e[7] << 8),
+                   (unsigned)get_u32(&e[8]));
+        }
+        cursor = first + (uint32_t)n;
+        if (n == 0 || cursor == next) {
+            break;
+        }
+    }
+}
+
+static void report(void)
+{
+    lat_summary_t lat;
+    wake_path_stats_t paths;
+    wake_dispatch_stats_t disp;
+    pm_gov_stats_t gov;
+    sim_host_stats_t host;
+    sim_ble_stats_t radio;
+    power_t pw;
+    sim_task_info_t t;
+    double secs = sim_now_us() / 1e6;
+
+    latency_get_summary(&lat);
+    wake_path_get_stats(&paths);
+    wake_dispatch_get_stats(&disp);
+    pm_gov_get_stats(&gov);
+    sim_host_get_stats(&host);
+    sim_ble_get_stats(&radio);
+    power_get(&pw);
+
+    printf("\n%s: %.3f s simulated\n", script_name, secs);
+
+    printf("\nWake latency, µs after the write (connect: before it), "
+           "%u wakes:\n", (unsigned)lat.wakes);
+    printf("  %-14s %7s %9s %9s %9s\n", "stage", "samples", "min", "avg",
+           "p99");
+    for (int i = 0; i < LAT_STAGE_COUNT; i++) {
+        const lat_stage_summary_t *s = &lat.stage[i];
+        printf("  %-14s %7u %9u %9u %9u\n", stage_names[i],
+               (unsigned)s->samples, (unsigned)s->min_us,
+               (unsigned)s->avg_us, (unsigned)s->p99_us);
+    }
+
+    printf("\nWake paths:\n");
+    printf("  %-11s %8s %5s %9s %7s %7s\n", "path", "attempts", "ok",
+           "fallbacks", "avg_ms", "max_ms");
+    for (int i = 0; i < WAKE_PATH_COUNT; i++) {
+        const wake_path_counters_t *c = &paths.path[i];
+        printf("  %-11s %8u %5u %9u %7u %7u\n", path_names[i],
+               (unsigned)c->attempts, (unsigned)c->ok,
+               (unsigned)c->fallbacks, c->avg_ms, c->max_ms);
+    }
+
+    printf("\nDispatcher: %u received, %u coalesced, %u dropped, "
+           "%u executed, %u failed\n",
+           (unsigned)disp.received, (unsigned)disp.coalesced,
+           (unsigned)disp.dropped, (unsigned)disp.executed,
+           (unsigned)disp.failed);
+    printf("USB host:   %u mounts, %u suspends, %u resumes (%u remote "
+           "wake-ups), %u PWR_SW presses\n",
+           (unsigned)host.mounts, (unsigned)host.suspends,
+           (unsigned)host.resumes, (unsigned)host.remote_wakeups,
+           (unsigned)host.pwr_presses);
+    printf("            reports: %u key, %u system, %u consumer\n",
+           (unsigned)host.key_reports, (unsigned)host.system_reports,
+           (unsigned)host.consumer_reports);
+    printf("Radio:      %u advertising events, %u connection events, "
+           "%u parameter requests, %u writes (%u rejected)\n",
+           (unsigned)radio.adv_events, (unsigned)radio.conn_events,
+           (unsigned)radio.param_requests, (unsigned)radio.writes,
+           (unsigned)radio.rejected);
+    printf("Power:      %u CPU wake-ups from timers and timeouts (%.2f/s), "
+           "%u from the host and centrals\n",
+           (unsigned)pw.wakeups, secs > 0 ? pw.wakeups / secs : 0.0,
+           (unsigned)pw.interrupts);
+    printf("            light sleep %u.%u %% of the time in %u periods; "
+           "CPU at max for %u ms in %u holds\n",
+           (unsigned)(pw.sleep_permille / 10),
+           (unsigned)(pw.sleep_permille % 10), (unsigned)pw.sleeps,
+           (unsigned)pw.cpu_max_ms, (unsigned)gov.holds);
+
+    printf("\nTasks:\n  %-12s %4s %8s %8s\n", "name", "prio", "runs",
+           "wake-ups");
+    for (int i = 0; sim_task_info(i, &t); i++) {
+        printf("  %-12s %4u %8u %8u\n", t.name, t.prio, (unsigned)t.runs,
+               (unsigned)t.cpu_wakeups);
+    }
+
+    printf("\nChecks: %d passed, %d failed\n", checks_passed, checks_failed);
+}
+
+/* ── Entry point ─────────────────────────────────────────────────────────── */
+static int usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-v] [-t] scenario.sim\n", prog);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    bool trace = false;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            sim_log_set_verbose(true);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            trace = true;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (i != argc - 1) {
+        return usage(argv[0]);
+    }
+    script_name = argv[i];
+
+    FILE *f = fopen(script_name, "r");
+    if (f == NULL) {
+        perror(script_name);
+        return 2;
+    }
+    int64_t end_us = load_script(f);
+    fclose(f);
+    if (end_us < 0) {
+        return 2;
+    }
+
+    sim_kernel_init();
+    xTaskCreate(world_task, "world", 4096, NULL, WORLD_TASK_PRIO, NULL);
+    xTaskCreate(main_task, "main", 3584, NULL, MAIN_TASK_PRIO, NULL);
+    sim_run_until(end_us);
+
+    report();
+    if (trace) {
+        dump_trace();
+    }
+    return checks_failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,451 @@
+/**
+ * sim_platform.c
+ *
+ * The rest of ESP-IDF the firmware calls, on the virtual clock (sim.h):
+ * logging, error names, power management, NVS, GPIO and the odd system
+ * query.
+ *
+ * Power management keeps the books the chip would: time spent with an
+ * ESP_PM_CPU_FREQ_MAX or ESP_PM_NO_LIGHT_SLEEP lock held, and the idle
+ * periods that would have been light sleep – once esp_pm_configure() has
+ * enabled it, with no NO_LIGHT_SLEEP lock held and the idle period at
+ * least CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP ticks long.
+ */
+
+#include "sim.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_private/esp_clk.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "freertos/FreeRTOS.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IDLE_TICKS_BEFORE_SLEEP 3       /* IDF default */
+#define TICK_US                 (1000000LL / configTICK_RATE_HZ)
+#define SIM_HEAP_FREE           (160 * 1024)
+#define SIM_HEAP_MIN            (152 * 1024)
+#define SIM_HEAP_LARGEST        (112 * 1024)
+
+/* ── Logging ─────────────────────────────────────────────────────────────── */
+static bool verbose;
+
+void sim_log_set_verbose(bool on)
+{
+    verbose = on;
+}
+
+void sim_log(char level, const char *tag, const char *fmt, ...)
+{
+    if (!verbose && level != 'E' && level != 'W') {
+        return;
+    }
+    int64_t us = sim_now_us();
+    va_list ap;
+
+    printf("%c (%lld.%03lld) %s: ", level, (long long)(us / 1000),
+           (long long)(us % 1000), tag);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+}
+
+/* ── Errors ──────────────────────────────────────────────────────────────── */
+static const struct {
+    esp_err_t   err;
+    const char *name;
+} err_names[] = {
+    { ESP_OK,                       "ESP_OK" },
+    { ESP_FAIL,                     "ESP_FAIL" },
+    { ESP_ERR_NO_MEM,               "ESP_ERR_NO_MEM" },
+    { ESP_ERR_INVALID_ARG,          "ESP_ERR_INVALID_ARG" },
+    { ESP_ERR_INVALID_STATE,        "ESP_ERR_INVALID_STATE" },
+    { ESP_ERR_INVALID_SIZE,         "ESP_ERR_INVALID_SIZE" },
+    { ESP_ERR_NOT_FOUND,            "ESP_ERR_NOT_FOUND" },
+    { ESP_ERR_NOT_SUPPORTED,        "ESP_ERR_NOT_SUPPORTED" },
+    { ESP_ERR_TIMEOUT,              "ESP_ERR_TIMEOUT" },
+    { ESP_ERR_INVALID_RESPONSE,     "ESP_ERR_INVALID_RESPONSE" },
+    { ESP_ERR_INVALID_CRC,          "ESP_ERR_INVALID_CRC" },
+    { ESP_ERR_INVALID_VERSION,      "ESP_ERR_INVALID_VERSION" },
+    { ESP_ERR_NVS_NOT_INITIALIZED,  "ESP_ERR_NVS_NOT_INITIALIZED" },
+    { ESP_ERR_NVS_NOT_FOUND,        "ESP_ERR_NVS_NOT_FOUND" },
+    { ESP_ERR_NVS_INVALID_LENGTH,   "ESP_ERR_NVS_INVALID_LENGTH" },
+    { ESP_ERR_NVS_NO_FREE_PAGES,    "ESP_ERR_NVS_NO_FREE_PAGES" },
+    { ESP_ERR_NVS_NEW_VERSION_FOUND, "ESP_ERR_NVS_NEW_VERSION_FOUND" },
+};
+
+const char *esp_err_to_name(esp_err_t err)
+{
+    for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++) {
+        if (err_names[i].err == err) {
+            return err_names[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+/* Like the chip: ESP_ERROR_CHECK failing is fatal */
+void sim_error_check_failed(esp_err_t err, const char *file, int line,
+                            const char *expr)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s (0x%x) at %s:%d: %s\n",
+            esp_err_to_name(err), (unsigned)err, file, line, expr);
+    abort();
+}
+
+/* ── Power management ────────────────────────────────────────────────────── */
+#define PM_LOCK_TYPES           (ESP_PM_NO_LIGHT_SLEEP + 1)
+
+struct sim_pm_lock {
+    esp_pm_lock_type_t type;
+    const char        *name;
+    uint32_t           count;
+};
+
+static sim_pm_stats_t pm;
+static bool pm_configured;
+static uint32_t type_holders[PM_LOCK_TYPES];    /* locks with count > 0 */
+static int64_t type_since_us[PM_LOCK_TYPES];
+static int64_t type_total_us[PM_LOCK_TYPES];
+
+static int64_t held_us(esp_pm_lock_type_t type)
+{
+    int64_t us = type_total_us[type];
+
+    if (type_holders[type] > 0) {
+        us += sim_now_us() - type_since_us[type];
+    }
+    return us;
+}
+
+esp_err_t esp_pm_configure(const void *config)
+{
+    const esp_pm_config_t *c = config;
+
+    if (c->min_freq_mhz > c->max_freq_mhz) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pm.max_mhz     = c->max_freq_mhz;
+    pm.min_mhz     = c->min_freq_mhz;
+    pm.light_sleep = c->light_sleep_enable;
+    pm_configured  = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg,
+                             const char *name, esp_pm_lock_handle_t *out)
+{
+    (void)arg;
+    struct sim_pm_lock *lock = calloc(1, sizeof(*lock));
+
+    if (lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    lock->type = type;
+    lock->name = name;
+    *out = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t lock)
+{
+    if (lock->count++ == 0 && type_holders[lock->type]++ == 0) {
+        type_since_us[lock->type] = sim_now_us();
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t lock)
+{
+    if (lock->count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (--lock->count == 0 && --type_holders[lock->type] == 0) {
+        type_total_us[lock->type] += sim_now_us() -
+                                     type_since_us[lock->type];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t lock)
+{
+    if (lock->count > 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+    fprintf(stream, "cpu_max held %lld us, no_light_sleep held %lld us\n",
+            (long long)held_us(ESP_PM_CPU_FREQ_MAX),
+            (long long)held_us(ESP_PM_NO_LIGHT_SLEEP));
+    return ESP_OK;
+}
+
+void sim_pm_idle(int64_t end_us)
+{
+    int64_t span = end_us - sim_now_us();
+
+    if (pm_configured && pm.light_sleep &&
+        type_holders[ESP_PM_NO_LIGHT_SLEEP] == 0 &&
+        span >= IDLE_TICKS_BEFORE_SLEEP * TICK_US) {
+        pm.sleeps++;
+        pm.sleep_us += span;
+    }
+}
+
+void sim_pm_get_stats(sim_pm_stats_t *out)
+{
+    *out = pm;
+    out->cpu_max_us  = held_us(ESP_PM_CPU_FREQ_MAX);
+    out->no_sleep_us = held_us(ESP_PM_NO_LIGHT_SLEEP);
+}
+
+/* ── NVS ─────────────────────────────────────────────────────────────────── */
+#define NVS_MAX_NAMESPACES      4
+#define NVS_MAX_ENTRIES         16
+#define NVS_MAX_VALUE           512
+#define NVS_KEY_LEN             16      /* NVS_KEY_NAME_MAX_SIZE */
+
+typedef struct {
+    nvs_handle_t ns;                    /* 0 = free */
+    char         key[NVS_KEY_LEN];
+    uint8_t      value[NVS_MAX_VALUE];
+    size_t       len;
+} nvs_entry_t;
+
+static char nvs_namespaces[NVS_MAX_NAMESPACES][NVS_KEY_LEN];
+static nvs_entry_t nvs_entries[NVS_MAX_ENTRIES];
+static bool nvs_ready;
+static sim_nvs_cfg_t nvs_cfg;
+
+static nvs_entry_t *nvs_find(nvs_handle_t h, const char *key)
+{
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++) {
+        if (nvs_entries[i].ns == h &&
+            strncmp(nvs_entries[i].key, key, NVS_KEY_LEN) == 0) {
+            return &nvs_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_put(nvs_handle_t h, const char *key, const void *value,
+                         size_t len)
+{
+    nvs_entry_t *e = nvs_find(h, key);
+
+    if (len > NVS_MAX_VALUE || strlen(key) >= NVS_KEY_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (int i = 0; e == NULL && i < NVS_MAX_ENTRIES; i++) {
+        if (nvs_entries[i].ns == 0) {
+            e = &nvs_entries[i];
+            e->ns = h;
+            strcpy(e->key, key);
+        }
+    }
+    if (e == NULL) {
+        return ESP_ERR_NVS_NO_FREE_PAGES;
+    }
+    memcpy(e->value, value, len);
+    e->len = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    nvs_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(nvs_namespaces, 0, sizeof(nvs_namespaces));
+    memset(nvs_entries, 0, sizeof(nvs_entries));
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)mode;
+    if (!nvs_ready) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (strlen(ns) >= NVS_KEY_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < NVS_MAX_NAMESPACES; i++) {
+        if (nvs_namespaces[i][0] == '\0') {
+            strcpy(nvs_namespaces[i], ns);
+        }
+        if (strcmp(nvs_namespaces[i], ns) == 0) {
+            *out = (nvs_handle_t)i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NO_FREE_PAGES;
+}
+
+void nvs_close(nvs_handle_t h)
+{
+    (void)h;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out,
+                       size_t *len)
+{
+    const nvs_entry_t *e = nvs_find(h, key);
+
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out == NULL) {
+        *len = e->len;
+        return ESP_OK;
+    }
+    if (*len < e->len) {
+        *len = e->len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, e->value, e->len);
+    *len = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value,
+                       size_t len)
+{
+    return nvs_put(h, key, value, len);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t h, const char *key, uint32_t *out)
+{
+    size_t len = sizeof(*out);
+    const nvs_entry_t *e = nvs_find(h, key);
+
+    if (e != NULL && e->len != len) {
+        return ESP_ERR_NVS_NOT_FOUND;   /* stored with another type */
+    }
+    return nvs_get_blob(h, key, out, &len);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t h, const char *key, uint32_t value)
+{
+    return nvs_put(h, key, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t h, const char *key)
+{
+    nvs_entry_t *e = nvs_find(h, key);
+
+    if (e == NULL) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
+
+/* Writes land at once; nothing is lost by a missing commit here.  A
+ * scenario can make the next commits fail as a worn or full flash would. */
+esp_err_t nvs_commit(nvs_handle_t h)
+{
+    (void)h;
+    if (nvs_cfg.fail_commits > 0) {
+        nvs_cfg.fail_commits--;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+sim_nvs_cfg_t *sim_nvs_cfg(void)
+{
+    return &nvs_cfg;
+}
+
+/* ── GPIO ────────────────────────────────────────────────────────────────── */
+#define GPIO_PINS               22      /* ESP32-C3: GPIO0–21 */
+
+static uint8_t gpio_levels[GPIO_PINS];
+
+esp_err_t gpio_config(const gpio_config_t *cfg)
+{
+    if (cfg->pin_bit_mask == 0 || cfg->pin_bit_mask >> GPIO_PINS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if (pin < 0 || pin >= GPIO_PINS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    level = level != 0;
+    if (gpio_levels[pin] != level) {
+        gpio_levels[pin] = (uint8_t)level;
+        sim_host_pwr_sw(pin, level);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    int in = sim_host_gpio_in(pin);
+
+    if (in >= 0) {
+        return in;
+    }
+    return pin >= 0 && pin < GPIO_PINS ? gpio_levels[pin] : 0;
+}
+
+esp_err_t gpio_sleep_sel_dis(gpio_num_t pin)
+{
+    return pin >= 0 && pin < GPIO_PINS ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* ── System ──────────────────────────────────────────────────────────────── */
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() at %lld us\n", (long long)sim_now_us());
+    exit(3);
+}
+
+uint64_t esp_clk_rtc_time(void)
+{
+    return (uint64_t)sim_now_us();
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return SIM_HEAP_FREE;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    (void)caps;
+    return SIM_HEAP_MIN;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    (void)caps;
+    return SIM_HEAP_LARGEST;
+}
@@ -0,0 +1,384 @@
+/**
+ * sim_usb.c
+ *
+ * esp_tinyusb and the TinyUSB device stack as usb_hid.c uses them, and a
+ * model of the host PC on the other end of the cable (sim.h).
+ *
+ * Bus events reach the device like in TinyUSB: the "ISR" (here the world
+ * task) queues them and tud_task_ext() updates the device state and calls
+ * the tud_*_cb() callbacks in the USB task.  The host side keeps its own
+ * view: it powers up, enumerates the dongle, suspends the bus (arming
+ * remote wake-up or not), resumes it on remote wake-up signalling after
+ * resume_ms, and polls the HID interrupt endpoint every poll_ms, so a
+ * queued report is only collected at the next polling boundary.  Pressing
+ * PWR_SW boots a host that is off, resumes a suspended one and shuts down
+ * a running one.  The power-sense input reads the host as running while it
+ * is powered and not suspended, whether or not it enumerated the dongle.
+ */
+
+#include "sim.h"
+#include "class/hid/hid_device.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+#include "tinyusb.h"
+
+#include <string.h>
+
+static const char *TAG = "SIM_USB";
+
+#define ENUMERATE_MS            50      /* attach → tud_mount_cb() */
+#define EVENT_QUEUE_LEN         16
+
+/* Report IDs of the HID report descriptor (usb_hid.c) */
+#define REPORT_ID_KEYBOARD      1
+#define REPORT_ID_SYSTEM        2
+#define REPORT_ID_CONSUMER      3
+
+#if CONFIG_PENTA_PWR_SW_ACTIVE_LOW
+#define PWR_SW_PRESSED          0
+#else
+#define PWR_SW_PRESSED          1
+#endif
+#if CONFIG_PENTA_PWR_SENSE_ACTIVE_LOW
+#define PWR_SENSE_RUNNING       0
+#else
+#define PWR_SENSE_RUNNING       1
+#endif
+
+static sim_host_cfg_t cfg = {
+    .resume_ms   = 30,
+    .poll_ms     = 10,
+    .boot_ms     = 8000,
+    .shutdown_ms = 5000,
+    .wake_armed  = true,
+    .pwr_sw      = true,
+    .port_live   = true,
+};
+
+static sim_host_stats_t host = { .last_input_us = -1 };
+static uint32_t sleep_gen;          /* cancels a pending automatic suspend */
+static bool mount_pending;          /* host up before the driver installed */
+
+/* ── Device side ─────────────────────────────────────────────────────────── */
+typedef enum {
+    USB_EVT_MOUNT,
+    USB_EVT_UMOUNT,
+    USB_EVT_SUSPEND,
+    USB_EVT_RESUME,
+} usb_evt_t;
+
+typedef struct {
+    usb_evt_t type;
+    bool      armed;
+} usb_event_t;
+
+static QueueHandle_t events;        /* NULL until tinyusb_driver_install() */
+static bool dev_mounted;
+static bool dev_suspended;
+static bool dev_wake_en;
+static int64_t ep_free_us;          /* IN endpoint collected by then */
+
+/* World events that run a host model entry point */
+static void ev_mount(void *arg, int value)
+{
+    (void)arg; (void)value;
+    if (host.powered) {             /* not switched off while booting */
+        sim_host_mount();
+    }
+}
+
+static void ev_resume(void *arg, int value)
+{
+    (void)arg; (void)value;
+    sim_host_resume();
+}
+
+static void ev_power_off(void *arg, int value)
+{
+    (void)arg; (void)value;
+    sim_host_power_off();
+}
+
+static void post(usb_evt_t type, bool armed)
+{
+    const usb_event_t ev = { .type = type, .armed = armed };
+
+    if (xQueueSend(events, &ev, 0) != pdTRUE) {
+        ESP_LOGE(TAG, "Event queue full");
+    }
+}
+
+esp_err_t tinyusb_driver_install(const tinyusb_config_t *config)
+{
+    if (config == NULL || config->device_descriptor == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    events = xQueueCreate(EVENT_QUEUE_LEN, sizeof(usb_event_t));
+    if (mount_pending) {
+        mount_pending = false;
+        host.mounted = false;
+        sim_world_at(sim_now_us() + ENUMERATE_MS * SIM_MS,
+                     ev_mount, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+void tud_task_ext(uint32_t timeout_ms, bool in_isr)
+{
+    (void)in_isr;
+    usb_event_t ev;
+    TickType_t ticks = timeout_ms == UINT32_MAX ? portMAX_DELAY
+                                                : pdMS_TO_TICKS(timeout_ms);
+
+    if (xQueueReceive(events, &ev, ticks) != pdTRUE) {
+        return;
+    }
+    switch (ev.type) {
+    case USB_EVT_MOUNT:
+        dev_mounted   = true;
+        dev_suspended = false;
+        tud_mount_cb();
+        break;
+    case USB_EVT_UMOUNT:
+        dev_mounted   = false;
+        dev_suspended = false;
+        tud_umount_cb();
+        break;
+    case USB_EVT_SUSPEND:
+        dev_suspended = true;
+        dev_wake_en   = ev.armed;
+        tud_suspend_cb(ev.armed);
+        break;
+    case USB_EVT_RESUME:
+        dev_suspended = false;
+        tud_resume_cb();
+        break;
+    }
+}
+
+bool tud_mounted(void)
+{
+    return dev_mounted;
+}
+
+bool tud_suspended(void)
+{
+    return dev_suspended;
+}
+
+static void remote_resume(void *arg, int value)
+{
+    (void)arg; (void)value;
+    if (host.suspended) {
+        host.remote_wakeups++;
+        sim_host_resume();
+    }
+}
+
+/* As in TinyUSB: only on a suspended bus whose host armed remote wake-up */
+bool tud_remote_wakeup(void)
+{
+    if (!(dev_suspended && dev_wake_en)) {
+        return false;
+    }
+    sim_world_at(sim_now_us() + cfg.resume_ms * SIM_MS, remote_resume,
+                 NULL, 0);
+    return true;
+}
+
+uint8_t tud_hid_get_protocol(void)
+{
+    return cfg.boot_protocol ? HID_PROTOCOL_BOOT : HID_PROTOCOL_REPORT;
+}
+
+bool tud_hid_ready(void)
+{
+    return dev_mounted && !dev_suspended && host.mounted &&
+           !host.suspended && sim_now_us() >= ep_free_us;
+}
+
+static void host_input(void);
+
+bool tud_hid_report(uint8_t report_id, const void *report, uint16_t len)
+{
+    const uint8_t *b = report;
+
+    if (!tud_hid_ready()) {
+        return false;
+    }
+    /* Collected at the next polling boundary */
+    int64_t poll_us = (int64_t)cfg.poll_ms * SIM_MS;
+    ep_free_us = (sim_now_us() / poll_us + 1) * poll_us;
+
+    switch (report_id) {
+    case 0:                             /* boot protocol keyboard */
+    case REPORT_ID_KEYBOARD:
+        if (len >= 3 && b[2] != 0) {
+            host.key_reports++;
+            host_input();
+        }
+        break;
+    case REPORT_ID_SYSTEM:
+        if (len >= 1 && b[0] != 0) {
+            host.system_reports++;
+            host_input();
+        }
+        break;
+    case REPORT_ID_CONSUMER:
+        if (len >= 2 && (b[0] | b[1]) != 0) {
+            host.consumer_reports++;
+            host_input();
+        }
+        break;
+    }
+    return true;
+}
+
+bool tud_hid_keyboard_report(uint8_t report_id, uint8_t modifier,
+                             const uint8_t keycode[6])
+{
+    uint8_t r[8] = { modifier };
+
+    if (keycode != NULL) {
+        memcpy(&r[2], keycode, 6);
+    }
+    return tud_hid_report(report_id, r, sizeof(r));
+}
+
+/* ── Host model ──────────────────────────────────────────────────────────── */
+sim_host_cfg_t *sim_host_cfg(void)
+{
+    return &cfg;
+}
+
+void sim_host_get_stats(sim_host_stats_t *out)
+{
+    *out = host;
+}
+
+static void auto_suspend(void *arg, int gen)
+{
+    (void)arg;
+    if ((uint32_t)gen == sleep_gen) {
+        sim_host_suspend();
+    }
+}
+
+/* The host is in use from now on: restart its idle timer */
+static void host_awake(void)
+{
+    sleep_gen++;
+    if (cfg.sleep_after_ms > 0) {
+        sim_world_at(sim_now_us() + cfg.sleep_after_ms * SIM_MS,
+                     auto_suspend, NULL, (int)sleep_gen);
+    }
+}
+
+static void host_input(void)
+{
+    host.last_input_us = sim_now_us();
+    host_awake();
+}
+
+void sim_host_power_on(void)
+{
+    if (host.powered) {
+        return;
+    }
+    host.powered = true;
+    sim_world_at(sim_now_us() + cfg.boot_ms * SIM_MS,
+                 ev_mount, NULL, 0);
+}
+
+void sim_host_mount(void)
+{
+    host.powered = true;
+    if (host.mounted || !cfg.port_live) {
+        return;
+    }
+    host.mounted   = true;
+    host.suspended = false;
+    if (events == NULL) {
+        mount_pending = true;       /* enumerates once the driver is up */
+        return;
+    }
+    host.mounts++;
+    post(USB_EVT_MOUNT, false);
+    host_awake();
+}
+
+void sim_host_power_off(void)
+{
+    sleep_gen++;
+    if (host.mounted && events != NULL) {
+        post(USB_EVT_UMOUNT, false);
+    }
+    host.powered   = false;
+    host.mounted   = false;
+    host.suspended = false;
+    mount_pending  = false;
+}
+
+void sim_host_suspend(void)
+{
+    if (!host.mounted || host.suspended || events == NULL) {
+        return;
+    }
+    sleep_gen++;
+    host.suspended = true;
+    host.suspends++;
+    post(USB_EVT_SUSPEND, cfg.wake_armed);
+}
+
+void sim_host_resume(void)
+{
+    if (!host.suspended) {
+        return;
+    }
+    host.suspended = false;
+    host.resumes++;
+    post(USB_EVT_RESUME, false);
+    host_awake();
+}
+
+static void pwr_sw_press(void *arg, int value)
+{
+    (void)arg; (void)value;
+    host.pwr_presses++;
+    if (!host.powered) {
+        sim_host_power_on();
+    } else if (host.suspended) {
+        sim_world_at(sim_now_us() + cfg.resume_ms * SIM_MS,
+                     ev_resume, NULL, 0);
+    } else {
+        sim_world_at(sim_now_us() + cfg.shutdown_ms * SIM_MS,
+                     ev_power_off, NULL, 0);
+    }
+}
+
+int sim_host_gpio_in(int pin)
+{
+#if CONFIG_PENTA_PWR_SENSE
+    if (pin == CONFIG_PENTA_PWR_SENSE_GPIO) {
+        bool running = host.powered && !host.suspended;
+        return running ? PWR_SENSE_RUNNING : !PWR_SENSE_RUNNING;
+    }
+#else
+    (void)pin;
+#endif
+    return -1;
+}
+
+void sim_host_pwr_sw(int pin, uint32_t level)
+{
+#if CONFIG_PENTA_PWR_SW
+    if (pin == CONFIG_PENTA_PWR_SW_GPIO && cfg.pwr_sw &&
+        level == PWR_SW_PRESSED) {
+        sim_world_at(sim_now_us(), pwr_sw_press, NULL, 0);
+    }
+#else
+    (void)pin; (void)level;
+#endif
+}
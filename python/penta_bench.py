@@ -0,0 +1,298 @@
+# End-to-end wake benchmark for the Penta-GPU server, run from the Pi.
+#
+# Each cycle: suspend the host over SSH, wait until it stops answering,
+# give it time to reach S3, trigger a wake, then time how long until the
+# host answers again (ICMP, TCP port or SSH).  Recorded per cycle:
+#   scan_ms      finding the dongle by cached address or name
+#                (gatt method only, like connect_ms)
+#   connect_ms   BLE connect + service discovery
+#   write_ms     wake write until the ATT write response (or daemon reply)
+#   service_ms   wake trigger start until the probe succeeds
+#
+# Results go to <out>.csv (one row per cycle) and <out>.json (cycles,
+# percentiles, log2 histograms and the run parameters).  Use --label to name
+# the firmware variant, then compare runs:
+#
+#   python3 penta_bench.py run --host penta --label nimble-remote-wakeup -n 20
+#   python3 penta_bench.py run --host penta --target chatgpt --label chatgpt
+#   python3 penta_bench.py compare nimble-remote-wakeup.json chatgpt.json
+#
+# --target picks name / characteristic UUID for the other firmware trees in
+# esp32c3/ so all of them can be measured with the same harness.
+
+import argparse
+import asyncio
+import csv
+import json
+import math
+import platform
+import subprocess
+import time
+
+from penta_ble import DEVICE_NAME, WAKE_CHAR_UUID, WAKE_PAYLOAD, find_dongle
+
+TARGETS = {
+    # name: (advertised name, wake characteristic UUID)
+    "penta":       (DEVICE_NAME, WAKE_CHAR_UUID),
+    "claude-main": ("Power button Penta",
+                    "beb5483e-36e1-4688-b7f5-ea07361b26a8"),
+    "chatgpt":     ("PowerButton Penta",
+                    "12345678-1234-1234-1234-1234567890cd"),
+    "gemini":      ("Power button Penta", WAKE_CHAR_UUID),
+}
+
+METRICS = ["scan_ms", "connect_ms", "write_ms", "service_ms"]
+POLL_S = 0.1
+
+
+def ms_since(t0):
+    return round((time.perf_counter() - t0) * 1000, 1)
+
+
+# ── Host control and reachability ──────────────────────────────────────────
+
+def ssh_cmd(host, command, timeout=2):
+    return ["ssh", "-o", "BatchMode=yes", "-o", f"ConnectTimeout={timeout}",
+            host, command]
+
+
+async def run_quiet(argv, timeout):
+    proc = await asyncio.create_subprocess_exec(
+        *argv, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        return await asyncio.wait_for(proc.wait(), timeout) == 0
+    except asyncio.TimeoutError:
+        proc.kill()
+        await proc.wait()
+        return False
+
+
+async def probe(args):
+    """One reachability check; True if the host answers."""
+    if args.probe == "icmp":
+        return await run_quiet(["ping", "-c", "1", "-W", "1", args.addr], 2)
+    if args.probe == "ssh":
+        return await run_quiet(ssh_cmd(args.host, "true", 1), 3)
+    try:
+        _, writer = await asyncio.wait_for(
+            asyncio.open_connection(args.addr, args.port), 1)
+    except (OSError, asyncio.TimeoutError):
+        return False
+    writer.close()
+    return True
+
+
+async def wait_reachable(args, want, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if await probe(args) == want:
+            return True
+        await asyncio.sleep(POLL_S)
+    return False
+
+
+# ── Wake methods ────────────────────────────────────────────────────────────
+
+async def wake_gatt(args, row):
+    from bleak import BleakClient
+
+    name, char_uuid = TARGETS[args.target]
+    t0 = time.perf_counter()
+    # the address cache belongs to the penta firmware only
+    device = await find_dongle(args.address, name=name,
+                               use_cache=args.target == "penta")
+    if device is None:
+        raise RuntimeError("dongle not found")
+    row["scan_ms"] = ms_since(t0)
+    t0 = time.perf_counter()
+    async with BleakClient(device) as client:
+        row["connect_ms"] = ms_since(t0)
+        t0 = time.perf_counter()
+        # With a response so the ack time is measurable; the firmware
+        # handles write and write-without-response the same way.
+        await client.write_gatt_char(char_uuid, WAKE_PAYLOAD, response=True)
+        row["write_ms"] = ms_since(t0)
+
+
+async def wake_daemon(args, row):
+    from wake_penta import wake_via_daemon
+
+    t0 = time.perf_counter()
+    reply = await wake_via_daemon(args.socket)
+    if not reply.get("ok"):
+        raise RuntimeError(reply.get("error"))
+    row["write_ms"] = ms_since(t0)
+
+
+async def wake_beacon(args, row):
+    import wake_beacon as wb
+
+    data = wb.build_adv_data(bytes.fromhex(args.key), args.dongle,
+                             wb.next_counter())
+    await asyncio.to_thread(wb.broadcast, data, args.beacon_seconds)
+
+
+WAKE_METHODS = {"gatt": wake_gatt, "daemon": wake_daemon, "beacon": wake_beacon}
+
+
+# ── One cycle ──────────────────────────────────────────────────────────────
+
+async def cycle(args, n):
+    row = {"cycle": n, "label": args.label, **{m: None for m in METRICS},
+           "error": ""}
+    # ssh usually does not return cleanly while the host goes down
+    await run_quiet(ssh_cmd(args.host, args.suspend_cmd), 10)
+    if not await wait_reachable(args, False, args.down_timeout):
+        row["error"] = "host did not go down"
+        return row
+    await asyncio.sleep(args.settle)
+
+    t0 = time.perf_counter()
+    try:
+        await WAKE_METHODS[args.method](args, row)
+    except Exception as e:          # keep benchmarking; record the failure
+        row["error"] = f"wake: {e}"
+    if await wait_reachable(args, True, args.up_timeout):
+        row["service_ms"] = ms_since(t0)
+    elif not row["error"]:
+        row["error"] = "host did not come back"
+    return row
+
+
+# ── Statistics ─────────────────────────────────────────────────────────────
+
+def percentile(sorted_vals, p):
+    # nearest rank, same definition as the firmware's latency.c
+    return sorted_vals[max(0, math.ceil(len(sorted_vals) * p / 100) - 1)]
+
+
+def log2_histogram(vals):
+    """{upper bound ms: count} over power-of-two buckets – comparable
+    between runs without agreeing on a bin width first."""
+    hist = {}
+    for v in vals:
+        edge = 1 << max(0, math.ceil(math.log2(max(v, 1))))
+        hist[edge] = hist.get(edge, 0) + 1
+    return {str(k): hist[k] for k in sorted(hist)}
+
+
+def summarize(rows):
+    out = {}
+    for m in METRICS:
+        vals = sorted(r[m] for r in rows if r[m] is not None)
+        if not vals:
+            continue
+        out[m] = {"n": len(vals), "min": vals[0], "max": vals[-1],
+                  "mean": round(sum(vals) / len(vals), 1),
+                  "p50": percentile(vals, 50), "p90": percentile(vals, 90),
+                  "p99": percentile(vals, 99),
+                  "histogram_ms": log2_histogram(vals)}
+    out["failures"] = sum(1 for r in rows if r["error"])
+    return out
+
+
+def print_summary(label, summary):
+    print(f"\n{label}: {summary['failures']} failure(s)")
+    print(f"{'metric':<12}{'n':>4}{'min':>9}{'p50':>9}{'p90':>9}"
+          f"{'p99':>9}{'max':>9}")
+    for m in METRICS:
+        s = summary.get(m)
+        if s:
+            print(f"{m:<12}{s['n']:>4}{s['min']:>9.1f}{s['p50']:>9.1f}"
+                  f"{s['p90']:>9.1f}{s['p99']:>9.1f}{s['max']:>9.1f}")
+
+
+# ── Commands ───────────────────────────────────────────────────────────────
+
+async def cmd_run(args):
+    args.addr = args.addr or args.host.split("@")[-1]
+    rows = []
+    for n in range(1, args.cycles + 1):
+        row = await cycle(args, n)
+        rows.append(row)
+        print(f"cycle {n}/{args.cycles}: " +
+              " ".join(f"{m}={row[m]}" for m in METRICS) +
+              (f"  [{row['error']}]" if row["error"] else ""), flush=True)
+        await asyncio.sleep(args.pause)
+
+    stats = None
+    if args.stats and args.method == "gatt" and args.target == "penta":
+        from bleak import BleakClient
+        import penta_stats
+        device = await find_dongle(args.address)
+        if device is not None:
+            async with BleakClient(device) as client:
+                stats = await penta_stats.read_stats(client)
+
+    with open(f"{args.out or args.label}.csv", "w", newline="") as f:
+        w = csv.DictWriter(f, fieldnames=["cycle", "label"] + METRICS +
+                           ["error"])
+        w.writeheader()
+        w.writerows(rows)
+    summary = summarize(rows)
+    params = {k: v for k, v in vars(args).items() if k not in ("func", "key")}
+    with open(f"{args.out or args.label}.json", "w") as f:
+        json.dump({"label": args.label, "started": time.strftime("%FT%T%z"),
+                   "pi": platform.node(), "params": params, "summary": summary,
+                   "device_stats": stats, "cycles": rows}, f, indent=2)
+    print_summary(args.label, summary)
+
+
+def cmd_compare(args):
+    for path in args.runs:
+        with open(path) as f:
+            run = json.load(f)
+        p = run["params"]
+        print_summary(f"{run['label']} ({p['target']}, {p['method']}, "
+                      f"probe {p['probe']})", run["summary"])
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Penta end-to-end wake benchmark.")
+    sub = ap.add_subparsers(required=True)
+
+    r = sub.add_parser("run", help="run wake cycles against a host")
+    r.add_argument("--host", required=True, help="ssh destination of the host")
+    r.add_argument("--addr", help="address to probe (default: from --host)")
+    r.add_argument("--label", required=True,
+                   help="firmware variant name, e.g. bluedroid-hidkey")
+    r.add_argument("--out", help="output basename (default: label)")
+    r.add_argument("-n", "--cycles", type=int, default=10)
+    r.add_argument("--target", choices=TARGETS, default="penta")
+    r.add_argument("--method", choices=WAKE_METHODS, default="gatt")
+    r.add_argument("--address", help="dongle address (default: cache/scan)")
+    r.add_argument("--socket", help="penta_waked socket (method daemon)")
+    r.add_argument("--key", help="beacon key (method beacon)")
+    r.add_argument("--dongle", help="dongle BT MAC (method beacon)")
+    r.add_argument("--beacon-seconds", type=int, default=3)
+    r.add_argument("--probe", choices=["tcp", "icmp", "ssh"], default="tcp")
+    r.add_argument("--port", type=int, default=22, help="TCP probe port")
+    r.add_argument("--suspend-cmd", default="sudo systemctl suspend")
+    r.add_argument("--settle", type=float, default=10,
+                   help="seconds after the host goes down before waking")
+    r.add_argument("--down-timeout", type=float, default=60)
+    r.add_argument("--up-timeout", type=float, default=90)
+    r.add_argument("--pause", type=float, default=15,
+                   help="seconds between cycles, after the host is back")
+    r.add_argument("--stats", action="store_true",
+                   help="store the dongle's stats characteristic in the JSON")
+    r.set_defaults(func=cmd_run)
+
+    c = sub.add_parser("compare", help="print summaries of earlier runs")
+    c.add_argument("runs", nargs="+", metavar="RUN.json")
+    c.set_defaults(func=cmd_compare)
+
+    args = ap.parse_args()
+    if args.func is cmd_run:
+        if args.method == "beacon" and not (args.key and args.dongle):
+            ap.error("--method beacon needs --key and --dongle")
+        if args.method == "daemon" and args.socket is None:
+            from penta_waked import DEFAULT_SOCKET
+            args.socket = DEFAULT_SOCKET
+        asyncio.run(cmd_run(args))
+    else:
+        args.func(args)
+
+
+if __name__ == "__main__":
+    main()
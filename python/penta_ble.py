@@ -0,0 +1,248 @@
+# Shared constants and helpers for the Pi-side Penta dongle tools.
+#
+# UUIDs follow esp32c3/claude/power_button_penta (service 0x00FF).
+
+import fcntl
+import hashlib
+import hmac
+import os
+import struct
+
+DEVICE_NAME = "Penta Power Btn"
+
+SERVICE_UUID = "000000ff-0000-1000-8000-00805f9b34fb"
+WAKE_CHAR_UUID = "0000ff01-0000-1000-8000-00805f9b34fb"
+STATS_CHAR_UUID = "0000ff02-0000-1000-8000-00805f9b34fb"
+HOST_CHAR_UUID = "0000ff03-0000-1000-8000-00805f9b34fb"
+TRACE_CHAR_UUID = "0000ff04-0000-1000-8000-00805f9b34fb"
+OTA_CTRL_UUID = "0000ff05-0000-1000-8000-00805f9b34fb"
+OTA_DATA_UUID = "0000ff06-0000-1000-8000-00805f9b34fb"
+TUNE_CHAR_UUID = "0000ff07-0000-1000-8000-00805f9b34fb"
+
+WAKE_PAYLOAD = b"\x01"
+
+# ── Wake characteristic opcode protocol (main/wake_proto.h) ────────────────
+
+(OP_WAKE, OP_PING, OP_KEYS, OP_HOLD, OP_QUERY, OP_DELAY, OP_CONSUMER,
+ OP_POWER) = range(1, 9)
+PROTO_MAX_LEN = 125             # one ATT write at MTU 128
+
+MOD_SHIFT = 0x02
+FLAGS = {0x01: "mounted", 0x02: "suspended", 0x04: "wake_armed",
+         0x08: "busy"}
+
+# HID usage IDs of the US keyboard layout for text typed with op_keys()
+_KEYCODES = {**{chr(ord("a") + i): (0, 0x04 + i) for i in range(26)},
+             **{chr(ord("A") + i): (MOD_SHIFT, 0x04 + i) for i in range(26)},
+             **{str((i + 1) % 10): (0, 0x1E + i) for i in range(10)},
+             "\n": (0, 0x28), "\t": (0, 0x2B), " ": (0, 0x2C),
+             "-": (0, 0x2D), "=": (0, 0x2E), ".": (0, 0x37), ",": (0, 0x36),
+             "/": (0, 0x38), "!": (MOD_SHIFT, 0x1E), "@": (MOD_SHIFT, 0x1F),
+             "#": (MOD_SHIFT, 0x20), "_": (MOD_SHIFT, 0x2D)}
+
+
+def op_wake():
+    return bytes([OP_WAKE])
+
+
+def op_ping(token):
+    return bytes([OP_PING, token & 0xFF])
+
+
+def op_keys(keys):
+    """keys: text, or a list of (modifier, keycode) pairs."""
+    if isinstance(keys, str):
+        keys = [_KEYCODES[c] for c in keys]
+    out = b""
+    for i in range(0, len(keys), 255):
+        chunk = keys[i:i + 255]
+        out += bytes([OP_KEYS, len(chunk)]) + bytes(b for k in chunk for b in k)
+    return out
+
+
+def op_hold(ms):
+    return struct.pack("<BH", OP_HOLD, ms)
+
+
+def op_query(token):
+    return bytes([OP_QUERY, token & 0xFF])
+
+
+def op_delay(ms):
+    return struct.pack("<BH", OP_DELAY, ms)
+
+
+def op_consumer(usage):
+    """Consumer Control usage, e.g. 0xE9 volume up, 0xCD play/pause."""
+    return struct.pack("<BH", OP_CONSUMER, usage)
+
+
+def op_power():
+    """WAKE that may press PWR_SW on a dongle without a power-sense input.
+    Only send it when the host is known to be off or asleep."""
+    return bytes([OP_POWER])
+
+
+def decode_reply(data):
+    data = bytes(data)
+    version, ping, query, flags, hold, result, ops = struct.unpack(
+        "<BBBBHiI", data[:14])
+    # Older firmware has no auth_counter
+    auth = struct.unpack("<I", data[14:18])[0] if len(data) >= 18 else 0
+    return {"version": version, "ping_token": ping, "query_token": query,
+            "flags": [name for bit, name in FLAGS.items() if flags & bit],
+            "hold_ms": hold, "last_result": result, "ops_run": ops,
+            "auth_counter": auth}
+
+# ── Authenticated frames (main/wake_auth.h, CONFIG_PENTA_WAKE_AUTH) ────────
+#   counter u32 LE | ops | tag[16]
+#   tag = HMAC-SHA256(key, counter | ops | dongle BT MAC)[:16]
+
+AUTH_TAG_LEN = 16
+AUTH_OVERHEAD = 4 + AUTH_TAG_LEN
+WAKE_KEY_FILE = os.path.expanduser("~/.config/penta/wake_key")
+WAKE_COUNTER_FILE = os.path.expanduser("~/.config/penta/wake_counter")
+
+
+def load_wake_key(text=None):
+    """Key from the argument, $PENTA_WAKE_KEY or WAKE_KEY_FILE, as 64 hex
+    digits; None if none is set (unauthenticated firmware)."""
+    text = text or os.environ.get("PENTA_WAKE_KEY")
+    if not text and os.path.exists(WAKE_KEY_FILE):
+        with open(WAKE_KEY_FILE) as f:
+            text = f.read().strip()
+    if not text:
+        return None
+    key = bytes.fromhex(text)
+    if len(key) != 32:
+        raise ValueError("wake key must be 64 hex digits")
+    return key
+
+
+class WakeSigner:
+    """Wraps wake_proto sequences in authenticated frames.
+
+    The counter lives in WAKE_COUNTER_FILE, shared by every tool on this
+    machine under a lock, and only goes up.  floor is the dongle's last
+    accepted counter (decode_reply()["auth_counter"]): the next counter is
+    above both, so a lost counter file or a dongle that reserved ahead
+    after a reboot cost one read, not a refused wake."""
+
+    def __init__(self, key, path=WAKE_COUNTER_FILE):
+        self.key = key
+        self.path = path
+
+    def _next_counter(self, floor):
+        os.makedirs(os.path.dirname(self.path), exist_ok=True)
+        with open(self.path, "a+") as f:
+            fcntl.flock(f, fcntl.LOCK_EX)
+            f.seek(0)
+            try:
+                last = int(f.read().strip() or 0)
+            except ValueError:
+                last = 0
+            counter = max(last, floor) + 1
+            f.seek(0)
+            f.truncate()
+            f.write(str(counter))
+        return counter & 0xFFFFFFFF
+
+    def sign(self, ops, dongle_mac, floor=0):
+        if len(ops) + AUTH_OVERHEAD > PROTO_MAX_LEN:
+            raise ValueError(f"sequence too long to sign ({len(ops)} > "
+                             f"{PROTO_MAX_LEN - AUTH_OVERHEAD} bytes)")
+        mac = bytes.fromhex(dongle_mac.replace(":", ""))
+        body = struct.pack("<I", self._next_counter(floor)) + bytes(ops)
+        tag = hmac.new(self.key, body + mac, hashlib.sha256).digest()
+        return body + tag[:AUTH_TAG_LEN]
+
+# ── Host-state characteristic (main/host_state.h) ───────────────────────────
+
+HOST_STATES = ["unpowered", "mounted", "suspended", "resumed"]
+HOST_AWAKE = ("mounted", "resumed")
+
+
+def decode_host_state(data):
+    state, transitions, since_ms = struct.unpack("<BHI", bytes(data[:7]))
+    return {"state": HOST_STATES[state] if state < len(HOST_STATES) else state,
+            "transitions": transitions, "since_ms": since_ms}
+
+
+# ── Tuning characteristic (main/tuning.h, CONFIG_PENTA_TUNING) ──────────────
+#   read   version u8 | flags u8 | n × (id u8 | value u32)
+#   write  n × (id u8 | value u32), or 0xFF for the defaults
+
+TUNE_PARAMS = ["wake_report", "wake_key", "hold_ms",
+               "adv_fast_min", "adv_fast_max", "adv_medium_min",
+               "adv_medium_max", "adv_slow_min", "adv_slow_max",
+               "adv_awake_min", "adv_awake_max", "adv_burst_s",
+               "pm_max_mhz", "pm_min_mhz", "conn_idle_after_s",
+               "conn_idle_itvl_ms", "conn_idle_latency"]
+TUNE_RESET = b"\xff"
+TUNE_PAIR = struct.Struct("<BI")
+
+
+def decode_tuning(data):
+    data = bytes(data)
+    values = {}
+    for off in range(2, len(data) - TUNE_PAIR.size + 1, TUNE_PAIR.size):
+        pid, value = TUNE_PAIR.unpack_from(data, off)
+        name = TUNE_PARAMS[pid] if pid < len(TUNE_PARAMS) else f"param{pid}"
+        values[name] = value
+    return {"version": data[0], "pending": bool(data[1] & 0x01),
+            "values": values}
+
+
+def encode_tuning(values):
+    """values: {name or id: value} -> one write."""
+    out = b""
+    for key, value in values.items():
+        pid = key if isinstance(key, int) else TUNE_PARAMS.index(key)
+        out += TUNE_PAIR.pack(pid, value)
+    return out
+
+
+async def negotiated_mtu(client):
+    # BlueZ only reports the MTU after it has been acquired once
+    backend = getattr(client, "_backend", None)
+    if hasattr(backend, "_acquire_mtu"):
+        try:
+            await backend._acquire_mtu()
+        except Exception:           # noqa: BLE001 – fall back to the default
+            pass
+    return client.mtu_size
+
+
+CACHE_DIR = os.path.expanduser("~/.cache/penta")
+ADDRESS_CACHE = os.path.join(CACHE_DIR, "address")
+
+
+def load_cached_address():
+    try:
+        with open(ADDRESS_CACHE) as f:
+            return f.read().strip() or None
+    except OSError:
+        return None
+
+
+def store_cached_address(address):
+    os.makedirs(CACHE_DIR, exist_ok=True)
+    with open(ADDRESS_CACHE, "w") as f:
+        f.write(address)
+
+
+async def find_dongle(address=None, name=DEVICE_NAME, timeout=10.0,
+                      use_cache=True):
+    """Return a BLEDevice for the dongle, preferring a known address."""
+    from bleak import BleakScanner
+
+    if use_cache:
+        address = address or load_cached_address()
+    if address:
+        device = await BleakScanner.find_device_by_address(address, timeout=timeout)
+        if device is not None:
+            return device
+    device = await BleakScanner.find_device_by_name(name, timeout=timeout)
+    if device is not None and use_cache:
+        store_cached_address(device.address)
+    return device
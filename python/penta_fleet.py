@@ -0,0 +1,204 @@
+# Wake a fleet of Penta dongles from one Pi and report per-host timings.
+#
+# One BLE scan finds every dongle in range (by advertised name prefix or by
+# the wake service UUID in the scan response), then connections are opened
+# in parallel – at most --max-conn at a time, since the Pi's controller only
+# holds a handful of links – and each dongle is subscribed to host-state
+# notifications (0xFF03).  Wakes are staggered by --stagger seconds so a
+# rack of PSUs does not see every machine's inrush at the same moment.
+# Recorded per dongle:
+#   connect_ms   BLE connect + service discovery
+#   wake_at_ms   when the wake write went out, from the start of the run
+#   awake_ms     wake write until the dongle reported the host mounted or
+#                resumed (0 if it already was; the dongle then skips the key)
+#   service_ms   wake write until the --host TCP port answers
+#
+# --key signs each wake for dongles built with CONFIG_PENTA_WAKE_AUTH (one
+# fleet key; each tag still binds the dongle's own address).
+#
+#   python3 penta_fleet.py --list
+#   python3 penta_fleet.py --stagger 2 --host AA:BB:…=gpu1:22 --json
+
+import argparse
+import asyncio
+import json
+import sys
+import time
+
+from penta_ble import (HOST_AWAKE, HOST_CHAR_UUID, SERVICE_UUID,
+                       WAKE_CHAR_UUID, WAKE_PAYLOAD, WakeSigner,
+                       decode_host_state, decode_reply, load_wake_key)
+
+NAME_PREFIX = "Penta"
+POLL_S = 0.25
+
+
+async def discover(prefix, timeout):
+    """Return the BLEDevices that look like Penta dongles."""
+    from bleak import BleakScanner
+
+    found = await BleakScanner.discover(timeout=timeout, return_adv=True)
+    out = []
+    for device, adv in found.values():
+        name = adv.local_name or device.name or ""
+        if name.startswith(prefix) or SERVICE_UUID in adv.service_uuids:
+            out.append(device)
+    return sorted(out, key=lambda d: d.address)
+
+
+def parse_hosts(specs):
+    """ADDR=hostname[:port] → {ADDR: (hostname, port)}; port defaults to 22."""
+    hosts = {}
+    for spec in specs:
+        addr, _, target = spec.partition("=")
+        name, _, port = target.partition(":")
+        if not addr or not name:
+            raise SystemExit(f"bad --host {spec!r}, want ADDR=host[:port]")
+        hosts[addr.upper()] = (name, int(port or 22))
+    return hosts
+
+
+async def wait_service(host, port, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        try:
+            _, writer = await asyncio.wait_for(
+                asyncio.open_connection(host, port), 1)
+        except (OSError, asyncio.TimeoutError):
+            await asyncio.sleep(POLL_S)
+            continue
+        writer.close()
+        return True
+    return False
+
+
+async def wake_one(device, slot, t0, args, service):
+    from bleak import BleakClient
+
+    r = {"address": device.address, "name": device.name,
+         "connect_ms": None, "wake_at_ms": None, "awake_ms": None,
+         "service_ms": None, "host": None, "error": None}
+    awake = asyncio.Event()
+
+    def on_host(_, data):
+        r["host"] = decode_host_state(data)["state"]
+        if r["host"] in HOST_AWAKE:
+            awake.set()
+
+    async with args.slots:
+        try:
+            t = time.perf_counter()
+            async with BleakClient(device, timeout=args.timeout) as client:
+                r["connect_ms"] = round((time.perf_counter() - t) * 1000, 1)
+                on_host(None, await client.read_gatt_char(HOST_CHAR_UUID))
+                await client.start_notify(HOST_CHAR_UUID, on_host)
+                floor = 0
+                if args.signer is not None:
+                    floor = decode_reply(await client.read_gatt_char(
+                        WAKE_CHAR_UUID))["auth_counter"]
+
+                delay = t0 + slot * args.stagger - time.perf_counter()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                already = awake.is_set()
+                t = time.perf_counter()
+                r["wake_at_ms"] = round((t - t0) * 1000, 1)
+                payload = WAKE_PAYLOAD if args.signer is None else \
+                    args.signer.sign(WAKE_PAYLOAD, device.address, floor)
+                await client.write_gatt_char(WAKE_CHAR_UUID, payload,
+                                             response=True)
+                try:
+                    await asyncio.wait_for(awake.wait(), args.wait)
+                    r["awake_ms"] = 0.0 if already else round(
+                        (time.perf_counter() - t) * 1000, 1)
+                except asyncio.TimeoutError:
+                    r["error"] = "host not reported up"
+        except Exception as e:              # noqa: BLE001 – keep the others going
+            r["error"] = f"{type(e).__name__}: {e}"
+            return r
+
+    # Off the BLE slot: the probe may take tens of seconds
+    if service is not None and r["wake_at_ms"] is not None:
+        if await wait_service(*service, args.wait):
+            r["service_ms"] = round(
+                (time.perf_counter() - t0) * 1000 - r["wake_at_ms"], 1)
+        elif r["error"] is None:
+            r["error"] = f"{service[0]}:{service[1]} not answering"
+    return r
+
+
+def print_table(results):
+    cols = ["address", "connect_ms", "wake_at_ms", "awake_ms", "service_ms",
+            "host", "error"]
+    print("  ".join(f"{c:>11}" if c.endswith("_ms") else f"{c:<17}"
+                    for c in cols))
+    for r in results:
+        row = []
+        for c in cols:
+            v = "-" if r[c] is None else r[c]
+            row.append(f"{v:>11}" if c.endswith("_ms") else f"{v!s:<17}")
+        print("  ".join(row).rstrip())
+
+
+async def main():
+    ap = argparse.ArgumentParser(
+        description="Wake several Penta dongles, staggered.")
+    ap.add_argument("addresses", nargs="*",
+                    help="dongles to wake (default: every one found)")
+    ap.add_argument("--prefix", default=NAME_PREFIX,
+                    help="advertised name prefix (default %(default)s)")
+    ap.add_argument("--scan", type=float, default=5.0, metavar="S",
+                    help="scan time (default %(default)s s)")
+    ap.add_argument("--list", action="store_true",
+                    help="only list the dongles found")
+    ap.add_argument("--max-conn", type=int, default=3, metavar="N",
+                    help="BLE links open at once (default %(default)s)")
+    ap.add_argument("--stagger", type=float, default=1.0, metavar="S",
+                    help="seconds between wakes (default %(default)s)")
+    ap.add_argument("--wait", type=float, default=60.0, metavar="S",
+                    help="how long to wait for each host (default %(default)s)")
+    ap.add_argument("--timeout", type=float, default=10.0, metavar="S",
+                    help="BLE connect timeout (default %(default)s)")
+    ap.add_argument("--host", action="append", default=[],
+                    metavar="ADDR=HOST[:PORT]",
+                    help="probe this TCP port after waking dongle ADDR")
+    ap.add_argument("--key", help="wake HMAC key, 64 hex digits (default: "
+                    "$PENTA_WAKE_KEY or ~/.config/penta/wake_key)")
+    ap.add_argument("--json", action="store_true")
+    args = ap.parse_args()
+    key = load_wake_key(args.key)
+    args.signer = WakeSigner(key) if key else None
+
+    services = parse_hosts(args.host)
+    devices = await discover(args.prefix, args.scan)
+    if args.addresses:
+        wanted = {a.upper() for a in args.addresses}
+        devices = [d for d in devices if d.address.upper() in wanted]
+        missing = wanted - {d.address.upper() for d in devices}
+        if missing:
+            print(f"not found: {', '.join(sorted(missing))}", file=sys.stderr)
+    if not devices:
+        raise SystemExit("No dongles found.")
+    if args.list:
+        for d in devices:
+            print(d.address, d.name or "")
+        return
+
+    # Wake i is due at t0 + i * stagger; a dongle still waiting for a free
+    # --max-conn slot at that time is woken as soon as it gets one
+    args.slots = asyncio.Semaphore(args.max_conn)
+    t0 = time.perf_counter()
+    results = await asyncio.gather(*(
+        wake_one(d, i, t0, args, services.get(d.address.upper()))
+        for i, d in enumerate(devices)))
+
+    if args.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print_table(results)
+    if any(r["error"] for r in results):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
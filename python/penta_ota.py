@@ -0,0 +1,148 @@
+# Upload a firmware image to a Penta dongle over BLE (CONFIG_PENTA_OTA).
+#
+# Protocol (see esp32c3/claude/power_button_penta/main/ota_update.h):
+#   control 0xFF05  BEGIN size u32 | END | ABORT, status notifications
+#   data    0xFF06  offset u32 | image bytes, write-without-response
+#
+# The image is streamed in chunks as large as the negotiated MTU allows,
+# keeping at most the dongle's window unacknowledged.  A NAK rewinds to the
+# offset it names.  After END the dongle checks the hash and signature,
+# selects the new slot and reboots; the image confirms itself on the next
+# boot or the dongle rolls back.
+#
+#   python3 penta_ota.py build/power_button_penta.bin [--address AA:BB:…]
+#
+# Prints the effective throughput; --json prints it as JSON instead.
+
+import argparse
+import asyncio
+import json
+import os
+import struct
+import sys
+import time
+
+from penta_ble import OTA_CTRL_UUID, OTA_DATA_UUID, find_dongle, negotiated_mtu
+
+OP_BEGIN, OP_END, OP_ABORT = 1, 2, 3
+EVT_READY, EVT_ACK, EVT_NAK, EVT_DONE, EVT_ERROR = range(1, 6)
+EVT_NAMES = {EVT_READY: "ready", EVT_ACK: "ack", EVT_NAK: "nak",
+             EVT_DONE: "done", EVT_ERROR: "error"}
+ATT_VALUE_MAX = 512
+EVENT_TIMEOUT_S = 15.0
+VERIFY_TIMEOUT_S = 30.0         # esp_ota_end() hashes the whole image
+
+
+class UploadError(Exception):
+    pass
+
+
+def _err(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+async def upload(client, image, progress=None):
+    """Stream image over an open BleakClient.  Returns a result dict."""
+    events = asyncio.Queue()
+
+    def on_notify(_, data):
+        evt, value, extra = struct.unpack("<BIH", bytes(data[:7]))
+        events.put_nowait((evt, value, extra))
+
+    async def next_event(timeout=EVENT_TIMEOUT_S):
+        evt, value, extra = await asyncio.wait_for(events.get(), timeout)
+        if evt == EVT_ERROR:
+            raise UploadError(f"dongle refused the update: esp_err "
+                              f"0x{_err(value) & 0xFFFFFFFF:x}")
+        return evt, value, extra
+
+    mtu = await negotiated_mtu(client)
+    await client.start_notify(OTA_CTRL_UUID, on_notify)
+    await client.write_gatt_char(OTA_CTRL_UUID,
+                                 struct.pack("<BI", OP_BEGIN, len(image)),
+                                 response=True)
+    evt, window, chunk_max = await next_event()
+    if evt != EVT_READY:
+        raise UploadError(f"expected ready, got {EVT_NAMES.get(evt, evt)}")
+    chunk = min(min(mtu - 3, ATT_VALUE_MAX) - 4, chunk_max)
+
+    t0 = time.perf_counter()
+    sent = acked = 0
+    naks = 0
+    try:
+        while acked < len(image):
+            while sent < len(image) and sent - acked + chunk <= window:
+                data = image[sent:sent + chunk]
+                await client.write_gatt_char(
+                    OTA_DATA_UUID, struct.pack("<I", sent) + data,
+                    response=False)
+                sent += len(data)
+            evt, value, _ = await next_event()
+            if evt == EVT_ACK:
+                acked = max(acked, value)
+            elif evt == EVT_NAK:
+                naks += 1
+                acked = sent = value
+            if progress:
+                progress(acked, len(image), time.perf_counter() - t0)
+    except BaseException:
+        try:
+            await client.write_gatt_char(OTA_CTRL_UUID, bytes([OP_ABORT]),
+                                         response=True)
+        except Exception:           # noqa: BLE001 – link may already be gone
+            pass
+        raise
+    transfer_s = time.perf_counter() - t0
+
+    await client.write_gatt_char(OTA_CTRL_UUID, bytes([OP_END]),
+                                 response=True)
+    evt, _, _ = await next_event(VERIFY_TIMEOUT_S)
+    if evt != EVT_DONE:
+        raise UploadError(f"expected done, got {EVT_NAMES.get(evt, evt)}")
+    total_s = time.perf_counter() - t0
+    return {"bytes": len(image), "mtu": mtu, "chunk": chunk,
+            "window": window, "naks": naks,
+            "transfer_s": round(transfer_s, 2), "total_s": round(total_s, 2),
+            "kib_per_s": round(len(image) / 1024 / transfer_s, 1)}
+
+
+def _print_progress(done, total, elapsed):
+    rate = done / 1024 / elapsed if elapsed > 0 else 0.0
+    print(f"\r{done * 100 // total:3d}%  {done // 1024:5d}/{total // 1024} KiB"
+          f"  {rate:6.1f} KiB/s", end="", file=sys.stderr, flush=True)
+
+
+async def main():
+    from bleak import BleakClient
+
+    ap = argparse.ArgumentParser(description="Update Penta dongle firmware.")
+    ap.add_argument("image", help="signed app image (build/*.bin)")
+    ap.add_argument("--address", help="dongle address (default: cache/scan)")
+    ap.add_argument("--json", action="store_true", help="print JSON result")
+    args = ap.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        raise SystemExit(f"{args.image}: not an ESP app image")
+
+    device = await find_dongle(args.address)
+    if device is None:
+        raise SystemExit("Device not found.")
+    async with BleakClient(device) as client:
+        try:
+            result = await upload(client, image,
+                                  None if args.json else _print_progress)
+        except (UploadError, asyncio.TimeoutError) as e:
+            raise SystemExit(f"\nUpdate failed: {e or 'timed out'}")
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        print(f"\n{os.path.basename(args.image)}: {result['bytes'] // 1024} "
+              f"KiB in {result['transfer_s']} s ({result['kib_per_s']} KiB/s, "
+              f"MTU {result['mtu']}, {result['naks']} NAKs); verified and "
+              f"rebooting after {result['total_s']} s")
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,316 @@
+# Wake-on-demand TCP proxy for the Penta-GPU server, run on the Pi.
+#
+# Listens on the Pi for the host's service ports (SSH, Jupyter, an
+# inference API, …).  The first connection while the host sleeps triggers
+# one BLE wake, through penta_waked.py if it is running, else a direct
+# connect.  The client is held, not refused: its SYN is accepted and
+# whatever it sends waits in the kernel's buffers.  The proxy polls the
+# real port until the host accepts, then relays both directions with
+# splice(2) through a pipe, so payload bytes never enter Python.
+#
+# Clients that arrive while a wake is in flight share it: there is at most
+# one wake per resume, however many connections are waiting on it.
+#
+# With --suspend-ssh, the host is put back to sleep (--suspend-cmd over
+# SSH, as penta_bench.py does) once no proxied connection has been open or
+# passed a byte for --idle seconds.  Only proxied traffic counts; the proxy
+# cannot see anyone using the host directly.
+#
+#   python3 penta_proxy.py --target penta.lan --forward 2222:22 \
+#       --forward 8888 --forward 8000 --suspend-ssh me@penta.lan --idle 1800
+#
+# --forward LISTEN[:PORT] listens on LISTEN and forwards to PORT on the
+# target (default the same number).  Needs Linux and Python ≥ 3.10.
+
+import argparse
+import asyncio
+import errno
+import logging
+import os
+import socket
+import time
+
+from penta_bench import run_quiet, ssh_cmd
+from penta_waked import DEFAULT_SOCKET
+
+CONNECT_TIMEOUT_S = 2.0         # one attempt at the real port
+POLL_S = 0.25                   # between attempts while the host resumes
+WAKE_TIMEOUT_S = 90.0           # wake until the port must answer
+SUSPEND_TIMEOUT_S = 10.0        # ssh usually hangs while the host goes down
+DOWN_TIMEOUT_S = 30.0           # suspend until the host stops answering
+IDLE_CHECK_S = 5.0
+SPLICE_LEN = 1 << 16            # one default pipe's capacity
+SPLICE_FLAGS = getattr(os, "SPLICE_F_MOVE", 0) | getattr(
+    os, "SPLICE_F_NONBLOCK", 0)
+QUIET_ERRNOS = (errno.ECONNRESET, errno.EPIPE, errno.ENOTCONN)
+
+log = logging.getLogger("penta_proxy")
+
+
+# ── Zero-copy relay ─────────────────────────────────────────────────────────
+
+async def _wait_fd(fd, write):
+    loop = asyncio.get_running_loop()
+    ready = loop.create_future()
+    add, remove = ((loop.add_writer, loop.remove_writer) if write
+                   else (loop.add_reader, loop.remove_reader))
+    add(fd, lambda: ready.done() or ready.set_result(None))
+    try:
+        await ready
+    finally:
+        remove(fd)
+
+
+async def pump(src, dst, on_bytes):
+    """Move src to dst through a pipe until src reaches EOF."""
+    rd, wr = os.pipe()
+    try:
+        while True:
+            try:
+                n = os.splice(src.fileno(), wr, SPLICE_LEN, flags=SPLICE_FLAGS)
+            except BlockingIOError:
+                await _wait_fd(src.fileno(), False)
+                continue
+            if n == 0:
+                break
+            while n:
+                try:
+                    n -= os.splice(rd, dst.fileno(), n, flags=SPLICE_FLAGS)
+                except BlockingIOError:
+                    await _wait_fd(dst.fileno(), True)
+            on_bytes()
+        dst.shutdown(socket.SHUT_WR)
+    finally:
+        os.close(rd)
+        os.close(wr)
+
+
+async def relay(a, b, on_bytes):
+    """Relay both ways; returns once both sides have closed."""
+    tasks = [asyncio.ensure_future(pump(a, b, on_bytes)),
+             asyncio.ensure_future(pump(b, a, on_bytes))]
+    try:
+        # A reset on one side ends the other as well
+        done, _ = await asyncio.wait(tasks, return_when=asyncio.FIRST_EXCEPTION)
+        for t in done:
+            if t.exception() is not None:
+                raise t.exception()
+        await asyncio.gather(*tasks)
+    finally:
+        for t in tasks:
+            t.cancel()
+        await asyncio.gather(*tasks, return_exceptions=True)
+
+
+# ── Host power state ────────────────────────────────────────────────────────
+
+class Host:
+    """What the proxy knows about the target, and the wakes and suspends
+    it sends.  One wake is shared by every connection waiting on it."""
+
+    def __init__(self, addr, socket_path, address=None, signer=None,
+                 suspend_ssh=None, suspend_cmd=None, idle_s=0):
+        self.addr = addr
+        self.socket_path = socket_path
+        self.address = address          # dongle, for the direct fallback
+        self.signer = signer
+        self.suspend_ssh = suspend_ssh
+        self.suspend_cmd = suspend_cmd
+        self.idle_s = idle_s
+        self.up = True                  # until a connect says otherwise
+        self.sessions = 0
+        self.last_active = time.monotonic()
+        self.wakes = 0
+        self.suspends = 0
+        self._wake = None               # in-flight or recent wake task
+        self._suspend = None            # in-flight suspend task
+
+    def touch(self):
+        self.last_active = time.monotonic()
+
+    async def _try_connect(self, port, timeout):
+        loop = asyncio.get_running_loop()
+
+        async def attempt():
+            # Resolve every time: a sleeping host may drop out of mDNS
+            info = (await loop.getaddrinfo(self.addr, port,
+                                           type=socket.SOCK_STREAM))[0]
+            sock = socket.socket(info[0], info[1], info[2])
+            sock.setblocking(False)
+            try:
+                await loop.sock_connect(sock, info[4])
+            except BaseException:
+                sock.close()
+                raise
+            return sock
+
+        try:
+            sock = await asyncio.wait_for(attempt(), timeout)
+        except (OSError, asyncio.TimeoutError):
+            return None
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        return sock
+
+    async def _send_wake(self):
+        from wake_penta import wake_direct, wake_via_daemon
+
+        if self._suspend is not None:
+            await self._suspend         # let it finish going down first
+        t0 = time.perf_counter()
+        try:
+            reply = await wake_via_daemon(self.socket_path)
+            if not reply.get("ok"):
+                raise RuntimeError(reply.get("error"))
+        except OSError:
+            log.info("penta_waked not running – connecting directly")
+            try:
+                await wake_direct(self.address, signer=self.signer)
+            except (Exception, SystemExit) as e:
+                raise RuntimeError(f"wake failed: {e}") from None
+        self.wakes += 1
+        log.info("wake sent (%.0f ms)", (time.perf_counter() - t0) * 1000)
+
+    async def wake(self):
+        """Send a wake unless one is already on its way."""
+        if self._wake is None:
+            self._wake = asyncio.ensure_future(self._send_wake())
+        wake = self._wake
+        try:
+            await asyncio.shield(wake)
+        except Exception:
+            if self._wake is wake:
+                self._wake = None       # the next client tries again
+            raise
+
+    async def connect(self, port, timeout=WAKE_TIMEOUT_S):
+        """A socket connected to port on the host, waking it if needed."""
+        if self.up and self._suspend is None:
+            sock = await self._try_connect(port, CONNECT_TIMEOUT_S)
+            if sock is not None:
+                return sock
+            self.up = False
+        await self.wake()
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            sock = await self._try_connect(port, CONNECT_TIMEOUT_S)
+            if sock is not None:
+                if not self.up:
+                    log.info("host up on port %d", port)
+                self.up, self._wake = True, None
+                return sock
+            await asyncio.sleep(POLL_S)
+        raise TimeoutError(f"port {port} not up {timeout:.0f} s after wake")
+
+    async def _do_suspend(self, probe_port):
+        log.info("idle for %.0f s – suspending host", self.idle_s)
+        self.up, self._wake = False, None
+        await run_quiet(ssh_cmd(self.suspend_ssh, self.suspend_cmd),
+                        SUSPEND_TIMEOUT_S)
+        self.suspends += 1
+        deadline = time.monotonic() + DOWN_TIMEOUT_S
+        while time.monotonic() < deadline:
+            sock = await self._try_connect(probe_port, 1.0)
+            if sock is None:
+                return
+            sock.close()
+            await asyncio.sleep(POLL_S)
+        log.warning("host still answering %.0f s after suspend",
+                    DOWN_TIMEOUT_S)
+
+    async def idle_watch(self, probe_port):
+        while True:
+            await asyncio.sleep(IDLE_CHECK_S)
+            if (self.sessions or not self.up or
+                    time.monotonic() - self.last_active < self.idle_s):
+                continue
+            self._suspend = asyncio.ensure_future(self._do_suspend(probe_port))
+            try:
+                await self._suspend
+            finally:
+                self._suspend = None
+                self.touch()
+
+
+# ── Listeners ───────────────────────────────────────────────────────────────
+
+async def handle(host, client, peer, port):
+    host.sessions += 1
+    host.touch()
+    upstream = None
+    try:
+        upstream = await host.connect(port)
+        log.debug("%s:%d -> %s:%d", peer[0], peer[1], host.addr, port)
+        await relay(client, upstream, host.touch)
+    except (OSError, TimeoutError, RuntimeError) as e:
+        if getattr(e, "errno", None) not in QUIET_ERRNOS:
+            log.warning("%s:%d port %d: %s", peer[0], peer[1], port,
+                        e or type(e).__name__)
+    finally:
+        client.close()
+        if upstream is not None:
+            upstream.close()
+        host.sessions -= 1
+        host.touch()
+
+
+async def listen(host, bind, listen_port, port):
+    loop = asyncio.get_running_loop()
+    server = socket.create_server((bind, listen_port), backlog=64)
+    server.setblocking(False)
+    log.info("%s:%d -> %s:%d", bind or "*", listen_port, host.addr, port)
+    sessions = set()
+    while True:
+        client, peer = await loop.sock_accept(server)
+        client.setblocking(False)
+        client.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        task = asyncio.ensure_future(handle(host, client, peer, port))
+        sessions.add(task)
+        task.add_done_callback(sessions.discard)
+
+
+def parse_forward(text):
+    listen_port, _, port = text.partition(":")
+    try:
+        return int(listen_port), int(port or listen_port)
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"bad forward {text!r}")
+
+
+async def main():
+    from penta_ble import WakeSigner, load_wake_key
+
+    ap = argparse.ArgumentParser(description="Wake-on-demand Penta proxy.")
+    ap.add_argument("--target", required=True, help="host name or address")
+    ap.add_argument("--forward", type=parse_forward, action="append",
+                    required=True, metavar="LISTEN[:PORT]",
+                    help="listen on LISTEN, forward to PORT (repeatable)")
+    ap.add_argument("--bind", default="", help="listen address (default all)")
+    ap.add_argument("--socket", default=DEFAULT_SOCKET, help="daemon socket")
+    ap.add_argument("--address", help="dongle address for the direct fallback")
+    ap.add_argument("--key", help="wake HMAC key for the direct fallback")
+    ap.add_argument("--suspend-ssh", metavar="DEST",
+                    help="ssh destination used to suspend the idle host")
+    ap.add_argument("--suspend-cmd", default="sudo systemctl suspend")
+    ap.add_argument("--idle", type=float, default=1800, metavar="S",
+                    help="suspend after S s without proxied traffic "
+                    "(default 1800, needs --suspend-ssh)")
+    ap.add_argument("-v", "--verbose", action="store_true")
+    args = ap.parse_args()
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO,
+                        format="%(asctime)s %(levelname)s %(message)s")
+    if not hasattr(os, "splice"):
+        raise SystemExit("needs os.splice (Linux, Python 3.10 or later)")
+
+    key = load_wake_key(args.key)
+    host = Host(args.target, args.socket, args.address,
+                WakeSigner(key) if key else None, args.suspend_ssh,
+                args.suspend_cmd, args.idle)
+    tasks = [listen(host, args.bind, listen_port, port)
+             for listen_port, port in args.forward]
+    if args.suspend_ssh and args.idle > 0:
+        tasks.append(host.idle_watch(args.forward[0][1]))
+    await asyncio.gather(*tasks)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
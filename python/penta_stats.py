@@ -0,0 +1,311 @@
+# Read and decode the dongle's stats characteristic (0xFF02).
+#
+# Wire format (see esp32c3/claude/power_button_penta/main/stats.h):
+#   version u8, then sections of  id u8 | len u8 | body[len], little-endian.
+# Unknown sections are skipped.
+#
+#   python3 penta_stats.py                 # cached address or scan by name
+#   python3 penta_stats.py --json AA:BB:…  # by address, JSON output
+
+import argparse
+import asyncio
+import json
+import struct
+
+from penta_ble import STATS_CHAR_UUID, find_dongle
+
+STAGES = ["connect", "gatt_write", "usb_resume", "hid_ready",
+          "report_queued", "key_released"]
+ADV_MODES = ["fast", "medium", "slow", "host-awake"]
+
+
+def _latency(body):
+    (wakes,) = struct.unpack_from("<I", body, 0)
+    out = {"wakes": wakes, "stages": {}}
+    for i, name in enumerate(STAGES):
+        n, lo, avg, p99 = struct.unpack_from("<HIII", body, 4 + 14 * i)
+        out["stages"][name] = {"samples": n, "min_us": lo,
+                               "avg_us": avg, "p99_us": p99}
+    return out
+
+
+def _dispatch(body):
+    keys = ["received", "dropped", "coalesced", "executed", "failed"]
+    vals = struct.unpack_from("<5Ii", body)
+    return dict(zip(keys + ["last_result"], vals))
+
+
+def _adv(body):
+    mode, lo, hi, transitions = struct.unpack_from("<BHHI", body)
+    return {"mode": ADV_MODES[mode] if mode < len(ADV_MODES) else mode,
+            "itvl_min_ms": lo * 0.625, "itvl_max_ms": hi * 0.625,
+            "transitions": transitions}
+
+
+def _usb(body):
+    keys = ["task_wakeups", "suspends", "resumes", "remote_wakeups",
+            "wakes_skipped"]
+    n = min(len(body) // 4, len(keys))      # older firmware sends 4 fields
+    return dict(zip(keys, struct.unpack_from(f"<{n}I", body)))
+
+
+WAKE_SOURCES = ["timer", "bt", "gpio", "uart", "other"]
+PM_MODES = ["sleep", "apb_min", "apb_max", "cpu_max"]
+
+
+def _name(raw):
+    return raw.split(b"\0", 1)[0].decode(errors="replace")
+
+
+def _power(body):
+    uptime, slept, entries = struct.unpack_from("<3I", body)
+    wakeups = struct.unpack_from(f"<{len(WAKE_SOURCES)}I", body, 12)
+    pos = 12 + 4 * len(WAKE_SOURCES)
+    modes = {}
+    for name in PM_MODES:
+        freq, ms = struct.unpack_from("<HI", body, pos)
+        modes[name] = {"freq_mhz": freq, "time_ms": ms}
+        pos += 6
+    return {"uptime_ms": uptime, "sleep_ms": slept, "sleep_entries": entries,
+            "sleep_pct": round(100 * slept / uptime, 1) if uptime else 0,
+            "wakeups": dict(zip(WAKE_SOURCES, wakeups)), "modes": modes}
+
+
+def _pm_locks(body):
+    return [{"name": _name(body[i:i + 8]),
+             **dict(zip(["active", "taken", "held_ms"],
+                        struct.unpack_from("<BII", body, i + 8)))}
+            for i in range(0, len(body) - 16, 17)]
+
+
+def _tasks(body):
+    (total,) = struct.unpack_from("<I", body)
+    tasks = []
+    for i in range(4, len(body) - 13, 14):
+        runtime, stack_free = struct.unpack_from("<IH", body, i + 8)
+        tasks.append({"name": _name(body[i:i + 8]), "runtime": runtime,
+                      "cpu_pct": round(100 * runtime / total, 1) if total else 0,
+                      "stack_free": stack_free})
+    return {"runtime_total": total, "tasks": tasks}
+
+
+CONN_PHASES = ["fast", "idle", "bulk"]
+
+
+def _conn(body):
+    links = []
+    for i in range(0, len(body) - 12, 13):
+        conn, phase, itvl, lat, tmo, upd, rej = \
+            struct.unpack_from("<HBHHHHH", body, i)
+        links.append({"conn": conn,
+                      "phase": CONN_PHASES[phase] if phase < len(CONN_PHASES)
+                      else phase,
+                      "interval_ms": itvl * 1.25, "latency": lat,
+                      "timeout_ms": tmo * 10, "updates": upd,
+                      "rejected": rej})
+    return links
+
+
+def _clients(body):
+    clients = []
+    for i in range(0, len(body) - 16, 17):
+        conn, mtu, subs, writes, rejected, last = \
+            struct.unpack_from("<HHBIIi", body, i)
+        clients.append({"conn": conn, "mtu": mtu,
+                        "host_state_notify": bool(subs & 0x01),
+                        "ota_notify": bool(subs & 0x02),
+                        "writes": writes, "rejected": rejected,
+                        "last_result": last})
+    return clients
+
+
+def _pairing(body):
+    is_open, bonds, opened, bonded = struct.unpack_from("<BBII", body)
+    return {"open": bool(is_open), "bonds": bonds, "opened": opened,
+            "bonded": bonded}
+
+
+def _memory(body):
+    free, low, largest = struct.unpack_from("<3I", body)
+    tasks = {_name(body[i:i + 8]): struct.unpack_from("<H", body, i + 8)[0]
+             for i in range(12, len(body) - 9, 10)}
+    return {"heap_free": free, "heap_min": low, "heap_largest": largest,
+            "stack_free": tasks}
+
+
+BOOT_STAGES = ["app_start", "nvs", "ble_init", "ble_sync", "adv", "usb",
+               "usb_mount"]
+
+
+def _boot(body):
+    reason, target = struct.unpack_from("<BH", body)
+    n = min((len(body) - 3) // 4, len(BOOT_STAGES))
+    stages = struct.unpack_from(f"<{n}I", body, 3)
+    return {"reset_reason": reason, "target_ms": target,
+            "stages_ms": {name: us / 1000 if us else None
+                          for name, us in zip(BOOT_STAGES, stages)}}
+
+
+def _adv_sup(body):
+    keys = ["checks", "down", "retries", "recoveries", "host_resets"]
+    return dict(zip(keys, struct.unpack_from("<5I", body)))
+
+
+PHYS = ["?", "1M", "2M", "coded"]
+
+
+def _phy(i):
+    return PHYS[i] if i < len(PHYS) else i
+
+
+def _radio(body):
+    ext, prim, sec, pref, tx, rx, updates = struct.unpack_from("<6BH", body)
+    return {"ext_adv": bool(ext), "adv_primary": _phy(prim),
+            "adv_secondary": _phy(sec),
+            "conn_pref": _phy(pref) if pref else None,
+            "last_tx": _phy(tx), "last_rx": _phy(rx), "phy_updates": updates}
+
+
+def _auth(body):
+    keys = ["accepted", "malformed", "replayed", "bad_tag", "last_counter",
+            "reserved", "nvs_writes", "pend_errors", "nvs_errors"]
+    return dict(zip(keys, struct.unpack_from("<9I", body)))
+
+
+OTA_STATES = ["idle", "receiving", "probation"]
+
+
+def _ota(body):
+    state, *counts, err, nbytes, ms = struct.unpack_from("<B5IiII", body)
+    keys = ["sessions", "completed", "failed", "naks", "overruns"]
+    return {"state": OTA_STATES[state] if state < len(OTA_STATES) else state,
+            **dict(zip(keys, counts)), "last_err": err, "last_bytes": nbytes,
+            "last_ms": ms}
+
+
+WAKE_PATHS = ["usb_resume", "hid_report", "pwr_sw"]
+PATH = struct.Struct("<3I3Hi")
+
+
+def _wake_path(body):
+    last, guarded = struct.unpack_from("<BI", body)
+    paths = {}
+    for i, off in enumerate(range(5, len(body) - PATH.size + 1, PATH.size)):
+        attempts, ok, fallbacks, avg, peak, last_ms, err = \
+            PATH.unpack_from(body, off)
+        name = WAKE_PATHS[i] if i < len(WAKE_PATHS) else f"path{i}"
+        paths[name] = {"attempts": attempts, "ok": ok,
+                       "failed": attempts - ok, "fallbacks": fallbacks,
+                       "avg_ms": avg, "max_ms": peak, "last_ms": last_ms,
+                       "last_err": err}
+    return {"last_path": WAKE_PATHS[last] if last < len(WAKE_PATHS) else last,
+            "guarded": guarded, "paths": paths}
+
+
+def _tuning(body):
+    pending, *counts = struct.unpack_from("<B5I", body)
+    keys = ["writes", "rejected", "changes", "commits", "commit_errors"]
+    return {"pending": bool(pending), **dict(zip(keys, counts))}
+
+
+def _pm_gov(body):
+    active, *counts = struct.unpack_from("<B4I", body)
+    keys = ["holds", "held_ms", "max_ms", "last_ms"]
+    return {"active": bool(active), **dict(zip(keys, counts))}
+
+
+def _scan(body):
+    active, all_reports, itvl, window, changes, reports = \
+        struct.unpack_from("<BBHHII", body)
+    return {"active": bool(active), "all_reports": bool(all_reports),
+            "interval_ms": itvl * 0.625, "window_ms": window * 0.625,
+            "changes": changes, "reports": reports}
+
+
+def _proximity(body):
+    dense, devices, armed, nearest, *counts = \
+        struct.unpack_from("<BBBb5I", body)
+    keys = ["sightings", "resolves", "alerts", "prewakes", "skipped"]
+    return {"dense": bool(dense), "devices": devices, "armed": armed,
+            "nearest_rssi": None if nearest == -128 else nearest,
+            **dict(zip(keys, counts))}
+
+
+SECTIONS = {
+    0x01: ("latency", _latency),
+    0x02: ("dispatch", _dispatch),
+    0x03: ("adv", _adv),
+    0x04: ("usb", _usb),
+    0x05: ("power", _power),
+    0x06: ("pm_locks", _pm_locks),
+    0x07: ("tasks", _tasks),
+    0x08: ("conn", _conn),
+    0x09: ("pairing", _pairing),
+    0x0A: ("memory", _memory),
+    0x0B: ("boot", _boot),
+    0x0C: ("adv_sup", _adv_sup),
+    0x0D: ("radio", _radio),
+    0x0E: ("auth", _auth),
+    0x0F: ("ota", _ota),
+    0x10: ("wake_path", _wake_path),
+    0x11: ("tuning", _tuning),
+    0x12: ("pm_gov", _pm_gov),
+    0x13: ("clients", _clients),
+    0x14: ("scan", _scan),
+    0x15: ("proximity", _proximity),
+}
+
+
+def decode(payload):
+    data = bytes(payload)
+    out = {"version": data[0]}
+    pos = 1
+    while pos + 2 <= len(data):
+        sec_id, length = data[pos], data[pos + 1]
+        body = data[pos + 2:pos + 2 + length]
+        pos += 2 + length
+        if sec_id in SECTIONS:
+            name, parse = SECTIONS[sec_id]
+            out[name] = parse(body)
+    return out
+
+
+async def read_stats(client):
+    return decode(await client.read_gatt_char(STATS_CHAR_UUID))
+
+
+def print_stats(stats):
+    lat = stats.get("latency")
+    if lat:
+        print(f"wakes recorded: {lat['wakes']}")
+        print(f"{'stage':<14}{'n':>5}{'min ms':>10}{'avg ms':>10}{'p99 ms':>10}")
+        for name, st in lat["stages"].items():
+            if st["samples"]:
+                print(f"{name:<14}{st['samples']:>5}{st['min_us'] / 1000:>10.1f}"
+                      f"{st['avg_us'] / 1000:>10.1f}{st['p99_us'] / 1000:>10.1f}")
+    for name in stats:
+        if name not in ("version", "latency"):
+            print(f"{name}: {stats[name]}")
+
+
+async def main():
+    from bleak import BleakClient
+
+    ap = argparse.ArgumentParser(description="Read Penta dongle statistics.")
+    ap.add_argument("address", nargs="?", help="dongle address (default: scan)")
+    ap.add_argument("--json", action="store_true", help="print raw JSON")
+    args = ap.parse_args()
+
+    target = await find_dongle(args.address)
+    if target is None:
+        raise SystemExit("Device not found.")
+    async with BleakClient(target) as client:
+        stats = await read_stats(client)
+    if args.json:
+        print(json.dumps(stats, indent=2))
+    else:
+        print_stats(stats)
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,130 @@
+# Read and format the dongle's binary trace (characteristic 0xFF04).
+#
+# Wire format (see esp32c3/claude/power_button_penta/main/trace.h):
+#   version u8 | boot u16 | next_seq u32 | first_seq u32 | entries
+#   entry: time_us u32 | evt u8 | boot u8 | a u16 | b u32
+# Write seq u32 to move the cursor; each read returns what fits in one ATT
+# read from there.
+#
+#   python3 penta_trace.py                 # whole ring, cached address
+#   python3 penta_trace.py --since 120     # records from seq 120 on
+#   python3 penta_trace.py --json AA:BB:…
+
+import argparse
+import asyncio
+import json
+import struct
+
+from penta_ble import HOST_STATES, TRACE_CHAR_UUID, TUNE_PARAMS, find_dongle
+
+ADV_MODES = ["fast", "medium", "slow", "host-awake"]
+WAKE_METHODS = ["key", "system", "skipped", "pwr_sw"]
+WAKE_PATHS = ["usb_resume", "hid_report", "pwr_sw"]
+CONN_PHASES = ["fast", "idle", "bulk"]
+PHYS = ["?", "1M", "2M", "coded"]
+RESET_REASONS = ["unknown", "poweron", "ext", "sw", "panic", "int_wdt",
+                 "task_wdt", "wdt", "deepsleep", "brownout", "sdio"]
+
+
+def _pick(names, i):
+    return names[i] if i < len(names) else i
+
+
+def _err(b):
+    return b - (1 << 32) if b & 0x80000000 else b
+
+
+# evt id: (name, formatter of (a, b))
+EVENTS = {
+    1: ("boot", lambda a, b: f"reset={_pick(RESET_REASONS, a)}"),
+    2: ("connect", lambda a, b: f"conn={a}"),
+    3: ("disconnect", lambda a, b: f"conn={a} reason=0x{b:x}"),
+    4: ("adv_start", lambda a, b: f"itvl={a * 0.625:.1f}ms"),
+    5: ("adv_mode", lambda a, b: f"{_pick(ADV_MODES, a)} itvl={b * 0.625:.1f}ms"),
+    6: ("conn_phase", lambda a, b: f"conn={a} {_pick(CONN_PHASES, b)}"),
+    7: ("wake_write", lambda a, b: f"conn={a} len={b}"),
+    8: ("wake_reject", lambda a, b: f"conn={a} err=0x{b:x}"),
+    9: ("wake_sent", lambda a, b: f"{_pick(WAKE_METHODS, a)} err={_err(b)}"),
+    10: ("cmd_done", lambda a, b: f"cmd={a & 0xFF} merged={a >> 8} err={_err(b)}"),
+    11: ("host_state", lambda a, b: f"{_pick(HOST_STATES, a)} n={b}"),
+    12: ("bonded", lambda a, b: f"bonds={a}"),
+    13: ("adv_failed", lambda a, b: f"err={_err(b)}"),
+    14: ("adv_retry", lambda a, b: f"attempt={a} backoff={b}ms"),
+    15: ("adv_recover", lambda a, b: f"n={a}"),
+    16: ("host_reset", lambda a, b: f"reason={a} n={b}"),
+    17: ("phy_update", lambda a, b: f"conn={a} tx={_pick(PHYS, b & 0xFF)} "
+                                    f"rx={_pick(PHYS, b >> 8)}"),
+    18: ("ota_begin", lambda a, b: f"conn={a} size={b}"),
+    19: ("ota_nak", lambda a, b: f"conn={a} offset={b}"),
+    20: ("ota_end", lambda a, b: f"{a}kB/s err={_err(b)}"),
+    21: ("ota_confirm", lambda a, b: "valid" if a else "rolled back"),
+    22: ("wake_path", lambda a, b: f"{_pick(WAKE_PATHS, a & 0xFF)} "
+                                   f"{'failed' if a >> 8 else 'ok'} {b}ms"),
+    23: ("tune_set", lambda a, b: f"{_pick(TUNE_PARAMS, a)}={b}"),
+    24: ("tune_commit", lambda a, b: f"stored={a} err={_err(b)}"),
+    25: ("pm_hold", lambda a, b: f"n={a} {b}ms"),
+    26: ("prox_scan", lambda a, b: f"{'dense' if a else 'sparse'} devices={b}"),
+    27: ("prewake", lambda a, b: f"device={a & 0xFF} rssi={_err(b)}dBm"
+                                 f"{' skipped' if a >> 8 else ''}"),
+}
+
+HDR = struct.Struct("<BHII")
+ENTRY = struct.Struct("<IBBHI")
+
+
+def decode(data):
+    version, boot, next_seq, first = HDR.unpack_from(data)
+    entries = []
+    for i, off in enumerate(range(HDR.size, len(data) - ENTRY.size + 1,
+                                  ENTRY.size)):
+        t, evt, eboot, a, b = ENTRY.unpack_from(data, off)
+        name, fmt = EVENTS.get(evt, (f"evt{evt}", lambda a, b: f"a={a} b={b}"))
+        entries.append({"seq": first + i, "boot": eboot, "time_us": t,
+                        "event": name, "a": a, "b": b, "text": fmt(a, b)})
+    return {"version": version, "boot": boot, "next_seq": next_seq,
+            "first_seq": first, "entries": entries}
+
+
+async def read_trace(client, since=0):
+    """All records from seq `since` on, oldest first."""
+    out = []
+    seq = since
+    while True:
+        await client.write_gatt_char(TRACE_CHAR_UUID, struct.pack("<I", seq),
+                                     response=True)
+        page = decode(await client.read_gatt_char(TRACE_CHAR_UUID))
+        if not page["entries"]:
+            return page["boot"], out
+        out += page["entries"]
+        seq = page["first_seq"] + len(page["entries"])
+
+
+async def main():
+    from bleak import BleakClient
+
+    ap = argparse.ArgumentParser(description="Read the Penta dongle trace.")
+    ap.add_argument("address", nargs="?", help="dongle address (default: scan)")
+    ap.add_argument("--since", type=int, default=0, metavar="SEQ",
+                    help="first record to fetch (default: oldest kept)")
+    ap.add_argument("--json", action="store_true", help="print raw JSON")
+    args = ap.parse_args()
+
+    target = await find_dongle(args.address)
+    if target is None:
+        raise SystemExit("Device not found.")
+    async with BleakClient(target) as client:
+        boot, entries = await read_trace(client, args.since)
+    if args.json:
+        print(json.dumps({"boot": boot, "entries": entries}, indent=2))
+        return
+
+    # Entries of earlier runs (kept across a crash) are marked with their
+    # boot; times restart at zero on every boot
+    for e in entries:
+        run = "" if e["boot"] == boot & 0xFF else f" [boot {e['boot']}]"
+        print(f"{e['seq']:>7} {e['time_us'] / 1000:>11.3f} ms  "
+              f"{e['event']:<11} {e['text']}{run}")
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
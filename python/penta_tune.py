@@ -0,0 +1,88 @@
+# Read and change a Penta dongle's tuning parameters (CONFIG_PENTA_TUNING).
+#
+# Protocol: main/tuning.h, characteristic 0xFF07.  Changes apply at once;
+# the dongle stores them in NVS a couple of seconds after the last write.
+#
+#   python3 penta_tune.py                       list every parameter
+#   python3 penta_tune.py hold_ms=40 wake_key=0x2C
+#   python3 penta_tune.py adv_slow_min=0x640 adv_slow_max=0xC80
+#   python3 penta_tune.py --reset               back to the build defaults
+#
+# All assignments on one command line go out in a single write, so a
+# min/max pair can move past its old partner.  A refused write changes
+# nothing; the dongle answers ATT error 0x80.
+
+import argparse
+import asyncio
+import json
+
+from penta_ble import (TUNE_CHAR_UUID, TUNE_PARAMS, TUNE_RESET, decode_tuning,
+                       encode_tuning, find_dongle, negotiated_mtu)
+
+
+def _unit(name, value):
+    if name.startswith("adv_") and name != "adv_burst_s":
+        return f"{value * 0.625:.1f} ms"
+    if name == "wake_report":
+        return "System Wake Up report" if value else "key"
+    if name == "wake_key":
+        return f"HID usage 0x{value:02X}"
+    return ""
+
+
+def parse_assignment(text):
+    name, sep, value = text.partition("=")
+    if not sep or name not in TUNE_PARAMS:
+        raise argparse.ArgumentTypeError(
+            f"expected NAME=VALUE with NAME one of {', '.join(TUNE_PARAMS)}")
+    try:
+        return name, int(value, 0)
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"bad value {value!r}")
+
+
+async def main():
+    from bleak import BleakClient
+    from bleak.exc import BleakError
+
+    ap = argparse.ArgumentParser(description="Penta dongle tuning.")
+    ap.add_argument("set", nargs="*", type=parse_assignment,
+                    metavar="NAME=VALUE", help="parameters to change")
+    ap.add_argument("--reset", action="store_true",
+                    help="restore the build defaults")
+    ap.add_argument("--address", help="dongle address (default: cache/scan)")
+    ap.add_argument("--json", action="store_true", help="print JSON")
+    args = ap.parse_args()
+
+    device = await find_dongle(args.address)
+    if device is None:
+        raise SystemExit("Device not found.")
+    async with BleakClient(device) as client:
+        try:
+            if args.reset:
+                await client.write_gatt_char(TUNE_CHAR_UUID, TUNE_RESET,
+                                             response=True)
+            payload = encode_tuning(dict(args.set))
+            if payload:
+                # Prepared writes are refused: the set must fit one write
+                mtu = await negotiated_mtu(client)
+                if len(payload) > mtu - 3:
+                    raise SystemExit(f"{len(args.set)} parameters do not fit "
+                                     f"one write at MTU {mtu}")
+                await client.write_gatt_char(TUNE_CHAR_UUID, payload,
+                                             response=True)
+        except BleakError as e:
+            raise SystemExit(f"Refused: {e}")
+        tuning = decode_tuning(await client.read_gatt_char(TUNE_CHAR_UUID))
+
+    if args.json:
+        print(json.dumps(tuning, indent=2))
+        return
+    for name, value in tuning["values"].items():
+        print(f"{name:<20}{value:>8}  {_unit(name, value)}")
+    if tuning["pending"]:
+        print("(not yet stored; the dongle commits shortly)")
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
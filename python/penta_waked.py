@@ -0,0 +1,278 @@
+# Persistent wake daemon for the Penta-GPU server.
+#
+# Keeps one BLE connection to the dongle open and accepts wake requests on
+# a local Unix socket (and optionally a tiny HTTP endpoint), so a wake is a
+# single write-without-response instead of scan + connect + discover.
+#
+# If the link drops it reconnects in the background with exponential
+# backoff; the dongle address is cached in ~/.cache/penta/address.
+#
+# Socket protocol: one command per line, one JSON reply per line.
+#   wake    -> {"ok": true, "write_ms": 3.1}
+#   macro H -> same, for a hex-encoded wake_proto.h sequence
+#   reply   -> decoded read of the wake characteristic
+#   status  -> {"connected": true, "address": "...", "host": {...}, ...}
+#   stats   -> decoded stats characteristic (see penta_stats.py)
+#   host    -> last host state pushed by the dongle (main/host_state.h)
+#   wake-wait [S] -> wake, then wait up to S s (default 30) for the dongle
+#              to report the host mounted or resumed:
+#              {"ok": true, "write_ms": 3.1, "awake_ms": 812.0}
+#
+# The daemon subscribes to the host-state characteristic, so wake-wait is
+# one event wait instead of a network polling loop.
+#
+# With --key (or $PENTA_WAKE_KEY, ~/.config/penta/wake_key) every wake and
+# macro is signed for a dongle built with CONFIG_PENTA_WAKE_AUTH.  The
+# dongle's counter floor is read once per connection; signing itself costs
+# no round trip, so a wake is still one write-without-response.
+#
+# HTTP (with --http PORT): POST /wake, POST /wake-wait, GET /status,
+# GET /stats, GET /host.
+#
+#   python3 penta_waked.py [--address AA:BB:…] [--socket PATH] [--http 8088]
+
+import argparse
+import asyncio
+import json
+import logging
+import os
+import time
+
+from bleak import BleakClient
+from bleak.exc import BleakError
+
+import penta_stats
+from penta_ble import (HOST_AWAKE, HOST_CHAR_UUID, PROTO_MAX_LEN,
+                       WAKE_CHAR_UUID, WAKE_PAYLOAD, WakeSigner,
+                       decode_host_state, decode_reply, find_dongle,
+                       load_wake_key)
+
+DEFAULT_SOCKET = os.path.join(os.environ.get("XDG_RUNTIME_DIR", "/tmp"),
+                              "penta-waked.sock")
+BACKOFF_MIN_S = 0.5
+BACKOFF_MAX_S = 30.0
+WAKE_WAIT_S = 30.0
+
+log = logging.getLogger("penta_waked")
+
+
+class DongleLink:
+    """Owns the BLE connection and keeps it warm."""
+
+    def __init__(self, address=None, signer=None):
+        self.address = address
+        self.signer = signer
+        self.auth_floor = 0             # dongle's last accepted counter
+        self.client = None
+        self.wake_char = None
+        self.connected = asyncio.Event()
+        self.kick = asyncio.Event()     # skip the current backoff sleep
+        self.connects = 0
+        self.wakes = 0
+        self.last_error = None
+        self.host = None                # last decoded host-state value
+        self.host_changed = asyncio.Condition()
+
+    async def run(self):
+        backoff = BACKOFF_MIN_S
+        while True:
+            try:
+                await self._connect()
+                backoff = BACKOFF_MIN_S
+                await self._wait_disconnect()
+            except (BleakError, asyncio.TimeoutError, OSError) as e:
+                self.last_error = str(e)
+                log.warning("link down: %s (retry in %.1f s)", e, backoff)
+            self.connected.clear()
+            self.client = None
+            try:
+                await asyncio.wait_for(self.kick.wait(), backoff)
+            except asyncio.TimeoutError:
+                pass
+            self.kick.clear()
+            backoff = min(backoff * 2, BACKOFF_MAX_S)
+
+    async def _connect(self):
+        device = await find_dongle(self.address)
+        if device is None:
+            raise BleakError("dongle not found")
+        self.address = device.address
+        lost = asyncio.Event()
+        client = BleakClient(device, disconnected_callback=lambda _: lost.set())
+        await client.connect()
+        # Resolve the characteristic once; later writes go straight to its
+        # handle without another lookup.
+        self.wake_char = client.services.get_characteristic(WAKE_CHAR_UUID)
+        if self.wake_char is None:
+            await client.disconnect()
+            raise BleakError("wake characteristic missing")
+        self.client, self._lost = client, lost
+        if self.signer is not None:
+            reply = decode_reply(await client.read_gatt_char(self.wake_char))
+            self.auth_floor = reply["auth_counter"]
+        # Older firmware has no host-state characteristic
+        host_char = client.services.get_characteristic(HOST_CHAR_UUID)
+        if host_char is not None:
+            self._set_host(await client.read_gatt_char(host_char))
+            await client.start_notify(host_char,
+                                      lambda _, data: self._on_host(data))
+        self.connects += 1
+        self.connected.set()
+        log.info("connected to %s", device.address)
+
+    def _set_host(self, data):
+        self.host = decode_host_state(data)
+        log.info("host %s", self.host["state"])
+
+    def _on_host(self, data):
+        self._set_host(data)
+        asyncio.get_running_loop().create_task(self._notify_host())
+
+    async def _notify_host(self):
+        async with self.host_changed:
+            self.host_changed.notify_all()
+
+    def host_awake(self):
+        return self.host is not None and self.host["state"] in HOST_AWAKE
+
+    async def _wait_disconnect(self):
+        await self._lost.wait()
+        log.info("disconnected")
+
+    async def _ready(self, timeout):
+        if not self.connected.is_set():
+            self.kick.set()
+            await asyncio.wait_for(self.connected.wait(), timeout)
+
+    async def wake(self, payload=WAKE_PAYLOAD, timeout=10.0):
+        await self._ready(timeout)
+        if self.signer is not None:
+            payload = self.signer.sign(payload, self.address, self.auth_floor)
+        t0 = time.perf_counter()
+        await self.client.write_gatt_char(self.wake_char, payload,
+                                          response=False)
+        self.wakes += 1
+        return (time.perf_counter() - t0) * 1000
+
+    async def wake_wait(self, timeout=WAKE_WAIT_S):
+        """Wake and wait for the dongle to report the host running.
+        Returns (write_ms, awake_ms); awake_ms is 0 if it already was."""
+        await self._ready(10.0)
+        if self.host is None:
+            raise BleakError("firmware does not report the host state")
+        if self.host_awake():
+            return 0.0, 0.0
+        t0 = time.perf_counter()
+        async with self.host_changed:
+            write_ms = await self.wake()
+            await asyncio.wait_for(
+                self.host_changed.wait_for(self.host_awake), timeout)
+        return write_ms, (time.perf_counter() - t0) * 1000
+
+    async def reply(self, timeout=10.0):
+        await self._ready(timeout)
+        return decode_reply(await self.client.read_gatt_char(self.wake_char))
+
+    async def stats(self, timeout=10.0):
+        await self._ready(timeout)
+        return await penta_stats.read_stats(self.client)
+
+    def status(self):
+        return {"connected": self.connected.is_set(), "address": self.address,
+                "connects": self.connects, "wakes": self.wakes,
+                "host": self.host, "last_error": self.last_error}
+
+
+async def handle_command(link, line):
+    cmd, _, arg = line.partition(" ")
+    try:
+        if cmd == "wake":
+            return {"ok": True, "write_ms": round(await link.wake(), 2)}
+        if cmd == "macro":
+            payload = bytes.fromhex(arg)
+            if not 0 < len(payload) <= PROTO_MAX_LEN:
+                return {"ok": False, "error": "bad macro length"}
+            return {"ok": True, "write_ms": round(await link.wake(payload), 2)}
+        if cmd == "wake-wait":
+            write_ms, awake_ms = await link.wake_wait(
+                float(arg) if arg else WAKE_WAIT_S)
+            return {"ok": True, "write_ms": round(write_ms, 2),
+                    "awake_ms": round(awake_ms, 1)}
+        if cmd == "host":
+            return link.host or {"ok": False, "error": "unknown"}
+        if cmd == "reply":
+            return await link.reply()
+        if cmd == "status":
+            return link.status()
+        if cmd == "stats":
+            return await link.stats()
+        return {"ok": False, "error": f"unknown command {cmd!r}"}
+    except (BleakError, asyncio.TimeoutError, OSError, ValueError) as e:
+        return {"ok": False, "error": str(e) or type(e).__name__}
+
+
+async def serve_unix(link, path):
+    async def client(reader, writer):
+        while line := await reader.readline():
+            reply = await handle_command(link, line.decode().strip())
+            writer.write((json.dumps(reply) + "\n").encode())
+            await writer.drain()
+        writer.close()
+
+    if os.path.exists(path):
+        os.unlink(path)
+    server = await asyncio.start_unix_server(client, path)
+    os.chmod(path, 0o660)
+    log.info("listening on %s", path)
+    return server
+
+
+HTTP_ROUTES = {("POST", "/wake"): "wake", ("POST", "/wake-wait"): "wake-wait",
+               ("GET", "/status"): "status", ("GET", "/stats"): "stats",
+               ("GET", "/host"): "host"}
+
+
+async def serve_http(link, port):
+    async def client(reader, writer):
+        request = (await reader.readline()).decode().split()
+        while (await reader.readline()) not in (b"\r\n", b"\n", b""):
+            pass                                    # skip headers
+        cmd = HTTP_ROUTES.get(tuple(request[:2])) if len(request) >= 2 else None
+        if cmd is None:
+            status, reply = "404 Not Found", {"ok": False, "error": "not found"}
+        else:
+            status, reply = "200 OK", await handle_command(link, cmd)
+        body = json.dumps(reply).encode()
+        writer.write(f"HTTP/1.0 {status}\r\nContent-Type: application/json\r\n"
+                     f"Content-Length: {len(body)}\r\n\r\n".encode() + body)
+        await writer.drain()
+        writer.close()
+
+    server = await asyncio.start_server(client, "127.0.0.1", port)
+    log.info("HTTP on 127.0.0.1:%d", port)
+    return server
+
+
+async def main():
+    ap = argparse.ArgumentParser(description="Persistent Penta wake daemon.")
+    ap.add_argument("--address", help="dongle address (default: cache/scan)")
+    ap.add_argument("--socket", default=DEFAULT_SOCKET, help="Unix socket path")
+    ap.add_argument("--http", type=int, metavar="PORT",
+                    help="also serve HTTP on 127.0.0.1:PORT")
+    ap.add_argument("--key", help="wake HMAC key, 64 hex digits (default: "
+                    "$PENTA_WAKE_KEY or ~/.config/penta/wake_key)")
+    ap.add_argument("-v", "--verbose", action="store_true")
+    args = ap.parse_args()
+    logging.basicConfig(level=logging.DEBUG if args.verbose else logging.INFO,
+                        format="%(asctime)s %(levelname)s %(message)s")
+
+    key = load_wake_key(args.key)
+    link = DongleLink(args.address, WakeSigner(key) if key else None)
+    servers = [await serve_unix(link, args.socket)]
+    if args.http:
+        servers.append(await serve_http(link, args.http))
+    await link.run()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
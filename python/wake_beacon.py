@@ -0,0 +1,79 @@
+# Connectionless wake for the Penta-GPU server (CONFIG_PENTA_BEACON_WAKE).
+#
+# Broadcasts a short burst of signed advertisements that the dongle picks up
+# with its passive scan - no connect, discover or write round trips.
+#
+# Beacon payload (manufacturer-specific AD, company ID 0xFFFF):
+#   company u16 LE | type 0x01 | counter u32 LE | tag[8]
+#   tag = HMAC-SHA256(key, type | counter | dongle BT MAC)[:8]
+#
+# Uses BlueZ's btmgmt to advertise, so it must run as root (or with
+# CAP_NET_ADMIN).  Example:
+#   sudo python3 wake_beacon.py --key <64 hex digits> --dongle AA:BB:CC:DD:EE:FF
+
+import argparse
+import hashlib
+import hmac
+import os
+import struct
+import subprocess
+import time
+
+COMPANY_ID = 0xFFFF
+TYPE_WAKE = 0x01
+TAG_LEN = 8
+COUNTER_FILE = os.path.expanduser("~/.config/penta/beacon_counter")
+
+
+def next_counter(path=COUNTER_FILE):
+    """Strictly increasing across runs, even if the counter file is lost."""
+    last = 0
+    try:
+        with open(path) as f:
+            last = int(f.read().strip() or 0)
+    except (OSError, ValueError):
+        pass
+    counter = max(last + 1, int(time.time()))
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(str(counter))
+    return counter & 0xFFFFFFFF
+
+
+def build_adv_data(key, dongle_mac, counter):
+    mac = bytes.fromhex(dongle_mac.replace(":", ""))
+    body = struct.pack("<BI", TYPE_WAKE, counter)
+    tag = hmac.new(key, body + mac, hashlib.sha256).digest()[:TAG_LEN]
+    mfg = struct.pack("<H", COMPANY_ID) + body + tag
+    flags = bytes([2, 0x01, 0x06])                  # LE general disc, no BR/EDR
+    return flags + bytes([len(mfg) + 1, 0xFF]) + mfg
+
+
+def broadcast(adv_data, seconds, hci="0", instance=1):
+    # -t: timeout in seconds, after which BlueZ removes the instance itself
+    subprocess.run(["btmgmt", "--index", hci, "add-adv",
+                    "-d", adv_data.hex(), "-t", str(seconds), str(instance)],
+                   check=True, stdout=subprocess.DEVNULL)
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Broadcast a signed wake beacon.")
+    ap.add_argument("--key", default=os.environ.get("PENTA_BEACON_KEY"),
+                    help="64 hex digit HMAC key (or $PENTA_BEACON_KEY)")
+    ap.add_argument("--dongle", required=True,
+                    help="dongle BT MAC, AA:BB:CC:DD:EE:FF")
+    ap.add_argument("--seconds", type=int, default=3,
+                    help="burst length; must exceed the dongle scan interval")
+    ap.add_argument("--hci", default="0", help="controller index")
+    args = ap.parse_args()
+    if not args.key:
+        ap.error("--key or $PENTA_BEACON_KEY is required")
+
+    counter = next_counter()
+    broadcast(build_adv_data(bytes.fromhex(args.key), args.dongle, counter),
+              args.seconds, args.hci)
+    print(f"Wake beacon #{counter} broadcast for {args.seconds} s.")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,13 +1,164 @@
 # Script for the Raspberry Pi 4 to wake the Penta-GPU server
+#
+# Thin client for penta_waked.py: sends "wake" over the daemon's Unix
+# socket, which already holds the BLE link.  If the daemon is not running
+# it falls back to a one-shot scan + connect + write.
+#
+# --type sends one batched wake_proto.h sequence instead of a plain wake:
+# wake, wait --delay ms for the desktop, type the text (US layout) and
+# optionally press Enter – a single write-without-response.
+#
+#   python3 wake_penta.py [--socket PATH] [--address AA:BB:…]
+#   python3 wake_penta.py --type ' ' --delay 1500    # wake, then tap Space
+#
+# --wait waits until the dongle reports the host running again (host-state
+# notifications, main/host_state.h) and prints how long that took.
+#
+# --key signs the direct fallback for a dongle built with
+# CONFIG_PENTA_WAKE_AUTH (64 hex digits; default $PENTA_WAKE_KEY or
+# ~/.config/penta/wake_key).  Through the daemon, the daemon signs.
+#
+# --power may press the PWR_SW header (CONFIG_PENTA_PWR_SW) when USB cannot
+# wake the host, on a dongle without a power-sense input.  Only use it when
+# the host is off or asleep: a press on a running host shuts it down.
+#
+# --pair bonds with a dongle built with CONFIG_PENTA_BOND_FILTER.  Press
+# its BOOT button first; the Pi's Bluetooth stack keeps the keys, so the
+# daemon and later runs reconnect without asking again.
 
+import argparse
 import asyncio
-from bleak import BleakClient
+import json
+import sys
+import time
 
-DEVICE_ADDRESS = "XX:XX:XX:XX:XX:XX"  # your ESP32-C3's BLE MAC
-CHAR_UUID = "your-characteristic-uuid"
+from penta_ble import (HOST_AWAKE, HOST_CHAR_UUID, PROTO_MAX_LEN,
+                       WAKE_CHAR_UUID, WAKE_PAYLOAD, WakeSigner,
+                       decode_host_state, decode_reply, find_dongle,
+                       load_wake_key, op_delay, op_keys, op_power,
+                       op_wake)
+from penta_waked import DEFAULT_SOCKET
 
-async def wake():
-    async with BleakClient(DEVICE_ADDRESS) as client:
-        await client.write_gatt_char(CHAR_UUID, b'\x01')
 
-asyncio.run(wake())
+async def wake_via_daemon(path, command="wake"):
+    reader, writer = await asyncio.open_unix_connection(path)
+    writer.write(f"{command}\n".encode())
+    await writer.drain()
+    reply = json.loads(await reader.readline())
+    writer.close()
+    return reply
+
+
+async def wake_direct(address=None, payload=WAKE_PAYLOAD, wait_s=None,
+                      signer=None):
+    """One-shot wake.  With wait_s, return ms until the host was reported
+    running (0 if it already was)."""
+    from bleak import BleakClient
+
+    device = await find_dongle(address)
+    if device is None:
+        raise SystemExit("Device not found.")
+    async with BleakClient(device) as client:
+        if signer is not None:
+            reply = decode_reply(await client.read_gatt_char(WAKE_CHAR_UUID))
+            payload = signer.sign(payload, device.address,
+                                  reply["auth_counter"])
+        if wait_s is None:
+            await client.write_gatt_char(WAKE_CHAR_UUID, payload,
+                                         response=False)
+            return None
+        awake = asyncio.Event()
+
+        def on_host(_, data):
+            if decode_host_state(data)["state"] in HOST_AWAKE:
+                awake.set()
+
+        on_host(None, await client.read_gatt_char(HOST_CHAR_UUID))
+        if awake.is_set():
+            return 0.0
+        await client.start_notify(HOST_CHAR_UUID, on_host)
+        t0 = time.perf_counter()
+        await client.write_gatt_char(WAKE_CHAR_UUID, payload, response=False)
+        await asyncio.wait_for(awake.wait(), wait_s)
+        return (time.perf_counter() - t0) * 1000
+
+
+async def pair(address=None):
+    from bleak import BleakClient
+
+    device = await find_dongle(address)
+    if device is None:
+        raise SystemExit("Device not found – is the pairing window open?")
+    async with BleakClient(device) as client:
+        await client.pair()
+    print("Paired.")
+
+
+def build_macro(text, enter, delay_ms, power=False):
+    if enter:
+        text += "\n"
+    wake = op_power() if power else op_wake()
+    payload = wake + op_delay(delay_ms) + op_keys(text)
+    if len(payload) > PROTO_MAX_LEN:
+        raise SystemExit(f"Sequence too long ({len(payload)} > "
+                         f"{PROTO_MAX_LEN} bytes)")
+    return payload
+
+
+async def main():
+    ap = argparse.ArgumentParser(description="Wake the Penta-GPU server.")
+    ap.add_argument("--socket", default=DEFAULT_SOCKET, help="daemon socket")
+    ap.add_argument("--address", help="dongle address for the direct fallback")
+    ap.add_argument("--type", metavar="TEXT", help="type TEXT after waking")
+    ap.add_argument("--enter", action="store_true", help="press Enter after TEXT")
+    ap.add_argument("--delay", type=int, default=1000, metavar="MS",
+                    help="pause between wake and typing (default 1000)")
+    ap.add_argument("--wait", type=float, nargs="?", const=30.0, metavar="S",
+                    help="wait up to S s (default 30) for the host to be up")
+    ap.add_argument("--key", help="wake HMAC key for the direct fallback "
+                    "(default: $PENTA_WAKE_KEY or ~/.config/penta/wake_key)")
+    ap.add_argument("--power", action="store_true",
+                    help="allow a PWR_SW press (host must be off or asleep)")
+    ap.add_argument("--pair", action="store_true",
+                    help="bond with the dongle (press its BOOT button first)")
+    args = ap.parse_args()
+
+    if args.pair:
+        await pair(args.address)
+        return
+
+    payload = WAKE_PAYLOAD
+    command = "wake"
+    if args.type is not None or args.power:
+        if args.wait is not None:
+            raise SystemExit("--wait only works with a plain wake")
+        payload = (op_power() if args.type is None else
+                   build_macro(args.type, args.enter, args.delay, args.power))
+        command = f"macro {payload.hex()}"
+    elif args.wait is not None:
+        command = f"wake-wait {args.wait}"
+
+    try:
+        reply = await wake_via_daemon(args.socket, command)
+    except OSError:
+        print("penta_waked not running – connecting directly", file=sys.stderr)
+        key = load_wake_key(args.key)
+        signer = WakeSigner(key) if key else None
+        try:
+            awake_ms = await wake_direct(args.address, payload, args.wait,
+                                         signer)
+        except asyncio.TimeoutError:
+            raise SystemExit(f"Host not up after {args.wait} s")
+        print("Wake signal sent!")
+        if awake_ms is not None:
+            print(f"Host up after {awake_ms:.0f} ms")
+        return
+    if not reply.get("ok"):
+        raise SystemExit(f"Wake failed: {reply.get('error')}")
+    print(f"Wake signal sent! ({reply['write_ms']} ms)")
+    if "awake_ms" in reply:
+        print(f"Host up after {reply['awake_ms']:.0f} ms")
+
+
+if __name__ == "__main__":
+    asyncio.run(main())